@@ -2,6 +2,9 @@
 
 #include "types.hpp"
 #include <vector>
+#include <string>
+#include <unordered_map>
+#include <boost/utility/string_view.hpp>
 
 #include <glm/glm.hpp>
 #include <glm/vec3.hpp> // glm::vec3
@@ -12,6 +15,7 @@
 #include <glm/gtx/compatibility.hpp>
 #include "logger.hpp"
 #include <memory>
+#include <cmath>
 #include "imgui/imgui.h"
 
 struct ColourU8
@@ -55,6 +59,12 @@ public:
         return glm::vec4(screenRectPos, screenRectSize);
     }
 
+    // The x, y, w, h of the part of the world that is currently visible with the current view/projection
+    glm::vec4 WorldViewRect() const;
+
+    // True if the x, y, w, h rect overlaps viewRect, w and h can be negative (e.g a flipped sprite)
+    static bool RectsOverlap(const glm::vec4& viewRect, f32 x, f32 y, f32 w, f32 h);
+
     const glm::vec2& CameraPosition() const
     {
         return mCameraPosition;
@@ -86,12 +96,14 @@ public:
         }
     }
 
-    void UpdateCamera()
+    void UpdateCamera(f32 frameSeconds)
     {
         if (mSmoothCameraPosition)
         {
-            MatrixLerp(glm::value_ptr(mView), glm::value_ptr(mTargetView), 0.2f);
-            MatrixLerp(glm::value_ptr(mProjection), glm::value_ptr(mTargetProjection), 0.2f);
+            // Moves 20% of the way per 60fps frame, scaled so the speed doesn't depend on the render rate
+            const f32 t = 1.0f - std::pow(0.8f, frameSeconds * 60.0f);
+            MatrixLerp(glm::value_ptr(mView), glm::value_ptr(mTargetView), t);
+            MatrixLerp(glm::value_ptr(mProjection), glm::value_ptr(mTargetProjection), t);
         }
     }
 
@@ -151,7 +163,9 @@ public:
     {
         eRGB,
         eRGBA,
-        eA
+        eA,
+        eIndex8, // 8 bit palette indices, only valid when SupportsPalettedTextures() is true
+        ePlane8 // One 8 bit channel of a YCbCr image, only valid when SupportsYCbCrTextures() is true
     };
 
     enum eLayers
@@ -211,13 +225,27 @@ public:
     virtual void SetVSync(bool on) = 0;
 
     virtual TextureHandle CreateTexture(eTextureFormats internalFormat, u32 width, u32 height, eTextureFormats inputFormat, const void *pixels, bool interpolation) = 0;
+    // Replaces the whole contents of a texture, width and height must be what it was created with. For textures that
+    // change often (i.e FMV frames), this avoids creating a new texture object per update.
+    virtual void UpdateTexture(TextureHandle handle, u32 width, u32 height, eTextureFormats inputFormat, const void *pixels) = 0;
     void DestroyTexture(TextureHandle handle);
+    virtual bool SupportsPalettedTextures() const { return false; }
+    virtual bool SupportsYCbCrTextures() const { return false; }
+
+    // Expires on ShutDown() or destruction, for anything that keeps textures across frames and can outlive the renderer
+    std::weak_ptr<void> Lifetime() const { return mLifetime; }
 
     // Drawing commands, which will be buffered and issued at the end of the frame.
 
     void TexturedQuad(TextureHandle texHandle, f32 x, f32 y, f32 w, f32 h, int layer, ColourU8 colour, eBlendModes blendMode = eBlendModes::eNormal, eCoordinateSystem coordinateSystem = eCoordinateSystem::eWorld);
+    // indexTexHandle is an eIndex8 texture, paletteTexHandle is a 256x1 RGBA texture. The palette look up
+    // and filtering is done in the shader, so the index texture should be created without interpolation.
+    void PalettedTexturedQuad(TextureHandle indexTexHandle, TextureHandle paletteTexHandle, f32 x, f32 y, f32 w, f32 h, int layer, ColourU8 colour, eBlendModes blendMode = eBlendModes::eNormal, eCoordinateSystem coordinateSystem = eCoordinateSystem::eWorld);
+    // All three are ePlane8 textures, cbTexHandle and crTexHandle are half the size of yTexHandle (4:2:0) with 128
+    // as no colour difference. The conversion to RGB is done in the shader.
+    void YCbCrTexturedQuad(TextureHandle yTexHandle, TextureHandle cbTexHandle, TextureHandle crTexHandle, f32 x, f32 y, f32 w, f32 h, int layer, ColourU8 colour, eBlendModes blendMode = eBlendModes::eNormal, eCoordinateSystem coordinateSystem = eCoordinateSystem::eWorld);
     void Rect(f32 x, f32 y, f32 w, f32 h, int layer, ColourU8 colour, eBlendModes blendMode = eBlendModes::eNormal, eCoordinateSystem coordinateSystem = eCoordinateSystem::eWorld);
-    void Text(f32 x, f32 y, f32 fontSize, const char* text, ColourU8 colour, int layer, eBlendModes blendMode = eBlendModes::eNormal, eCoordinateSystem coordinateSystem = eCoordinateSystem::eWorld);
+    void Text(f32 x, f32 y, f32 fontSize, boost::string_view text, ColourU8 colour, int layer, eBlendModes blendMode = eBlendModes::eNormal, eCoordinateSystem coordinateSystem = eCoordinateSystem::eWorld);
     void PathBegin();
     void PathLineTo(f32 x, f32 y);
     void PathFill(ColourU8 colour, int layer, eBlendModes blendMode = eBlendModes::eNormal, eCoordinateSystem coordinateSystem = eCoordinateSystem::eWorld);
@@ -225,7 +253,21 @@ public:
     void Line(ColourU8 colour, f32 p1x, f32 p1y, f32 p2x, f32 p2y, f32 lineWidth, int layer, eBlendModes blendMode = eBlendModes::eNormal, eCoordinateSystem coordinateSystem = eCoordinateSystem::eWorld);
     void CircleFilled(ColourU8 colour, f32 x, f32 y, f32 radius, u32 numSegments,  int layer, eBlendModes blendMode = eBlendModes::eNormal, eCoordinateSystem coordinateSystem = eCoordinateSystem::eWorld);
     void FontStashTextureDebug(f32 x, f32 y);
-    void TextBounds(f32 x, f32 y, f32 fontSize, const char* text, f32* bounds);
+    void TextBounds(f32 x, f32 y, f32 fontSize, boost::string_view text, f32* bounds);
+
+    // View culling, commands that can't be seen are dropped at submission time rather than being sent to the GPU.
+    // The visible areas are calculated in BeginFrame() so the camera must not change between BeginFrame() and EndFrame().
+    bool IsVisible(f32 x, f32 y, f32 w, f32 h, eCoordinateSystem coordinateSystem = eCoordinateSystem::eWorld) const;
+    bool IsLineVisible(f32 p1x, f32 p1y, f32 p2x, f32 p2y, f32 lineWidth, eCoordinateSystem coordinateSystem = eCoordinateSystem::eWorld) const;
+    const glm::vec4& WorldCullRect() const { return mWorldCullRect; }
+    void SetCulling(bool enabled) { mCullingEnabled = enabled; }
+    bool CullingEnabled() const { return mCullingEnabled; }
+    u32 CulledCommandCount() const { return mLastCulledCommandCount; } // Number culled in the previous frame
+
+    // How far this frame is between the previous and the latest simulation step (0 to 1), used to
+    // interpolate positions when rendering faster than the simulation runs.
+    void SetInterpolation(f32 alpha) { mInterpolation = alpha; }
+    f32 Interpolation() const { return mInterpolation; }
 
 protected:
     struct CmdState
@@ -233,6 +275,9 @@ protected:
         AbstractRenderer* mThisPtr;
         eCoordinateSystem mCoordinateSystem;
         eBlendModes mBlendMode;
+        TextureHandle mPalette; // Only valid for paletted textured quads
+        TextureHandle mCb; // Only valid for YCbCr textured quads
+        TextureHandle mCr; // Only valid for YCbCr textured quads
     };
     virtual void OnSetRenderState(CmdState& info) = 0;
 private:
@@ -326,14 +371,29 @@ private:
     void EnsureCmdFreeSpace(u32 size);
     void generateImGuiCommands();
     static void RenderCallBack(const struct ImDrawList*, const ImDrawCmd* cmd);
-    void PushCallBack(eCoordinateSystem& lastCoordSystem, eBlendModes& lastBlendMode, CmdHeader& header, bool force = false);
+    void PushCallBack(CmdState& lastState, CmdHeader& header, bool force = false);
     void PushTexture(ImTextureID& last, ImTextureID current);
 
+    bool CullCommand(f32 x, f32 y, f32 w, f32 h, eCoordinateSystem coordinateSystem);
+    bool CullPath(f32 lineWidth, eCoordinateSystem coordinateSystem);
+
     std::vector<u8> mDrawCommandBuffer;
     u32 mWritePos = 0;
     bool mInPath = false;
     u32 mPathBeginPos = 0;
 
+    // Bounds of the PathLineTo() points of the path being built, used to cull the whole path
+    glm::vec2 mPathMin;
+    glm::vec2 mPathMax;
+
+    bool mCullingEnabled = true;
+    glm::vec4 mWorldCullRect;
+    glm::vec4 mScreenCullRect;
+    u32 mCulledCommandCount = 0;
+    u32 mLastCulledCommandCount = 0;
+
+    f32 mInterpolation = 1.0f;
+
     // Rather than moving around lots of data to sort mDrawCommandBuffer
     // we just sort points to items in mDrawCommandBuffer instead and then iterate
     // this when generating GPU commands.
@@ -348,11 +408,42 @@ private:
     std::unique_ptr<struct FONSparams> mFontStashParams;
     struct FONScontext* mFontStashContext = nullptr;
     TextureHandle mFontStashTexture;
+    std::shared_ptr<void> mLifetime = std::make_shared<bool>(true);
     int mFontStashFontHandles[3] = {};
     u32 mFontStashWidth = 0;
     u32 mFontStashHeight = 0;
 
-    void HandleTextCommand(f32 dx, f32 dy, f32 fontSize, const char* text, ColourU8* colour, f32* bounds);
+    void HandleTextCommand(f32 dx, f32 dy, f32 fontSize, boost::string_view text, ColourU8* colour, f32* bounds);
+
+    // Glyph quads of a laid out string, as 2 floats per vertex for position and UV in the same way FontStash
+    // outputs them. Positions are relative to where the string is drawn.
+    struct TextGlyphs
+    {
+        std::vector<f32> mVerts;
+        std::vector<f32> mUvs;
+    };
+
+    // Laying out text through FontStash is slow when there are lots of labels on screen, so the
+    // glyph quads of each string are cached and translated to where the string is drawn.
+    struct TextRun
+    {
+        std::string mText; // Full string to detect hash collisions
+        f32 mFontSize = 0.0f;
+        TextGlyphs mShadow;
+        TextGlyphs mGlyphs;
+        f32 mBounds[4] = {};
+        u32 mLastUsedFrame = 0;
+    };
+    const TextRun& GetTextRun(boost::string_view text, f32 fontSize);
+    void AddGlyphs(const f32* verts, const f32* uvs, int nverts, f32 dx, f32 dy, u32 colour);
+    void AddGlyphs(const TextGlyphs& glyphs, f32 dx, f32 dy, u32 colour);
+    void ClearTextRuns();
+
+    // Runs that haven't been drawn or measured for this many frames are removed
+    static const u32 kTextRunMaxAge = 120;
+    std::unordered_map<u64, TextRun> mTextRuns;
+    TextGlyphs* mCapturingGlyphs = nullptr; // When set FontStash output is stored here rather than drawn
+    u32 mFrameNumber = 0;
 
     void AddUiCmd();
 protected:
@@ -28,14 +28,22 @@ public:
         Stop();
     }
 
-    void Add(QueuedItemType item)
+    // High priority items are taken before any normal priority item that is still waiting
+    void Add(QueuedItemType item, bool highPriority = false)
     {
         if (!mQuit && !mStopWork)
         {
             {
                 std::unique_lock<std::mutex> startStopLock(mStartStopMutex);
                 std::unique_lock<std::mutex> queueLock(mQueueMutex);
-                mQueue.push_back(std::move(item));
+                if (highPriority)
+                {
+                    mHighPriorityQueue.push_back(std::move(item));
+                }
+                else
+                {
+                    mQueue.push_back(std::move(item));
+                }
             } // Do not hold lock while doing notify_one()
             mHaveWork.notify_one();
         }
@@ -44,7 +52,7 @@ public:
     bool IsIdle() const
     {
         std::unique_lock<std::mutex> queueLock(mQueueMutex);
-        return mExecutingJobCount == 0 && mQueue.empty();
+        return mExecutingJobCount == 0 && mQueue.empty() && mHighPriorityQueue.empty();
     }
 
     // Don't take anymore work, stop any existing work and return immediately while this happens
@@ -55,6 +63,7 @@ public:
         {
             std::unique_lock<std::mutex> queueLock(mQueueMutex);
             mQueue.clear();
+            mHighPriorityQueue.clear();
         }
 
         mStopWork = true;
@@ -105,6 +114,7 @@ public:
         {
             std::unique_lock<std::mutex> queueLock(mQueueMutex);
             mQueue.clear();
+            mHighPriorityQueue.clear();
         }
 
         mHaveWork.notify_all();
@@ -132,7 +142,7 @@ private:
         {
             mHaveWork.wait(lock, [this]() 
             {
-                return !mQueue.empty() || mQuit;
+                return !mQueue.empty() || !mHighPriorityQueue.empty() || mQuit;
             });
 
             if (mQuit)
@@ -140,14 +150,17 @@ private:
                 return;
             }
 
-            if (!mQueue.empty())
+            std::deque<QueuedItemType>& queue = mHighPriorityQueue.empty() ? mQueue : mHighPriorityQueue;
+            if (!queue.empty())
             {
-                auto item = std::move(mQueue.front());
-                mQueue.pop_front();
+                auto item = std::move(queue.front());
+                queue.pop_front();
+
+                // Counted before unlocking so IsIdle() can't see an empty queue and no jobs in between
+                mExecutingJobCount++;
 
                 lock.unlock();
 
-                mExecutingJobCount++;
                 mExecFunc(std::move(item), mStopWork);
                 mExecutingJobCount--;
 
@@ -157,13 +170,14 @@ private:
     }
 
     std::mutex mStartStopMutex; // Prevent concurrent Start/Stop/Add
-    mutable std::mutex mQueueMutex;     // Protect mQueue
+    mutable std::mutex mQueueMutex;     // Protect mQueue and mHighPriorityQueue
     std::atomic<bool> mQuit { false };
     std::atomic<bool> mStopWork { false };
     std::atomic<u32> mRunningThreadCount { 0 };
     std::atomic<u32> mExecutingJobCount { 0 };
     std::condition_variable mHaveWork;
     std::deque<QueuedItemType> mQueue;
+    std::deque<QueuedItemType> mHighPriorityQueue;
     std::vector<std::thread> mWorkers;
     std::function<void(QueuedItemType item, std::atomic<bool>& quitFlag)> mExecFunc;
 };
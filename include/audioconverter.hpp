@@ -3,14 +3,67 @@
 #include "oddlib/stream.hpp"
 #include "oddlib/lvlarchive.hpp"
 #include <vorbis/vorbisenc.h>
+#define OV_EXCLUDE_STATIC_CALLBACKS
+#include <vorbis/vorbisfile.h>
 #include <atomic>
+#include <memory>
+#include <vector>
 
 class ISound;
 
-class OggDecoder // TODO
+// Decodes an Ogg Vorbis stream a chunk at a time to interleaved floats, stereo or the
+// 4 channel dry + reverb send layout written by eConvertReverb::eSeparate
+class OggDecoder
 {
 public:
+    // Decodes from memory, the data is shared so many decoders can play the same sound
+    explicit OggDecoder(std::shared_ptr<std::vector<u8>> data);
 
+    // Reads the stream as it goes so only the decoder's own state is kept in memory
+    explicit OggDecoder(std::unique_ptr<Oddlib::IStream> stream);
+
+    ~OggDecoder();
+    OggDecoder(const OggDecoder&) = delete;
+    OggDecoder& operator = (const OggDecoder&) = delete;
+
+    bool IsOpen() const { return mOpen; }
+
+    // Interleaved channels per decoded frame, either 2 or 4
+    u32 OutputChannels() const { return mChannels == 4 ? 4 : 2; }
+
+    // Decodes up to numFrames frames into buffer, returns how many were decoded or 0 at the end
+    u32 Decode(f32* buffer, u32 numFrames);
+
+    // Goes back to the first frame
+    void Rewind();
+
+private:
+    void Open();
+    size_t Read(u8* buffer, size_t size);
+    int Seek(s64 offset, int whence);
+    long Tell() const;
+
+    static size_t ReadCallback(void* ptr, size_t size, size_t nmemb, void* datasource);
+    static int SeekCallback(void* datasource, ogg_int64_t offset, int whence);
+    static long TellCallback(void* datasource);
+
+    std::shared_ptr<std::vector<u8>> mData;
+    std::unique_ptr<Oddlib::IStream> mStream;
+    size_t mPos = 0;
+
+    OggVorbis_File mFile;
+    bool mOpen = false;
+    int mChannels = 0;
+};
+
+// How the reverb of a converted sound ends up in the output
+enum class eConvertReverb
+{
+    // Stereo with the reverb applied, rendering carries on until the reverb tail has died away
+    eBake,
+
+    // 4 channels, dry left/right then reverb send left/right, so the reverb is applied when played
+    eSeparate,
 };
 
 class AudioConverter
@@ -18,8 +71,9 @@ class AudioConverter
 public:
     AudioConverter() = delete;
 
+    // Renders the sound offline as fast as it can be mixed and stops as soon as nothing more can be heard
     template<class EncoderAlgorithm>
-    static void Convert(ISound& sound, const char* outputName, std::atomic<bool>& quitFlag);
+    static void Convert(ISound& sound, const char* outputName, std::atomic<bool>& quitFlag, eConvertReverb reverb = eConvertReverb::eBake);
 };
 
 class WavHeader
@@ -66,7 +120,7 @@ public:
 class WavEncoder
 {
 public:
-    WavEncoder(const char* outputName);
+    WavEncoder(const char* outputName, u32 numChannels = 2);
     void Consume(float* readbuffer, long bufferSizeInBytes);
     void Finish();
 private:
@@ -77,12 +131,16 @@ private:
 class OggEncoder
 {
 public:
-    explicit OggEncoder(const char* outputName);
+    explicit OggEncoder(const char* outputName, u32 numChannels = 2);
     ~OggEncoder();
     void Consume(float* readbuffer, long bufferSizeInBytes);
-    void Finish() { }
+    void Finish();
 private:
     void InitEncoder();
+    void WritePages();
+
+    bool mEndOfStream = false;
+    u32 mNumChannels = 2;
 
     FILE*            output = nullptr;
     ogg_stream_state os; // take physical pages, weld into a logical stream of packets
@@ -7,6 +7,7 @@
 #include "oddlib/stream.hpp"
 #include "logger.hpp"
 #include <cassert>
+#include <cstring>
 #include "filesystem.hpp"
 
 class InvalidCdImageException : public Oddlib::Exception
@@ -374,6 +375,24 @@ public:
             // a full sector will be read for each read. This is slightly hacky but it works
             if (mIncludeSubHeader)
             {
+                // A multiple of the sub header and data of a sector reads that many sectors with a single read
+                // of the image, dropping the sync and header of each raw sector
+                const size_t kSectorData = kRawSectorSize - 16;
+                if (destSize > kSectorData && (destSize % kSectorData) == 0)
+                {
+                    const size_t numSectors = destSize / kSectorData;
+                    mRawBuffer.resize(numSectors * kRawSectorSize);
+                    mStream->Seek(mSector * kRawSectorSize);
+                    mStream->ReadBytes(mRawBuffer.data(), mRawBuffer.size());
+                    for (size_t i = 0; i < numSectors; i++)
+                    {
+                        memcpy(pDest + (i * kSectorData), mRawBuffer.data() + (i * kRawSectorSize) + 16, kSectorData);
+                    }
+                    mSector += static_cast<u32>(numSectors);
+                    mPos += numSectors * 2048;
+                    return;
+                }
+
                 mStream->Seek((mSector * kRawSectorSize) + 16);
                 mSector++;
 
@@ -456,32 +475,20 @@ public:
                 return;
             }
 
-            if (pos == 0)
-            {
-                mSector = mDr.location.little;
-                mPos = 0;
-                mStream->Seek((mSector * kRawSectorSize) + 16);
-                return;
-            }
-
+            // Each raw read is a whole sector, so only the start of a sector can be seeked to
             if ((pos % 2048) != 0)
             {
-                mPos = 0;
-                mSector = static_cast<u32>(pos / 2048);
-                mStream->Seek((mSector * kRawSectorSize) + 16);
-                return;
+                throw std::runtime_error("Seek() must be to the start of a sector");
             }
 
-            throw std::runtime_error("Seek() not implemented");
+            mSector = mDr.location.little + static_cast<u32>(pos / 2048);
+            mPos = pos;
+            mStream->Seek((mSector * kRawSectorSize) + 16);
         }
 
         virtual size_t Pos() const override
         {
-            if (!mIncludeSubHeader)
-            {
-                return mPos;
-            }
-            throw std::runtime_error("Pos() not implemented");
+            return mPos;
         }
 
         virtual size_t Size() const override
@@ -514,6 +521,7 @@ public:
 
         // Stream the raw cd bin image file
         std::unique_ptr<Oddlib::IStream> mStream;
+        std::vector<u8> mRawBuffer;
     };
 
 private:
@@ -18,7 +18,11 @@ struct Debug
     bool mSubtitleTestItalic = false;
     bool mSubtitleTestBold = false;
     bool mDrawFontAtlas = false;
+    bool mViewCulling = true;
     bool mVsync = true;
+    bool mInterpolate = true;
+    bool mFrameLimit = true;
+    int mMaxFps = 144;
     bool mShowDebugUi = true;
     bool mChangeVSync = false;
 
@@ -32,6 +32,7 @@ private:
     virtual void ClearFrameBufferImpl(f32 r, f32 g, f32 b, f32 a) override;
     virtual void RenderCommandsImpl() override;
     virtual TextureHandle CreateTexture(eTextureFormats internalFormat, u32 width, u32 height, eTextureFormats inputFormat, const void *pixels, bool interpolation) override;
+    virtual void UpdateTexture(TextureHandle handle, u32 width, u32 height, eTextureFormats inputFormat, const void *pixels) override;
     virtual void DestroyTextures() override;
     virtual const char* Name() const override;
     void doDraw(struct ImDrawList* list, int& vtx_offset, int& idx_offset);
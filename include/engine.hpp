@@ -586,7 +586,7 @@ private:
     void RunInitScript();
     void Include(const std::string& scriptName);
     void Update();
-    void Render();
+    void Render(f32 frameSeconds);
     bool InitSDL();
     void AddGameDefinitionsFrom(const char* path);
     void AddModDefinitionsFrom(const char* path);
@@ -596,6 +596,7 @@ private:
     void InitImGui();
     void ImGui_WindowResize();
     void RenderLoadingIcon();
+    void RenderSoundCacheProgress();
 protected:
     void BindScriptTypes();
     void InitSubSystems();
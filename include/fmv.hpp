@@ -9,12 +9,17 @@
 #include "core/audiobuffer.hpp"
 #include "subtitles.hpp"
 #include "stdthread.h"
+#include "spscqueue.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include "resourcemapper.hpp"
 #include <functional>
 
 class GameData;
 class IAudioController;
 class AbstractRenderer;
+class IFileSystem;
 
 class IMovie : public IAudioPlayer
 {
@@ -38,37 +43,139 @@ public:
 
     void Start();
     void Stop();
+
+    // Main thread context. Every frame of every format is intra coded so decoding restarts right at
+    // the frame sought to. Counting the frames can mean scanning the whole stream the first time.
+    size_t NumberOfFrames();
+    size_t CurrentFrame() const;
+    bool Seek(size_t frameNum);
+
+    // Formats that have to scan the stream to find each frame keep what they found in fileName
+    void SetFrameIndexCache(IFileSystem& fs, const std::string& fileName);
+
+    // Main thread context. Decodes from the current frame to the end as fast as possible without an audio
+    // device or renderer, for tools. Frames are 32 bit RGBA and audio is 16 bit stereo at 44100. Only for
+    // movies that haven't been rendered, as frames already decoded for the renderer can be YCbCr.
+    // onDecoded is called on the decode thread as each frame is queued, before onFrame gets it. Returns
+    // the seconds the decode thread spent decoding, which leaves out waiting for the queues to drain.
+    f64 DecodeAll(const std::function<void(size_t frameNum, u32 w, u32 h, const u8* pixels)>& onFrame,
+        const std::function<void(const s16* samples, u32 count)>& onAudio,
+        const std::function<void(size_t frameNum)>& onDecoded = nullptr);
 protected:
+    struct Frame
+    {
+        size_t mFrameNum;
+        u32 mW;
+        u32 mH;
+        bool mYCbCr; // mPixels is the Y, Cb then Cr planes (4:2:0) rather than 32 bit RGBA
+        std::vector<u8> mPixels;
+
+        // Always resized as its possible for a stream to change its frame size part way through
+        void Resize(u32 w, u32 h, bool yCbCr)
+        {
+            mW = w;
+            mH = h;
+            mYCbCr = yCbCr;
+            mPixels.resize(yCbCr ? (w * h) + (ChromaW() * ChromaH() * 2) : w * h * 4);
+        }
+
+        u32 ChromaW() const { return (mW + 1) / 2; }
+        u32 ChromaH() const { return (mH + 1) / 2; }
+        u8* Y() { return mPixels.data(); }
+        u8* Cb() { return Y() + (mW * mH); }
+        u8* Cr() { return Cb() + (ChromaW() * ChromaH()); }
+        const u8* Y() const { return mPixels.data(); }
+        const u8* Cb() const { return Y() + (mW * mH); }
+        const u8* Cr() const { return Cb() + (ChromaW() * ChromaH()); }
+    };
+
+    // Decode thread context
     virtual bool EndOfStream() = 0;
-    virtual bool NeedBuffer() = 0;
     virtual void FillBuffers() = 0;
 
+    // Main thread context, only called while the decode thread is stopped. SeekToFrame returns the
+    // number of audio bytes that come before frameNum, frameNum is always less than CountFrames().
+    virtual size_t CountFrames() = 0;
+    virtual size_t SeekToFrame(size_t frameNum) = 0;
+
     // Audio thread context, from IAudioPlayer
     virtual bool Play(f32* stream, u32 len) override;
 
 
-    void RenderFrame(AbstractRenderer& rend, int width, int height, const void* pixels, const char* subtitles);
+    void RenderFrame(AbstractRenderer& rend, const Frame& frame, const char* subtitles);
+
+    // Decode thread context, true while there is a free frame and the audio isn't too far ahead
+    bool NeedBuffer() const;
+
+    // Decode thread context, true if the renderer can take frames as YCbCr planes and do the colour conversion itself
+    bool WantYCbCrFrames() const { return mYCbCrFrames; }
+
+    // Decode thread context, these wait for the render or audio thread to make room. They give up
+    // and return nullptr/false if decoding is being stopped.
+    Frame* AcquireFrame();
+    void QueueFrame();
+    bool QueueAudio(const s16* samples, u32 count);
+    bool QueueSilence(u32 count);
+
+    // Must be called by the most derived destructor, the decode thread calls into the derived class
+    void StopDecoding();
 
 protected:
-    struct Frame
-    {
-        size_t mFrameNum;
-        u32 mW;
-        u32 mH;
-        std::vector<u8> mPixels;
-    };
-    size_t mFrameCounter = 0;
-    size_t mConsumedAudioBytes = 0;
-    std::mutex mAudioBufferMutex;
-    std::deque<u8> mAudioBuffer;
-    std::deque<Frame> mVideoBuffer;
     IAudioController& mAudioController;
     u32 mAudioBytesPerFrame = 1;
     std::unique_ptr<SubTitleParser> mSubTitles;
     std::string mName;
+    IFileSystem* mIndexCacheFs = nullptr;
+    std::string mIndexCacheFileName;
 
 private:
+    void DecodeThread();
+    void PauseDecoding();
+    void ResetQueues();
+    bool WaitForRoom();
+    void ReleaseFrame(u32 index);
+    void UploadFrame(AbstractRenderer& rend, const Frame& frame);
+    void DestroyFrameTexture();
+
     bool mPlaying = false;
+    size_t mNumberOfFrames = 0;
+    bool mFramesCounted = false;
+
+    // Frames go round in a loop, free ones back to the decoder and decoded ones on to the render thread
+    static const u32 kFrameQueueSize = 16;
+    std::vector<Frame> mFrames;
+    SpscQueue<u32> mFreeFrames{ kFrameQueueSize };
+    SpscQueue<u32> mDecodedFrames{ kFrameQueueSize };
+    SpscQueue<s16> mAudioQueue{ 0 };
+    u32 mAudioTargetSamples = 0;
+    s32 mAcquiredFrame = -1; // Decode thread only
+    size_t mFrameCounter = 0; // Decode thread only
+    std::chrono::steady_clock::duration mDecodeTime{}; // Decode thread only
+    std::chrono::steady_clock::duration mWaitTime{}; // Decode thread only
+    std::function<void(size_t frameNum)> mOnDecoded; // Only set by DecodeAll
+
+    // Render thread only, the frame on screen and the next one once its time comes
+    s32 mShownFrame = -1;
+    s32 mNextFrame = -1;
+
+    std::atomic<size_t> mConsumedAudioBytes{ 0 };
+    std::atomic<bool> mDecodeFinished{ false };
+    std::atomic<bool> mStopDecode{ false };
+    std::atomic<bool> mYCbCrFrames{ false };
+    std::mutex mDecodeWakeMutex;
+    std::condition_variable mDecodeWake;
+    std::thread mDecodeThread;
+
+    // Reused for every video frame, only recreated if the frame size or format changes. mFrameTexture
+    // is the Y plane for YCbCr frames.
+    AbstractRenderer* mRenderer = nullptr;
+    TextureHandle mFrameTexture;
+    TextureHandle mCbTexture;
+    TextureHandle mCrTexture;
+    u32 mFrameTextureW = 0;
+    u32 mFrameTextureH = 0;
+    bool mFrameTextureYCbCr = false;
+    size_t mFrameTextureNum = 0; // The video frame currently in mFrameTexture
     //AutoMouseCursorHide mHideMouseCursor;
 };
 
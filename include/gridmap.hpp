@@ -46,6 +46,9 @@ public:
     bool LoadMap(const Oddlib::Path& path);
     void Update(const InputState& input, CoordinateSpace& coords);
     void Render(AbstractRenderer& rend);
+
+    // Every sound the loaded map's objects use, without duplicates
+    std::vector<std::string> SoundResources() const;
 private:
     void RenderDebugPathSelection();
     std::unique_ptr<class GridMap> mMap;
@@ -120,6 +123,17 @@ public:
     eStates mState = eStates::eInGame;
     u32 mModeSwitchTimeout = 0;
 
+    // Range of mScreens indices [begin, end) that overlap the current view, used to skip
+    // everything in the map that can't be seen without testing every camera.
+    struct ScreenRange
+    {
+        u32 mXBegin;
+        u32 mXEnd;
+        u32 mYBegin;
+        u32 mYEnd;
+    };
+    ScreenRange VisibleScreens(const AbstractRenderer& rend, u32 margin = 0) const;
+
     void RenderDebug(AbstractRenderer& rend) const;
     void DebugRayCast(AbstractRenderer& rend, const glm::vec2& from, const glm::vec2& to, u32 collisionType, const glm::vec2& fromDrawOffset = glm::vec2()) const;
 private:
@@ -138,6 +152,7 @@ public:
     bool LoadMap(const Oddlib::Path& path, ResourceLocator& locator);
     void Update(const InputState& input, CoordinateSpace& coords);
     void Render(AbstractRenderer& rend) const;
+    std::vector<std::string> SoundResources() const;
     static void RegisterScriptBindings();
 private:
     class Loader
@@ -80,12 +80,23 @@ public:
     bool ContainsPoint(s32 x, s32 y) const;
     const std::string& Name() const { return mName; }
 
+    // The script's kSoundResources, known once the object has loaded
+    const std::vector<std::string>& SoundResources() const { return mSoundResources; }
+
     // TODO: Shouldn't be part of this object
     void SnapXToGrid();
 
+    // Moves without interpolating from the old position, for anything that moves the object outside of Update()
+    void SetPosition(float xpos, float ypos);
+
     float mXPos = 50.0f;
     float mYPos = 100.0f;
 
+    // Position at the start of the last Update(), rendering interpolates from here to mXPos/mYPos
+    float mPrevXPos = 50.0f;
+    float mPrevYPos = 100.0f;
+    bool mPrevPosValid = false;
+
     s32 Id() const { return mId; }
     bool WallCollision(IMap& map, f32 dx, f32 dy) const;
     bool CellingCollision(IMap& map, f32 dx, f32 dy) const;
@@ -123,6 +134,7 @@ private:
 
     std::map<std::string, std::shared_ptr<Animation>> mAnims;
     Animation* mAnim = nullptr;
+    std::vector<std::string> mSoundResources;
 
     void LoadScript();
 private: // Actions
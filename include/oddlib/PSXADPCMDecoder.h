@@ -5,17 +5,26 @@
 #endif
 
 #include <stdint.h>
+#include <array>
 #include <vector>
 #include "SDL_stdinc.h"
 #include "oddlib/stream.hpp"
 
-
+// PSX ADPCM decoder, a whole 28 sample block at a time
 class PSXADPCMDecoder
 {
 public:
+    // Interleaved stereo samples in one XA sound frame
+    static const u32 kSamplesPerFrame = 4032;
+
     PSXADPCMDecoder() = default;
-    void DecodeFrameToPCM(std::array<s16, 4032>& out, uint8_t *arg_adpcm_frame);
+    void DecodeFrameToPCM(std::array<s16, kSamplesPerFrame>& out, uint8_t *arg_adpcm_frame);
     void DecodeFrameToPCM(std::vector<s16>& out, uint8_t *arg_adpcm_frame);
+
+    // Writes kSamplesPerFrame samples, the filter state carries on from the previous frame
+    void DecodeFrameToPCM(s16* out, const u8* adpcmFrame);
+
+    // Appends little endian 16 bit mono samples up to the block with the end flag
     void DecodeVagStream(Oddlib::IStream& s, std::vector<u8>& out);
 
 public:
@@ -35,4 +44,10 @@ public:
     };
 
 #pragma pack(pop)
+
+private:
+    s32 mOldLeft = 0;
+    s32 mOlderLeft = 0;
+    s32 mOldRight = 0;
+    s32 mOlderRight = 0;
 };
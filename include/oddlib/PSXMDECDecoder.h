@@ -33,6 +33,7 @@
 
 
 #include <stdint.h>
+#include <vector>
 
 
 
@@ -41,13 +42,32 @@ class PSXMDECDecoder
 public:
     PSXMDECDecoder();
 
-    uint8_t DecodeFrameToABGR32(uint16_t *arg_decoded_image,
+    uint8_t DecodeFrameToRGBA32(uint16_t *arg_decoded_image,
         uint16_t *arg_bs_image,
         uint16_t arg_width,
         uint16_t arg_height);
 
+    // Rows of the output are arg_pitch bytes apart, so a frame can be decoded straight
+    // into a locked texture or surface
+    void DecodeFrameToRGBA32(uint8_t *arg_decoded_image,
+        uint32_t arg_pitch,
+        const uint16_t *arg_bs_image,
+        uint16_t arg_width,
+        uint16_t arg_height);
+
+    // Planar 4:2:0 output for when the colour conversion is done on the GPU. The planes are packed, Y is
+    // arg_width x arg_height and Cb and Cr are half that rounded up, with 128 as no colour difference.
+    void DecodeFrameToYCbCr420(uint8_t *arg_y,
+        uint8_t *arg_cb,
+        uint8_t *arg_cr,
+        const uint16_t *arg_bs_image,
+        uint16_t arg_width,
+        uint16_t arg_height);
+
     static void IDCT(int16_t *, uint8_t);
-private:
+protected:
+    // The VLC and IDCT code is reachable from tests, so that the fast table and the SSE2 IDCT
+    // can be checked against the table chain and scalar IDCT they replaced
     static const uint8_t  VLC_SBIT = 17;
     static const uint16_t VLC_EOB = 0xfe00;
     static const uint32_t VLC_ESCAPE_CODE;
@@ -63,6 +83,15 @@ private:
     static const uint32_t VLC_DC_Y_TABLE_0[48];
     static const uint32_t VLC_DC_UV_TABLE_0[56];
 
+    // Codes up to 12 bits long are looked up with the top bits of the bit buffer in one go
+    static const uint8_t VLC_FAST_BITS = 13;
+    static const uint32_t* VLCFastTable();
+    static uint32_t VLCLookup(uint32_t code);
+
+    static void IDCTScalar(int16_t *, uint8_t);
+    void DecodeDCTVLC(uint16_t *mdec_rl, const uint16_t *mdec_bs);
+
+private:
     static const uint8_t DCT_SIZE = 8;
     static const uint8_t DCT_BLOCK_SIZE = 64;
 
@@ -80,18 +109,29 @@ private:
 
     static const uint8_t RL_ZSCAN_MATRIX[DCT_BLOCK_SIZE];
 
-    uint8_t BSRoundTable[256 * 3];
     int IQTable[DCT_BLOCK_SIZE];
 
-    void BSRoundTableInit();
+    // Run length codes of the frame being decoded, kept to save allocating every frame
+    std::vector<uint16_t> mRunLengths;
+
     void IQTableInit();
-   
-    void YUVfunction1(uint8_t arg_image[][4], int index, int r0, int g0, int b0, int y);
-    void YUV2BGRA32(int16_t *arg_blk,
-        uint8_t arg_image[][4]);
+
+    void YUV2RGBA32(const int16_t *arg_blk,
+        uint8_t *arg_image,
+        uint32_t arg_pitch,
+        uint16_t arg_width,
+        uint16_t arg_height);
+
+    static void YUV2Planes(const int16_t *arg_blk,
+        uint8_t *arg_y,
+        uint8_t *arg_cb,
+        uint8_t *arg_cr,
+        uint32_t arg_y_pitch,
+        uint32_t arg_chroma_pitch,
+        uint16_t arg_width,
+        uint16_t arg_height);
 
     uint16_t *RL2BLK(uint16_t *, int16_t *);
-    void DecodeDCTVLC(uint16_t *mdec_rl, uint16_t *mdec_bs);
 };
 
 
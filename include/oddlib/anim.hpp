@@ -61,6 +61,13 @@ namespace Oddlib
         AnimSerializer& operator = (const AnimSerializer&) = delete;
 
         SDL_SurfacePtr ApplyPalleteToFrame(const FrameHeader& header, u32 realWidth, const std::vector<u8>& decompressedData, std::vector<u32>& pixels);
+
+        // Unpacks 4 or 8 bit frame data to one palette index per byte, indices that are out of
+        // the palette range are clamped in the same way as ApplyPalleteToFrame
+        std::vector<u8> UnpackFrameIndices(const FrameHeader& header, const std::vector<u8>& decompressedData) const;
+
+        // Palette entries are stored as (r << 24) | (g << 16) | (b << 8) | a
+        const std::vector<u32>& Pallete() const { return mPalt; }
         const std::set< u32 >& UniqueFrames() const { return mUniqueFrameHeaderOffsets; }
         u32 MaxW() const { return mHeader.mMaxW; }
         u32 MaxH() const { return mHeader.mMaxH; }
@@ -123,6 +130,7 @@ namespace Oddlib
 
         const std::vector<std::unique_ptr<AnimationHeader>>& Animations() const { return mAnimationHeaders; }
     private:
+        u8 ClampPaltIndex(u32 idx) const;
         u32 GetPaltValue(u32 idx);
         u32 ParsePallete();
         void ParseAnimationSets();
@@ -200,7 +208,8 @@ namespace Oddlib
             BoundingBoxPoint mTopLeft;
             BoundingBoxPoint mBottomRight;
 
-            // Image pixel data - pointer as data is sometimes shared between frames
+            // Image pixel data - pointer as data is sometimes shared between frames. This is an
+            // 8 bit indexed surface with a pitch equal to its width, the colours come from AnimationSet::Palette()
             SDL_Surface* mFrame;
         };
 
@@ -230,14 +239,27 @@ namespace Oddlib
         SDL_Surface* FrameByOffset(u32 offset) const;
         u32 MaxW() const { return mMaxW; }
         u32 MaxH() const { return mMaxH; }
+
+        static const u32 kPaletteSize = 256;
+
+        // kPaletteSize colours with the RGBA byte order used for textures, the colour
+        // channels are premultiplied by alpha
+        const std::vector<u32>& Palette() const { return mPalette; }
     private:
+        void MakePalette(const AnimSerializer& as);
         SDL_SurfacePtr MakeFrame(AnimSerializer& as, const AnimSerializer::DecodedFrame& df, u32 offsetData);
 
         std::vector<std::unique_ptr<Animation>> mAnimations;
 
+        // Backing storage of the indexed frame surfaces, must outlive mFrames
+        std::map<u32, std::vector<u8>> mFramePixels;
+
         // Map of frame offsets to frame images
         std::map<u32, SDL_SurfacePtr> mFrames;
 
+        std::vector<u32> mPalette;
+        SDL_PalettePtr mSdlPalette;
+
         u32 mMaxW = 0;
         u32 mMaxH = 0;
     };
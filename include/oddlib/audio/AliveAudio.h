@@ -17,63 +17,148 @@
 #include "ADSR.h"
 #include "core/audiobuffer.hpp"
 #include "stdthread.h"
+#include "spscqueue.hpp"
 #include "AudioInterpolation.h"
-
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable:4267) //  'return' : conversion from 'size_t' to 'unsigned long', possible loss of data
-#endif
-#include "stk/include/FreeVerb.h"
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif
+#include "MixBus.h"
+#include "VoicePool.h"
 
 const int kAliveAudioSampleRate = 44100;
 
+// Frames mixed per voice at a time
+const u32 kAliveAudioMixBlockFrames = 256;
+
+// Size of each AliveAudio's voice pool unless ReserveVoices() asks for more
+const u32 kAliveAudioDefaultVoices = 64;
+
+// Voices that may sound at once before new notes start stealing them
+const u32 kAliveAudioDefaultPolyphony = 32;
+
+// Priority given to notes when nothing more specific has been set, see SoundResource::mPriority
+const u8 kAliveAudioDefaultPriority = 64;
+
 class FileSystem;
 
+// Requests from the game thread, applied by the audio thread at the start of the next mix
+enum class eAliveAudioCommands
+{
+    eNoteOn,
+    eNoteOff,
+    eClearAllVoices,
+    eClearAllTrackVoices,
+    eStartSequence,
+    eStopSequence,
+};
+
+struct AliveAudioCommand
+{
+    eAliveAudioCommands mType = eAliveAudioCommands::eNoteOn;
+    int mProgram = 0;
+    int mNote = 0;
+    char mVelocity = 0;
+    u8 mPriority = kAliveAudioDefaultPriority;
+    f64 mTrackDelay = 0.0;
+    f64 mPitch = 0.0;
+    bool mIgnoreLoops = false;
+    bool mForceKill = false;
+};
+
+// A sequence event, mSample is relative to the start of the sequence
+struct AliveAudioSequenceEvent
+{
+    u64 mSample = 0;
+    AliveAudioCommand mCommand;
+};
+
 class AliveAudio
 {
 public:
-    AliveAudio() = default;
+    AliveAudio();
     AliveAudio(AliveAudio&&) = delete;
     AliveAudio(const AliveAudio&) = delete;
     AliveAudio& operator = (const AliveAudio&) = delete;
     AliveAudio& operator = (AliveAudio&&) = delete;
 
+    // These only queue the request, they never block on the audio thread
     void NoteOn(int program, int note, char velocity, f64 trackDelay = 0, f64 pitch = 0.0f, bool ignoreLoops = false);
     void NoteOff(int program, int note);
-    void NoteOffDelay(int program, int note, f32 trackDelay = 0);
     void ClearAllVoices(bool forceKill = true);
     void ClearAllTrackVoices(bool forceKill = false);
 
+    // Starts the sequence from the beginning, mCurrentSampleIndex is reset to 0 when it starts
+    void PlaySequence();
+    void StopSequence();
+
+    // True until the audio thread has picked up the last PlaySequence()
+    bool SequenceStartPending() const { return mSequenceStartsRequested != mSequenceStartsDone; }
+
+    // Not thread safe, must be called before the audio thread starts mixing this instance.
+    // The events must be sorted by time, they are dispatched by the audio thread as they fall due.
+    void SetSequence(std::vector<AliveAudioSequenceEvent> events);
+
+    // Not thread safe, must be called before the audio thread starts mixing this instance
     void SetSoundbank(std::unique_ptr<AliveAudioSoundbank> soundbank);
 
-    u64 mCurrentSampleIndex = 0;
+    // Not thread safe, must be called before the audio thread starts mixing this instance.
+    // Sizes the voice pool and the command queue so that count notes can be pending at once.
+    void ReserveVoices(u32 count);
+
+    std::atomic<u64> mCurrentSampleIndex{ 0 };
 
+    // Renders into a private bus with its own reverb, for use outside of the game's shared mix
     void Play(f32* stream, u32 len);
 
-    u32 NumberOfActiveVoices() const { return static_cast<u32>(m_Voices.size()); }
+    // Renders the voices into the shared dry bus and reverb send
+    void Mix(AliveAudioMixBus& bus, u32 len);
+
+    // Includes notes that have been queued but not started by the audio thread yet
+    u32 NumberOfActiveVoices() const { return mActiveVoiceCount + mQueuedNoteOnCount; }
+
+    // Notes that could not be played because every voice was busy with a higher priority note
+    u32 NumberOfDroppedNotes() const { return mDroppedNoteCount; }
+
+    // Voices that were cut off to make room for a new note
+    u32 NumberOfStolenVoices() const { return mStolenVoiceCount; }
 
     // Can be changed from outside class
     AudioInterpolation Interpolation = AudioInterpolation_hermite;
     bool ForceReverb = false;
-    f32 ReverbMix = 0.5f;
     bool DebugDisableVoiceResampling = false;
+    u32 MaxPolyphony = kAliveAudioDefaultPolyphony;
+    eVoiceStealing VoiceStealing = eVoiceStealing::eQuietest;
+    std::atomic<u8> Priority{ kAliveAudioDefaultPriority }; // Given to notes as they are queued or the sequence plays them
 
     // TODO: Temp for sound effect debugging
     void VabBrowserUi();
 private:
+    void PushCommand(const AliveAudioCommand& cmd);
+
+    // Audio thread only
+    void ProcessCommands();
+    void ExecuteCommand(const AliveAudioCommand& cmd);
+    void DispatchDueSequenceEvents();
+    u32 FramesUntilNextSequenceEvent(u32 maxFrames) const;
+    void DoNoteOn(const AliveAudioCommand& cmd);
+    void DoNoteOff(const AliveAudioCommand& cmd);
+    void DoClearVoices(bool forceKill);
+    void CleanVoices();
+    void AliveRenderAudio(AliveAudioMixBus& bus, u32 StreamLength);
+
     std::unique_ptr<AliveAudioSoundbank> m_Soundbank;
 
-    std::vector<AliveAudioVoice *> m_Voices;
-    std::vector<f32> m_DryChannelBuffer;
-    std::vector<f32> m_ReverbChannelBuffer;
+    SpscQueue<AliveAudioCommand> mCommands;
+    std::atomic<u32> mQueuedNoteOnCount{ 0 };
+    std::atomic<u32> mActiveVoiceCount{ 0 };
+    std::atomic<u32> mDroppedNoteCount{ 0 };
+    std::atomic<u32> mStolenVoiceCount{ 0 };
 
-    stk::FreeVerb m_Reverb;
+    std::vector<AliveAudioSequenceEvent> mSequence;
+    size_t mNextSequenceEvent = 0; // Audio thread only
+    bool mSequencePlaying = false; // Audio thread only
+    u32 mSequenceStartsRequested = 0; // Game thread only
+    std::atomic<u32> mSequenceStartsDone{ 0 };
 
-    void CleanVoices();
-    void AliveRenderAudio(f32* AudioStream, int StreamLength);
+    AliveAudioVoicePool m_Voices; // Audio thread only
+    f32 m_VoiceBuffer[kAliveAudioMixBlockFrames];
 
-    std::recursive_mutex mVoiceMutex;
+    std::unique_ptr<AliveAudioMixBus> m_PrivateBus;
 };
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "types.hpp"
+#include <vector>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable:4267) //  'return' : conversion from 'size_t' to 'unsigned long', possible loss of data
+#endif
+#include "stk/include/FreeVerb.h"
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+// Most interleaved samples the buses hold, callers mix larger buffers in pieces
+const u32 kAliveAudioMixBusMaxSamples = 8192;
+
+// The dry bus and reverb send that every playing sound mixes into, so that there is only
+// one reverb no matter how many sequences are playing at once.
+class AliveAudioMixBus
+{
+public:
+    AliveAudioMixBus();
+    AliveAudioMixBus(const AliveAudioMixBus&) = delete;
+    AliveAudioMixBus& operator = (const AliveAudioMixBus&) = delete;
+
+    // Clears both buses ready for len (at most kAliveAudioMixBusMaxSamples) interleaved stereo samples to be mixed in
+    void Begin(u32 len);
+
+    // Runs the reverb over the send and adds the dry and wet signal to stream
+    void Resolve(f32* stream, u32 len);
+
+    f32* Dry() { return mDry.data(); }
+    f32* ReverbSend() { return mReverbSend.data(); }
+
+    bool ReverbActive() const { return mReverbActive; }
+
+    f32 ReverbMix = 0.5f;
+
+private:
+    std::vector<f32> mDry;
+    std::vector<f32> mReverbSend;
+
+    // Still true while the tail of the last non silent input is ringing out
+    bool mReverbActive = false;
+
+    stk::FreeVerb mReverb;
+};
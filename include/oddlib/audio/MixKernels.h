@@ -0,0 +1,165 @@
+#pragma once
+
+#include "types.hpp"
+#include "oddlib/audio/AudioInterpolation.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ALIVE_AUDIO_SSE 1
+#include <emmintrin.h>
+#endif
+
+// Block kernels used by the voice renderer and the mixer. The SSE paths do 4 frames
+// at a time, the scalar loops are kept simple enough that the compiler can vectorise
+// them on other targets (NEON).
+namespace MixKernels
+{
+    // Interpolated sample taps for a block of frames, x1 is the sample at floor(offset)
+    struct Taps
+    {
+        const f32* x0;
+        const f32* x1;
+        const f32* x2;
+        const f32* x3;
+        const f32* t;
+    };
+
+    // out[i] = interpolate(taps, i) * gain[i] * velocity
+    inline void Resample(f32* out, const Taps& taps, const f32* gain, f32 velocity, u32 count, AudioInterpolation interpolation)
+    {
+        u32 i = 0;
+        switch (interpolation)
+        {
+        case AudioInterpolation_none:
+            for (; i < count; i++)
+            {
+                out[i] = taps.x1[i] * gain[i] * velocity;
+            }
+            break;
+
+        case AudioInterpolation_linear:
+#ifdef ALIVE_AUDIO_SSE
+            {
+                const __m128 vel = _mm_set1_ps(velocity);
+                for (; i + 4 <= count; i += 4)
+                {
+                    const __m128 x1 = _mm_loadu_ps(taps.x1 + i);
+                    const __m128 x2 = _mm_loadu_ps(taps.x2 + i);
+                    const __m128 t = _mm_loadu_ps(taps.t + i);
+                    const __m128 s = _mm_add_ps(x1, _mm_mul_ps(_mm_sub_ps(x2, x1), t));
+                    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_mul_ps(s, _mm_loadu_ps(gain + i)), vel));
+                }
+            }
+#endif
+            for (; i < count; i++)
+            {
+                const f32 s = taps.x1[i] + ((taps.x2[i] - taps.x1[i]) * taps.t[i]);
+                out[i] = s * gain[i] * velocity;
+            }
+            break;
+
+        case AudioInterpolation_cubic:
+#ifdef ALIVE_AUDIO_SSE
+            {
+                const __m128 vel = _mm_set1_ps(velocity);
+                for (; i + 4 <= count; i += 4)
+                {
+                    const __m128 x0 = _mm_loadu_ps(taps.x0 + i);
+                    const __m128 x1 = _mm_loadu_ps(taps.x1 + i);
+                    const __m128 x2 = _mm_loadu_ps(taps.x2 + i);
+                    const __m128 x3 = _mm_loadu_ps(taps.x3 + i);
+                    const __m128 t = _mm_loadu_ps(taps.t + i);
+                    const __m128 a0 = _mm_add_ps(_mm_sub_ps(_mm_sub_ps(x3, x2), x0), x1);
+                    const __m128 a1 = _mm_sub_ps(_mm_sub_ps(x0, x1), a0);
+                    const __m128 a2 = _mm_sub_ps(x2, x0);
+                    const __m128 s = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(a0, t), a1), t), a2), t), x1);
+                    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_mul_ps(s, _mm_loadu_ps(gain + i)), vel));
+                }
+            }
+#endif
+            for (; i < count; i++)
+            {
+                const f32 t = taps.t[i];
+                const f32 a0 = taps.x3[i] - taps.x2[i] - taps.x0[i] + taps.x1[i];
+                const f32 a1 = taps.x0[i] - taps.x1[i] - a0;
+                const f32 a2 = taps.x2[i] - taps.x0[i];
+                const f32 s = (((((a0 * t) + a1) * t) + a2) * t) + taps.x1[i];
+                out[i] = s * gain[i] * velocity;
+            }
+            break;
+
+        case AudioInterpolation_hermite:
+#ifdef ALIVE_AUDIO_SSE
+            {
+                const __m128 vel = _mm_set1_ps(velocity);
+                const __m128 half = _mm_set1_ps(0.5f);
+                const __m128 oneAndHalf = _mm_set1_ps(1.5f);
+                const __m128 two = _mm_set1_ps(2.0f);
+                const __m128 twoAndHalf = _mm_set1_ps(2.5f);
+                for (; i + 4 <= count; i += 4)
+                {
+                    const __m128 x0 = _mm_loadu_ps(taps.x0 + i);
+                    const __m128 x1 = _mm_loadu_ps(taps.x1 + i);
+                    const __m128 x2 = _mm_loadu_ps(taps.x2 + i);
+                    const __m128 x3 = _mm_loadu_ps(taps.x3 + i);
+                    const __m128 t = _mm_loadu_ps(taps.t + i);
+                    const __m128 c1 = _mm_mul_ps(half, _mm_sub_ps(x2, x0));
+                    const __m128 c2 = _mm_sub_ps(_mm_add_ps(_mm_sub_ps(x0, _mm_mul_ps(twoAndHalf, x1)), _mm_mul_ps(two, x2)), _mm_mul_ps(half, x3));
+                    const __m128 c3 = _mm_add_ps(_mm_mul_ps(half, _mm_sub_ps(x3, x0)), _mm_mul_ps(oneAndHalf, _mm_sub_ps(x1, x2)));
+                    const __m128 s = _mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(c3, t), c2), t), c1), t), x1);
+                    _mm_storeu_ps(out + i, _mm_mul_ps(_mm_mul_ps(s, _mm_loadu_ps(gain + i)), vel));
+                }
+            }
+#endif
+            for (; i < count; i++)
+            {
+                const f32 t = taps.t[i];
+                const f32 c1 = .5F * (taps.x2[i] - taps.x0[i]);
+                const f32 c2 = taps.x0[i] - (2.5F * taps.x1[i]) + (2 * taps.x2[i]) - (.5F * taps.x3[i]);
+                const f32 c3 = (.5F * (taps.x3[i] - taps.x0[i])) + (1.5F * (taps.x1[i] - taps.x2[i]));
+                const f32 s = (((((c3 * t) + c2) * t) + c1) * t) + taps.x1[i];
+                out[i] = s * gain[i] * velocity;
+            }
+            break;
+        }
+    }
+
+    // Adds a mono block to an interleaved stereo buffer with per channel gains
+    inline void MixMonoToStereo(f32* stereo, const f32* mono, u32 frames, f32 leftGain, f32 rightGain)
+    {
+        u32 i = 0;
+#ifdef ALIVE_AUDIO_SSE
+        const __m128 lg = _mm_set1_ps(leftGain);
+        const __m128 rg = _mm_set1_ps(rightGain);
+        for (; i + 4 <= frames; i += 4)
+        {
+            const __m128 s = _mm_loadu_ps(mono + i);
+            const __m128 l = _mm_mul_ps(s, lg);
+            const __m128 r = _mm_mul_ps(s, rg);
+            f32* dst = stereo + (i * 2);
+            _mm_storeu_ps(dst, _mm_add_ps(_mm_loadu_ps(dst), _mm_unpacklo_ps(l, r)));
+            _mm_storeu_ps(dst + 4, _mm_add_ps(_mm_loadu_ps(dst + 4), _mm_unpackhi_ps(l, r)));
+        }
+#endif
+        for (; i < frames; i++)
+        {
+            stereo[(i * 2)] += mono[i] * leftGain;
+            stereo[(i * 2) + 1] += mono[i] * rightGain;
+        }
+    }
+
+    // dst[i] += src[i]
+    inline void Accumulate(f32* dst, const f32* src, u32 count)
+    {
+        u32 i = 0;
+#ifdef ALIVE_AUDIO_SSE
+        for (; i + 4 <= count; i += 4)
+        {
+            _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+        }
+#endif
+        for (; i < count; i++)
+        {
+            dst[i] += src[i];
+        }
+    }
+}
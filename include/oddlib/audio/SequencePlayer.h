@@ -41,7 +41,7 @@ enum AliveAudioSequencerState
     ALIVE_SEQUENCER_STOPPED = 1,
     ALIVE_SEQUENCER_PLAYING = 3,
     ALIVE_SEQUENCER_FINISHED = 4,
-    ALIVE_SEQUENCER_INIT_VOICES = 5,
+    ALIVE_SEQUENCER_STARTING = 5, // Waiting for the audio thread to start the sequence
 };
 
 struct AliveAudioMidiMessage
@@ -63,6 +63,8 @@ struct AliveAudioMidiMessage
     int Special = 0;
 };
 
+// Everything other than Play() and Mix() must be called from the game (or loader) thread,
+// the audio thread is only ever talked to through AliveAudio's command queue.
 class SequencePlayer
 {
 public:
@@ -74,12 +76,19 @@ public:
     void PlaySequence();
     void StopSequence();
 
+    // Priority of the notes played from now on when they compete for voices
+    void SetPriority(u8 priority);
+
     void NoteOnSingleShot(int program, int note, char velocity, f64 trackDelay = 0, f64 pitch = 0.0f);
     void Update();
 
     bool AtEnd() const;
     void Restart();
+
+    // Includes notes that are queued but haven't started yet
+    u32 NumberOfActiveVoices() const { return mAliveAudio.NumberOfActiveVoices(); }
     void Play(f32* stream, u32 len);
+    void Mix(AliveAudioMixBus& bus, u32 len);
 
     const std::string& Name() const { return mName; }
 
@@ -97,8 +106,8 @@ private:
     std::function<void()> m_QuarterCallback;
 
     //private:
-    Uint64 m_SongFinishSample = 0; // Not relative.
-    int m_SongBeginSample = 0;	// Not relative.
+    Uint64 m_SongFinishSample = 0; // Relative to the start of the sequence.
+    int m_SongBeginSample = 0;	// Relative to the start of the sequence.
     int m_PrevBar = 0;
     int m_TimeSignatureBars = 0;
     f64 m_SongTempo = 1.0f;
@@ -107,9 +116,10 @@ private:
     std::string mName;
 
     std::vector<AliveAudioMidiMessage> m_MessageList;
-    mutable std::mutex mMutex;
     AliveAudio mAliveAudio;
 
+    void BuildSequence();
+
 
     void DoQuaterCallback()
     {
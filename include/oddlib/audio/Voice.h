@@ -16,6 +16,8 @@ public:
     AliveAudioVoice() = default;
     AliveAudioVoice(const AliveAudioVoice&) = delete;
     AliveAudioVoice& operator = (const AliveAudioVoice&) = delete;
+    AliveAudioVoice(AliveAudioVoice&&) = default;
+    AliveAudioVoice& operator = (AliveAudioVoice&&) = default;
 
     class AliveAudioTone * m_Tone = nullptr;
     int		i_Program = 0;
@@ -28,13 +30,26 @@ public:
     bool    m_DebugDisableResampling = false;
     bool mbIgnoreLoops = false;
 
-    f64	f_TrackDelay = 0; // Used by the sequencer for perfect timing
-    bool	m_UsesNoteOffDelay = false;
-    f64	f_NoteOffDelay = 0;
+    f64	f_TrackDelay = 0; // Frames to wait before the voice starts
 
-    f32 GetSample(AudioInterpolation interpolation, bool antiAliasFilteringEnabled);
+    // Renders the next numFrames mono frames into buffer. Returns false without touching
+    // buffer if the voice made no sound at all in this block (not started yet or dead).
+    bool Render(f32* buffer, u32 numFrames, AudioInterpolation interpolation);
+
+    // How loud the voice is right now, the envelope level scaled by the velocity
+    f32 Level() const { return static_cast<f32>(m_ADSR_Level * f_Velocity); }
 
 private:
+    void RenderSegment(f32* buffer, u32 numFrames, AudioInterpolation interpolation);
+    u32 AdvanceEnvelope(f32* gain, u32 numFrames);
+    f64 SampleFrameRateMul();
+
     f64 m_ADSR_Level = 0; // Value of the adsr curve at current time
     ADSR_State m_ADSR_State = ADSR_State_attack;
+
+    // pow() of the pitch is only redone when the note or pitch changes
+    f64 m_SampleFrameRateMul = 1.0;
+    int m_SampleFrameRateMulNote = 0;
+    f64 m_SampleFrameRateMulPitch = 0.0;
+    bool m_SampleFrameRateMulValid = false;
 };
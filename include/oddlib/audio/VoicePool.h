@@ -0,0 +1,58 @@
+#pragma once
+
+#include "types.hpp"
+#include "Voice.h"
+#include <vector>
+
+// Which voice gives way when a note starts and the polyphony limit has been reached.
+// A voice is only ever stolen by a note of the same or higher priority.
+enum class eVoiceStealing
+{
+    eOldest,
+    eQuietest,
+    eLowestPriority, // Oldest of the lowest priority voices
+};
+
+// Fixed capacity voice storage. The voices live in one contiguous array and everything the
+// stealing decision looks at is kept in separate parallel arrays, so finding a victim only
+// walks a few small arrays instead of touching every voice.
+class AliveAudioVoicePool
+{
+public:
+    AliveAudioVoicePool() = default;
+    AliveAudioVoicePool(const AliveAudioVoicePool&) = delete;
+    AliveAudioVoicePool& operator = (const AliveAudioVoicePool&) = delete;
+
+    // Frees every voice and sizes the pool, the only time it allocates
+    void Reset(u32 capacity);
+
+    // Returns a freshly reset voice, stealing one if polyphony voices are already playing.
+    // Returns nullptr if nothing could be stolen.
+    AliveAudioVoice* Allocate(u8 priority, u32 polyphony, eVoiceStealing policy);
+
+    // Returns dead voices to the free list and refreshes the levels used by eQuietest
+    void Collect();
+
+    u32 Capacity() const { return static_cast<u32>(mVoices.size()); }
+    u32 ActiveCount() const { return static_cast<u32>(mActive.size()); }
+    AliveAudioVoice& Active(u32 index) { return mVoices[mActive[index]]; }
+
+    u32 StolenCount() const { return mStolenCount; }
+
+private:
+    s32 FindVictim(u8 priority, eVoiceStealing policy) const;
+
+    std::vector<AliveAudioVoice> mVoices;
+
+    // Indexed the same as mVoices
+    std::vector<u8> mPriority;
+    std::vector<u64> mStartOrder;
+    std::vector<f32> mLevel;
+
+    // Indices into mVoices, mActive is in no particular order
+    std::vector<u16> mActive;
+    std::vector<u16> mFree;
+
+    u64 mNextStartOrder = 0;
+    u32 mStolenCount = 0;
+};
@@ -3,6 +3,10 @@
 #include "types.hpp"
 #include "stream.hpp"
 #include "oddlib/exceptions.hpp"
+#include <array>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 
 namespace Oddlib
@@ -16,9 +20,6 @@ namespace Oddlib
         s32 mAudioFrameSizeBytes = 0;
         u16* mAudioFrameDataPtr = nullptr;
 
-        static u8 gSndTbl_byte_62EEB0[256];
-
-        AudioDecompressor();
         static s32 GetSoundTableValue(s16 tblIndex);
         s16 sub_408F50(s16 a1);
         s32 ReadNextAudioWord(s32 value);
@@ -28,7 +29,25 @@ namespace Oddlib
         void decode_16bit_audio_frame(u16* outPtr, s32 numSamplesPerFrame, bool isLast);
         u16* SetupAudioDecodePtrs(u16 *rawFrameBuffer);
         s32 SetAudioFrameSizeBytesAndBits(s32 audioFrameSizeBytes);
-        static void init_Snd_tbl();
+    };
+
+    // TODO: Should probably just be 64? Making this bigger fixes a sound glitch which is probably caused
+    // by an out of bounds write somewhere.
+    typedef std::array<s32, 64 * 4> T64IntsArray;
+
+    // Everything a macro block decode writes to, one per decoder so that many can run at once
+    struct MacroBlockContext
+    {
+        // Dequantisation tables built from the frame's quant scale
+        u32 mYQuant[64] = {};
+        u32 mCQuant[64] = {};
+
+        T64IntsArray mCr = {};
+        T64IntsArray mCb = {};
+        T64IntsArray mY1 = {};
+        T64IntsArray mY2 = {};
+        T64IntsArray mY3 = {};
+        T64IntsArray mY4 = {};
     };
 
     class InvalidDdv : public Exception
@@ -46,6 +65,7 @@ namespace Oddlib
         Masher() = default;
         Masher(const Masher&) = delete;
         Masher& operator = (const Masher&) = delete;
+        ~Masher();
 
         explicit Masher(std::unique_ptr<Oddlib::IStream> stream) : mStream(std::move(stream))
         {
@@ -54,6 +74,13 @@ namespace Oddlib
 
         bool Update(u32* pixelBuffer, u8* audioBuffer);
 
+        // Leaves the colour conversion to whoever shows the frame. The planes are packed, Y is Width() x Height()
+        // and Cb and Cr are half that rounded up, with 128 as no colour difference.
+        bool Update(u8* yPlane, u8* cbPlane, u8* crPlane, u8* audioBuffer);
+
+        // The next Update() decodes frameNumber, false if there is no such frame
+        bool SeekToFrame(u32 frameNumber);
+
         u32 Width() const  { return mVideoHeader.mWidth;  }
         u32 Height() const { return mVideoHeader.mHeight; }
         bool HasVideo() const { return mbHasVideo; }
@@ -63,11 +90,32 @@ namespace Oddlib
         u32 FrameNumber() const { return mCurrentFrame; }
         u32 FrameRate() const { return mFileHeader.mFrameRate; }
         u32 NumberOfFrames() const { return mFileHeader.mNumberOfFrames; }
+
+        // Most threads to turn macro blocks into pixels with, 0 picks based on the frame size and number of cores
+        void SetDecodeThreads(u32 threads) { mDecodeThreads = threads; }
     protected:
         void decode_audio_frame(u16 *rawFrameBuffer, u16 *outPtr, signed int numSamplesPerFrame);
+
+        // One block or macro block at a time, so that tests can check the SSE2 versions against the plain maths
+        static void IdctBlock(int16_t* input, T64IntsArray& output, bool fast);
+        static void ConvertMacroBlock(const MacroBlockContext& ctx, u32* pixels, int xoff, int yoff, int width, int height);
     private:
+        // Either the RGB pixels or the Y, Cb and Cr planes are set
+        struct VideoOutput
+        {
+            u32* mPixels;
+            u8* mY;
+            u8* mCb;
+            u8* mCr;
+        };
+
         void Read();
-        void ParseVideoFrame(u32* pixelBuffer);
+        bool Update(const VideoOutput& video, u8* audioBuffer);
+        void ParseVideoFrame(const VideoOutput& video);
+        void DecodeMacroBlockRows(const VideoOutput& video, MacroBlockContext& ctx, u32 firstRow, u32 endRow);
+        u32 NumberOfDecodeBands() const;
+        void StartBandWorkers(u32 bands);
+        void BandWorker(u32 band, u32 lastFrame);
 
         void ParseAudioFrame(u8* audioBuffer);
        
@@ -115,6 +163,7 @@ namespace Oddlib
 
         std::vector<uint32_t> mAudioFrameSizes;
         std::vector<uint32_t> mFrameSizes;
+        std::vector<size_t> mFrameOffsets;
 
         uint32_t mCurrentFrame = 0;
 
@@ -122,6 +171,23 @@ namespace Oddlib
         std::vector<uint8_t> mAudioFrameData;
 
         std::vector<u16> mMacroBlockBuffer;
+        MacroBlockContext mMacroBlockContext;
+
+        // Only the IDCT and colour outputs are used, one for each band of rows being decoded at once
+        std::vector<MacroBlockContext> mBandContexts;
+        u32 mDecodeThreads = 0;
+
+        // Band 0 is done by whoever calls Update(), the others by workers that stay around between frames.
+        // Each frame bumps mBandFrame, and the frame is done when mBandsLeft drops to 0.
+        std::vector<std::thread> mBandWorkers;
+        std::mutex mBandMutex;
+        std::condition_variable mBandStart;
+        std::condition_variable mBandDone;
+        const VideoOutput* mBandVideo = nullptr;
+        u32 mBandCount = 0;
+        u32 mBandFrame = 0;
+        u32 mBandsLeft = 0;
+        bool mStopBandWorkers = false;
 
     protected:
         std::vector<u16> mDecodedVideoFrameData;
@@ -20,6 +20,19 @@ struct FreeSurface_Functor
 
 typedef std::unique_ptr<SDL_Surface, FreeSurface_Functor> SDL_SurfacePtr;
 
+struct FreePalette_Functor
+{
+    void operator() (SDL_Palette* pPalette) const
+    {
+        if (pPalette)
+        {
+            SDL_FreePalette(pPalette);
+        }
+    }
+};
+
+typedef std::unique_ptr<SDL_Palette, FreePalette_Functor> SDL_PalettePtr;
+
 class SDLHelpers
 {
 public:
@@ -2,6 +2,7 @@
 
 #include "abstractrenderer.hpp"
 #include "SDL.h"
+#include <array>
 
 class OpenGLRenderer : public AbstractRenderer
 {
@@ -10,13 +11,24 @@ public:
     ~OpenGLRenderer();
 
     virtual TextureHandle CreateTexture(eTextureFormats internalFormat, u32 width, u32 height, eTextureFormats inputFormat, const void *pixels, bool interpolation) override;
+    virtual void UpdateTexture(TextureHandle handle, u32 width, u32 height, eTextureFormats inputFormat, const void *pixels) override;
     virtual void DestroyTextures() override;
     virtual const char* Name() const override;
     virtual void SetVSync(bool on) override;
+    virtual bool SupportsPalettedTextures() const override { return true; }
+    virtual bool SupportsYCbCrTextures() const override { return true; }
 
 private:
-    void SetWorldMatrix();
-    void SetScreenMatrix();
+    enum class eShaders
+    {
+        eTextured,
+        ePaletted,
+        eYCbCr
+    };
+
+    void SetWorldMatrix(eShaders shader = eShaders::eTextured);
+    void SetScreenMatrix(eShaders shader = eShaders::eTextured);
+    void UseShader(eShaders shader, const float* projMtx);
 
     virtual void OnSetRenderState(CmdState& info) override;
 
@@ -47,4 +59,25 @@ private:
     int mAttribLocationPosition = 0;
     int mAttribLocationUV = 0;
     int mAttribLocationColor = 0;
+
+    // Draws eIndex8 textures by looking up each texel in a palette texture bound to texture unit 1
+    std::unique_ptr<class Shader> mPaletteShader;
+
+    int mPaletteLocationTex = 0;
+    int mPaletteLocationPalette = 0;
+    int mPaletteLocationProjMtx = 0;
+
+    // Draws an ePlane8 Y texture as RGB with the Cb and Cr textures bound to texture units 1 and 2
+    std::unique_ptr<class Shader> mYCbCrShader;
+
+    int mYCbCrLocationTex = 0;
+    int mYCbCrLocationCb = 0;
+    int mYCbCrLocationCr = 0;
+    int mYCbCrLocationProjMtx = 0;
+
+    // Pixel unpack buffers that UpdateTexture() cycles through, so uploading a texture
+    // doesn't have to wait for the GPU to finish reading the previous upload
+    static const u32 kNumUploadBuffers = 3;
+    std::array<std::unique_ptr<class BufferObject>, kNumUploadBuffers> mUploadBuffers;
+    u32 mNextUploadBuffer = 0;
 };
\ No newline at end of file
@@ -248,6 +248,7 @@ public:
     UiContext mUi;
 
     const std::map<std::string, ResourceMapper::PathMapping>& PathMaps() const { return mPathMaps; }
+    const std::map<std::string, ResourceMapper::FmvMapping>& FmvMaps() const { return mFmvMaps; }
 
 private:
 
@@ -500,6 +501,27 @@ inline bool PointInRect(T px, T py, T x, T y, T w, T h)
     return true;
 }
 
+// The palette of an AnimationSet as a texture. It's created the first time one of the set's animations is
+// drawn and shared by all of them, so their quads have the same render state and get batched together.
+class AnimationPaletteTexture
+{
+public:
+    AnimationPaletteTexture(const AnimationPaletteTexture&) = delete;
+    AnimationPaletteTexture& operator = (const AnimationPaletteTexture&) = delete;
+    explicit AnimationPaletteTexture(const std::vector<u32>& palette);
+    ~AnimationPaletteTexture();
+
+    // Main thread context
+    TextureHandle Get(AbstractRenderer& rend);
+private:
+    void Destroy();
+
+    const std::vector<u32>& mPalette;
+    AbstractRenderer* mRenderer = nullptr;
+    std::weak_ptr<void> mRendererLifetime;
+    TextureHandle mTexture;
+};
+
 class Animation
 {
 public:
@@ -509,13 +531,16 @@ public:
     struct AnimationSetHolder
     {
     public:
-        AnimationSetHolder(std::shared_ptr<Oddlib::LvlArchive> sLvlPtr, std::shared_ptr<Oddlib::AnimationSet> sAnimSetPtr, u32 animIdx);
+        AnimationSetHolder(std::shared_ptr<Oddlib::LvlArchive> sLvlPtr, std::shared_ptr<Oddlib::AnimationSet> sAnimSetPtr, std::shared_ptr<AnimationPaletteTexture> sPaletteTexturePtr, u32 animIdx);
         const Oddlib::Animation& Animation() const;
         u32 MaxW() const;
         u32 MaxH() const;
+        const std::vector<u32>& Palette() const;
+        TextureHandle PaletteTexture(AbstractRenderer& rend) const;
     private:
         std::shared_ptr<Oddlib::LvlArchive> mLvlPtr;
         std::shared_ptr<Oddlib::AnimationSet> mAnimSetPtr;
+        std::shared_ptr<AnimationPaletteTexture> mPaletteTexturePtr; // After mAnimSetPtr as it refers to its palette
         const Oddlib::Animation* mAnim;
     };
     Animation(const Animation&) = delete;
@@ -619,6 +644,18 @@ public:
         return Get<Oddlib::AnimationSet>(key, mAnimationSets);
     }
 
+    // One per AnimationSet, lives as long as any Animation of the set
+    std::shared_ptr<AnimationPaletteTexture> GetPaletteTexture(const std::shared_ptr<Oddlib::AnimationSet>& animSet)
+    {
+        const Oddlib::AnimationSet* key = animSet.get();
+        std::shared_ptr<AnimationPaletteTexture> sptr = Get<AnimationPaletteTexture>(key, mPaletteTextures);
+        if (!sptr)
+        {
+            sptr = Add(key, mPaletteTextures, std::make_unique<AnimationPaletteTexture>(animSet->Palette()));
+        }
+        return sptr;
+    }
+
 private:
     template<class ObjectType, class KeyType, class Container>
     std::shared_ptr<ObjectType> Add(KeyType& key, Container& container, std::unique_ptr<ObjectType> uptr)
@@ -645,8 +682,11 @@ private:
     std::mutex mMutex;
     std::map<std::string, std::weak_ptr<Oddlib::LvlArchive>> mOpenLvls;
     std::map<std::string, std::weak_ptr<Oddlib::AnimationSet>> mAnimationSets;
+    std::map<const Oddlib::AnimationSet*, std::weak_ptr<AnimationPaletteTexture>> mPaletteTextures;
 };
 
+class AliveAudioMixBus;
+
 // TODO: Provide higher level abstraction
 class ISound
 {
@@ -655,6 +695,9 @@ public:
     virtual ~ISound() = default;
     virtual void DebugUi() = 0;
     virtual void Play(f32* stream, u32 len) = 0;
+
+    // Mixes into the shared buses, by default all output is dry
+    virtual void Mix(AliveAudioMixBus& bus, u32 len);
     virtual bool AtEnd() const = 0;
     virtual void Restart() = 0;
     virtual void Update() = 0;
@@ -669,6 +712,7 @@ public:
     BaseSeqSound(const char* soundName, std::unique_ptr<Vab> vab);
     virtual void DebugUi() override;
     virtual void Play(f32* stream, u32 len) override;
+    virtual void Mix(AliveAudioMixBus& bus, u32 len) override;
     virtual bool AtEnd() const override;
     virtual void Restart() override;
     virtual void Update() override;
@@ -678,6 +722,10 @@ public:
     std::unique_ptr<Vab> mVab;
     std::unique_ptr<class SequencePlayer> mSeqPlayer;
     std::string mSoundName;
+    s32 mPriority = kDefaultSoundPriority; // Passed on to the player's voices in Load()
+
+protected:
+    std::unique_ptr<class SequencePlayer> CreatePlayer();
 };
 
 class SingleSeqSampleSound : public BaseSeqSound
@@ -720,6 +768,9 @@ public:
     // Not thread safe - only used by debug path browsers etc
     const std::map<std::string, ResourceMapper::PathMapping>& PathMaps() const { return mResMapper.PathMaps(); }
 
+    // Not thread safe - only used by tools that go through every FMV
+    const std::map<std::string, ResourceMapper::FmvMapping>& FmvMaps() const { return mResMapper.FmvMaps(); }
+
     std::future<std::string> LocateScript(const std::string& scriptName);
 
     std::future<std::unique_ptr<ISound>> LocateSound(const std::string& resourceName, const std::string& explicitSoundBankName = "", bool useMusicRec = true, bool useSfxRec = true);
@@ -740,8 +791,8 @@ public:
 
     std::future<std::unique_ptr<Vab>> LocateVab(const std::string& dataSetName, const std::string& baseVabName);
 private:
-    std::unique_ptr<ISound> DoLoadSoundEffect(const char* resourceName, const DataPaths::FileSystemInfo& fs, const std::string& strSb, const SoundEffectResource& sfxRes, const SoundEffectResourceLocation& sfxResLoc);
-    std::unique_ptr<ISound> DoLoadSoundMusic(const char* resourceName, const DataPaths::FileSystemInfo& fs, const std::string& strSb, const MusicResource& sfxRes);
+    std::unique_ptr<ISound> DoLoadSoundEffect(const char* resourceName, const DataPaths::FileSystemInfo& fs, const std::string& strSb, const SoundEffectResource& sfxRes, const SoundEffectResourceLocation& sfxResLoc, s32 priority);
+    std::unique_ptr<ISound> DoLoadSoundMusic(const char* resourceName, const DataPaths::FileSystemInfo& fs, const std::string& strSb, const MusicResource& sfxRes, s32 priority);
 
     std::unique_ptr<Animation> DoLocateAnimation(const DataPaths::FileSystemInfo& fs, const char* resourceName, const ResourceMapper::AnimMapping& animMapping);
 
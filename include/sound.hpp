@@ -9,6 +9,8 @@
 #include <future>
 #include "core/audiobuffer.hpp"
 #include "soundcache.hpp"
+#include "oddlib/audio/MixBus.h"
+#include "spscqueue.hpp"
 
 class GameData;
 class IAudioController;
@@ -67,6 +69,9 @@ namespace Oddlib
 
 using SoundId = u32;
 
+// Sound effects that can play at once before new ones have to replace an old one
+const u32 kDefaultMaxSoundEffects = 16;
+
 class Sound : public IAudioPlayer
 {
 public:
@@ -76,7 +81,13 @@ public:
     ~Sound();
 
     void SetMusicTheme(const char* themeName, const char* eventOnLoad = nullptr);
+
+    // Sounds the map uses, cached along with the music theme before the rest of the sound effects
+    void SetPrioritySounds(std::vector<std::string> soundNames);
+
+    // Only waits for the music theme and priority sounds, the rest are cached in the background
     bool IsLoading() const;
+    SoundCacheProgress CacheProgress() const { return mCache.Progress(); }
 
     void HandleMusicEvent(const char* eventName);
     SoundId PlaySoundEffect(const char* soundName);
@@ -90,6 +101,21 @@ private:
     void SoundBrowserUi();
     std::unique_ptr<ISound> PlayThemeEntry(const char* entryName);
     void EnsureAmbiance();
+
+    // Takes over a loaded sound effect, making room for it under mMaxSoundEffects.
+    // Returns 0 without starting it if every playing effect has a higher priority.
+    SoundId AddSoundEffect(std::unique_ptr<ISound> sound, s32 priority);
+    s32 SoundPriority(const std::string& soundName);
+
+    // Game thread side of handing sounds to the audio thread
+    void StartSound(ISound* sound);
+    void RetireSound(std::unique_ptr<ISound> sound);
+    void ReplaceSound(std::unique_ptr<ISound>& slot, std::unique_ptr<ISound> sound);
+    void FlushAudioThreadCommands();
+    void FreeRetiredSounds();
+
+    // Audio thread side
+    void ProcessAudioThreadCommands();
 private: // IAudioPlayer
     virtual bool Play(f32* stream, u32 len) override;
 private:
@@ -100,29 +126,57 @@ private:
     const MusicTheme* mActiveTheme = nullptr;
     const MusicTheme* mThemeToLoad = nullptr;
     std::string mEventToSetAfterLoad;
+    std::vector<std::string> mPrioritySounds;
 
     ActiveMusicThemeEntry mActiveThemeEntry;
 
-    std::mutex mSoundPlayersMutex;
-
-    // Thread safe
+    // The sounds are owned by the game thread, the audio thread only has a list of pointers
+    // that is kept in sync through mToAudioThread. A sound that is no longer wanted is moved
+    // to mRetiredSounds and only freed once the audio thread says it has stopped mixing it.
     std::unique_ptr<ISound> mAmbiance;
-
-    // Thread safe
     std::unique_ptr<ISound> mMusicTrack;
+    struct SoundEffect
+    {
+        std::unique_ptr<ISound> mSound;
+        s32 mPriority = 0;
+    };
+    std::map<SoundId, SoundEffect> mSoundPlayers; // Ordered by id, so the oldest comes first
+    u32 mMaxSoundEffects = kDefaultMaxSoundEffects;
+    u32 mRejectedSoundEffects = 0;
+    std::unique_ptr<ISound> mSoundBankBeingBrowsed;
 
-    // Thread safe
-    std::map<SoundId, std::unique_ptr<ISound>> mSoundPlayers;
+    enum class eAudioThreadCommands
+    {
+        eAddSound,
+        eRemoveSound
+    };
+
+    struct AudioThreadCommand
+    {
+        eAudioThreadCommands mType = eAudioThreadCommands::eAddSound;
+        ISound* mSound = nullptr;
+    };
+
+    SpscQueue<AudioThreadCommand> mToAudioThread{ 1024 };
+    SpscQueue<ISound*> mFromAudioThread{ 1024 };
+
+    // Commands that didn't fit in mToAudioThread yet, sent in order on the next flush
+    std::deque<AudioThreadCommand> mUnsentCommands;
+    std::vector<std::unique_ptr<ISound>> mRetiredSounds;
+
+    // Audio thread only, reserved up front and never grown
+    std::vector<ISound*> mAudioThreadSounds;
 
     static std::atomic<SoundId> mSoundId;
 
+    // Audio thread only, except for the reverb mix set by the debug UI
+    AliveAudioMixBus mMixBus;
+
     enum class eSoundStates
     {
         eLoadSoundEffects,
         eLoadingSoundEffects,
         eUnloadingActiveSoundTheme,
-        eLoadActiveSoundTheme,
-        eLoadingActiveSoundTheme,
         eCancel,
         eCancelling,
         eIdle
@@ -130,7 +184,4 @@ private:
     eSoundStates mState = eSoundStates::eIdle;
 
     void SetState(Sound::eSoundStates state);
-
-    // Shared to avoid locking
-    std::shared_ptr<class SequencePlayer> mSoundBankBeingBrowsed;
 };
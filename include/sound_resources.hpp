@@ -47,11 +47,15 @@ public:
     std::vector<SoundEffectResourceLocation> mSoundBanks;
 };
 
+// Sounds with a higher priority win when there are too many playing at once
+const s32 kDefaultSoundPriority = 64;
+
 class SoundResource
 {
 public:
     std::string mResourceName;
     bool mIsCacheResident;
+    s32 mPriority = kDefaultSoundPriority;
     MusicResource mMusic;
     SoundEffectResource mSoundEffect;
     std::string mComment;
@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <string>
+#include <chrono>
 #include "asyncqueue.hpp"
 
 class ResourceLocator;
@@ -24,13 +25,15 @@ using UP_BaseSoundCacheJob = std::unique_ptr<BaseSoundCacheJob>;
 class SoundAddToCacheJob : public BaseSoundCacheJob
 {
 public:
-    SoundAddToCacheJob(SoundCache& soundCache, ResourceLocator& locator, const std::string& name)
-        : BaseSoundCacheJob(soundCache, locator), mName(name)  {  }
+    SoundAddToCacheJob(SoundCache& soundCache, ResourceLocator& locator, const std::string& name, bool memoryResident, bool highPriority);
+    ~SoundAddToCacheJob();
     
     virtual void Execute(std::atomic<bool>& quitFlag) override;
 
 private:
     std::string mName;
+    bool mMemoryResident;
+    bool mHighPriority;
 };
 
 class CacheAllSoundEffectsJob :  public BaseSoundCacheJob
@@ -42,7 +45,15 @@ public:
     virtual void Execute(std::atomic<bool>& quitFlag) override;
 };
 
-// Thread safe
+struct SoundCacheProgress
+{
+    u32 mDone = 0;
+    u32 mTotal = 0;
+    f32 mSecondsRemaining = 0.0f; // Estimated from how long the finished sounds took, 0 until one has finished
+};
+
+// Thread safe. Sounds are converted to Ogg files in the disk cache. Memory resident sounds keep
+// the whole Ogg file in memory, everything else is streamed from disk while it plays.
 class SoundCache
 {
 public:
@@ -52,24 +63,49 @@ public:
     bool ExistsInMemoryCache(const std::string& name) const;
     std::unique_ptr<ISound> GetCached(const std::string& name);
     bool IsBusy() const;
+
+    // True while any sound queued as high priority is still waiting or being converted
+    bool IsBusyWithHighPriority() const { return mHighPriorityJobsAlive > 0; }
+
+    // Of the sounds queued since the cache was last idle
+    SoundCacheProgress Progress() const;
+
     void Cancel();
-    void CacheSound(ResourceLocator& locator, const std::string& name);
+
+    // High priority sounds are converted before any normal priority sound still waiting
+    void CacheSound(ResourceLocator& locator, const std::string& name, bool memoryResident = false, bool highPriority = false);
     void CacheAllSoundEffects(ResourceLocator& locator);
 private:
     void CacheAllSoundEffectsImp(ResourceLocator& locator, std::atomic<bool>& quitFlag);
 
     void DeleteAll();
-    void CacheSoundImpl(ResourceLocator& locator, const std::string& name, std::atomic<bool>& quitFlag);
+    void CacheSoundImpl(ResourceLocator& locator, const std::string& name, bool memoryResident, std::atomic<bool>& quitFlag);
 
-    void AddToMemoryAndDiskCache(std::unique_ptr<ISound> sound, std::atomic<bool>& quitFlag);
-    bool AddToMemoryCacheFromDiskCache(const std::string& name);
+    void AddToMemoryAndDiskCache(std::unique_ptr<ISound> sound, bool memoryResident, std::atomic<bool>& quitFlag);
+    bool AddToMemoryCacheFromDiskCache(const std::string& name, bool memoryResident);
     void AsyncQueueWorkerFunction(UP_BaseSoundCacheJob item, std::atomic<bool>& quitFlag);
     void DeleteFromDiskCache(const std::string& filter);
 
 
     OSBaseFileSystem& mFs;
-    std::map<std::string, std::shared_ptr<std::vector<u8>>> mSoundDataCache;
+    struct CachedSound
+    {
+        std::string mFileName;
+
+        // The whole Ogg file if the sound is memory resident, otherwise null
+        std::shared_ptr<std::vector<u8>> mData;
+    };
+    std::map<std::string, CachedSound> mSoundDataCache;
     mutable std::recursive_mutex mCacheMutex;
+
+    // Each SoundAddToCacheJob counts itself alive from construction to destruction, so jobs
+    // dropped by Cancel() are accounted for as well
+    std::atomic<u32> mJobsAlive{ 0 };
+    std::atomic<u32> mHighPriorityJobsAlive{ 0 };
+    std::atomic<u32> mJobsQueued{ 0 };
+    std::atomic<u32> mJobsDone{ 0 };
+    std::atomic<u32> mTmpFileCounter{ 0 };
+    std::chrono::steady_clock::time_point mBatchStartTime; // Guarded by mCacheMutex
 public:
     void RemoveFromMemoryCache(const std::string& name);
     ASyncQueue<UP_BaseSoundCacheJob> mLoaderQueue;
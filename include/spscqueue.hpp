@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "types.hpp"
+
+// Bounded single producer, single consumer queue. Once sized neither side blocks or
+// allocates, which makes it safe to talk to the audio thread with.
+template<class QueuedItemType>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(u32 capacity = 256)
+    {
+        Reset(capacity);
+    }
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator = (const SpscQueue&) = delete;
+
+    // Not thread safe, only call when neither the producer or the consumer is using the queue.
+    // The capacity is rounded up to a power of 2 and anything still queued is dropped.
+    void Reset(u32 capacity)
+    {
+        u32 size = 1;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+
+        mItems.clear();
+        mItems.resize(size);
+        mMask = size - 1;
+        mHead = 0;
+        mTail = 0;
+    }
+
+    // Producer only, returns false if the queue is full
+    bool Push(const QueuedItemType& item)
+    {
+        const u32 tail = mTail.load(std::memory_order_relaxed);
+        if (tail - mHead.load(std::memory_order_acquire) > mMask)
+        {
+            return false;
+        }
+
+        mItems[tail & mMask] = item;
+        mTail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only, returns false if the queue is empty
+    bool Pop(QueuedItemType& item)
+    {
+        const u32 head = mHead.load(std::memory_order_relaxed);
+        if (head == mTail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        item = std::move(mItems[head & mMask]);
+        mHead.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer only, pushes as many of items as there is room for and returns how many that was
+    u32 PushMany(const QueuedItemType* items, u32 count)
+    {
+        const u32 tail = mTail.load(std::memory_order_relaxed);
+        const u32 space = Capacity() - (tail - mHead.load(std::memory_order_acquire));
+        const u32 toPush = count < space ? count : space;
+
+        // At most two contiguous runs, up to the end of the buffer then from the start
+        const u32 start = tail & mMask;
+        const u32 firstRun = std::min(toPush, Capacity() - start);
+        std::copy(items, items + firstRun, mItems.begin() + start);
+        std::copy(items + firstRun, items + toPush, mItems.begin());
+        mTail.store(tail + toPush, std::memory_order_release);
+        return toPush;
+    }
+
+    // Consumer only, pops up to count items and returns how many there were
+    u32 PopMany(QueuedItemType* items, u32 count)
+    {
+        const u32 head = mHead.load(std::memory_order_relaxed);
+        const u32 available = mTail.load(std::memory_order_acquire) - head;
+        const u32 toPop = count < available ? count : available;
+
+        const u32 start = head & mMask;
+        const u32 firstRun = std::min(toPop, Capacity() - start);
+        std::move(mItems.begin() + start, mItems.begin() + start + firstRun, items);
+        std::move(mItems.begin(), mItems.begin() + (toPop - firstRun), items + firstRun);
+        mHead.store(head + toPop, std::memory_order_release);
+        return toPop;
+    }
+
+    // Only exact when called from the producer or consumer while the other side is idle, otherwise
+    // the producer sees an upper bound and the consumer a lower bound
+    u32 Size() const
+    {
+        return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire);
+    }
+
+    bool Empty() const
+    {
+        return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+    }
+
+    u32 Capacity() const
+    {
+        return mMask + 1;
+    }
+
+private:
+    std::vector<QueuedItemType> mItems;
+    u32 mMask = 0;
+    std::atomic<u32> mHead{ 0 };
+    std::atomic<u32> mTail{ 0 };
+};
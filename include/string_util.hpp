@@ -108,48 +108,34 @@ namespace string_util
         return true;
     }
 
-    inline bool ends_with(std::string const& value, std::string const& ending, bool ignoreCase = false)
+    // Takes string_views so text that is checked every frame doesn't need copying into std::strings
+    inline bool ends_with(boost::string_view value, boost::string_view ending, bool ignoreCase = false)
     {
-
         if (ending.size() > value.size())
         {
             return false;
         }
 
-        if (ignoreCase)
+        const size_t offset = value.size() - ending.size();
+        for (size_t i = 0; i < ending.size(); ++i)
         {
-            std::string valueLower = value;
-            std::transform(valueLower.begin(), valueLower.end(), valueLower.begin(), c_tolower);
-
-            std::string endingLower = ending;
-            std::transform(endingLower.begin(), endingLower.end(), endingLower.begin(), c_tolower);
-
-            return std::equal(endingLower.rbegin(), endingLower.rend(), valueLower.rbegin());
-        }
-        else
-        {
-            return std::equal(ending.rbegin(), ending.rend(), value.rbegin());
+            const char a = ignoreCase ? c_tolower(value[offset + i]) : value[offset + i];
+            const char b = ignoreCase ? c_tolower(ending[i]) : ending[i];
+            if (a != b)
+            {
+                return false;
+            }
         }
+        return true;
     }
 
-    inline bool starts_with(const std::string& toCheck, const std::string& prefix, bool ignoreCase = false)
+    inline bool starts_with(boost::string_view toCheck, boost::string_view prefix, bool ignoreCase = false)
     {
         if (prefix.size() > toCheck.size())
         {
             return false;
         }
-
-        if (ignoreCase)
-        {
-            std::string ltoCheck = toCheck;
-            std::transform(ltoCheck.begin(), ltoCheck.end(), ltoCheck.begin(), c_tolower);
-
-            std::string lprefix = prefix;
-            std::transform(lprefix.begin(), lprefix.end(), lprefix.begin(), c_tolower);
-
-            return std::equal(lprefix.begin(), lprefix.end(), ltoCheck.begin());
-        }
-        return std::equal(prefix.begin(), prefix.end(), toCheck.begin());
+        return ends_with(toCheck.substr(0, prefix.size()), prefix, ignoreCase);
     }
 
     inline bool contains(const std::string& haystack, const std::string& needle)
@@ -3,6 +3,7 @@
 
 #include <algorithm>
 #include <cassert>
+#include <limits>
 #include "SDL.h"
 #include "SDL_pixels.h"
 
@@ -39,6 +40,36 @@ glm::vec2 CoordinateSpace::ScreenToWorld(const glm::vec2& screenPos)
     return glm::inverse(mProjection * mView) * ((glm::vec4(screenPos.x ,screenPos.y, 1, 1) - glm::vec4(mW / 2, mH / 2, 0, 0)) / glm::vec4(mW / 2, -mH / 2, 1, 1));
 }
 
+glm::vec4 CoordinateSpace::WorldViewRect() const
+{
+    // Un-project the corners of normalised device space, this also gives the correct
+    // area when the view/projection is part way through a smoothed camera change.
+    const glm::mat4 invViewProj = glm::inverse(mProjection * mView);
+    const glm::vec4 corner1 = invViewProj * glm::vec4(-1.0f, -1.0f, 0.0f, 1.0f);
+    const glm::vec4 corner2 = invViewProj * glm::vec4(1.0f, 1.0f, 0.0f, 1.0f);
+    const glm::vec2 topLeft(std::min(corner1.x, corner2.x), std::min(corner1.y, corner2.y));
+    const glm::vec2 bottomRight(std::max(corner1.x, corner2.x), std::max(corner1.y, corner2.y));
+    return glm::vec4(topLeft, bottomRight - topLeft);
+}
+
+/*static*/ bool CoordinateSpace::RectsOverlap(const glm::vec4& viewRect, f32 x, f32 y, f32 w, f32 h)
+{
+    if (w < 0.0f)
+    {
+        x += w;
+        w = -w;
+    }
+
+    if (h < 0.0f)
+    {
+        y += h;
+        h = -h;
+    }
+
+    return x <= viewRect.x + viewRect.z && x + w >= viewRect.x &&
+           y <= viewRect.y + viewRect.w && y + h >= viewRect.y;
+}
+
 AbstractRenderer::AbstractRenderer()
 {
     // These should be large enough so that no allocations are done during game
@@ -91,6 +122,7 @@ void AbstractRenderer::Init(const char* regularFontPath, const char* italticFont
 
 void AbstractRenderer::ShutDown()
 {
+    mLifetime.reset();
     DestroyTexture(mFontStashTexture);
     DestroyTextures();
     if (mFontStashContext)
@@ -122,7 +154,14 @@ void AbstractRenderer::BeginFrame(int w, int h)
     if (mScreenSizeChanged)
     {
         fonsResetAtlas(mFontStashContext, 512, 512);
+        ClearTextRuns();
     }
+
+    mFrameNumber++;
+
+    mWorldCullRect = WorldViewRect();
+    mScreenCullRect = glm::vec4(0.0f, 0.0f, static_cast<f32>(mW), static_cast<f32>(mH));
+    mCulledCommandCount = 0;
 }
 
 void AbstractRenderer::Clear(f32 r, f32 g, f32 b)
@@ -157,6 +196,24 @@ void AbstractRenderer::EndFrame()
     DestroyTextures();
     mScreenSizeChanged = false;
 
+    mLastCulledCommandCount = mCulledCommandCount;
+
+    if (mFrameNumber % kTextRunMaxAge == 0)
+    {
+        // Drop strings that are no longer shown, i.e debug text with changing numbers in it
+        for (auto it = mTextRuns.begin(); it != mTextRuns.end();)
+        {
+            if (mFrameNumber - it->second.mLastUsedFrame > kTextRunMaxAge)
+            {
+                it = mTextRuns.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
     mWritePos = 0;
     mDrawList.Clear();
     mDrawCommandBuffer.clear();
@@ -188,14 +245,18 @@ void AbstractRenderer::RenderCallBack(const struct ImDrawList*, const ImDrawCmd*
     }
 }
 
-void AbstractRenderer::PushCallBack(AbstractRenderer::eCoordinateSystem& lastCoordSystem, AbstractRenderer::eBlendModes& lastBlendMode, AbstractRenderer::CmdHeader& header, bool force)
+void AbstractRenderer::PushCallBack(AbstractRenderer::CmdState& lastState, AbstractRenderer::CmdHeader& header, bool force)
 {
-    if (force || (header.mState.mCoordinateSystem != lastCoordSystem || header.mState.mBlendMode != lastBlendMode))
+    if (force ||
+        header.mState.mCoordinateSystem != lastState.mCoordinateSystem ||
+        header.mState.mBlendMode != lastState.mBlendMode ||
+        header.mState.mPalette.mData != lastState.mPalette.mData ||
+        header.mState.mCb.mData != lastState.mCb.mData ||
+        header.mState.mCr.mData != lastState.mCr.mData)
     {
         header.mState.mThisPtr = this;
         mDrawList.AddCallback(RenderCallBack, &header);
-        lastBlendMode = header.mState.mBlendMode;
-        lastCoordSystem = header.mState.mCoordinateSystem;
+        lastState = header.mState;
     }
 }
 
@@ -228,6 +289,9 @@ int AbstractRenderer::FontStashRenderResize(void* uptr, int width, int height)
     auto pRenderer = reinterpret_cast<AbstractRenderer*>(uptr);
     pRenderer->mFontStashWidth = width;
     pRenderer->mFontStashHeight = height;
+
+    // Cached UVs are relative to the old atlas size
+    pRenderer->ClearTextRuns();
     return 1;
 }
 
@@ -271,78 +335,135 @@ nverts is the number of vertices to draw
 void AbstractRenderer::FontStashRenderDraw(void* uptr, const float* verts, const float* tcoords, const unsigned int* colors, int nverts)
 {
     auto pRenderer = reinterpret_cast<AbstractRenderer*>(uptr);
+    if (pRenderer->mCapturingGlyphs)
+    {
+        // Laying out a TextRun, keep the quads for drawing later
+        pRenderer->mCapturingGlyphs->mVerts.insert(pRenderer->mCapturingGlyphs->mVerts.end(), verts, verts + (nverts * 2));
+        pRenderer->mCapturingGlyphs->mUvs.insert(pRenderer->mCapturingGlyphs->mUvs.end(), tcoords, tcoords + (nverts * 2));
+        return;
+    }
+    pRenderer->AddGlyphs(verts, tcoords, nverts, 0.0f, 0.0f, colors[0]);
+}
 
+void AbstractRenderer::AddGlyphs(const f32* verts, const f32* uvs, int nverts, f32 dx, f32 dy, u32 colour)
+{
     const int numTris = nverts / 3;
     if (numTris)
     {
-        pRenderer->mDrawList.PushTextureID(pRenderer->mFontStashTexture.mData);
+        mDrawList.PushTextureID(mFontStashTexture.mData);
         int i = 0;
         for (int j = 0; j < numTris; j++)
         {
-            pRenderer->mDrawList.PrimReserve(3, 3);
-            PrimTriangleUV(pRenderer->mDrawList,
-                { verts[0 + i], verts[1 + i] }, 
-                { verts[2 + i], verts[3 + i], },
-                { verts[4 + i], verts[5 + i] },
-                { tcoords[0 + i], tcoords[1 + i] },
-                { tcoords[2 + i], tcoords[3 + i] },
-                { tcoords[4 + i], tcoords[5 + i] },
-                colors[0]);
+            mDrawList.PrimReserve(3, 3);
+            PrimTriangleUV(mDrawList,
+                { verts[0 + i] + dx, verts[1 + i] + dy },
+                { verts[2 + i] + dx, verts[3 + i] + dy },
+                { verts[4 + i] + dx, verts[5 + i] + dy },
+                { uvs[0 + i], uvs[1 + i] },
+                { uvs[2 + i], uvs[3 + i] },
+                { uvs[4 + i], uvs[5 + i] },
+                colour);
             i += 6;
         }
     }
 }
 
+void AbstractRenderer::AddGlyphs(const TextGlyphs& glyphs, f32 dx, f32 dy, u32 colour)
+{
+    AddGlyphs(glyphs.mVerts.data(), glyphs.mUvs.data(), static_cast<int>(glyphs.mVerts.size() / 2), dx, dy, colour);
+}
 
-void AbstractRenderer::HandleTextCommand(f32 dx, f32 dy, f32 fontSize, const char* text, ColourU8* colour, f32* bounds)
+void AbstractRenderer::ClearTextRuns()
 {
+    mTextRuns.clear();
+}
 
-    fonsSetAlign(mFontStashContext, FONS_ALIGN_LEFT | FONS_ALIGN_TOP);
-    fonsSetFont(mFontStashContext, mFontStashFontHandles[0]);
+// FNV-1a over the string and font size, the font is selected by tags in the string so is covered too
+static u64 HashTextRun(boost::string_view text, f32 fontSize)
+{
+    u64 hash = 14695981039346656037ull;
+    const auto hashBytes = [&hash](const char* bytes, size_t len)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            hash ^= static_cast<u8>(bytes[i]);
+            hash *= 1099511628211ull;
+        }
+    };
+    hashBytes(reinterpret_cast<const char*>(&fontSize), sizeof(fontSize));
+    hashBytes(text.data(), text.size());
+    return hash;
+}
 
-    boost::string_view sv(text);
-    
-    const char* end = text + sv.length();
+const AbstractRenderer::TextRun& AbstractRenderer::GetTextRun(boost::string_view text, f32 fontSize)
+{
+    TextRun& run = mTextRuns[HashTextRun(text, fontSize)];
+    run.mLastUsedFrame = mFrameNumber;
+    if (run.mFontSize == fontSize && run.mText == text && !run.mText.empty())
+    {
+        return run;
+    }
 
-    // TODO: Change utils to use boost::string_view to avoid per frame allocs
-    std::string s = sv.to_string();
+    // Not cached, or a hash collision which just replaces the old run
+    run.mText.assign(text.data(), text.size());
+    run.mFontSize = fontSize;
+    run.mShadow = TextGlyphs();
+    run.mGlyphs = TextGlyphs();
 
     int fontToUse = 0;
-    if (string_util::starts_with(s, "<i>", true) && string_util::ends_with(s, "</i>", true))
+    if (string_util::starts_with(text, "<i>", true) && string_util::ends_with(text, "</i>", true))
     {
         fontToUse = 1;
-        text += 3;
-        end -= 4;
+        text = text.substr(3, text.size() - 7);
     }
-    else if (string_util::starts_with(s, "<b>", true) && string_util::ends_with(s, "</b>", true))
+    else if (string_util::starts_with(text, "<b>", true) && string_util::ends_with(text, "</b>", true))
     {
         fontToUse = 2;
-        text += 3;
-        end -= 4;
+        text = text.substr(3, text.size() - 7);
     }
-    
+    const char* begin = text.data();
+    const char* end = text.data() + text.size();
+
+    fonsSetAlign(mFontStashContext, FONS_ALIGN_LEFT | FONS_ALIGN_TOP);
     fonsSetFont(mFontStashContext, fontToUse);
     fonsSetSize(mFontStashContext, fontSize);
     fonsSetSpacing(mFontStashContext, 0.0f);
+    fonsSetBlur(mFontStashContext, 0.0f);
+    fonsTextBounds(mFontStashContext, 0.0f, 0.0f, begin, end, run.mBounds);
+
+    mCapturingGlyphs = &run.mShadow;
+    fonsSetBlur(mFontStashContext, 2.0f);
+    fonsDrawText(mFontStashContext, -2.0f, 2.0f, begin, end);
+
+    mCapturingGlyphs = &run.mGlyphs;
+    fonsSetBlur(mFontStashContext, 0.0f);
+    fonsDrawText(mFontStashContext, 0.0f, 0.0f, begin, end);
+
+    mCapturingGlyphs = nullptr;
+    return run;
+}
+
+
+void AbstractRenderer::HandleTextCommand(f32 dx, f32 dy, f32 fontSize, boost::string_view text, ColourU8* colour, f32* bounds)
+{
+    const TextRun& run = GetTextRun(text, fontSize);
 
     // Measure only
     if (bounds)
     {
-        fonsTextBounds(mFontStashContext, dx, dy, text, end, bounds);
+        bounds[0] = run.mBounds[0] + dx;
+        bounds[1] = run.mBounds[1] + dy;
+        bounds[2] = run.mBounds[2] + dx;
+        bounds[3] = run.mBounds[3] + dy;
     }
     else
     {
-        fonsSetBlur(mFontStashContext, 2.0f);
-        fonsSetColor(mFontStashContext, ColourU8{ 0, 0, 0, 255 }.To32Bit());
-        fonsDrawText(mFontStashContext, dx - 2.0f, dy + 2.0f, text, end);
-
-        fonsSetBlur(mFontStashContext, 0.0f);
-        fonsSetColor(mFontStashContext, colour->To32Bit());
-        fonsDrawText(mFontStashContext, dx, dy, text, end);
+        AddGlyphs(run.mShadow, dx, dy, ColourU8{ 0, 0, 0, 255 }.To32Bit());
+        AddGlyphs(run.mGlyphs, dx, dy, colour->To32Bit());
     }
 }
 
-void AbstractRenderer::TextBounds(f32 x, f32 y, f32 fontSize, const char* text, f32* bounds)
+void AbstractRenderer::TextBounds(f32 x, f32 y, f32 fontSize, boost::string_view text, f32* bounds)
 {
     assert(bounds != nullptr);
     HandleTextCommand(x, y, fontSize, text, nullptr, bounds);
@@ -351,8 +472,9 @@ void AbstractRenderer::TextBounds(f32 x, f32 y, f32 fontSize, const char* text,
 void AbstractRenderer::generateImGuiCommands()
 {
     // Used to cache previous state and skip redundant ones
-    eCoordinateSystem lastCoordSystem = eCoordinateSystem::eScreen;
-    eBlendModes lastBlendMode = eBlendModes::eOpaque;
+    CmdState lastState = {};
+    lastState.mCoordinateSystem = eCoordinateSystem::eScreen;
+    lastState.mBlendMode = eBlendModes::eOpaque;
     ImTextureID lastTextureId = nullptr;
 
     for (u8* cmdType : mPointersToOrderedCommands)
@@ -362,14 +484,14 @@ void AbstractRenderer::generateImGuiCommands()
         case eImGuiUi:
         {
             CmdHeader* cmd = reinterpret_cast<CmdHeader*>(cmdType);
-            PushCallBack(lastCoordSystem, lastBlendMode, *cmd, true);
+            PushCallBack(lastState, *cmd, true);
         }
         break;
 
         case eRect:
         {
             CmdRect* cmd = reinterpret_cast<CmdRect*>(cmdType);
-            PushCallBack(lastCoordSystem, lastBlendMode, cmd->mHeader);
+            PushCallBack(lastState, cmd->mHeader);
             PushTexture(lastTextureId, ImGui::GetIO().Fonts->TexID);
             mDrawList.AddRect({ cmd->mX, cmd->mY }, { cmd->mX+cmd->mW, cmd->mY+cmd->mH }, ToImCol(cmd->mHeader.mColour));
         }
@@ -378,7 +500,7 @@ void AbstractRenderer::generateImGuiCommands()
         case eTexturedQuad:
         {
             CmdTexturedQuad* cmd = reinterpret_cast<CmdTexturedQuad*>(cmdType);
-            PushCallBack(lastCoordSystem, lastBlendMode, cmd->mHeader);
+            PushCallBack(lastState, cmd->mHeader);
             PushTexture(lastTextureId, cmd->mTexture.mData);
             mDrawList.PrimReserve(6, 4);
             mDrawList.PrimRectUV(
@@ -393,7 +515,7 @@ void AbstractRenderer::generateImGuiCommands()
         case eText:
         {
             CmdText* cmd = reinterpret_cast<CmdText*>(cmdType);
-            PushCallBack(lastCoordSystem, lastBlendMode, cmd->mHeader, true);
+            PushCallBack(lastState, cmd->mHeader, true);
             PushTexture(lastTextureId, ImGui::GetIO().Fonts->TexID);
             mDrawList.PushClipRectFullScreen();
             HandleTextCommand(cmd->mX, cmd->mY, cmd->mFontSize, &cmd->mText, &cmd->mHeader.mColour, nullptr);
@@ -403,7 +525,7 @@ void AbstractRenderer::generateImGuiCommands()
         case ePath:
         {
             CmdBeginPath* cmd = reinterpret_cast<CmdBeginPath*>(cmdType);
-            PushCallBack(lastCoordSystem, lastBlendMode, cmd->mHeader);
+            PushCallBack(lastState, cmd->mHeader);
             PushTexture(lastTextureId, ImGui::GetIO().Fonts->TexID);
 
             const u32 remainderSize = cmd->mHeader.mSize - sizeof(CmdBeginPath);
@@ -433,7 +555,7 @@ void AbstractRenderer::generateImGuiCommands()
         case eLine:
         {
             CmdLine* cmd = reinterpret_cast<CmdLine*>(cmdType);
-            PushCallBack(lastCoordSystem, lastBlendMode, cmd->mHeader);
+            PushCallBack(lastState, cmd->mHeader);
             PushTexture(lastTextureId, ImGui::GetIO().Fonts->TexID);
             mDrawList.AddLine({ cmd->mP1X, cmd->mP1Y }, { cmd->mP2X, cmd->mP2Y }, ToImCol(cmd->mHeader.mColour), cmd->mLineWidth);
         }
@@ -442,7 +564,7 @@ void AbstractRenderer::generateImGuiCommands()
         case eCircleFilled:
         {
             CmdCircleFilled* cmd = reinterpret_cast<CmdCircleFilled*>(cmdType);
-            PushCallBack(lastCoordSystem, lastBlendMode, cmd->mHeader);
+            PushCallBack(lastState, cmd->mHeader);
             PushTexture(lastTextureId, ImGui::GetIO().Fonts->TexID);
             mDrawList.AddCircleFilled({ cmd->mX, cmd->mY }, cmd->mRadius, ToImCol(cmd->mHeader.mColour), cmd->mNumSegments);
         }
@@ -465,9 +587,40 @@ void AbstractRenderer::generateImGuiCommands()
     }
 }
 
+bool AbstractRenderer::IsVisible(f32 x, f32 y, f32 w, f32 h, eCoordinateSystem coordinateSystem) const
+{
+    if (!mCullingEnabled)
+    {
+        return true;
+    }
+    return RectsOverlap(coordinateSystem == eCoordinateSystem::eWorld ? mWorldCullRect : mScreenCullRect, x, y, w, h);
+}
+
+bool AbstractRenderer::IsLineVisible(f32 p1x, f32 p1y, f32 p2x, f32 p2y, f32 lineWidth, eCoordinateSystem coordinateSystem) const
+{
+    const f32 halfWidth = lineWidth / 2.0f;
+    const f32 minX = std::min(p1x, p2x) - halfWidth;
+    const f32 minY = std::min(p1y, p2y) - halfWidth;
+    return IsVisible(minX, minY, std::max(p1x, p2x) + halfWidth - minX, std::max(p1y, p2y) + halfWidth - minY, coordinateSystem);
+}
+
+bool AbstractRenderer::CullCommand(f32 x, f32 y, f32 w, f32 h, eCoordinateSystem coordinateSystem)
+{
+    if (!IsVisible(x, y, w, h, coordinateSystem))
+    {
+        mCulledCommandCount++;
+        return true;
+    }
+    return false;
+}
+
 void AbstractRenderer::TexturedQuad(TextureHandle texHandle, f32 x, f32 y, f32 w, f32 h, int layer, ColourU8 colour, eBlendModes blendMode, eCoordinateSystem coordinateSystem)
 {
     assert(mInPath == false);
+    if (CullCommand(x, y, w, h, coordinateSystem))
+    {
+        return;
+    }
     EnsureCmdFreeSpace(sizeof(CmdTexturedQuad));
     u8* const ptr = mDrawCommandBuffer.data() + mWritePos;
     mWritePos += sizeof(CmdTexturedQuad);
@@ -485,9 +638,37 @@ void AbstractRenderer::TexturedQuad(TextureHandle texHandle, f32 x, f32 y, f32 w
     cmd->mHeader.mState.mCoordinateSystem = coordinateSystem;
 }
 
+void AbstractRenderer::PalettedTexturedQuad(TextureHandle indexTexHandle, TextureHandle paletteTexHandle, f32 x, f32 y, f32 w, f32 h, int layer, ColourU8 colour, eBlendModes blendMode, eCoordinateSystem coordinateSystem)
+{
+    const u32 cmdPos = mWritePos;
+    TexturedQuad(indexTexHandle, x, y, w, h, layer, colour, blendMode, coordinateSystem);
+    if (mWritePos != cmdPos) // Not culled
+    {
+        // A change of palette forces a render state change, which is where the renderer switches to its palette shader
+        reinterpret_cast<CmdTexturedQuad*>(mDrawCommandBuffer.data() + cmdPos)->mHeader.mState.mPalette = paletteTexHandle;
+    }
+}
+
+void AbstractRenderer::YCbCrTexturedQuad(TextureHandle yTexHandle, TextureHandle cbTexHandle, TextureHandle crTexHandle, f32 x, f32 y, f32 w, f32 h, int layer, ColourU8 colour, eBlendModes blendMode, eCoordinateSystem coordinateSystem)
+{
+    const u32 cmdPos = mWritePos;
+    TexturedQuad(yTexHandle, x, y, w, h, layer, colour, blendMode, coordinateSystem);
+    if (mWritePos != cmdPos) // Not culled
+    {
+        // Same as the palette, the change of state is where the renderer switches to its YCbCr shader
+        CmdState& state = reinterpret_cast<CmdTexturedQuad*>(mDrawCommandBuffer.data() + cmdPos)->mHeader.mState;
+        state.mCb = cbTexHandle;
+        state.mCr = crTexHandle;
+    }
+}
+
 void AbstractRenderer::Rect(f32 x, f32 y, f32 w, f32 h, int layer, ColourU8 colour, eBlendModes blendMode, eCoordinateSystem coordinateSystem)
 {
     assert(mInPath == false);
+    if (CullCommand(x, y, w, h, coordinateSystem))
+    {
+        return;
+    }
     EnsureCmdFreeSpace(sizeof(CmdRect));
     u8* const ptr = mDrawCommandBuffer.data() + mWritePos;
     mWritePos += sizeof(CmdRect);
@@ -504,10 +685,10 @@ void AbstractRenderer::Rect(f32 x, f32 y, f32 w, f32 h, int layer, ColourU8 colo
     cmd->mHeader.mState.mCoordinateSystem = coordinateSystem;
 }
 
-void AbstractRenderer::Text(f32 x, f32 y, f32 fontSize, const char* text, ColourU8 colour, int layer, eBlendModes blendMode, eCoordinateSystem coordinateSystem)
+void AbstractRenderer::Text(f32 x, f32 y, f32 fontSize, boost::string_view text, ColourU8 colour, int layer, eBlendModes blendMode, eCoordinateSystem coordinateSystem)
 {
     assert(mInPath == false);
-    const u32 textLength = static_cast<u32>(strlen(text)+1);
+    const u32 textLength = static_cast<u32>(text.size() + 1);
     EnsureCmdFreeSpace(sizeof(CmdText) + textLength);
     u8* const ptr = mDrawCommandBuffer.data() + mWritePos;
     mWritePos += sizeof(CmdText) + textLength;
@@ -519,7 +700,8 @@ void AbstractRenderer::Text(f32 x, f32 y, f32 fontSize, const char* text, Colour
     cmd->mX = x;
     cmd->mY = y;
     cmd->mFontSize = fontSize;
-    memcpy(&cmd->mText, text, textLength);
+    memcpy(&cmd->mText, text.data(), text.size());
+    (&cmd->mText)[text.size()] = '\0';
     cmd->mHeader.mState.mBlendMode = blendMode;
     cmd->mHeader.mState.mCoordinateSystem = coordinateSystem;
 }
@@ -529,6 +711,8 @@ void AbstractRenderer::PathBegin()
     assert(mInPath == false);
     mInPath = true;
     mPathBeginPos = mWritePos;
+    mPathMin = glm::vec2(std::numeric_limits<f32>::max());
+    mPathMax = glm::vec2(std::numeric_limits<f32>::lowest());
     EnsureCmdFreeSpace(sizeof(CmdBeginPath));
     u8* const ptr = mDrawCommandBuffer.data() + mWritePos;
     mWritePos += sizeof(CmdBeginPath);
@@ -545,11 +729,33 @@ void AbstractRenderer::PathLineTo(f32 x, f32 y)
     SubCmdPathLineTo* const cmd = new (ptr) SubCmdPathLineTo;
     cmd->mX = x;
     cmd->mY = y;
+
+    mPathMin = glm::min(mPathMin, glm::vec2(x, y));
+    mPathMax = glm::max(mPathMax, glm::vec2(x, y));
+}
+
+bool AbstractRenderer::CullPath(f32 lineWidth, eCoordinateSystem coordinateSystem)
+{
+    const glm::vec2 halfWidth(lineWidth / 2.0f);
+    const glm::vec2 size = (mPathMax + halfWidth) - (mPathMin - halfWidth);
+    if (mPathMin.x > mPathMax.x || CullCommand(mPathMin.x - halfWidth.x, mPathMin.y - halfWidth.y, size.x, size.y, coordinateSystem))
+    {
+        // Throw away the path begin and all of the line to sub commands
+        mWritePos = mPathBeginPos;
+        mDrawCommandBuffer.resize(mWritePos);
+        mInPath = false;
+        return true;
+    }
+    return false;
 }
 
 void AbstractRenderer::PathFill(ColourU8 colour, int layer, eBlendModes blendMode, eCoordinateSystem coordinateSystem)
 {
     assert(mInPath == true);
+    if (CullPath(0.0f, coordinateSystem))
+    {
+        return;
+    }
 
     u32 cmdSize = mWritePos - mPathBeginPos;
     CmdBeginPath* cmdPathBegin = reinterpret_cast<CmdBeginPath*>(mDrawCommandBuffer.data() + mPathBeginPos);
@@ -566,6 +772,10 @@ void AbstractRenderer::PathFill(ColourU8 colour, int layer, eBlendModes blendMod
 void AbstractRenderer::PathStroke(ColourU8 colour, f32 width, int layer, eBlendModes blendMode, eCoordinateSystem coordinateSystem)
 {
     assert(mInPath == true);
+    if (CullPath(width, coordinateSystem))
+    {
+        return;
+    }
 
     u32 cmdSize = mWritePos - mPathBeginPos;
     CmdBeginPath* cmdPathBegin = reinterpret_cast<CmdBeginPath*>(mDrawCommandBuffer.data() + mPathBeginPos);
@@ -583,6 +793,11 @@ void AbstractRenderer::PathStroke(ColourU8 colour, f32 width, int layer, eBlendM
 void AbstractRenderer::Line(ColourU8 colour, f32 p1x, f32 p1y, f32 p2x, f32 p2y, f32 lineWidth, int layer, eBlendModes blendMode, eCoordinateSystem coordinateSystem)
 {
     assert(mInPath == false);
+    if (!IsLineVisible(p1x, p1y, p2x, p2y, lineWidth, coordinateSystem))
+    {
+        mCulledCommandCount++;
+        return;
+    }
     EnsureCmdFreeSpace(sizeof(CmdLine));
     u8* const ptr = mDrawCommandBuffer.data() + mWritePos;
     mWritePos += sizeof(CmdLine);
@@ -603,6 +818,10 @@ void AbstractRenderer::Line(ColourU8 colour, f32 p1x, f32 p1y, f32 p2x, f32 p2y,
 void AbstractRenderer::CircleFilled(ColourU8 colour, f32 x, f32 y, f32 radius, u32 numSegments, int layer, eBlendModes blendMode, eCoordinateSystem coordinateSystem)
 {
     assert(mInPath == false);
+    if (CullCommand(x - radius, y - radius, radius * 2.0f, radius * 2.0f, coordinateSystem))
+    {
+        return;
+    }
     EnsureCmdFreeSpace(sizeof(CmdCircleFilled));
     u8* const ptr = mDrawCommandBuffer.data() + mWritePos;
     mWritePos += sizeof(CmdCircleFilled);
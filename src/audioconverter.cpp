@@ -1,39 +1,68 @@
 #include "audioconverter.hpp"
 #include "resourcemapper.hpp"
+#include "oddlib/audio/MixBus.h"
+#include <algorithm>
 
-template void AudioConverter::Convert<OggEncoder>(ISound& sound, const char* outputName, std::atomic<bool>& quitFlag);
-template void AudioConverter::Convert<WavEncoder>(ISound& sound, const char* outputName, std::atomic<bool>& quitFlag);
+template void AudioConverter::Convert<OggEncoder>(ISound& sound, const char* outputName, std::atomic<bool>& quitFlag, eConvertReverb reverb);
+template void AudioConverter::Convert<WavEncoder>(ISound& sound, const char* outputName, std::atomic<bool>& quitFlag, eConvertReverb reverb);
 
 template<class EncoderAlgorithm>
-void AudioConverter::Convert(ISound& sound, const char* outputName, std::atomic<bool>& quitFlag)
+void AudioConverter::Convert(ISound& sound, const char* outputName, std::atomic<bool>& quitFlag, eConvertReverb reverb)
 {
     TRACE_ENTRYEXIT;
 
-    EncoderAlgorithm encoder(outputName);
+    const u32 numChannels = reverb == eConvertReverb::eSeparate ? 4 : 2;
+    EncoderAlgorithm encoder(outputName, numChannels);
+
+    // Nothing is waiting on the output so mix the biggest blocks the bus can take
+    const u32 kBlockSamples = kAliveAudioMixBusMaxSamples;
+    const u32 kBlockFrames = kBlockSamples / 2;
+    std::unique_ptr<AliveAudioMixBus> bus = std::make_unique<AliveAudioMixBus>();
+    std::vector<f32> buffer(kBlockFrames * numChannels);
 
     for (;;)
     {
-        f32 buffer[1024] = {};
-
         sound.Update();
 
-        sound.Play(buffer, 1024);
-        const bool endOfAudio = sound.AtEnd();
-        u32 numSamplesToUse = 1024;
+        bus->Begin(kBlockSamples);
+        sound.Mix(*bus, kBlockSamples);
+        bool endOfAudio = sound.AtEnd();
+
+        if (reverb == eConvertReverb::eSeparate)
+        {
+            const f32* dry = bus->Dry();
+            const f32* send = bus->ReverbSend();
+            for (u32 i = 0; i < kBlockFrames; i++)
+            {
+                buffer[(i * 4)] = dry[(i * 2)];
+                buffer[(i * 4) + 1] = dry[(i * 2) + 1];
+                buffer[(i * 4) + 2] = send[(i * 2)];
+                buffer[(i * 4) + 3] = send[(i * 2) + 1];
+            }
+        }
+        else
+        {
+            std::fill(buffer.begin(), buffer.end(), 0.0f);
+            bus->Resolve(buffer.data(), kBlockSamples);
+
+            // The voices have finished but the reverb is still ringing out
+            endOfAudio = endOfAudio && !bus->ReverbActive();
+        }
+
+        u32 numSamplesToUse = kBlockFrames * numChannels;
         if (endOfAudio)
         {
-            // Trim down the buffer so the trailing silence is chopped off
-            for (u32 i = 1024; i-- > 0; )
+            // Trim down the buffer a whole frame at a time so the trailing silence is chopped off
+            while (numSamplesToUse > 0 && std::all_of(buffer.begin() + (numSamplesToUse - numChannels), buffer.begin() + numSamplesToUse, [](f32 s) { return s == 0.0f; }))
             {
-                if (buffer[i] != 0.0f)
-                {
-                    break;
-                }
-                numSamplesToUse--;
+                numSamplesToUse -= numChannels;
             }
         }
 
-        encoder.Consume(buffer, numSamplesToUse * sizeof(f32));
+        if (numSamplesToUse > 0)
+        {
+            encoder.Consume(buffer.data(), numSamplesToUse * sizeof(f32));
+        }
 
         if (endOfAudio || quitFlag)
         {
@@ -83,11 +112,11 @@ void WavHeader::WaveChunk::Write(Oddlib::IStream& stream)
     stream.Write(mBitsPerSample);
 }
 
-WavEncoder::WavEncoder(const char* outputName) 
+WavEncoder::WavEncoder(const char* outputName, u32 numChannels)
     : mStream(outputName, Oddlib::IStream::ReadMode::ReadWrite)
 {
     mHeader.mData.mWaveChunk.mBitsPerSample = 32;
-    mHeader.mData.mWaveChunk.mNumberOfChannels = 2;
+    mHeader.mData.mWaveChunk.mNumberOfChannels = static_cast<u16>(numChannels);
     mHeader.mData.mWaveChunk.mBlockAlignment = (mHeader.mData.mWaveChunk.mNumberOfChannels * mHeader.mData.mWaveChunk.mBitsPerSample) / 8;
     mHeader.mData.mWaveChunk.mNumberOfSamplesPerSecond = 44100L;
     mHeader.mData.mWaveChunk.mBytesPerSecond = mHeader.mData.mWaveChunk.mNumberOfSamplesPerSecond * mHeader.mData.mWaveChunk.mBlockAlignment;
@@ -101,16 +130,11 @@ WavEncoder::WavEncoder(const char* outputName)
 
 void WavEncoder::Consume(float* readbuffer, long bufferSizeInBytes)
 {
+    // Already interleaved in the order the wav format wants
     const u32 kNumFloats = bufferSizeInBytes / sizeof(float);
-    const u32 kFloatsPerChannel = kNumFloats / 2;
-    u32 pos = 0;
-    for (u32 i = 0; i < kFloatsPerChannel; i++)
+    for (u32 i = 0; i < kNumFloats; i++)
     {
-        const float left = readbuffer[pos++];
-        const float right = readbuffer[pos++];
-
-        mStream.Write(left);
-        mStream.Write(right);
+        mStream.Write(readbuffer[i]);
     }
 }
 
@@ -119,7 +143,8 @@ void WavEncoder::Finish()
     mHeader.FixHeaderSizes(mStream);
 }
 
-OggEncoder::OggEncoder(const char* outputName)
+OggEncoder::OggEncoder(const char* outputName, u32 numChannels)
+    : mNumChannels(numChannels)
 {
     output = fopen(outputName, "wb");
     InitEncoder();
@@ -142,12 +167,13 @@ void OggEncoder::Consume(float* readbuffer, long bufferSizeInBytes)
     {
         // Mark as the last frame
         vorbis_analysis_wrote(&vd, 0);
+        mEndOfStream = true;
     }
     else
     {
         /* data to encode */
         int numFloats = bufferSizeInBytes / sizeof(float);
-        const auto numChannels = 2;
+        const int numChannels = static_cast<int>(mNumChannels);
         const auto floatsPerChannel = numFloats / numChannels;
 
         /* expose the buffer to submit data */
@@ -156,14 +182,38 @@ void OggEncoder::Consume(float* readbuffer, long bufferSizeInBytes)
         int pos = 0;
         for (auto i = 0; i < floatsPerChannel; i++)
         {
-            buffer[0][i] = readbuffer[pos++];
-            buffer[1][i] = readbuffer[pos++];
+            for (int channel = 0; channel < numChannels; channel++)
+            {
+                buffer[channel][i] = readbuffer[pos++];
+            }
         }
 
         /* tell the library how much we actually submitted */
         vorbis_analysis_wrote(&vd, floatsPerChannel);
     }
 
+    WritePages();
+}
+
+void OggEncoder::Finish()
+{
+    if (!mEndOfStream)
+    {
+        vorbis_analysis_wrote(&vd, 0);
+        mEndOfStream = true;
+        WritePages();
+    }
+
+    // Whatever is left over didn't fill a whole page, without this the end of the sound is lost
+    while (ogg_stream_flush(&os, &og) != 0)
+    {
+        fwrite(og.header, 1, og.header_len, output);
+        fwrite(og.body, 1, og.body_len, output);
+    }
+}
+
+void OggEncoder::WritePages()
+{
     /* vorbis does some data preanalysis, then divvies up blocks for
     more involved (potentially parallel) processing.  Get a single
     block for encoding now */
@@ -178,16 +228,12 @@ void OggEncoder::Consume(float* readbuffer, long bufferSizeInBytes)
             /* weld the packet into the bitstream */
             ogg_stream_packetin(&os, &op);
 
-            /* write out pages (if any) */
-            int result = ogg_stream_pageout(&os, &og);
-            if (result == 0)
+            /* write out pages (if any), a partial page waits for more packets */
+            while (ogg_stream_pageout(&os, &og) != 0)
             {
-                // Error or not enough data, ogg_stream_flush can force a new page
-                break;
+                fwrite(og.header, 1, og.header_len, output);
+                fwrite(og.body, 1, og.body_len, output);
             }
-
-            fwrite(og.header, 1, og.header_len, output);
-            fwrite(og.body, 1, og.body_len, output);
         }
     }
 }
@@ -196,7 +242,7 @@ void OggEncoder::InitEncoder()
 {
     vorbis_info_init(&vi);
 
-    /*int ret =*/ vorbis_encode_init_vbr(&vi, 2, 44100, 0.1f);
+    /*int ret =*/ vorbis_encode_init_vbr(&vi, static_cast<long>(mNumChannels), 44100, 0.1f);
 
     // Appears in the file info to show which app created it
     vorbis_comment_init(&vc);
@@ -236,3 +282,165 @@ void OggEncoder::InitEncoder()
     fwrite(og.header, 1, og.header_len, output);
     fwrite(og.body, 1, og.body_len, output);
 }
+
+OggDecoder::OggDecoder(std::shared_ptr<std::vector<u8>> data)
+    : mData(std::move(data))
+{
+    Open();
+}
+
+OggDecoder::OggDecoder(std::unique_ptr<Oddlib::IStream> stream)
+    : mStream(std::move(stream))
+{
+    Open();
+}
+
+OggDecoder::~OggDecoder()
+{
+    if (mOpen)
+    {
+        ov_clear(&mFile);
+    }
+}
+
+void OggDecoder::Open()
+{
+    ov_callbacks callbacks = {};
+    callbacks.read_func = &OggDecoder::ReadCallback;
+    callbacks.seek_func = &OggDecoder::SeekCallback;
+    callbacks.tell_func = &OggDecoder::TellCallback;
+    callbacks.close_func = nullptr; // The data or stream is owned by this object
+
+    if (ov_open_callbacks(this, &mFile, nullptr, 0, callbacks) != 0)
+    {
+        LOG_ERROR("Not a valid Ogg Vorbis stream");
+        return;
+    }
+
+    mChannels = ov_info(&mFile, -1)->channels;
+    mOpen = true;
+}
+
+u32 OggDecoder::Decode(f32* buffer, u32 numFrames)
+{
+    if (!mOpen)
+    {
+        return 0;
+    }
+
+    u32 decoded = 0;
+    while (decoded < numFrames)
+    {
+        f32** pcm = nullptr;
+        int bitStream = 0;
+        const long frames = ov_read_float(&mFile, &pcm, static_cast<int>(numFrames - decoded), &bitStream);
+        if (frames == OV_HOLE)
+        {
+            // Corrupt or missing data, carry on from the next good packet
+            continue;
+        }
+
+        if (frames <= 0)
+        {
+            break;
+        }
+
+        const u32 outputChannels = OutputChannels();
+        f32* dst = buffer + (decoded * outputChannels);
+        if (outputChannels == 4)
+        {
+            for (long i = 0; i < frames; i++)
+            {
+                for (u32 channel = 0; channel < 4; channel++)
+                {
+                    dst[(i * 4) + channel] = pcm[channel][i];
+                }
+            }
+        }
+        else
+        {
+            // Mono is played on both sides
+            const f32* left = pcm[0];
+            const f32* right = mChannels > 1 ? pcm[1] : pcm[0];
+            for (long i = 0; i < frames; i++)
+            {
+                dst[(i * 2)] = left[i];
+                dst[(i * 2) + 1] = right[i];
+            }
+        }
+        decoded += static_cast<u32>(frames);
+    }
+    return decoded;
+}
+
+void OggDecoder::Rewind()
+{
+    if (mOpen)
+    {
+        ov_raw_seek(&mFile, 0);
+    }
+}
+
+size_t OggDecoder::Read(u8* buffer, size_t size)
+{
+    if (mData)
+    {
+        const size_t toRead = std::min(size, mData->size() - mPos);
+        memcpy(buffer, mData->data() + mPos, toRead);
+        mPos += toRead;
+        return toRead;
+    }
+
+    const size_t toRead = std::min(size, mStream->Size() - mStream->Pos());
+    mStream->ReadBytes(buffer, toRead);
+    return toRead;
+}
+
+int OggDecoder::Seek(s64 offset, int whence)
+{
+    const s64 size = static_cast<s64>(mData ? mData->size() : mStream->Size());
+    s64 pos = offset;
+    if (whence == SEEK_CUR)
+    {
+        pos += Tell();
+    }
+    else if (whence == SEEK_END)
+    {
+        pos += size;
+    }
+
+    if (pos < 0 || pos > size)
+    {
+        return -1;
+    }
+
+    if (mData)
+    {
+        mPos = static_cast<size_t>(pos);
+    }
+    else
+    {
+        mStream->Seek(static_cast<size_t>(pos));
+    }
+    return 0;
+}
+
+long OggDecoder::Tell() const
+{
+    return static_cast<long>(mData ? mPos : mStream->Pos());
+}
+
+size_t OggDecoder::ReadCallback(void* ptr, size_t size, size_t nmemb, void* datasource)
+{
+    return static_cast<OggDecoder*>(datasource)->Read(static_cast<u8*>(ptr), size * nmemb) / size;
+}
+
+int OggDecoder::SeekCallback(void* datasource, ogg_int64_t offset, int whence)
+{
+    return static_cast<OggDecoder*>(datasource)->Seek(offset, whence);
+}
+
+long OggDecoder::TellCallback(void* datasource)
+{
+    return static_cast<OggDecoder*>(datasource)->Tell();
+}
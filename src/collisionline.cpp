@@ -157,6 +157,12 @@ static void RenderLineAndOptionalArrowHead(AbstractRenderer& rend, const Line& l
     static float arrowHeight = 18.0f;
     float lineWidth = width;// 4.0f;
 
+    // The arrow head can stick out past either end of the line
+    if (!rend.IsLineVisible(line.mP1.x, line.mP1.y, line.mP2.x, line.mP2.y, (arrowHeight + lineWidth) * 2.0f, AbstractRenderer::eScreen))
+    {
+        return;
+    }
+
     ImVec2 lineP1 = { line.mP1.x, line.mP1.y };
     ImVec2 lineP2 = { line.mP2.x, line.mP2.y };
 
@@ -50,10 +50,14 @@ void Debug::Update(class InputState& input)
                 ImGui::Checkbox("Object bounding boxes", &mObjectBoundingBoxes);
                 ImGui::Checkbox("Ray casts", &mRayCasts);
                 ImGui::Checkbox("Display font atlas", &mDrawFontAtlas);
+                ImGui::Checkbox("View culling", &mViewCulling);
                 if (ImGui::Checkbox("VSync", &mVsync))
                 {
                     mChangeVSync = true;
                 }
+                ImGui::Checkbox("Interpolation", &mInterpolate);
+                ImGui::Checkbox("Frame limiter", &mFrameLimit);
+                ImGui::SliderInt("Max FPS", &mMaxFps, 30, 300);
             }
 
             if (ImGui::CollapsingHeader("Subtitle test"))
@@ -132,6 +136,8 @@ void Debug::Update(class InputState& input)
 
 void Debug::Render(AbstractRenderer& rend)
 {
+    rend.SetCulling(mViewCulling);
+
     if (mChangeVSync)
     {
         mChangeVSync = false;
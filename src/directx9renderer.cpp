@@ -374,11 +374,53 @@ static inline D3DFORMAT ToD3DFormat(AbstractRenderer::eTextureFormats format) {
             return D3DFMT_A8R8G8B8;
         case AbstractRenderer::eTextureFormats::eA:
             return D3DFMT_A8;
+        case AbstractRenderer::eTextureFormats::eIndex8:
+            // No palette support, stored as grey scale so the indices are still visible for debugging
+            return D3DFMT_A8R8G8B8;
+        case AbstractRenderer::eTextureFormats::ePlane8:
+            // Never asked for as SupportsYCbCrTextures() is false, grey scale the same as eIndex8
+            return D3DFMT_A8R8G8B8;
     }
     abort();
 }
 
 
+static void CopyToLockedRect(const D3DLOCKED_RECT &lockedRect, u32 width, u32 height,
+                             AbstractRenderer::eTextureFormats inputFormat, const void *pixels) {
+    DWORD *imageData = (DWORD *) lockedRect.pBits;
+    BYTE *iPixelData = (BYTE *) pixels;
+
+    DWORD srcIdx = 0;
+
+    for (u32 y = 0; y < height; ++y) {
+        for (u32 x = 0; x < width; x++) {
+            unsigned char r = 0xff;
+            unsigned char g = 0xff;
+            unsigned char b = 0xff;
+            unsigned char a = 0xff;
+
+            if (inputFormat == AbstractRenderer::eTextureFormats::eRGBA ||
+                inputFormat == AbstractRenderer::eTextureFormats::eRGB) {
+                r = iPixelData[srcIdx++];
+                g = iPixelData[srcIdx++];
+                b = iPixelData[srcIdx++];
+            }
+
+            if (inputFormat == AbstractRenderer::eTextureFormats::eRGBA ||
+                inputFormat == AbstractRenderer::eTextureFormats::eA) {
+                a = iPixelData[srcIdx++];
+            }
+
+            if (inputFormat == AbstractRenderer::eTextureFormats::eIndex8 || inputFormat == AbstractRenderer::eTextureFormats::ePlane8) {
+                r = g = b = iPixelData[srcIdx++];
+            }
+
+            const DWORD index = (x * 4 + (y * (lockedRect.Pitch)));
+            imageData[index / 4] = D3DCOLOR_RGBA(r, g, b, a);
+        }
+    }
+}
+
 TextureHandle DirectX9Renderer::CreateTexture(AbstractRenderer::eTextureFormats internalFormat, u32 width, u32 height,
                                               AbstractRenderer::eTextureFormats inputFormat, const void *pixels,
                                               bool /*interpolation*/) {
@@ -395,37 +437,7 @@ TextureHandle DirectX9Renderer::CreateTexture(AbstractRenderer::eTextureFormats
             LOG_ERROR("LockRect for texture failed");
             return DxToTextureHandle(nullptr);
         }
-
-
-        DWORD *imageData = (DWORD *) lockedRect.pBits;
-        BYTE *iPixelData = (BYTE *) pixels;
-
-        DWORD srcIdx = 0;
-
-        for (u32 y = 0; y < height; ++y) {
-            for (u32 x = 0; x < width; x++) {
-                unsigned char r = 0xff;
-                unsigned char g = 0xff;
-                unsigned char b = 0xff;
-                unsigned char a = 0xff;
-
-                if (inputFormat == AbstractRenderer::eTextureFormats::eRGBA ||
-                    inputFormat == AbstractRenderer::eTextureFormats::eRGB) {
-                    r = iPixelData[srcIdx++];
-                    g = iPixelData[srcIdx++];
-                    b = iPixelData[srcIdx++];
-                }
-
-                if (inputFormat == AbstractRenderer::eTextureFormats::eRGBA ||
-                    inputFormat == AbstractRenderer::eTextureFormats::eA) {
-                    a = iPixelData[srcIdx++];
-                }
-
-                const DWORD index = (x * 4 + (y * (lockedRect.Pitch)));
-                imageData[index / 4] = D3DCOLOR_RGBA(r, g, b, a);
-            }
-        }
-
+        CopyToLockedRect(lockedRect, width, height, inputFormat, pixels);
         pTexture->UnlockRect(0);
     }
 
@@ -437,6 +449,19 @@ TextureHandle DirectX9Renderer::CreateTexture(AbstractRenderer::eTextureFormats
     return DxToTextureHandle(pTexture);
 }
 
+void DirectX9Renderer::UpdateTexture(TextureHandle handle, u32 width, u32 height,
+                                     AbstractRenderer::eTextureFormats inputFormat, const void *pixels) {
+    // Managed textures are backed by a system memory copy, so locking doesn't stall on the GPU
+    const LPDIRECT3DTEXTURE9 pTexture = TextureHandleToDx(handle);
+    D3DLOCKED_RECT lockedRect = {};
+    if (FAILED(pTexture->LockRect(0, &lockedRect, nullptr, 0))) {
+        LOG_ERROR("LockRect for texture update failed");
+        return;
+    }
+    CopyToLockedRect(lockedRect, width, height, inputFormat, pixels);
+    pTexture->UnlockRect(0);
+}
+
 void DirectX9Renderer::DestroyTextures() {
     if (!mDestroyTextureList.empty()) {
         for (size_t i = 0; i < mDestroyTextureList.size(); ++i) {
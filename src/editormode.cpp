@@ -288,8 +288,7 @@ void EditorMode::Update(const InputState& input, CoordinateSpace& coords)
 
         if (mMapState.mCameraSubject)
         {
-            mMapState.mCameraSubject->mXPos = mMapState.mCameraPosition.x;
-            mMapState.mCameraSubject->mYPos = mMapState.mCameraPosition.y;
+            mMapState.mCameraSubject->SetPosition(mMapState.mCameraPosition.x, mMapState.mCameraPosition.y);
         }
     }
 
@@ -457,10 +456,11 @@ void EditorMode::Render(AbstractRenderer& rend) const
 {
     if (Debugging().mDrawCameras)
     {
-        // Draw every cam
-        for (auto x = 0u; x < mMapState.mScreens.size(); x++)
+        // Draw every cam that can be seen
+        const GridMapState::ScreenRange visible = mMapState.VisibleScreens(rend);
+        for (auto x = visible.mXBegin; x < visible.mXEnd; x++)
         {
-            for (auto y = 0u; y < mMapState.mScreens[x].size(); y++)
+            for (auto y = visible.mYBegin; y < std::min(visible.mYEnd, static_cast<u32>(mMapState.mScreens[x].size())); y++)
             {
                 // screen can be null while the array is being populated during loading
                 GridScreen* screen = mMapState.mScreens[x][y].get();
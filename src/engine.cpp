@@ -392,30 +392,77 @@ static char* WindowTitle(const char* rendererName, f32 fps)
     return buffer;
 }
 
+// The simulation always steps at this rate no matter how fast or slow rendering is
+static const std::chrono::nanoseconds kSimulationStep(16666666);
+
+// After a stall (loading, window dragging, a slow frame) only catch up this many steps rather than
+// trying to run all of the missed ones, which would make the next frame even slower
+static const u32 kMaxSimulationStepsPerFrame = 5;
+
+// Sleeps most of the way to target then yields for the remainder, as sleeps are only accurate to a millisecond or so
+static void WaitUntil(THighResClock::time_point target)
+{
+    for (;;)
+    {
+        const THighResClock::duration remaining = target - THighResClock::now();
+        if (remaining <= THighResClock::duration::zero())
+        {
+            break;
+        }
+
+        if (remaining > std::chrono::milliseconds(2))
+        {
+            SDL_Delay(1);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
 int Engine::Run()
 {
     BasicFramesPerSecondCounter fpsCounter;
-    auto startTime = THighResClock::now();
+    THighResClock::time_point lastFrameTime = THighResClock::now();
+    THighResClock::duration accumulatedTime = THighResClock::duration::zero();
 
     while (mState != EngineStates::eQuit)
     {
-        // Limit update to 60fps
-        const THighResClock::duration totalRunTime = THighResClock::now() - startTime;
-        const Sint64 timePassed = std::chrono::duration_cast<std::chrono::nanoseconds>(totalRunTime).count();
+        const THighResClock::time_point frameStartTime = THighResClock::now();
+        THighResClock::duration frameTime = frameStartTime - lastFrameTime;
+        lastFrameTime = frameStartTime;
 
+        const THighResClock::duration maxFrameTime = kSimulationStep * kMaxSimulationStepsPerFrame;
+        if (frameTime > maxFrameTime)
+        {
+            frameTime = maxFrameTime;
+        }
 
-        if (timePassed >= 16666666)
+        // Run as many fixed steps as the time since the last frame covers, so game speed doesn't depend on the frame rate
+        accumulatedTime += frameTime;
+        while (accumulatedTime >= kSimulationStep)
         {
             Update();
             ImGui::Render();
-            startTime = THighResClock::now();
+            accumulatedTime -= kSimulationStep;
         }
 
-        Render();
+        // Whatever is left over is how far we are into the next step
+        const f32 alpha = static_cast<f32>(accumulatedTime.count()) / static_cast<f32>(std::chrono::duration_cast<THighResClock::duration>(kSimulationStep).count());
+        mRenderer->SetInterpolation(Debugging().mInterpolate ? alpha : 1.0f);
+
+        Render(std::chrono::duration_cast<std::chrono::duration<f32>>(frameTime).count());
         fpsCounter.Update([&](f32 fps)
         {
             SDL_SetWindowTitle(mWindow, WindowTitle(mRenderer->Name(), fps));
         });
+
+        // Frame limiter, this works with or without vsync
+        if (Debugging().mFrameLimit && Debugging().mMaxFps > 0)
+        {
+            WaitUntil(frameStartTime + std::chrono::duration_cast<THighResClock::duration>(std::chrono::nanoseconds(1000000000 / Debugging().mMaxFps)));
+        }
     }
 
     mRenderer->DestroyTexture(mGuiFontHandle);
@@ -774,13 +821,13 @@ void Engine::Update()
     mGlobalFrameCounter++;
 }
 
-void Engine::Render()
+void Engine::Render(f32 frameSeconds)
 {
     int w = 0;
     int h = 0;
     SDL_GetWindowSize(mWindow, &w, &h);
 
-    mRenderer->UpdateCamera();
+    mRenderer->UpdateCamera(frameSeconds);
     mRenderer->BeginFrame(w, h);
 
     switch (mState)
@@ -820,9 +867,44 @@ void Engine::Render()
         RenderLoadingIcon();
     }
 
+    if (mSound)
+    {
+        RenderSoundCacheProgress();
+    }
+
     mRenderer->EndFrame();
 }
 
+void Engine::RenderSoundCacheProgress()
+{
+    // Sound effects the map doesn't use carry on caching in the background after it has loaded
+    const SoundCacheProgress progress = mSound->CacheProgress();
+    if (progress.mTotal <= progress.mDone)
+    {
+        return;
+    }
+
+    char text[128] = {};
+    if (progress.mSecondsRemaining > 0.0f)
+    {
+        const u32 seconds = static_cast<u32>(progress.mSecondsRemaining);
+        snprintf(text, sizeof(text), "Caching sounds %u/%u, %u:%02u left", progress.mDone, progress.mTotal, seconds / 60, seconds % 60);
+    }
+    else
+    {
+        snprintf(text, sizeof(text), "Caching sounds %u/%u", progress.mDone, progress.mTotal);
+    }
+
+    const f32 padding = 30.0f;
+    mRenderer->Text(padding, static_cast<f32>(mRenderer->Height()) - padding,
+        24.0f,
+        text,
+        ColourU8{ 255, 255, 255, 255 },
+        AbstractRenderer::eLayers::eFmv + 5,
+        AbstractRenderer::eBlendModes::eNormal,
+        AbstractRenderer::eCoordinateSystem::eScreen);
+}
+
 void Engine::RenderLoadingIcon()
 {
     if (!mLoadingIcon)
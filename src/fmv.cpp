@@ -6,6 +6,8 @@
 #include "cdromfilesystem.hpp"
 #include "soxr.h"
 #include "engine.hpp"
+#include <algorithm>
+#include <chrono>
 
 class AutoMouseCursorHide
 {
@@ -54,29 +56,43 @@ IMovie::IMovie(const std::string& resourceName, IAudioController& controller, st
 
 }
 
+void IMovie::SetFrameIndexCache(IFileSystem& fs, const std::string& fileName)
+{
+    mIndexCacheFs = &fs;
+    mIndexCacheFileName = fileName;
+}
+
 IMovie::~IMovie()
 {
+    // Too late to be safe as the derived class is already gone, but better than a joinable thread being destroyed
+    StopDecoding();
+    DestroyFrameTexture();
+}
 
+void IMovie::DestroyFrameTexture()
+{
+    for (TextureHandle* texture : { &mFrameTexture, &mCbTexture, &mCrTexture })
+    {
+        if (texture->IsValid())
+        {
+            mRenderer->DestroyTexture(*texture);
+            texture->mData = nullptr;
+        }
+    }
 }
 
 
 // Main thread context
 void IMovie::OnRenderFrame(AbstractRenderer& rend)
 {
-    // TODO: Populate mAudioBuffer and mVideoBuffer
-    // for up to N buffered frames
-    std::lock_guard<std::mutex> lock(mAudioBufferMutex);
+    // Frames decoded before this is seen are RGBA, RenderFrame() takes either
+    mYCbCrFrames = rend.SupportsYCbCrTextures();
 
     if (!mPlaying)
     {
         return;
     }
 
-    while (NeedBuffer())
-    {
-        FillBuffers();
-    }
-
     // TODO: If the buffer call back for audio is large, then this might only get called every N frames meaning
     // we can drop video frames even if not running too slowly. We should take this into account and interpolate between
     // now and the expected next call time.
@@ -97,54 +113,49 @@ void IMovie::OnRenderFrame(AbstractRenderer& rend)
         }
     }
 
-    bool played = false;
-    while (!mVideoBuffer.empty())
+    // Move on to the newest frame the audio has reached, anything older is dropped. The shown frame is
+    // kept until there is a newer one so the last frame stays up if the audio outlasts the video.
+    for (;;)
     {
-        Frame& f = mVideoBuffer.front();
-        if (f.mFrameNum < videoFrameIndex)
+        if (mNextFrame < 0)
         {
-            if (mVideoBuffer.size() == 1)
+            u32 index = 0;
+            if (!mDecodedFrames.Pop(index))
             {
-                // Don't remove everything otherwise we won't have any frame to display at all
                 break;
             }
-
-            mVideoBuffer.pop_front();
-            continue;
+            mNextFrame = static_cast<s32>(index);
         }
 
-        if (f.mFrameNum == videoFrameIndex)
+        // If the audio has run dry while every frame is waiting to be shown the decoder can't make progress,
+        // so skip ahead rather than stall
+        const bool starved = mAudioQueue.Empty() && mFreeFrames.Empty();
+        if (mShownFrame >= 0 && mFrames[mNextFrame].mFrameNum > videoFrameIndex && !starved)
         {
-            // Don't pop frame after rendering for the case when the video ends and we are playing
-            // audio but there are no more frames. In the case we just keep displaying whatever the last
-            // frame was (since we didn't pop it).
-            RenderFrame(rend, f.mW, f.mH, f.mPixels.data(), current_subs);
-            played = true;
             break;
         }
 
+        if (mShownFrame >= 0)
+        {
+            ReleaseFrame(mShownFrame);
+        }
+        mShownFrame = mNextFrame;
+        mNextFrame = -1;
     }
 
-    if (!played && !mVideoBuffer.empty())
-    {
-        Frame& f = mVideoBuffer.front();
-        RenderFrame(rend, f.mW, f.mH, f.mPixels.data(), current_subs);
-    }
-
-    while (NeedBuffer())
+    if (mShownFrame >= 0)
     {
-        FillBuffers();
+        RenderFrame(rend, mFrames[mShownFrame], current_subs);
     }
 }
 
 // Main thread context
 bool IMovie::IsEnd()
 {
-    std::lock_guard<std::mutex> lock(mAudioBufferMutex);
-    const auto ret = EndOfStream() && mAudioBuffer.empty();
-    if (ret && mVideoBuffer.size() > 1)
+    const auto ret = mDecodeFinished && mAudioQueue.Empty();
+    if (ret && !mDecodedFrames.Empty())
     {
-        LOG_ERROR("Still " << mVideoBuffer.size() << " frames left after audio finished");
+        LOG_ERROR("Still " << mDecodedFrames.Size() << " frames left after audio finished");
     }
     return ret;
 }
@@ -152,7 +163,17 @@ bool IMovie::IsEnd()
 // Main thread context
 void IMovie::Start()
 {
-    std::lock_guard<std::mutex> lock(mAudioBufferMutex);
+    if (mFrames.empty())
+    {
+        ResetQueues();
+    }
+
+    if (!mDecodeThread.joinable())
+    {
+        mStopDecode = false;
+        mDecodeThread = std::thread(&IMovie::DecodeThread, this);
+    }
+
     mAudioController.SetExclusiveAudioPlayer(this);
     mPlaying = true;
 }
@@ -160,57 +181,383 @@ void IMovie::Start()
 // Main thread context
 void IMovie::Stop()
 {
-    std::lock_guard<std::mutex> lock(mAudioBufferMutex);
     mAudioController.SetExclusiveAudioPlayer(nullptr);
     mPlaying = false;
+    StopDecoding();
+}
+
+// Main thread context, anything decoded is dropped and every frame goes back to the decoder. Only safe
+// while decoding is stopped and the audio thread isn't playing this movie.
+void IMovie::ResetQueues()
+{
+    // Enough audio to cover half of the frame queue, which is about half a second at 15 fps
+    mAudioTargetSamples = static_cast<u32>((mAudioBytesPerFrame / sizeof(s16)) * (kFrameQueueSize / 2));
+    mAudioQueue.Reset(mAudioTargetSamples * 2);
+
+    mFrames.resize(kFrameQueueSize);
+    mDecodedFrames.Reset(kFrameQueueSize);
+    mFreeFrames.Reset(kFrameQueueSize);
+    for (u32 i = 0; i < kFrameQueueSize; i++)
+    {
+        mFreeFrames.Push(i);
+    }
+
+    mAcquiredFrame = -1;
+    mShownFrame = -1;
+    mNextFrame = -1;
+}
+
+// Main thread context, Start() carries on again
+void IMovie::PauseDecoding()
+{
+    mAudioController.SetExclusiveAudioPlayer(nullptr);
+    StopDecoding();
+}
+
+// Main thread context
+size_t IMovie::NumberOfFrames()
+{
+    if (!mFramesCounted)
+    {
+        const size_t frameNum = CurrentFrame();
+        PauseDecoding();
+        mNumberOfFrames = CountFrames();
+        mFramesCounted = true;
+
+        // Decoding may have been stopped part way through a frame, so start again from the one being shown
+        if (!Seek(frameNum) && mPlaying)
+        {
+            Start();
+        }
+    }
+    return mNumberOfFrames;
+}
+
+// Main thread context
+size_t IMovie::CurrentFrame() const
+{
+    return mConsumedAudioBytes / mAudioBytesPerFrame;
+}
+
+// Main thread context
+bool IMovie::Seek(size_t frameNum)
+{
+    if (frameNum >= NumberOfFrames())
+    {
+        return false;
+    }
+
+    PauseDecoding();
+    const size_t audioBytes = SeekToFrame(frameNum);
+    ResetQueues();
+
+    // The audio clock picks the frame to show, so it has to start at the new frame too
+    mFrameCounter = frameNum;
+    mConsumedAudioBytes = audioBytes;
+    mDecodeFinished = false;
+
+    if (mPlaying)
+    {
+        Start();
+    }
+    return true;
+}
+
+// Main thread context
+f64 IMovie::DecodeAll(const std::function<void(size_t frameNum, u32 w, u32 h, const u8* pixels)>& onFrame,
+    const std::function<void(const s16* samples, u32 count)>& onAudio,
+    const std::function<void(size_t frameNum)>& onDecoded)
+{
+    PauseDecoding();
+    if (mFrames.empty())
+    {
+        ResetQueues();
+    }
+
+    mYCbCrFrames = false;
+    mStopDecode = false;
+    mDecodeTime = std::chrono::steady_clock::duration::zero();
+    mOnDecoded = onDecoded;
+    mDecodeThread = std::thread(&IMovie::DecodeThread, this);
+
+    s16 samples[1024];
+    for (;;)
+    {
+        // Checked before draining so that anything queued before the decoder finished is still handed out
+        const bool finished = mDecodeFinished;
+
+        bool drained = false;
+        u32 index = 0;
+        while (mDecodedFrames.Pop(index))
+        {
+            const Frame& f = mFrames[index];
+            onFrame(f.mFrameNum, f.mW, f.mH, f.mPixels.data());
+            ReleaseFrame(index);
+            drained = true;
+        }
+
+        u32 popped = 0;
+        while ((popped = mAudioQueue.PopMany(samples, static_cast<u32>(sizeof(samples) / sizeof(s16)))) > 0)
+        {
+            onAudio(samples, popped);
+            mConsumedAudioBytes += popped * sizeof(s16);
+            drained = true;
+        }
+
+        if (finished)
+        {
+            break;
+        }
+
+        if (drained)
+        {
+            mDecodeWake.notify_one();
+        }
+        else
+        {
+            // The queues hold many frames so this never holds the decoder up
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    StopDecoding();
+    mOnDecoded = nullptr;
+    return std::chrono::duration<f64>(mDecodeTime).count();
+}
+
+void IMovie::StopDecoding()
+{
+    mStopDecode = true;
+    mDecodeWake.notify_all();
+    if (mDecodeThread.joinable())
+    {
+        mDecodeThread.join();
+    }
+}
+
+// Render thread context
+void IMovie::ReleaseFrame(u32 index)
+{
+    mFreeFrames.Push(index);
+    mDecodeWake.notify_one();
+}
+
+// Decode thread context
+void IMovie::DecodeThread()
+{
+    while (!mStopDecode)
+    {
+        if (EndOfStream())
+        {
+            mDecodeFinished = true;
+            break;
+        }
+
+        if (NeedBuffer())
+        {
+            // Waiting for room part way through isn't counted as decoding
+            const auto start = std::chrono::steady_clock::now();
+            const auto waitedBefore = mWaitTime;
+            FillBuffers();
+            mDecodeTime += (std::chrono::steady_clock::now() - start) - (mWaitTime - waitedBefore);
+        }
+        else
+        {
+            WaitForRoom();
+        }
+    }
+}
+
+// Decode thread context. The audio thread never waits on anything so it doesn't wake us, hence the time out.
+bool IMovie::WaitForRoom()
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mDecodeWakeMutex);
+    if (!mStopDecode)
+    {
+        mDecodeWake.wait_for(lock, std::chrono::milliseconds(5));
+    }
+    mWaitTime += std::chrono::steady_clock::now() - start;
+    return !mStopDecode;
+}
+
+// Decode thread context
+bool IMovie::NeedBuffer() const
+{
+    return !mStopDecode && !mFreeFrames.Empty() && (mDecodedFrames.Empty() || mAudioQueue.Size() < mAudioTargetSamples);
+}
+
+// Decode thread context
+IMovie::Frame* IMovie::AcquireFrame()
+{
+    // Still held if decoding was stopped part way through a frame
+    if (mAcquiredFrame < 0)
+    {
+        u32 index = 0;
+        while (!mFreeFrames.Pop(index))
+        {
+            if (!WaitForRoom())
+            {
+                return nullptr;
+            }
+        }
+        mAcquiredFrame = static_cast<s32>(index);
+    }
+    return &mFrames[mAcquiredFrame];
+}
+
+// Decode thread context
+void IMovie::QueueFrame()
+{
+    mFrames[mAcquiredFrame].mFrameNum = mFrameCounter++;
+    if (mOnDecoded)
+    {
+        mOnDecoded(mFrames[mAcquiredFrame].mFrameNum);
+    }
+
+    // Can't fail, there are only as many frames as the queue holds
+    mDecodedFrames.Push(static_cast<u32>(mAcquiredFrame));
+    mAcquiredFrame = -1;
+}
+
+// Decode thread context
+bool IMovie::QueueAudio(const s16* samples, u32 count)
+{
+    while (count > 0)
+    {
+        const u32 pushed = mAudioQueue.PushMany(samples, count);
+        if (pushed == 0 && !WaitForRoom())
+        {
+            return false;
+        }
+        samples += pushed;
+        count -= pushed;
+    }
+    return true;
+}
+
+// Decode thread context
+bool IMovie::QueueSilence(u32 count)
+{
+    static const s16 kSilence[1024] = {};
+    while (count > 0)
+    {
+        const u32 chunk = std::min(count, static_cast<u32>(sizeof(kSilence) / sizeof(s16)));
+        if (!QueueAudio(kSilence, chunk))
+        {
+            return false;
+        }
+        count -= chunk;
+    }
+    return true;
 }
 
 // Audio thread context, from IAudioPlayer
 bool IMovie::Play(f32* stream, u32 len)
 {
-    std::lock_guard<std::mutex> lock(mAudioBufferMutex);
+    // Consume mAudioQueue and update the amount of consumed bytes
+    s16 samples[1024];
+    u32 done = 0;
+    while (done < len)
+    {
+        const u32 popped = mAudioQueue.PopMany(samples, std::min(len - done, static_cast<u32>(sizeof(samples) / sizeof(s16))));
+        if (popped == 0)
+        {
+            break;
+        }
+
+        for (u32 i = 0; i < popped; i++)
+        {
+            // TODO: Add a proper audio mixing algorithm/API, this will clip/overflow and cause weridnes when
+            // 2 streams of diff sample rates are mixed
+            stream[done + i] += samples[i] / 32768.0f;
+        }
+        done += popped;
+    }
 
-    // Consume mAudioBuffer and update the amount of consumed bytes
-    size_t have = mAudioBuffer.size()/sizeof(int16_t);
-    size_t take = len;
-    if (take > have)
+    if (done < len && !mDecodeFinished)
     {
         // Buffer underflow - we don't have enough data to fill the requested buffer
         // audio glitches ahoy!
-        LOG_ERROR("Audio buffer underflow want " << take << " samples " << " have " << have << " samples");
-        take = have;
+        LOG_ERROR("Audio buffer underflow want " << len << " samples " << " have " << done << " samples");
     }
 
-    for (auto i = 0u; i < take; i++)
-    {
-        uint8_t low = mAudioBuffer[i*sizeof(int16_t)];
-        uint8_t high = mAudioBuffer[i*sizeof(int16_t) + 1];
-        int16_t fixed = (int16_t)(low | (high << 8));
+    mConsumedAudioBytes += done * sizeof(s16);
+    return false;
+}
 
-        // TODO: Add a proper audio mixing algorithm/API, this will clip/overflow and cause weridnes when
-        // 2 streams of diff sample rates are mixed
-        stream[i] += fixed / 32768.0f;
+void IMovie::UploadFrame(AbstractRenderer& rend, const Frame& frame)
+{
+    if (frame.mYCbCr)
+    {
+        // 1.5 bytes a pixel rather than 4
+        rend.UpdateTexture(mFrameTexture, frame.mW, frame.mH, AbstractRenderer::eTextureFormats::ePlane8, frame.Y());
+        rend.UpdateTexture(mCbTexture, frame.ChromaW(), frame.ChromaH(), AbstractRenderer::eTextureFormats::ePlane8, frame.Cb());
+        rend.UpdateTexture(mCrTexture, frame.ChromaW(), frame.ChromaH(), AbstractRenderer::eTextureFormats::ePlane8, frame.Cr());
+    }
+    else
+    {
+        rend.UpdateTexture(mFrameTexture, frame.mW, frame.mH, AbstractRenderer::eTextureFormats::eRGBA, frame.mPixels.data());
     }
-    mAudioBuffer.erase(mAudioBuffer.begin(), mAudioBuffer.begin() + take*sizeof(int16_t));
-    mConsumedAudioBytes += take*sizeof(int16_t);
-    return false;
 }
 
-void IMovie::RenderFrame(AbstractRenderer &rend, int width, int height, const void *pixels, const char* subtitles)
+void IMovie::RenderFrame(AbstractRenderer &rend, const Frame& frame, const char* subtitles)
 {
-    // TODO: Optimize - should update 1 texture rather than creating per frame
-    TextureHandle texhandle = rend.CreateTexture(AbstractRenderer::eTextureFormats::eRGB, width, height, AbstractRenderer::eTextureFormats::eRGBA, pixels, true);
-    
-    rend.TexturedQuad(texhandle, 
-        0,
-        0,
-        static_cast<f32>(rend.Width()),
-        static_cast<f32>(rend.Height()),
-        AbstractRenderer::eFmv,
-        ColourU8{ 255, 255, 255, 255 },
-        AbstractRenderer::eNormal,
-        AbstractRenderer::eScreen);
-    
+    if (mFrameTexture.IsValid() && mRenderer == &rend && mFrameTextureW == frame.mW && mFrameTextureH == frame.mH && mFrameTextureYCbCr == frame.mYCbCr)
+    {
+        // The same video frame is usually shown for several render frames, only upload it once
+        if (mFrameTextureNum != frame.mFrameNum)
+        {
+            UploadFrame(rend, frame);
+        }
+    }
+    else
+    {
+        DestroyFrameTexture();
+        mRenderer = &rend;
+        if (frame.mYCbCr)
+        {
+            mFrameTexture = rend.CreateTexture(AbstractRenderer::eTextureFormats::ePlane8, frame.mW, frame.mH, AbstractRenderer::eTextureFormats::ePlane8, frame.Y(), true);
+            mCbTexture = rend.CreateTexture(AbstractRenderer::eTextureFormats::ePlane8, frame.ChromaW(), frame.ChromaH(), AbstractRenderer::eTextureFormats::ePlane8, frame.Cb(), true);
+            mCrTexture = rend.CreateTexture(AbstractRenderer::eTextureFormats::ePlane8, frame.ChromaW(), frame.ChromaH(), AbstractRenderer::eTextureFormats::ePlane8, frame.Cr(), true);
+        }
+        else
+        {
+            mFrameTexture = rend.CreateTexture(AbstractRenderer::eTextureFormats::eRGB, frame.mW, frame.mH, AbstractRenderer::eTextureFormats::eRGBA, frame.mPixels.data(), true);
+        }
+        mFrameTextureW = frame.mW;
+        mFrameTextureH = frame.mH;
+        mFrameTextureYCbCr = frame.mYCbCr;
+    }
+    mFrameTextureNum = frame.mFrameNum;
+
+    if (frame.mYCbCr)
+    {
+        rend.YCbCrTexturedQuad(mFrameTexture,
+            mCbTexture,
+            mCrTexture,
+            0,
+            0,
+            static_cast<f32>(rend.Width()),
+            static_cast<f32>(rend.Height()),
+            AbstractRenderer::eFmv,
+            ColourU8{ 255, 255, 255, 255 },
+            AbstractRenderer::eNormal,
+            AbstractRenderer::eScreen);
+    }
+    else
+    {
+        rend.TexturedQuad(mFrameTexture,
+            0,
+            0,
+            static_cast<f32>(rend.Width()),
+            static_cast<f32>(rend.Height()),
+            AbstractRenderer::eFmv,
+            ColourU8{ 255, 255, 255, 255 },
+            AbstractRenderer::eNormal,
+            AbstractRenderer::eScreen);
+    }
+
 
     if (subtitles)
     {
@@ -221,8 +568,6 @@ void IMovie::RenderFrame(AbstractRenderer &rend, int width, int height, const vo
             static_cast<f32>(rend.Width()),
             static_cast<f32>(rend.Height()));
     }
-
-    rend.DestroyTexture(texhandle);
 }
 
 // PSX MOV/STR format, all PSX game versions use this.
@@ -242,7 +587,7 @@ public:
 
     ~MovMovie()
     {
-
+        StopDecoding();
     }
 
     MovMovie(const std::string& resourceName, IAudioController& audioController, std::unique_ptr<Oddlib::IStream> stream, std::unique_ptr<SubTitleParser> subtitles, u32 startSector, u32 numberOfSectors)
@@ -268,13 +613,6 @@ public:
         mPsx = true;
     }
 
-    struct RawCDXASector
-    {
-        uint8_t data[2328 + 12 + 4 + 8];
-    };
-
-    static const uint8_t m_CDXA_STEREO = 3;
-
 #pragma pack(push)
 #pragma pack(1)
     struct PsxVideoFrameHeader
@@ -310,151 +648,362 @@ public:
 
     virtual bool EndOfStream() override
     {
-        return mFmvStream->AtEnd();
+        // The audio after the last frame counts as one more
+        return mDemuxIndexed && mNextDemuxFrame > mFrameSectors.size();
     }
 
-    virtual bool NeedBuffer() override
+    virtual size_t CountFrames() override
     {
-        const u32 kNumChans = 2;
-        const u32 requiredSize = mAudioController.SampleRate() * sizeof(u16) * kNumChans;
+        LoadOrBuildDemuxIndex();
+        return mFrameSectors.size();
+    }
 
-        return (mVideoBuffer.size() == 0 || mAudioBuffer.size() < (requiredSize*2)) && !mFmvStream->AtEnd();
+    virtual size_t SeekToFrame(size_t frameNum) override
+    {
+        mNextDemuxFrame = frameNum;
+
+        // The filter history is from whatever audio sector came before
+        mAdpcm = PSXADPCMDecoder();
+        return mFrameSectors[frameNum].mAudioSectors * kSamplesPerAudioSector * sizeof(s16);
     }
 
     virtual void FillBuffers() override
     {
-        while (NeedBuffer())
+        LoadOrBuildDemuxIndex();
+        while (NeedBuffer() && !EndOfStream())
         {
-            const int kXaFrameDataSize = 2016;
-            const int kNumAudioChannels = 2;
-            const int kBytesPerSample = 2;
-            std::array<s16, (kXaFrameDataSize * kNumAudioChannels * kBytesPerSample) / 2> outPtr;
-
-            if (mDemuxBuffer.empty())
+            if (!DecodeNextFrame())
             {
-                mDemuxBuffer.resize(1024 * 1024);
+                return;
             }
+        }
+    }
 
-            std::vector<u8> pixelBuffer;
-            for (;;)
+private:
+    static const u32 kXaFrameDataSize = 2016;
+    static const u32 kNumAudioChannels = 2;
+
+    // Every audio sector is played as 2352 stereo samples, silent ones included
+    static const u32 kSamplesPerAudioSector = 2352 * 2;
+
+    // What each sector holds, video sectors are the part of the frame they hold
+    static const u16 kAudioSector = 0xFFFF;
+    static const u16 kSilentSector = 0xFFFE;
+
+    // The sectors read for one video frame, from straight after the last sector of the frame before up to
+    // and including its own last sector. Any audio sectors in between are played first.
+    struct FrameSectors
+    {
+        u32 mFirstSector;
+        u32 mNumSectors;
+        u32 mAudioSectors; // Before mFirstSector, to put the audio clock back to where it would be
+        u32 mDataLen;
+        u16 mWidth;
+        u16 mHeight;
+    };
+
+    static const u32 kDemuxIndexVersion = 2;
+    static const u32 kScanSectors = 64;
+
+    // Decode thread context, or the main thread while decoding is stopped
+    void LoadOrBuildDemuxIndex()
+    {
+        if (!mDemuxIndexed)
+        {
+            if (!LoadDemuxIndex())
             {
+                BuildDemuxIndex();
+                SaveDemuxIndex();
+            }
+            mDemuxBuffer.resize(1024 * 1024);
+            mDemuxIndexed = true;
+        }
+    }
 
-                PsxStrHeader w;
-                if (mFmvStream->AtEnd())
+    // Sectors are back to back in the stream so any run of them is a single read
+    void ReadSectors(u32 firstSector, u32 numSectors)
+    {
+        mSectorBuffer.resize(numSectors);
+        if (numSectors > 0)
+        {
+            mFmvStream->Seek(static_cast<size_t>(firstSector) * mSectorStride);
+            mFmvStream->ReadBytes(reinterpret_cast<u8*>(mSectorBuffer.data()), numSectors * sizeof(PsxStrHeader));
+        }
+    }
+
+    // Reads every sector of the next frame in one go and plays the audio among them, then decodes the video
+    bool DecodeNextFrame()
+    {
+        const bool trailingAudio = mNextDemuxFrame == mFrameSectors.size();
+        const FrameSectors& frame = trailingAudio ? mTrailingAudio : mFrameSectors[mNextDemuxFrame];
+        ReadSectors(frame.mFirstSector, frame.mNumSectors);
+
+        for (u32 i = 0; i < frame.mNumSectors; i++)
+        {
+            const PsxStrHeader& sector = mSectorBuffer[i];
+            const u16 kind = mSectorKinds[frame.mFirstSector + i];
+            if (kind == kSilentSector)
+            {
+                // Blank/empty audio frame, play silence so video stays in sync
+                if (!QueueSilence(kSamplesPerAudioSector))
                 {
-                    return;
+                    return false;
                 }
-                mFmvStream->ReadBytes(reinterpret_cast<u8*>(&w), sizeof(w));
-
-                // PC sector must start with "MOIR" if video, else starts with "VALE"
-                if (!mPsx && w.mSectorType != 0x52494f4d)
+            }
+            else if (kind == kAudioSector)
+            {
+                if (!QueueXaAudio(sector))
+                {
+                    return false;
+                }
+            }
+            else
+            {
+                const u32 offset = kind * kXaFrameDataSize;
+                if (offset < frame.mDataLen && offset + kXaFrameDataSize <= mDemuxBuffer.size())
                 {
-                    // abort();
+                    const u32 bytesLeft = frame.mDataLen - offset;
+                    memcpy(mDemuxBuffer.data() + offset, sector.frame, bytesLeft < kXaFrameDataSize ? bytesLeft : kXaFrameDataSize);
                 }
+            }
+        }
+
+        if (!trailingAudio)
+        {
+            Frame* out = AcquireFrame();
+            if (!out)
+            {
+                return false;
+            }
+
+            // The AE PSX MI.MOV streams change their frame size part way through
+            out->Resize(frame.mWidth, frame.mHeight, WantYCbCrFrames());
+            const u16* bitStream = reinterpret_cast<const u16*>(mDemuxBuffer.data());
+            if (out->mYCbCr)
+            {
+                mMdec.DecodeFrameToYCbCr420(out->Y(), out->Cb(), out->Cr(), bitStream, frame.mWidth, frame.mHeight);
+            }
+            else
+            {
+                mMdec.DecodeFrameToRGBA32(out->mPixels.data(), frame.mWidth * 4, bitStream, frame.mWidth, frame.mHeight);
+            }
+            QueueFrame();
+        }
+        mNextDemuxFrame++;
+        return true;
+    }
+
+    bool QueueXaAudio(const PsxStrHeader& sector)
+    {
+        // PSX sectors still have the XA sub header in front of the sound data, PC ones only have the first half of the AKIK header
+        const u8* xa = mPsx ? reinterpret_cast<const RawCdImage::CDXASector&>(sector).data : reinterpret_cast<const u8*>(&sector.mAkikMagic);
+        mAdpcm.DecodeFrameToPCM(mXaAudio.data(), xa);
+
+        size_t consumedSrc = 0;
+        size_t wroteSamples = 0;
+        size_t inLenSampsPerChan = kXaFrameDataSize;
+        // 2016 samples at 37800Hz is exactly 2352 at 44100Hz, limit to what mResampledAudio holds
+        size_t outLenSampsPerChan = mResampledAudio.size() / kNumAudioChannels;
+
+        soxr_io_spec_t ioSpec = soxr_io_spec(
+            SOXR_INT16_I,   // In type
+            SOXR_INT16_I);  // Out type
+
+        soxr_oneshot(
+            37800,       // Input rate
+            44100,      // Output rate
+            2,          // Num channels
+            mXaAudio.data(),
+            inLenSampsPerChan,
+            &consumedSrc,
+            mResampledAudio.data(),
+            outLenSampsPerChan,
+            &wroteSamples,
+            &ioSpec,    // IO spec
+            nullptr,    // Quality spec
+            nullptr     // Runtime spec
+        );
+
+        return QueueAudio(mResampledAudio.data(), static_cast<u32>(wroteSamples * 2));
+    }
+
+    // One pass over the headers of every sector, a big run of them at a time
+    void BuildDemuxIndex()
+    {
+        // AKIK is 0x80010160 in PSX
+        const auto kMagic = mPsx ? 0x80010160 : 0x4b494b41;
+        mFrameSectors.clear();
+        mSectorKinds.clear();
+        mTrailingAudio = {};
+
+        // Raw CD images move the stream 2048 bytes for each sector whatever is read, so find out from the first one
+        mSectorStride = sizeof(PsxStrHeader);
+        mFmvStream->Seek(0);
+        if (mFmvStream->AtEnd())
+        {
+            return;
+        }
+        mSectorBuffer.resize(1);
+        mFmvStream->ReadBytes(reinterpret_cast<u8*>(mSectorBuffer.data()), sizeof(PsxStrHeader));
+        mSectorStride = static_cast<u32>(mFmvStream->Pos());
 
-                // AKIK is 0x80010160 in PSX
-                const auto kMagic = mPsx ? 0x80010160 : 0x4b494b41;
-                bool noAudio = false;
+        const u32 numSectors = static_cast<u32>(mFmvStream->Size() / mSectorStride);
+        mSectorKinds.reserve(numSectors);
+
+        FrameSectors frame = {};
+        u32 audioSectors = 0;
+        u32 sector = 0;
+        while (sector < numSectors)
+        {
+            if (sector > 0)
+            {
+                const u32 sectorsLeft = numSectors - sector;
+                ReadSectors(sector, sectorsLeft < kScanSectors ? sectorsLeft : kScanSectors);
+            }
+            sector += static_cast<u32>(mSectorBuffer.size());
+
+            for (const PsxStrHeader& w : mSectorBuffer)
+            {
                 if (w.mAkikMagic != kMagic)
                 {
-                    if (mPsx)
-                    {
-                        /*
-                        std::cout <<
-                        (CHECK_BIT(xa->subheader.coding_info, 0) ? "Mono " : "Stereo ") <<
-                        (CHECK_BIT(xa->subheader.coding_info, 2) ? "37800Hz " : "18900Hz ") <<
-                        (CHECK_BIT(xa->subheader.coding_info, 4) ? "4bit " : "8bit ")
-                        */
-
-                        RawCdImage::CDXASector* rawXa = (RawCdImage::CDXASector*)&w;
-                        if (rawXa->subheader.coding_info != 0)
-                        {
-                            mAdpcm.DecodeFrameToPCM(outPtr, &rawXa->data[0]);
-                        }
-                        else
-                        {
-                            // Blank/empty audio frame, play silence so video stays in sync
-                            //numBytes = 2016 * 2 * 2;
-                            mAudioBuffer.resize(mAudioBuffer.size() + (2352*4));
-                            noAudio = true;
-                        }
-                    }
-                    else
+                    const bool silent = mPsx && reinterpret_cast<const RawCdImage::CDXASector&>(w).subheader.coding_info == 0;
+                    const u16 kind = silent ? kSilentSector : kAudioSector;
+                    mSectorKinds.push_back(kind);
+                    audioSectors++;
+                }
+                else
+                {
+                    const u16 part = w.mSectorNumberInFrame;
+                    mSectorKinds.push_back(part);
+                    if (w.mSectorNumberInFrame == w.mNumSectorsInFrame - 1)
                     {
-                        mAdpcm.DecodeFrameToPCM(outPtr, (uint8_t *)&w.mAkikMagic);
+                        frame.mNumSectors = static_cast<u32>(mSectorKinds.size()) - frame.mFirstSector;
+                        frame.mDataLen = w.mFrameDataLen;
+                        frame.mWidth = w.mWidth;
+                        frame.mHeight = w.mHeight;
+                        mFrameSectors.push_back(frame);
+
+                        frame = {};
+                        frame.mFirstSector = static_cast<u32>(mSectorKinds.size());
+                        frame.mAudioSectors = audioSectors;
                     }
+                }
+            }
+        }
 
-                    if (!noAudio)
-                    {
-                        size_t consumedSrc = 0;
-                        size_t wroteSamples = 0;
-                        size_t inLenSampsPerChan = kXaFrameDataSize;
-                        size_t outLenSampsPerChan = inLenSampsPerChan * 2;
-                        std::vector<u8> tmp2(2352 * 4);
-
-                        soxr_io_spec_t ioSpec = soxr_io_spec(
-                            SOXR_INT16_I,   // In type
-                            SOXR_INT16_I);  // Out type
-
-                        soxr_oneshot(
-                            37800,       // Input rate
-                            44100,      // Output rate
-                            2,          // Num channels
-                            outPtr.data(),
-                            inLenSampsPerChan,
-                            &consumedSrc,
-                            tmp2.data(),
-                            outLenSampsPerChan,
-                            &wroteSamples,
-                            &ioSpec,    // IO spec
-                            nullptr,    // Quality spec
-                            nullptr     // Runtime spec
-                        );
-
-
-                        for (auto i = 0u; i < wroteSamples * 4; i++)
-                        {
-                            mAudioBuffer.push_back(tmp2[i]);
-                        }
-                    }
+        // Whatever comes after the last frame is still played
+        frame.mNumSectors = static_cast<u32>(mSectorKinds.size()) - frame.mFirstSector;
+        mTrailingAudio = frame;
+    }
 
-                    // Must be VALE
-                    continue;
-                }
-                else
-                {
-                    const u16 frameW = w.mWidth;
-                    const u16 frameH = w.mHeight;
+    static void ReadFrameSectors(Oddlib::IStream& stream, FrameSectors& frame)
+    {
+        stream.Read(frame.mFirstSector);
+        stream.Read(frame.mNumSectors);
+        stream.Read(frame.mAudioSectors);
+        stream.Read(frame.mDataLen);
+        stream.Read(frame.mWidth);
+        stream.Read(frame.mHeight);
+    }
 
-                    uint32_t bytes_to_copy = w.mFrameDataLen - w.mSectorNumberInFrame *kXaFrameDataSize;
-                    if (bytes_to_copy > 0)
-                    {
-                        if (bytes_to_copy > kXaFrameDataSize)
-                        {
-                            bytes_to_copy = kXaFrameDataSize;
-                        }
+    static void WriteFrameSectors(Oddlib::IStream& stream, const FrameSectors& frame)
+    {
+        stream.Write(frame.mFirstSector);
+        stream.Write(frame.mNumSectors);
+        stream.Write(frame.mAudioSectors);
+        stream.Write(frame.mDataLen);
+        stream.Write(frame.mWidth);
+        stream.Write(frame.mHeight);
+    }
 
-                        memcpy(mDemuxBuffer.data() + w.mSectorNumberInFrame * kXaFrameDataSize, w.frame, bytes_to_copy);
-                    }
+    // The cache is version, movie size, sector stride, frame and sector counts, then every frame, the
+    // trailing audio and what each sector holds
+    bool LoadDemuxIndex()
+    {
+        std::string fileName = mIndexCacheFileName;
+        if (!mIndexCacheFs || !mIndexCacheFs->FileExists(fileName))
+        {
+            return false;
+        }
 
-                    if (w.mSectorNumberInFrame == w.mNumSectorsInFrame - 1)
-                    {
-                        // Always resize as its possible for a stream to change its frame size to be smaller or larger
-                        // this happens in the AE PSX MI.MOV streams
-                        pixelBuffer.resize(frameW * frameH * 4); // 4 bytes per pixel
+        const size_t kHeaderSize = sizeof(u32) * 5;
+        const size_t kFrameSize = (sizeof(u32) * 4) + (sizeof(u16) * 2);
+        auto stream = mIndexCacheFs->Open(fileName);
+        if (stream->Size() < kHeaderSize)
+        {
+            return false;
+        }
 
-                        mMdec.DecodeFrameToABGR32((uint16_t*)pixelBuffer.data(), (uint16_t*)mDemuxBuffer.data(), frameW, frameH);
-                        mVideoBuffer.push_back(Frame{ mFrameCounter++, frameW, frameH, pixelBuffer });
+        u32 version = 0;
+        u32 streamSize = 0;
+        u32 stride = 0;
+        u32 numFrames = 0;
+        u32 numSectors = 0;
+        stream->Read(version);
+        stream->Read(streamSize);
+        stream->Read(stride);
+        stream->Read(numFrames);
+        stream->Read(numSectors);
+        if (version != kDemuxIndexVersion || streamSize != mFmvStream->Size() || stride == 0 ||
+            stream->Size() != kHeaderSize + ((numFrames + 1) * kFrameSize) + (numSectors * sizeof(u16)))
+        {
+            LOG_WARNING("Ignoring stale demux index " << fileName);
+            return false;
+        }
 
-                        return;
-                    }
-                }
+        mSectorStride = stride;
+        mFrameSectors.resize(numFrames);
+        for (FrameSectors& frame : mFrameSectors)
+        {
+            ReadFrameSectors(*stream, frame);
+        }
+        ReadFrameSectors(*stream, mTrailingAudio);
+        mSectorKinds.resize(numSectors);
+        stream->Read(mSectorKinds);
+        return true;
+    }
+
+    void SaveDemuxIndex()
+    {
+        if (!mIndexCacheFs)
+        {
+            return;
+        }
+
+        try
+        {
+            auto stream = mIndexCacheFs->Create(mIndexCacheFileName);
+            const u32 version = kDemuxIndexVersion;
+            stream->Write(version);
+            stream->Write(static_cast<u32>(mFmvStream->Size()));
+            stream->Write(mSectorStride);
+            stream->Write(static_cast<u32>(mFrameSectors.size()));
+            stream->Write(static_cast<u32>(mSectorKinds.size()));
+            for (const FrameSectors& frame : mFrameSectors)
+            {
+                WriteFrameSectors(*stream, frame);
             }
+            WriteFrameSectors(*stream, mTrailingAudio);
+            stream->Write(mSectorKinds);
+        }
+        catch (const Oddlib::Exception& e)
+        {
+            // Only costs another scan next time
+            LOG_WARNING("Failed to save demux index " << mIndexCacheFileName << ": " << e.what());
         }
     }
 
-private:
+    bool mDemuxIndexed = false;
+    u32 mSectorStride = sizeof(PsxStrHeader);
+    std::vector<FrameSectors> mFrameSectors;
+    FrameSectors mTrailingAudio = {};
+    std::vector<u16> mSectorKinds;
+    size_t mNextDemuxFrame = 0; // Decode thread only
+
+    std::vector<PsxStrHeader> mSectorBuffer;
     std::vector<unsigned char> mDemuxBuffer;
+    std::array<s16, kXaFrameDataSize * kNumAudioChannels> mXaAudio;
+    std::array<s16, kSamplesPerAudioSector> mResampledAudio;
     PSXMDECDecoder mMdec;
     PSXADPCMDecoder mAdpcm;
 };
@@ -495,18 +1044,14 @@ public:
             //mAudioController.SetAudioSpec(static_cast<u16>(mMasher->SingleAudioFrameSizeSamples()), mMasher->AudioSampleRate());
         }
 
-        if (mMasher->HasVideo())
-        {
-            mFramePixels.resize(mMasher->Width() * mMasher->Height() * sizeof(u32));
-        }
-
         const u32 kNumChannels = 2;
         mAudioBytesPerFrame = sizeof(u16) * kNumChannels * mMasher->SingleAudioFrameSizeSamples();
+        mDecodedAudioFrame.resize(mMasher->SingleAudioFrameSizeSamples() * kNumChannels);
     }
 
     ~MasherMovie()
     {
-
+        StopDecoding();
     }
 
     virtual bool EndOfStream() override
@@ -514,27 +1059,46 @@ public:
         return mAtEndOfStream;
     }
 
-    virtual bool NeedBuffer() override
+    virtual size_t CountFrames() override
     {
-        return (mVideoBuffer.size() == 0 || mAudioBuffer.size() < (mMasher->SingleAudioFrameSizeSamples()*2*2*4)) && !mAtEndOfStream;
+        return mMasher->NumberOfFrames();
+    }
+
+    virtual size_t SeekToFrame(size_t frameNum) override
+    {
+        mMasher->SeekToFrame(static_cast<u32>(frameNum));
+        mAtEndOfStream = false;
+        return frameNum * mAudioBytesPerFrame;
     }
 
     virtual void FillBuffers() override
     {
         while (NeedBuffer())
         {
-            const s32 kNumChannels = 2;
-            std::vector<u8> decodedAudioFrame(mMasher->SingleAudioFrameSizeSamples() * kNumChannels * sizeof(s16));
-            mAtEndOfStream = !mMasher->Update((u32*)mFramePixels.data(), decodedAudioFrame.data());
+            Frame* frame = AcquireFrame();
+            if (!frame)
+            {
+                break;
+            }
+
+            frame->Resize(mMasher->Width(), mMasher->Height(), WantYCbCrFrames());
+            u8* audio = reinterpret_cast<u8*>(mDecodedAudioFrame.data());
+            if (frame->mYCbCr)
+            {
+                mAtEndOfStream = !mMasher->Update(frame->Y(), frame->Cb(), frame->Cr(), audio);
+            }
+            else
+            {
+                mAtEndOfStream = !mMasher->Update(reinterpret_cast<u32*>(frame->mPixels.data()), audio);
+            }
             if (!mAtEndOfStream)
             {
-                // Copy to audio threads buffer
-                for (size_t i = 0; i < decodedAudioFrame.size(); i++)
+                // Audio first so the frame isn't shown before the audio that goes with it is queued
+                if (!QueueAudio(mDecodedAudioFrame.data(), static_cast<u32>(mDecodedAudioFrame.size())))
                 {
-                    mAudioBuffer.push_back(decodedAudioFrame[i]);
+                    break;
                 }
-
-                mVideoBuffer.push_back(Frame{ mFrameCounter++, mMasher->Width(), mMasher->Height(), mFramePixels });
+                QueueFrame();
             }
             else
             {
@@ -546,7 +1110,7 @@ public:
 private:
     bool mAtEndOfStream = false;
     std::unique_ptr<Oddlib::Masher> mMasher;
-    std::vector<u8> mFramePixels;
+    std::vector<s16> mDecodedAudioFrame;
 };
 
 
@@ -754,5 +1318,17 @@ void Fmv::DebugUi()
             ImGui::EndChild();
         }
         ImGui::EndGroup();
+
+        if (mFmv)
+        {
+            // The first time this is shown for a PSX movie the whole stream is scanned for where the frames are
+            const int lastFrame = static_cast<int>(mFmv->NumberOfFrames()) - 1;
+            int frame = static_cast<int>(mFmv->CurrentFrame());
+            ImGui::Text("Playing: %s", mFmvName.c_str());
+            if (lastFrame >= 0 && ImGui::SliderInt("Frame", &frame, 0, lastFrame))
+            {
+                mFmv->Seek(static_cast<size_t>(frame));
+            }
+        }
     }
 }
@@ -7,6 +7,7 @@
 #include <cassert>
 #include "oddlib/sdl_raii.hpp"
 #include <algorithm> // min/max
+#include <set>
 #include <cmath>
 #include "resourcemapper.hpp"
 #include "engine.hpp"
@@ -30,6 +31,15 @@ bool Level::LoadMap(const Oddlib::Path& path)
     return mMap->LoadMap(path, mLocator);
 }
 
+std::vector<std::string> Level::SoundResources() const
+{
+    if (mMap)
+    {
+        return mMap->SoundResources();
+    }
+    return {};
+}
+
 void Level::Update(const InputState& input, CoordinateSpace& coords)
 {
     if (mMap)
@@ -86,8 +96,11 @@ void GridScreen::LoadTextures(AbstractRenderer& rend)
         mCam = mLocator.LocateCamera(mFileName).get();
         if (mCam) // One path trys to load BRP08C10.CAM which exists in no data sets anywhere!
         {
+            // Create the textures empty and fill them with UpdateTexture() so the pixels go through the
+            // renderers streaming upload path, as cameras are loaded while scrolling through a map
             SDL_Surface* surf = mCam->GetSurface();
-            mTexHandle = rend.CreateTexture(AbstractRenderer::eTextureFormats::eRGB, surf->w, surf->h, AbstractRenderer::eTextureFormats::eRGB, surf->pixels, true);
+            mTexHandle = rend.CreateTexture(AbstractRenderer::eTextureFormats::eRGB, surf->w, surf->h, AbstractRenderer::eTextureFormats::eRGB, nullptr, true);
+            rend.UpdateTexture(mTexHandle, surf->w, surf->h, AbstractRenderer::eTextureFormats::eRGB, surf->pixels);
 
             if (!mTexHandle2.IsValid())
             {
@@ -96,7 +109,8 @@ void GridScreen::LoadTextures(AbstractRenderer& rend)
                     SDL_Surface* fg1Surf = mCam->GetFg1()->GetSurface();
                     if (fg1Surf)
                     {
-                        mTexHandle2 = rend.CreateTexture(AbstractRenderer::eTextureFormats::eRGBA, fg1Surf->w, fg1Surf->h, AbstractRenderer::eTextureFormats::eRGBA, fg1Surf->pixels, true);
+                        mTexHandle2 = rend.CreateTexture(AbstractRenderer::eTextureFormats::eRGBA, fg1Surf->w, fg1Surf->h, AbstractRenderer::eTextureFormats::eRGBA, nullptr, true);
+                        rend.UpdateTexture(mTexHandle2, fg1Surf->w, fg1Surf->h, AbstractRenderer::eTextureFormats::eRGBA, fg1Surf->pixels);
                     }
                 }
             }
@@ -134,6 +148,12 @@ bool GridScreen::hasTexture() const
 
 void GridScreen::Render(AbstractRenderer& rend, float x, float y, float w, float h)
 {
+    // Avoid loading the textures of cameras that can't be seen
+    if (!rend.IsVisible(x, y, w, h))
+    {
+        return;
+    }
+
     LoadTextures(rend);
     if (mTexHandle.IsValid())
     {
@@ -380,6 +400,16 @@ GridMap::~GridMap()
     TRACE_ENTRYEXIT;
 }
 
+std::vector<std::string> GridMap::SoundResources() const
+{
+    std::set<std::string> names;
+    for (const auto& obj : mMapState.mObjs)
+    {
+        names.insert(obj->SoundResources().begin(), obj->SoundResources().end());
+    }
+    return std::vector<std::string>(names.begin(), names.end());
+}
+
 void GridMap::Update(const InputState& input, CoordinateSpace& coords)
 {
     if (mMapState.mState == GridMapState::eStates::eEditor)
@@ -452,6 +482,41 @@ void GridMapState::RenderGrid(AbstractRenderer& rend) const
     }
 }
 
+static u32 ToScreenIndex(f32 worldPos, f32 blockSize, s32 delta, u32 count)
+{
+    const s32 idx = static_cast<s32>(std::floor(worldPos / blockSize)) + delta;
+    return static_cast<u32>(glm::clamp(idx, 0, static_cast<s32>(count)));
+}
+
+GridMapState::ScreenRange GridMapState::VisibleScreens(const AbstractRenderer& rend, u32 margin) const
+{
+    ScreenRange range = {};
+    if (mScreens.empty())
+    {
+        return range;
+    }
+
+    const u32 xCount = static_cast<u32>(mScreens.size());
+    const u32 yCount = static_cast<u32>(mScreens[0].size());
+    if (!rend.CullingEnabled() || kCameraBlockSize.x <= 0.0f || kCameraBlockSize.y <= 0.0f)
+    {
+        return { 0, xCount, 0, yCount };
+    }
+
+    // A camera image starts at kCameraBlockImageOffset in to its block and is kVirtualScreenSize big
+    const glm::vec4& view = rend.WorldCullRect();
+    const glm::vec2 viewMin = glm::vec2(view.x, view.y) - kCameraBlockImageOffset - kVirtualScreenSize;
+    const glm::vec2 viewMax = glm::vec2(view.x + view.z, view.y + view.w) - kCameraBlockImageOffset;
+
+    const s32 delta = static_cast<s32>(margin);
+
+    range.mXBegin = ToScreenIndex(viewMin.x, kCameraBlockSize.x, -delta, xCount);
+    range.mXEnd = ToScreenIndex(viewMax.x, kCameraBlockSize.x, delta + 1, xCount);
+    range.mYBegin = ToScreenIndex(viewMin.y, kCameraBlockSize.y, -delta, yCount);
+    range.mYEnd = ToScreenIndex(viewMax.y, kCameraBlockSize.y, delta + 1, yCount);
+    return range;
+}
+
 void GridMapState::RenderDebug(AbstractRenderer& rend) const
 {
     //rend.SetActiveLayer(AbstractRenderer::eEditor);
@@ -471,9 +536,11 @@ void GridMapState::RenderDebug(AbstractRenderer& rend) const
     // Draw objects
     if (Debugging().mObjectBoundingBoxes)
     {
-        for (auto x = 0u; x < mScreens.size(); x++)
+        // Objects can hang over the edge of the camera they belong to
+        const ScreenRange visible = VisibleScreens(rend, 1);
+        for (auto x = visible.mXBegin; x < visible.mXEnd; x++)
         {
-            for (auto y = 0u; y < mScreens[x].size(); y++)
+            for (auto y = visible.mYBegin; y < std::min(visible.mYEnd, static_cast<u32>(mScreens[x].size())); y++)
             {
                 GridScreen* screen = mScreens[x][y].get();
                 if (!screen)
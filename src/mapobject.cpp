@@ -5,6 +5,7 @@
 #include "collisionline.hpp"
 #include "gridmap.hpp"
 #include "resourcemapper.hpp"
+#include <cmath>
 
 /*static*/ void MapObject::RegisterScriptBindings()
 {
@@ -33,6 +34,7 @@
         c.Func("FloorCollision", &MapObject::FloorCollision);
 
         c.Func("SnapXToGrid", &MapObject::SnapXToGrid);
+        c.Func("SetPosition", &MapObject::SetPosition);
         c.Func("FacingLeft", &MapObject::FacingLeft);
 
         c.Func("FacingRight", &MapObject::FacingRight);
@@ -131,8 +133,8 @@ void MapObject::Loader::LoadSounds()
             Sqrat::SharedPtr<std::string> item = soundsArray.GetValue<std::string>(static_cast<int>(mForLoop.Value()));
             if (item)
             {
-                // TODO: Now that all sfx are cached this probably shouldn't be needed.. unless used as hook for loading mod fx?
-                LOG_INFO(*item);
+                // Cached ahead of the other sound effects when the map loads
+                mMapObj.mSoundResources.push_back(*item);
             }
         }))
         {
@@ -281,6 +283,10 @@ void MapObject::Update(const InputState& input)
 {
     //TRACE_ENTRYEXIT;
 
+    mPrevXPos = mXPos;
+    mPrevYPos = mYPos;
+    mPrevPosValid = true;
+
     Debugging().mDebugObj = this;
     if (Debugging().mSingleStepObject && !Debugging().mDoSingleStepObject)
     {
@@ -405,12 +411,27 @@ void MapObject::ReloadScript()
     SnapXToGrid();
 }
 
+// Moves bigger than this in one step are teleports (i.e the script setting a new position) so aren't interpolated
+static const float kMaxInterpolationDistance = 64.0f;
+
+static float InterpolatePosition(float prev, float current, float alpha)
+{
+    if (std::abs(current - prev) > kMaxInterpolationDistance)
+    {
+        return current;
+    }
+    return prev + ((current - prev) * alpha);
+}
+
 void MapObject::Render(AbstractRenderer& rend, int x, int y, float scale, int layer) const
 {
     if (mAnim)
     {
-        mAnim->SetXPos(static_cast<s32>(mXPos) + x);
-        mAnim->SetYPos(static_cast<s32>(mYPos) + y);
+        const float xpos = mPrevPosValid ? InterpolatePosition(mPrevXPos, mXPos, rend.Interpolation()) : mXPos;
+        const float ypos = mPrevPosValid ? InterpolatePosition(mPrevYPos, mYPos, rend.Interpolation()) : mYPos;
+        // Round rather than truncate so that negative positions don't snap the other way
+        mAnim->SetXPos(static_cast<s32>(std::floor(xpos + 0.5f)) + x);
+        mAnim->SetYPos(static_cast<s32>(std::floor(ypos + 0.5f)) + y);
         mAnim->SetScale(scale);
         mAnim->Render(rend, mFlipX, layer);
     }
@@ -420,6 +441,14 @@ void MapObject::Render(AbstractRenderer& rend, int x, int y, float scale, int la
     }
 }
 
+void MapObject::SetPosition(float xpos, float ypos)
+{
+    mXPos = xpos;
+    mYPos = ypos;
+    mPrevXPos = xpos;
+    mPrevYPos = ypos;
+}
+
 bool MapObject::ContainsPoint(s32 x, s32 y) const
 {
     if (!mAnim)
@@ -439,11 +468,11 @@ void MapObject::SnapXToGrid()
     const s32 gridPos = (xpos - 12) % 25;
     if (gridPos >= 13)
     {
-        mXPos = static_cast<float>(xpos - gridPos + 25);
+        SetPosition(static_cast<float>(xpos - gridPos + 25), mYPos);
     }
     else
     {
-        mXPos = static_cast<float>(xpos - gridPos);
+        SetPosition(static_cast<float>(xpos - gridPos), mYPos);
     }
 
     LOG_INFO("SnapX: " << oldX << " to " << mXPos);
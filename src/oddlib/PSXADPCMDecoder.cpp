@@ -3,10 +3,19 @@
 #include <algorithm>
 #include "types.hpp"
 
-// Pos / neg Tables
-const short pos_adpcm_table[5] = { 0, +60, +115, +98, +122 };
-const short neg_adpcm_table[5] = { 0, 0, -52, -55, -60 };
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PSX_ADPCM_SSE 1
+#include <emmintrin.h>
+#endif
 
+// Samples in one block of both VAG and XA data
+static const u32 kBlockSamples = 28;
+
+// Pos / neg Tables, in 64ths
+static const s32 pos_adpcm_table[5] = { 0, +60, +115, +98, +122 };
+static const s32 neg_adpcm_table[5] = { 0, 0, -52, -55, -60 };
+
+#ifndef PSX_ADPCM_SSE
 static s8 Signed4bit(u8 number)
 {
     if ((number & 0x8) == 0x8)
@@ -18,56 +27,112 @@ static s8 Signed4bit(u8 number)
         return number;
     }
 }
+#endif
+
+// XA ranges 13 to 15 are reserved, the hardware treats them as 9. VAG keeps the shift as it is.
+static u32 ShiftRange(u8 range)
+{
+    return range > 12 ? 9 : range;
+}
 
-static int MinMax(int number, int min, int max)
+// Runs the prediction filter over a block of scaled nibbles. This is the only part that has to be
+// done a sample at a time as every sample depends on the two before it.
+static void Predict(const s32* scaled, u32 filter, s32& old, s32& older, s16* out, u32 outStride)
 {
-    if (number < min)
+    const s32 f0 = pos_adpcm_table[filter];
+    const s32 f1 = neg_adpcm_table[filter];
+    for (u32 i = 0; i < kBlockSamples; i++)
     {
-        return min;
+        // Division truncates toward zero, the same as the float code this replaced
+        const s32 sample = ((scaled[i] * 64) + (old * f0) + (older * f1) + 32) / 64;
+        const s16 clamped = static_cast<s16>(std::min(std::max(sample, -32768), 32767));
+
+        out[i * outStride] = clamped;
+        older = old;
+        old = clamped;
     }
+}
 
-    if (number > max)
+// The VAG version of Predict(). Sound banks have always been decoded by carrying the unrounded filter
+// output from sample to sample in doubles and wrapping the rounded result to 16 bits, this keeps them
+// sounding exactly as they did.
+static void PredictVag(const s32* scaled, u32 filter, f64& old, f64& older, s16* out)
+{
+    const f64 f0 = pos_adpcm_table[filter] / 64.0;
+    const f64 f1 = neg_adpcm_table[filter] / 64.0;
+    for (u32 i = 0; i < kBlockSamples; i++)
     {
-        return max;
+        const f64 sample = static_cast<f64>(scaled[i]) + old * f0 + older * f1;
+        older = old;
+        old = sample;
+        out[i] = static_cast<s16>(static_cast<u16>(static_cast<s32>(sample + 0.5)));
     }
+}
 
-    return number;
+#ifdef PSX_ADPCM_SSE
+// Each 32 bit lane holds a nibble in its top 4 bits, an arithmetic shift sign extends and scales it in one go
+static void StoreScaled(s32* out, __m128i topNibbles, __m128i range)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_sra_epi32(topNibbles, range));
 }
+#endif
 
-static int SignExtend(int s)
+// Sign extends and scales the 28 nibbles of a VAG block, low nibble of each byte first. Each nibble
+// goes to the top of 16 bits and is shifted right by range, which can be anything from 0 to 15.
+// data must be 16 bytes long for the SSE path, out 32 entries.
+static void ExpandVagBlock(const u8 (&data)[16], u32 range, s32 (&out)[32])
 {
-    if (s & 0x8000)
+#ifdef PSX_ADPCM_SSE
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i highNibbles = _mm_set1_epi8(static_cast<char>(0xF0));
+    const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(16 + range));
+
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    const __m128i lo = _mm_and_si128(_mm_slli_epi16(bytes, 4), highNibbles);
+    const __m128i hi = _mm_and_si128(bytes, highNibbles);
+
+    // Nibbles in sample order, each at the top of a byte
+    const __m128i nibbles[2] = { _mm_unpacklo_epi8(lo, hi), _mm_unpackhi_epi8(lo, hi) };
+    for (u32 i = 0; i < 2; i++)
+    {
+        const __m128i words[2] = { _mm_unpacklo_epi8(zero, nibbles[i]), _mm_unpackhi_epi8(zero, nibbles[i]) };
+        for (u32 j = 0; j < 2; j++)
+        {
+            s32* dst = out + (i * 16) + (j * 8);
+            StoreScaled(dst, _mm_unpacklo_epi16(zero, words[j]), shift);
+            StoreScaled(dst + 4, _mm_unpackhi_epi16(zero, words[j]), shift);
+        }
+    }
+#else
+    for (u32 i = 0; i < kBlockSamples / 2; i++)
     {
-        s |= 0xffff0000;
+        out[(i * 2)] = (Signed4bit(data[i] & 0xF) * 4096) >> range;
+        out[(i * 2) + 1] = (Signed4bit(data[i] >> 4) * 4096) >> range;
     }
-    return s;
+#endif
 }
 
-static void DecodeNibble(bool firstNibble, int shift, int filter, int d, f64& old, f64& older, FILE* pcm, std::vector<u8>* out = nullptr)
+// Sign extends and scales the 28 nibbles of one XA block, they are in byte "block" of each 32 bit word
+static void ExpandXaBlock(const u8 (&samples)[112], u32 block, u32 nibble, u32 range, s32 (&out)[kBlockSamples])
 {
-    const f64 f0 = static_cast<f64>(pos_adpcm_table[filter]) / 64.0f;
-    const f64 f1 = static_cast<f64>(neg_adpcm_table[filter]) / 64.0f;
-
-    int s = firstNibble ? (d & 0x0f) << 12 : (d & 0xf0) << 8;
-    s = SignExtend(s);
-    
-    const f64 sample = static_cast<f64>(s >> shift) + old * f0 + older * f1;
-
-    older = old;
-    old = sample;
-
-    const int x = (int)(sample + 0.5);
-    if (pcm)
+    const u32 bitOffset = (block * 8) + (nibble * 4);
+#ifdef PSX_ADPCM_SSE
+    // Shifting left drops everything above the nibble and the mask everything below, 4 words of 7 make up the block
+    const __m128i toTop = _mm_cvtsi32_si128(static_cast<int>(28 - bitOffset));
+    const __m128i topNibble = _mm_set1_epi32(static_cast<int>(0xF0000000));
+    const __m128i shift = _mm_cvtsi32_si128(static_cast<int>(16 + range));
+    for (u32 i = 0; i < kBlockSamples; i += 4)
     {
-        fputc(x & 0xff, pcm);
-        fputc(x >> 8, pcm);
+        const __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + (i * 4)));
+        StoreScaled(out + i, _mm_and_si128(_mm_sll_epi32(words, toTop), topNibble), shift);
     }
-
-    if (out)
+#else
+    const s32 scale = 1 << (12 - range);
+    for (u32 i = 0; i < kBlockSamples; i++)
     {
-        out->push_back(x & 0xff);
-        out->push_back(static_cast<u8>(x >> 8));
+        out[i] = Signed4bit(static_cast<u8>((samples[block + (i * 4)] >> (bitOffset - (block * 8))) & 0xF)) * scale;
     }
+#endif
 }
 
 void PSXADPCMDecoder::DecodeVagStream(Oddlib::IStream& s, std::vector<u8>& out)
@@ -75,17 +140,22 @@ void PSXADPCMDecoder::DecodeVagStream(Oddlib::IStream& s, std::vector<u8>& out)
     f64 old = 0.0;
     f64 older = 0.0;
 
+    // Only 14 bytes are used, the rest is padding for the SSE loads
+    u8 data[16] = {};
+    s32 scaled[32];
+    s16 pcm[kBlockSamples];
+
     for (;;)
     {
-        // Filter and shift nibbles
-        u8 filter = 0;
-        s.Read(filter);
-        const int shift = filter & 0xf;
-        filter >>= 4;
-
-        // Flags byte
-        u8 flags = 0;
-        s.Read(flags);
+        // Filter and shift nibbles then the flags byte
+        u8 header[2] = {};
+        s.ReadBytes(header, sizeof(header));
+        const u32 shift = header[0] & 0xf;
+
+        // Only 5 filters exist
+        const u32 filter = std::min(header[0] >> 4, 4);
+
+        const u8 flags = header[1];
         if (flags & 1) // EOF flag, checking for == 7 is wrong
         {
             break;
@@ -100,81 +170,69 @@ void PSXADPCMDecoder::DecodeVagStream(Oddlib::IStream& s, std::vector<u8>& out)
         }
 
         // 14 bytes of data
-        for (int i = 0; i < 28 / 2; i++)
+        s.ReadBytes(data, 14);
+        ExpandVagBlock(data, shift, scaled);
+        PredictVag(scaled, filter, old, older, pcm);
+
+        const size_t pos = out.size();
+        out.resize(pos + sizeof(pcm));
+        u8* dst = out.data() + pos;
+        for (u32 i = 0; i < kBlockSamples; i++)
         {
-            u8 tmp = 0;
-            s.Read(tmp);
-            DecodeNibble(true, shift, filter, tmp, old, older, nullptr, &out);
-            DecodeNibble(false, shift, filter, tmp, old, older, nullptr, &out);
+            dst[(i * 2)] = static_cast<u8>(pcm[i] & 0xff);
+            dst[(i * 2) + 1] = static_cast<u8>(static_cast<u16>(pcm[i]) >> 8);
         }
     }
-
 }
 
-template<class T>
 static void DecodeBlock(
-    T& out,
-    const u8(&samples)[112],
-    const u8(&parameters)[16],
-    u8 block,
-    u8 nibble,
-    short& dst,
-    f64& old,
-    f64& older)
+    s16* out,
+    const PSXADPCMDecoder::SoundFrame::SoundGroup& group,
+    u32 block,
+    u32 nibble,
+    s32& old,
+    s32& older)
 {
     // 4 blocks for each nibble, so 8 blocks total
-    const int shift = (u8)(12 - (parameters[4 + block * 2 + nibble] & 0xF));
-    const int filter = (s8)((parameters[4 + block * 2 + nibble] & 0x30) >> 4);
+    const u8 parameters = group.sound_parameters[4 + block * 2 + nibble];
+    const u32 range = ShiftRange(parameters & 0xF);
+    const u32 filter = (parameters & 0x30) >> 4;
 
-    const int f0 = pos_adpcm_table[filter];
-    const int f1 = neg_adpcm_table[filter];
-
-    for (int d = 0; d < 28; d++)
-    {
-        const u8 value = samples[block + d * 4];
-        const int t = Signed4bit((u8)((value >> (nibble * 4)) & 0xF));
-        int s = (short)((t << shift) + ((old * f0 + older * f1 + 32) / 64));
-        s = static_cast<u16>(MinMax(s, -32768, 32767));
-       
-
-        out[dst] = static_cast<short>(s);
-        dst += 2;
-
-        older = old;
-        old = static_cast<short>(s);
-    }
+    s32 scaled[kBlockSamples];
+    ExpandXaBlock(group.audio_sample_bytes, block, nibble, range, scaled);
+    Predict(scaled, filter, old, older, out, 2);
 }
 
-template<class T>
-static void Decode(const PSXADPCMDecoder::SoundFrame& sf, T& out)
+void PSXADPCMDecoder::DecodeFrameToPCM(s16* out, const u8* adpcmFrame)
 {
-    short dstLeft = 0;
-    static f64 oldLeft = 0;
-    static f64 olderLeft = 0;
-    
-    short dstRight = 1;
-    static f64 oldRight = 0;
-    static f64 olderRight = 0;
-
-    for (int i = 0; i<18; i++)
+    const SoundFrame& sf = *reinterpret_cast<const SoundFrame*>(adpcmFrame);
+
+    // Interleaved, the high nibbles are the left channel
+    s16* left = out;
+    s16* right = out + 1;
+    for (int i = 0; i < 18; i++)
     {
-        const PSXADPCMDecoder::SoundFrame::SoundGroup& sg = sf.sound_groups[i];
-        for (u8 b = 0; b < 4; b++)
+        const SoundFrame::SoundGroup& sg = sf.sound_groups[i];
+        for (u32 b = 0; b < 4; b++)
         {
-            DecodeBlock(out, sg.audio_sample_bytes, sg.sound_parameters, b, 1, dstLeft, oldLeft, olderLeft);
-            DecodeBlock(out, sg.audio_sample_bytes, sg.sound_parameters, b, 0, dstRight, oldRight, olderRight);
+            DecodeBlock(left, sg, b, 1, mOldLeft, mOlderLeft);
+            DecodeBlock(right, sg, b, 0, mOldRight, mOlderRight);
+            left += kBlockSamples * 2;
+            right += kBlockSamples * 2;
         }
     }
 }
 
 void PSXADPCMDecoder::DecodeFrameToPCM(std::vector<s16>& out, uint8_t* arg_adpcm_frame)
 {
-    const PSXADPCMDecoder::SoundFrame* sf = reinterpret_cast<const PSXADPCMDecoder::SoundFrame*>(arg_adpcm_frame);
-    Decode(*sf, out);
+    if (out.size() < kSamplesPerFrame)
+    {
+        out.resize(kSamplesPerFrame);
+    }
+    DecodeFrameToPCM(out.data(), arg_adpcm_frame);
 }
 
-void PSXADPCMDecoder::DecodeFrameToPCM(std::array<s16, 4032>& out, uint8_t *arg_adpcm_frame)
+void PSXADPCMDecoder::DecodeFrameToPCM(std::array<s16, kSamplesPerFrame>& out, uint8_t *arg_adpcm_frame)
 {
-    const PSXADPCMDecoder::SoundFrame* sf = reinterpret_cast<const PSXADPCMDecoder::SoundFrame*>(arg_adpcm_frame);
-    Decode(*sf, out);
-}
\ No newline at end of file
+    DecodeFrameToPCM(out.data(), arg_adpcm_frame);
+}
@@ -26,10 +26,17 @@
  */
 
 #include <memory.h>
+#include <algorithm>
+#include <array>
 
 #include "oddlib/PSXMDECDecoder.h"
 #include "types.hpp"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PSX_MDEC_SSE 1
+#include <emmintrin.h>
+#endif
+
 // This tables based on MPEG2DEC by MPEG Software Simulation Group
 #define CODE1(a,b,c) (((a)<<10)|((b)&0x3ff)|((c)<<16))
 #define CODE(a,b,c) CODE1(a,b,c+1),CODE1(a,-b,c+1)
@@ -222,22 +229,10 @@ const uint8_t PSXMDECDecoder::RL_ZSCAN_MATRIX[64] =
 
 PSXMDECDecoder::PSXMDECDecoder()
 {
-    BSRoundTableInit();
     IQTableInit();
 }
 
 
-void PSXMDECDecoder::BSRoundTableInit()
-{
-    for (uint16_t i = 0; i < 256; i++)
-    {
-        BSRoundTable[i] = 0;
-        BSRoundTable[i + 256] = static_cast<uint8_t>(i);
-        BSRoundTable[i + 512] = 255;
-    }
-}
-
-
 void PSXMDECDecoder::IQTableInit()
 {
     for (uint8_t i = 0; i < DCT_BLOCK_SIZE; i++)
@@ -246,7 +241,150 @@ void PSXMDECDecoder::IQTableInit()
 }
 
 
+#ifdef PSX_MDEC_SSE
+// (a * c) >> 8 cut down to 16 bits, the same as the scalar code storing it in an int16_t
+static __m128i MulShift8(__m128i a, int16_t c)
+{
+    const __m128i k = _mm_set1_epi16(c);
+    return _mm_or_si128(_mm_slli_epi16(_mm_mulhi_epi16(a, k), 8), _mm_srli_epi16(_mm_mullo_epi16(a, k), 8));
+}
+
+// Keeps the low 16 bits of each 32 bit lane, wrapping rather than saturating
+static __m128i Truncate32To16(__m128i lo, __m128i hi)
+{
+    return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(lo, 16), 16), _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16));
+}
+
+// ((a - b) * c) >> 8 where, like the scalar code, the difference is not cut down to 16 bits first
+static __m128i MulDiffShift8(__m128i a, __m128i b, int16_t c)
+{
+    const __m128i k = _mm_set_epi16(-c, c, -c, c, -c, c, -c, c);
+    const __m128i lo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(a, b), k), 8);
+    const __m128i hi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(a, b), k), 8);
+    return Truncate32To16(lo, hi);
+}
+
+// (a + b) >> shift and (a - b) >> shift worked out in 32 bits
+static void ButterflyShift(__m128i a, __m128i b, int shift, __m128i& sum, __m128i& difference)
+{
+    const __m128i count = _mm_cvtsi32_si128(shift);
+    const __m128i add = _mm_set1_epi16(1);
+    const __m128i sub = _mm_set_epi16(-1, 1, -1, 1, -1, 1, -1, 1);
+    const __m128i lo = _mm_unpacklo_epi16(a, b);
+    const __m128i hi = _mm_unpackhi_epi16(a, b);
+    sum = _mm_packs_epi32(_mm_sra_epi32(_mm_madd_epi16(lo, add), count), _mm_sra_epi32(_mm_madd_epi16(hi, add), count));
+    difference = _mm_packs_epi32(_mm_sra_epi32(_mm_madd_epi16(lo, sub), count), _mm_sra_epi32(_mm_madd_epi16(hi, sub), count));
+}
+
+static void Transpose8x8(__m128i (&v)[8])
+{
+    const __m128i a0 = _mm_unpacklo_epi16(v[0], v[1]);
+    const __m128i a1 = _mm_unpackhi_epi16(v[0], v[1]);
+    const __m128i a2 = _mm_unpacklo_epi16(v[2], v[3]);
+    const __m128i a3 = _mm_unpackhi_epi16(v[2], v[3]);
+    const __m128i a4 = _mm_unpacklo_epi16(v[4], v[5]);
+    const __m128i a5 = _mm_unpackhi_epi16(v[4], v[5]);
+    const __m128i a6 = _mm_unpacklo_epi16(v[6], v[7]);
+    const __m128i a7 = _mm_unpackhi_epi16(v[6], v[7]);
+
+    const __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+    const __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+    const __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+    const __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+    const __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+    const __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+    const __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+    const __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+    v[0] = _mm_unpacklo_epi64(b0, b4);
+    v[1] = _mm_unpackhi_epi64(b0, b4);
+    v[2] = _mm_unpacklo_epi64(b1, b5);
+    v[3] = _mm_unpackhi_epi64(b1, b5);
+    v[4] = _mm_unpacklo_epi64(b2, b6);
+    v[5] = _mm_unpackhi_epi64(b2, b6);
+    v[6] = _mm_unpacklo_epi64(b3, b7);
+    v[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+// One pass of IDCTScalar over 8 columns side by side, v[] holds the rows. The rows pass
+// is done by transposing first. Gives exactly the same results, overflow included.
+static void IDCTPassSse2(__m128i (&v)[8], int outputShift)
+{
+    __m128i z10 = _mm_add_epi16(v[0], v[4]);
+    __m128i z11 = _mm_sub_epi16(v[0], v[4]);
+    __m128i z13 = _mm_add_epi16(v[2], v[6]);
+    __m128i z12 = _mm_sub_epi16(MulDiffShift8(v[2], v[6], 362), z13);
+
+    const __m128i tmp0 = _mm_add_epi16(z10, z13);
+    const __m128i tmp3 = _mm_sub_epi16(z10, z13);
+    const __m128i tmp1 = _mm_add_epi16(z11, z12);
+    const __m128i tmp2 = _mm_sub_epi16(z11, z12);
+
+    z13 = _mm_add_epi16(v[3], v[5]);
+    z10 = _mm_sub_epi16(v[3], v[5]);
+    z11 = _mm_add_epi16(v[1], v[7]);
+    z12 = _mm_sub_epi16(v[1], v[7]);
+
+    const __m128i z5 = MulDiffShift8(z12, z10, 473);
+    const __m128i tmp7 = _mm_add_epi16(z11, z13);
+    const __m128i tmp6 = _mm_sub_epi16(_mm_add_epi16(MulShift8(z10, 669), z5), tmp7);
+    const __m128i tmp5 = _mm_sub_epi16(MulDiffShift8(z11, z13, 362), tmp6);
+    const __m128i tmp4 = _mm_add_epi16(_mm_sub_epi16(MulShift8(z12, 277), z5), tmp5);
+
+    if (outputShift == 0)
+    {
+        v[0] = _mm_add_epi16(tmp0, tmp7);
+        v[7] = _mm_sub_epi16(tmp0, tmp7);
+        v[1] = _mm_add_epi16(tmp1, tmp6);
+        v[6] = _mm_sub_epi16(tmp1, tmp6);
+        v[2] = _mm_add_epi16(tmp2, tmp5);
+        v[5] = _mm_sub_epi16(tmp2, tmp5);
+        v[4] = _mm_add_epi16(tmp3, tmp4);
+        v[3] = _mm_sub_epi16(tmp3, tmp4);
+    }
+    else
+    {
+        ButterflyShift(tmp0, tmp7, outputShift, v[0], v[7]);
+        ButterflyShift(tmp1, tmp6, outputShift, v[1], v[6]);
+        ButterflyShift(tmp2, tmp5, outputShift, v[2], v[5]);
+        ButterflyShift(tmp3, tmp4, outputShift, v[4], v[3]);
+    }
+}
+#endif
+
 void PSXMDECDecoder::IDCT(int16_t *arg_block, uint8_t arg_k)
+{
+    // Only the DC value is set, which is quicker to do as it is
+    if (arg_k <= 1)
+    {
+        IDCTScalar(arg_block, 0);
+        return;
+    }
+
+#ifdef PSX_MDEC_SSE
+    __m128i* rows = reinterpret_cast<__m128i*>(arg_block);
+    __m128i v[DCT_SIZE];
+    for (uint8_t i = 0; i < DCT_SIZE; i++)
+    {
+        v[i] = _mm_loadu_si128(rows + i);
+    }
+
+    IDCTPassSse2(v, 0);
+    Transpose8x8(v);
+    IDCTPassSse2(v, IDCT_PASS1_BITS + 3);
+    Transpose8x8(v);
+
+    for (uint8_t i = 0; i < DCT_SIZE; i++)
+    {
+        _mm_storeu_si128(rows + i, v[i]);
+    }
+#else
+    IDCTScalar(arg_block, arg_k);
+#endif
+}
+
+
+void PSXMDECDecoder::IDCTScalar(int16_t *arg_block, uint8_t arg_k)
 {
     if (!arg_k)
     {
@@ -350,13 +488,56 @@ void PSXMDECDecoder::IDCT(int16_t *arg_block, uint8_t arg_k)
 }
 
 
+// Finds the AC code at the top of a VLC_SBIT bit window, 0 if it isn't valid
+uint32_t PSXMDECDecoder::VLCLookup(uint32_t code)
+{
+    if (code >= 1 << (VLC_SBIT - 2))
+        return VLC_TABLE_NEXT[(code >> 12) - 8];
+    else if (code >= 1 << (VLC_SBIT - 6))
+        return VLC_TABLE_0[(code >> 8) - 8];
+    else if (code >= 1 << (VLC_SBIT - 7))
+        return VLC_TABLE_1[(code >> 6) - 16];
+    else if (code >= 1 << (VLC_SBIT - 8))
+        return VLC_TABLE_2[(code >> 4) - 32];
+    else if (code >= 1 << (VLC_SBIT - 9))
+        return VLC_TABLE_3[(code >> 3) - 32];
+    else if (code >= 1 << (VLC_SBIT - 10))
+        return VLC_TABLE_4[(code >> 2) - 32];
+    else if (code >= 1 << (VLC_SBIT - 11))
+        return VLC_TABLE_5[(code >> 1) - 32];
+    else if (code >= 1 << (VLC_SBIT - 12))
+        return VLC_TABLE_6[(code >> 0) - 32];
+    return 0;
+}
+
+
+// VLC_TABLE_NEXT to VLC_TABLE_2 merged into one table, indexed by the top VLC_FAST_BITS bits.
+// Longer codes have 0 entries and go through VLCLookup.
+const uint32_t* PSXMDECDecoder::VLCFastTable()
+{
+    static const std::array<uint32_t, 1 << VLC_FAST_BITS> table = []()
+    {
+        std::array<uint32_t, 1 << VLC_FAST_BITS> t = {};
+        const uint32_t shift = VLC_SBIT - VLC_FAST_BITS;
+        for (uint32_t i = (1 << (VLC_SBIT - 8)) >> shift; i < t.size(); i++)
+        {
+            t[i] = VLCLookup(i << shift);
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+
 void PSXMDECDecoder::DecodeDCTVLC(uint16_t *arg_mdec_rl,
-    uint16_t *arg_mdec_bs)
+    const uint16_t *arg_mdec_bs)
 {
-    *(int32_t *)arg_mdec_rl = *(int32_t *)arg_mdec_bs;
+    const uint32_t* fastTable = VLCFastTable();
+
+    *(int32_t *)arg_mdec_rl = *(const int32_t *)arg_mdec_bs;
     arg_mdec_rl += 2;
 
-    uint16_t *rl_end = arg_mdec_rl + (uint16_t)arg_mdec_bs[0] * 2;
+    const uint16_t *rl_end = arg_mdec_rl + (uint16_t)arg_mdec_bs[0] * 2;
     uint16_t q_code = (arg_mdec_bs[2] << 10);
     uint16_t version = arg_mdec_bs[3];
     arg_mdec_bs += 4;
@@ -439,41 +620,25 @@ void PSXMDECDecoder::DecodeDCTVLC(uint16_t *arg_mdec_rl,
                 incnt -= 16;
             }
 
-            code2 = (bitbuf >> (32 - VLC_SBIT));
-            if (code2 >= 1 << (VLC_SBIT - 2))
-            {
-                code2 = VLC_TABLE_NEXT[(code2 >> 12) - 8];
-                if (code2 == VLC_EOB_CODE)
-                    break;
-            }
-            else if (code2 >= 1 << (VLC_SBIT - 6))
+            const uint32_t window = (bitbuf >> (32 - VLC_SBIT));
+            code2 = fastTable[window >> (VLC_SBIT - VLC_FAST_BITS)];
+            if (!code2)
+                code2 = VLCLookup(window);
+
+            if (code2 == VLC_EOB_CODE)
+                break;
+            else if (code2 == VLC_ESCAPE_CODE)
             {
-                code2 = VLC_TABLE_0[(code2 >> 8) - 8];
-                if (code2 == VLC_ESCAPE_CODE)
+                bitbuf <<= 6;
+                incnt += 6;
+                while (incnt >= 0)
                 {
-                    bitbuf <<= 6;
-                    incnt += 6;
-                    while (incnt >= 0)
-                    {
-                        bitbuf |= *arg_mdec_bs++ << incnt;
-                        incnt -= 16;
-                    }
-                    code2 = (bitbuf >> (32 - 16)) | (16 << 16);
+                    bitbuf |= *arg_mdec_bs++ << incnt;
+                    incnt -= 16;
                 }
+                code2 = (bitbuf >> (32 - 16)) | (16 << 16);
             }
-            else if (code2 >= 1 << (VLC_SBIT - 7))
-                code2 = VLC_TABLE_1[(code2 >> 6) - 16];
-            else if (code2 >= 1 << (VLC_SBIT - 8))
-                code2 = VLC_TABLE_2[(code2 >> 4) - 32];
-            else if (code2 >= 1 << (VLC_SBIT - 9))
-                code2 = VLC_TABLE_3[(code2 >> 3) - 32];
-            else if (code2 >= 1 << (VLC_SBIT - 10))
-                code2 = VLC_TABLE_4[(code2 >> 2) - 32];
-            else if (code2 >= 1 << (VLC_SBIT - 11))
-                code2 = VLC_TABLE_5[(code2 >> 1) - 32];
-            else if (code2 >= 1 << (VLC_SBIT - 12))
-                code2 = VLC_TABLE_6[(code2 >> 0) - 32];
-            else
+            else if (!code2)
             {
                 do
                 {
@@ -521,121 +686,209 @@ uint16_t *PSXMDECDecoder::RL2BLK(uint16_t *arg_mdec_rl, int16_t *arg_blk)
     return arg_mdec_rl;
 }
 
-// An overly used bit of code in the YUV2BGRA32 function. Instead of huge code repeats, this will
-// make things much more nicer.
-void PSXMDECDecoder::YUVfunction1(uint8_t arg_image[][4], int index, int r0, int g0, int b0, int y)
+// Corrupt data can take a value well past the 0-255 range
+static uint8_t Saturate(int value)
 {
-    const int red = 2;
-    const int green = 1;
-    const int blue = 0;
-    const int alpha = 3;
-
-    arg_image[index][red] = BSRoundTable[r0 + y + 256];
-    arg_image[index][green] = BSRoundTable[g0 + y + 256];
-    arg_image[index][blue] = BSRoundTable[b0 + y + 256];
-    arg_image[index][alpha] = 0xFF;
+    return static_cast<uint8_t>(std::min(std::max(value, 0), 255));
 }
 
-// Old code was a mess. New code should be much better.
-// Could be cleaned up even more, but theres no need at the moment.
-void PSXMDECDecoder::YUV2BGRA32(int16_t *arg_blk,
-    uint8_t arg_image[][4])
+// Writes a 16x16 macro block as RGBA, cut down to arg_width x arg_height where it overhangs the frame
+void PSXMDECDecoder::YUV2RGBA32(const int16_t *arg_blk,
+    uint8_t *arg_image,
+    uint32_t arg_pitch,
+    uint16_t arg_width,
+    uint16_t arg_height)
 {
-    f64 rConstant = 1.402;
-    f64 gConstant = -0.3437;
-    f64 g2Constant = -0.7143;
-    f64 bConstant = 1.772;
+    const f64 rConstant = 1.402;
+    const f64 gConstant = -0.3437;
+    const f64 g2Constant = -0.7143;
+    const f64 bConstant = 1.772;
+
+    // Colour differences for each 2x2 quad, the Cr block comes before the Cb one
+    int16_t r0[DCT_BLOCK_SIZE];
+    int16_t g0[DCT_BLOCK_SIZE];
+    int16_t b0[DCT_BLOCK_SIZE];
+    for (uint8_t i = 0; i < DCT_BLOCK_SIZE; i++)
+    {
+        r0[i] = static_cast<int16_t>(arg_blk[i] * rConstant);
+        g0[i] = static_cast<int16_t>((arg_blk[DCT_BLOCK_SIZE + i] * gConstant) + (arg_blk[i] * g2Constant));
+        b0[i] = static_cast<int16_t>(arg_blk[DCT_BLOCK_SIZE + i] * bConstant);
+    }
 
-    int16_t *yblk = arg_blk + DCT_BLOCK_SIZE * 2;
-    for (uint8_t yy = 0; yy < 16; yy += 2, arg_blk += 4, yblk += 8,
-        arg_image += 24)
+    // Y blocks are top left, top right, bottom left, bottom right
+    const int16_t *yblk = arg_blk + DCT_BLOCK_SIZE * 2;
+    for (uint16_t y = 0; y < arg_height; y++)
     {
-        if (yy == 8)
-            yblk += DCT_BLOCK_SIZE;
-        for (uint8_t x = 0; x < 4; x++, arg_blk++, yblk += 2, arg_image += 2)
+        const int16_t *left = yblk + (y >= DCT_SIZE ? DCT_BLOCK_SIZE * 2 : 0) + (y % DCT_SIZE) * DCT_SIZE;
+        const int16_t *right = left + DCT_BLOCK_SIZE;
+        const uint8_t chroma = (y / 2) * DCT_SIZE;
+        uint8_t *dst = arg_image + y * arg_pitch;
+
+#ifdef PSX_MDEC_SSE
+        const __m128i bias = _mm_set1_epi16(128);
+        const __m128i lumaLeft = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(left)), bias);
+        const __m128i lumaRight = _mm_add_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(right)), bias);
+
+        // Each chroma value covers 2 pixels across, packing saturates to 0-255
+        __m128i channels[3];
+        const int16_t *differences[3] = { r0 + chroma, g0 + chroma, b0 + chroma };
+        for (int c = 0; c < 3; c++)
         {
-            int16_t r0, g0, b0;
-
-            // Set up YUV stuff
-            r0 = static_cast<int16_t>(arg_blk[DCT_BLOCK_SIZE] * rConstant);
-            g0 = static_cast<int16_t>((arg_blk[0] * gConstant) + (arg_blk[DCT_BLOCK_SIZE] * g2Constant));
-            b0 = static_cast<int16_t>(arg_blk[0] * bConstant);
-
-            int16_t y = yblk[0] + 128;
-            YUVfunction1(arg_image, 0, r0, g0, b0, y);
-
-            y = yblk[1] + 128;
-            YUVfunction1(arg_image, 1, r0, g0, b0, y);
-
-            y = yblk[8] + 128;
-            YUVfunction1(arg_image, 16, r0, g0, b0, y);
-
-            y = yblk[9] + 128;
-            YUVfunction1(arg_image, 17, r0, g0, b0, y);
-
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(differences[c]));
+            channels[c] = _mm_packus_epi16(
+                _mm_add_epi16(lumaLeft, _mm_unpacklo_epi16(d, d)),
+                _mm_add_epi16(lumaRight, _mm_unpackhi_epi16(d, d)));
+        }
 
-            // Set up YUV stuff again
-            r0 = static_cast<int16_t>(arg_blk[4 + DCT_BLOCK_SIZE] * rConstant);
-            g0 = static_cast<int16_t>((arg_blk[4] * gConstant) + (arg_blk[4 + DCT_BLOCK_SIZE] * g2Constant));
-            b0 = static_cast<int16_t>(arg_blk[4] * bConstant);
+        const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+        const __m128i rgLo = _mm_unpacklo_epi8(channels[0], channels[1]);
+        const __m128i rgHi = _mm_unpackhi_epi8(channels[0], channels[1]);
+        const __m128i baLo = _mm_unpacklo_epi8(channels[2], alpha);
+        const __m128i baHi = _mm_unpackhi_epi8(channels[2], alpha);
 
-            y = yblk[DCT_BLOCK_SIZE + 0] + 128;
-            YUVfunction1(arg_image, 8, r0, g0, b0, y);
+        __m128i pixels[4] =
+        {
+            _mm_unpacklo_epi16(rgLo, baLo),
+            _mm_unpackhi_epi16(rgLo, baLo),
+            _mm_unpacklo_epi16(rgHi, baHi),
+            _mm_unpackhi_epi16(rgHi, baHi)
+        };
 
-            y = yblk[DCT_BLOCK_SIZE + 1] + 128;
-            YUVfunction1(arg_image, 9, r0, g0, b0, y);
+        if (arg_width == 16)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst) + i, pixels[i]);
+            }
+        }
+        else
+        {
+            memcpy(dst, pixels, arg_width * 4);
+        }
+#else
+        for (uint16_t x = 0; x < arg_width; x++)
+        {
+            const int luma = (x < DCT_SIZE ? left[x] : right[x - DCT_SIZE]) + 128;
+            const uint8_t c = chroma + (x / 2);
+            dst[(x * 4) + 0] = Saturate(r0[c] + luma);
+            dst[(x * 4) + 1] = Saturate(g0[c] + luma);
+            dst[(x * 4) + 2] = Saturate(b0[c] + luma);
+            dst[(x * 4) + 3] = 0xFF;
+        }
+#endif
+    }
+}
 
-            y = yblk[DCT_BLOCK_SIZE + 8] + 128;
-            YUVfunction1(arg_image, 24, r0, g0, b0, y);
+// Writes a 16x16 macro block into the planes, cut down to arg_width x arg_height where it overhangs the frame
+void PSXMDECDecoder::YUV2Planes(const int16_t *arg_blk,
+    uint8_t *arg_y,
+    uint8_t *arg_cb,
+    uint8_t *arg_cr,
+    uint32_t arg_y_pitch,
+    uint32_t arg_chroma_pitch,
+    uint16_t arg_width,
+    uint16_t arg_height)
+{
+    const int16_t *yblk = arg_blk + DCT_BLOCK_SIZE * 2;
+    for (uint16_t y = 0; y < arg_height; y++)
+    {
+        const int16_t *left = yblk + (y >= DCT_SIZE ? DCT_BLOCK_SIZE * 2 : 0) + (y % DCT_SIZE) * DCT_SIZE;
+        const int16_t *right = left + DCT_BLOCK_SIZE;
+        uint8_t *dst = arg_y + y * arg_y_pitch;
+        for (uint16_t x = 0; x < arg_width; x++)
+        {
+            dst[x] = Saturate((x < DCT_SIZE ? left[x] : right[x - DCT_SIZE]) + 128);
+        }
+    }
 
-            y = yblk[DCT_BLOCK_SIZE + 9] + 128;
-            YUVfunction1(arg_image, 25, r0, g0, b0, y);
+    const uint16_t chromaWidth = (arg_width + 1) / 2;
+    const uint16_t chromaHeight = (arg_height + 1) / 2;
+    for (uint16_t y = 0; y < chromaHeight; y++)
+    {
+        for (uint16_t x = 0; x < chromaWidth; x++)
+        {
+            const uint8_t c = (y * DCT_SIZE) + x;
+            arg_cr[(y * arg_chroma_pitch) + x] = Saturate(arg_blk[c] + 128);
+            arg_cb[(y * arg_chroma_pitch) + x] = Saturate(arg_blk[DCT_BLOCK_SIZE + c] + 128);
         }
     }
 }
 
-uint8_t PSXMDECDecoder::DecodeFrameToABGR32(uint16_t *arg_decoded_image,
+uint8_t PSXMDECDecoder::DecodeFrameToRGBA32(uint16_t *arg_decoded_image,
     uint16_t *arg_bs_image,
     uint16_t arg_width,
     uint16_t arg_height)
 {
-    uint16_t *rl = new uint16_t[(arg_bs_image[0] + 2) * sizeof(int32_t)];
-    DecodeDCTVLC(rl, arg_bs_image);
+    DecodeFrameToRGBA32(reinterpret_cast<uint8_t*>(arg_decoded_image), arg_width * 4, arg_bs_image, arg_width, arg_height);
+    return 0;
+}
 
-    uint16_t *tmp_rl = rl;
-    tmp_rl += 2;
+void PSXMDECDecoder::DecodeFrameToRGBA32(uint8_t *arg_decoded_image,
+    uint32_t arg_pitch,
+    const uint16_t *arg_bs_image,
+    uint16_t arg_width,
+    uint16_t arg_height)
+{
+    const size_t rlSize = (arg_bs_image[0] + 2) * sizeof(int32_t);
+    if (mRunLengths.size() < rlSize)
+    {
+        mRunLengths.resize(rlSize);
+    }
+    DecodeDCTVLC(mRunLengths.data(), arg_bs_image);
 
-    uint8_t color_bytes = 4;
-    uint8_t w = color_bytes * 8;
-    uint16_t height2 = (arg_height + 15) &~15;
-    uint16_t *image = new uint16_t[height2 * w * sizeof(int16_t)];
-    uint16_t slice = height2 * w / 2;
-    arg_width = arg_width * color_bytes / 2;
-    for (uint16_t x = 0; x < arg_width; x += w)
+    uint16_t *tmp_rl = mRunLengths.data() + 2;
+
+    // Macro blocks go down a 16 pixel wide column before moving across to the next one
+    const uint16_t numMacroBlocksY = (arg_height + 15) / 16;
+    int16_t blk[DCT_BLOCK_SIZE * 6];
+    for (uint16_t x = 0; x < arg_width; x += 16)
     {
-        uint16_t *arg_image = image;
-        uint16_t arg_size = slice;
-        int16_t blk[DCT_BLOCK_SIZE * 6];
-        uint16_t blocksize = 16 * 16 * color_bytes / 2;
-        for (; arg_size > 0; arg_size -= blocksize / 2, arg_image += blocksize)
+        for (uint16_t mb = 0; mb < numMacroBlocksY; mb++)
         {
+            const uint16_t y = mb * 16;
             tmp_rl = RL2BLK(tmp_rl, blk);
-            YUV2BGRA32(blk, (uint8_t(*)[4])arg_image);
+            YUV2RGBA32(blk,
+                arg_decoded_image + (y * arg_pitch) + (x * 4),
+                arg_pitch,
+                static_cast<uint16_t>(std::min(16, arg_width - x)),
+                static_cast<uint16_t>(std::min(16, arg_height - y)));
         }
+    }
+}
+
+void PSXMDECDecoder::DecodeFrameToYCbCr420(uint8_t *arg_y,
+    uint8_t *arg_cb,
+    uint8_t *arg_cr,
+    const uint16_t *arg_bs_image,
+    uint16_t arg_width,
+    uint16_t arg_height)
+{
+    const size_t rlSize = (arg_bs_image[0] + 2) * sizeof(int32_t);
+    if (mRunLengths.size() < rlSize)
+    {
+        mRunLengths.resize(rlSize);
+    }
+    DecodeDCTVLC(mRunLengths.data(), arg_bs_image);
 
+    uint16_t *tmp_rl = mRunLengths.data() + 2;
 
-        uint16_t *src = image;
-        uint16_t *dst = arg_decoded_image + x;
-        for (int16_t y = arg_height - 1; y >= 0; y--)
+    const uint32_t chromaPitch = (arg_width + 1) / 2;
+    const uint16_t numMacroBlocksY = (arg_height + 15) / 16;
+    int16_t blk[DCT_BLOCK_SIZE * 6];
+    for (uint16_t x = 0; x < arg_width; x += 16)
+    {
+        for (uint16_t mb = 0; mb < numMacroBlocksY; mb++)
         {
-            memcpy(dst, src, w * 2);
-            src += w;
-            dst += arg_width;
+            const uint16_t y = mb * 16;
+            tmp_rl = RL2BLK(tmp_rl, blk);
+            YUV2Planes(blk,
+                arg_y + (y * arg_width) + x,
+                arg_cb + ((y / 2) * chromaPitch) + (x / 2),
+                arg_cr + ((y / 2) * chromaPitch) + (x / 2),
+                arg_width,
+                chromaPitch,
+                static_cast<uint16_t>(std::min(16, arg_width - x)),
+                static_cast<uint16_t>(std::min(16, arg_height - y)));
         }
     }
-    delete[] image;
-    delete[] rl;
-
-    return 0;
 }
-
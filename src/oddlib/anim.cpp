@@ -11,6 +11,7 @@
 #include "oddlib/sdl_raii.hpp"
 #include <assert.h>
 #include <array>
+#include <algorithm>
 
 namespace Oddlib
 {
@@ -53,6 +54,8 @@ namespace Oddlib
         mMaxW = as.MaxW();
         mMaxH = as.MaxH();
 
+        MakePalette(as);
+
         // Add all frames
         for (auto it : as.UniqueFrames())
         {
@@ -73,8 +76,7 @@ namespace Oddlib
 
     SDL_SurfacePtr AnimationSet::MakeFrame(AnimSerializer& as, const AnimSerializer::DecodedFrame& df, u32 offsetData)
     {
-        std::vector<u32> pixels;
-        auto frame = as.ApplyPalleteToFrame(df.mFrameHeader, df.mFixedWidth, df.mPixelData, pixels);
+        const std::vector<u8> indices = as.UnpackFrameIndices(df.mFrameHeader, df.mPixelData);
 
         SDL_Rect dstRect;
         dstRect.x = 0;
@@ -114,14 +116,53 @@ namespace Oddlib
             srcRect.h = df.mFrameHeader.mHeight;
         }
 
-        const auto red_mask = 0x000000ff;
-        const auto green_mask = 0x0000ff00;
-        const auto blue_mask = 0x00ff0000;
-        const auto alpha_mask = 0xff000000;
-        SDL_SurfacePtr tmp(SDL_CreateRGBSurface(0, dstRect.w, dstRect.h, 32, red_mask, green_mask, blue_mask, alpha_mask));
+        std::vector<u8>& pixels = mFramePixels[offsetData];
+        pixels.assign(dstRect.w * dstRect.h, 0);
+
+        // Clip the source rect against the decoded frame in the same way SDL_BlitSurface would
+        const s32 copyW = std::max(0, std::min(srcRect.w, static_cast<s32>(df.mFrameHeader.mWidth) - srcRect.x));
+        const s32 copyH = std::max(0, std::min(srcRect.h, static_cast<s32>(df.mFrameHeader.mHeight) - srcRect.y));
+        for (s32 y = 0; y < copyH; y++)
+        {
+            const u8* srcRow = indices.data() + ((srcRect.y + y) * df.mFixedWidth) + srcRect.x;
+            std::copy(srcRow, srcRow + copyW, pixels.data() + (y * dstRect.w));
+        }
+
+        // Indexed surface over our own tightly packed buffer so the pixels can be uploaded as is
+        SDL_SurfacePtr surface(SDL_CreateRGBSurfaceFrom(pixels.data(), dstRect.w, dstRect.h, 8, dstRect.w, 0, 0, 0, 0));
+        if (!surface)
+        {
+            throw Exception("Failed to create indexed frame surface");
+        }
+        SDL_SetSurfacePalette(surface.get(), mSdlPalette.get());
+        return surface;
+    }
+
+    void AnimationSet::MakePalette(const AnimSerializer& as)
+    {
+        const std::vector<u32>& palt = as.Pallete();
+        const u32 count = std::min(static_cast<u32>(palt.size()), kPaletteSize);
+
+        mPalette.assign(kPaletteSize, 0);
+        std::array<SDL_Color, kPaletteSize> colours = {};
+        for (u32 i = 0; i < count; i++)
+        {
+            // Premultiply so the colours match what blending the frames onto a blank RGBA surface used to produce
+            const u32 a = palt[i] & 0xff;
+            const u32 r = (((palt[i] >> 24) & 0xff) * a) / 255;
+            const u32 g = (((palt[i] >> 16) & 0xff) * a) / 255;
+            const u32 b = (((palt[i] >> 8) & 0xff) * a) / 255;
 
-        SDL_BlitSurface(frame.get(), &srcRect, tmp.get(), &dstRect);
-        return tmp;
+            mPalette[i] = r | (g << 8) | (b << 16) | (a << 24);
+            colours[i] = SDL_Color{ static_cast<u8>(r), static_cast<u8>(g), static_cast<u8>(b), static_cast<u8>(a) };
+        }
+
+        mSdlPalette.reset(SDL_AllocPalette(kPaletteSize));
+        if (!mSdlPalette)
+        {
+            throw Exception("Failed to allocate frame palette");
+        }
+        SDL_SetPaletteColors(mSdlPalette.get(), colours.data(), 0, kPaletteSize);
     }
 
     u32 AnimationSet::NumberOfAnimations() const
@@ -550,16 +591,20 @@ namespace Oddlib
         return decompressedData;
     }
 
-    u32 AnimSerializer::GetPaltValue(u32 idx)
+    u8 AnimSerializer::ClampPaltIndex(u32 idx) const
     {
         // ABEEND.BAN from the AO PSX demo goes out of bounds - probably why the resulting
         // beta image looks quite strange.
         if (idx >= mPalt.size())
         {
-            idx = static_cast<unsigned char>(mPalt.size() - 1);
+            return static_cast<u8>(mPalt.size() - 1);
         }
-        
-        return mPalt[idx];
+        return static_cast<u8>(idx);
+    }
+
+    u32 AnimSerializer::GetPaltValue(u32 idx)
+    {
+        return mPalt[ClampPaltIndex(idx)];
     }
 
     SDL_SurfacePtr AnimSerializer::ApplyPalleteToFrame(const FrameHeader& header, u32 realWidth, const std::vector<u8>& decompressedData, std::vector<u32>& pixels)
@@ -609,6 +654,33 @@ namespace Oddlib
         }
     }
 
+    std::vector<u8> AnimSerializer::UnpackFrameIndices(const FrameHeader& header, const std::vector<u8>& decompressedData) const
+    {
+        std::vector<u8> indices;
+        if (header.mColourDepth == 8)
+        {
+            indices.reserve(decompressedData.size());
+            for (auto v : decompressedData)
+            {
+                indices.push_back(ClampPaltIndex(v));
+            }
+        }
+        else if (header.mColourDepth == 4)
+        {
+            indices.reserve(decompressedData.size() * 2);
+            for (auto v : decompressedData)
+            {
+                indices.push_back(ClampPaltIndex(LO_NIBBLE(v)));
+                indices.push_back(ClampPaltIndex(HI_NIBBLE(v)));
+            }
+        }
+        else
+        {
+            abort();
+        }
+        return indices;
+    }
+
     AnimSerializer::DecodedFrame AnimSerializer::ReadAndDecompressFrame(u32 frameOffset)
     {
         DecodedFrame ret;
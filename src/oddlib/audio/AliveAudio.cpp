@@ -1,135 +1,194 @@
 #include "oddlib/audio/AliveAudio.h"
+#include "oddlib/audio/MixKernels.h"
 #include "imgui/imgui.h"
+#include "logger.hpp"
 
-void AliveAudio::CleanVoices()
+AliveAudio::AliveAudio()
+{
+    ReserveVoices(kAliveAudioDefaultVoices);
+}
+
+void AliveAudio::ReserveVoices(u32 count)
+{
+    m_Voices.Reset(count);
+
+    // Each note is at most a note on and a delayed note off
+    mCommands.Reset((count * 2) + 64);
+    mQueuedNoteOnCount = 0;
+    mActiveVoiceCount = 0;
+    mStolenVoiceCount = 0;
+}
+
+void AliveAudio::PushCommand(const AliveAudioCommand& cmd)
 {
-    std::vector<AliveAudioVoice *> deadVoices;
-    std::unique_lock<std::recursive_mutex> voiceLock(mVoiceMutex);
-    for (auto& voice : m_Voices)
+    if (cmd.mType == eAliveAudioCommands::eNoteOn)
     {
-        if (voice->b_Dead)
+        // Counted before it is visible to the audio thread so NumberOfActiveVoices() never dips to 0 in between
+        mQueuedNoteOnCount++;
+    }
+
+    if (!mCommands.Push(cmd))
+    {
+        LOG_WARNING("AliveAudio command queue is full, dropping command");
+        if (cmd.mType == eAliveAudioCommands::eNoteOn)
         {
-            deadVoices.push_back(voice);
+            mQueuedNoteOnCount--;
+            mDroppedNoteCount++;
         }
     }
+}
 
-    for (auto& obj : deadVoices)
+void AliveAudio::ProcessCommands()
+{
+    AliveAudioCommand cmd;
+    while (mCommands.Pop(cmd))
     {
-        delete obj;
-
-        m_Voices.erase(std::remove(m_Voices.begin(), m_Voices.end(), obj), m_Voices.end());
+        ExecuteCommand(cmd);
+        if (cmd.mType == eAliveAudioCommands::eNoteOn)
+        {
+            mQueuedNoteOnCount--;
+        }
     }
 }
 
-void AliveAudio::AliveRenderAudio(f32 * AudioStream, int StreamLength)
+void AliveAudio::ExecuteCommand(const AliveAudioCommand& cmd)
 {
-    // Reset buffers
-    for (int i = 0; i < StreamLength; ++i)
+    switch (cmd.mType)
     {
-        m_DryChannelBuffer[i] = 0;
-        m_ReverbChannelBuffer[i] = 0;
+    case eAliveAudioCommands::eNoteOn:
+        DoNoteOn(cmd);
+        mActiveVoiceCount = m_Voices.ActiveCount();
+        mStolenVoiceCount = m_Voices.StolenCount();
+        break;
+
+    case eAliveAudioCommands::eNoteOff:
+        DoNoteOff(cmd);
+        break;
+
+    case eAliveAudioCommands::eClearAllVoices:
+    case eAliveAudioCommands::eClearAllTrackVoices:
+        DoClearVoices(cmd.mForceKill);
+        break;
+
+    case eAliveAudioCommands::eStartSequence:
+        mCurrentSampleIndex = 0;
+        mNextSequenceEvent = 0;
+        mSequencePlaying = true;
+        mSequenceStartsDone++;
+        break;
+
+    case eAliveAudioCommands::eStopSequence:
+        mSequencePlaying = false;
+        break;
     }
+}
 
+void AliveAudio::DispatchDueSequenceEvents()
+{
+    if (!mSequencePlaying)
     {
-        std::unique_lock<std::recursive_mutex> voiceLock(mVoiceMutex);
-        const size_t voiceCount = m_Voices.size();
+        return;
+    }
 
-        AliveAudioVoice ** rawPointer = m_Voices.data(); // Real nice speed boost here.
+    // Priority can change after the sequence is loaded, so it is read as each note starts
+    const u8 priority = Priority;
+    while (mNextSequenceEvent < mSequence.size() && mSequence[mNextSequenceEvent].mSample <= mCurrentSampleIndex)
+    {
+        AliveAudioCommand cmd = mSequence[mNextSequenceEvent].mCommand;
+        cmd.mPriority = priority;
+        ExecuteCommand(cmd);
+        mNextSequenceEvent++;
+    }
 
-        for (int i = 0; i < StreamLength; i += 2)
-        {
-            for (size_t v = 0; v < voiceCount; v++)
-            {
-                AliveAudioVoice * voice = rawPointer[v]; // Raw pointer skips all that vector bottleneck crap
+    if (mNextSequenceEvent >= mSequence.size())
+    {
+        mSequencePlaying = false;
+    }
+}
 
-                voice->f_TrackDelay--;
+u32 AliveAudio::FramesUntilNextSequenceEvent(u32 maxFrames) const
+{
+    if (!mSequencePlaying || mNextSequenceEvent >= mSequence.size())
+    {
+        return maxFrames;
+    }
 
-                if (voice->m_UsesNoteOffDelay)
-                {
-                    voice->f_NoteOffDelay--;
-                }
+    const u64 frames = mSequence[mNextSequenceEvent].mSample - mCurrentSampleIndex;
+    return frames < maxFrames ? static_cast<u32>(frames) : maxFrames;
+}
 
-                if (voice->m_UsesNoteOffDelay && voice->f_NoteOffDelay <= 0 && voice->b_NoteOn == true)
-                {
-                    voice->b_NoteOn = false;
-                    //printf("off");
-                }
+void AliveAudio::CleanVoices()
+{
+    m_Voices.Collect();
+    mActiveVoiceCount = m_Voices.ActiveCount();
+}
 
-                if (voice->b_Dead || voice->f_TrackDelay > 0)
-                {
-                    continue;
-                }
+void AliveAudio::AliveRenderAudio(AliveAudioMixBus& bus, u32 StreamLength)
+{
+    ProcessCommands();
 
-                f32 centerPan = voice->m_Tone->f_Pan;
-                f32 leftPan = 1.0f;
-                f32 rightPan = 1.0f;
+    // Each voice renders a whole block of mono frames which then gets panned into the dry or reverb bus.
+    // Blocks are cut short at the next sequence event so notes start and stop on the exact sample.
+    const u32 totalFrames = StreamLength / 2;
+    u32 frames = 0;
+    for (u32 blockStart = 0; blockStart < totalFrames; blockStart += frames)
+    {
+        DispatchDueSequenceEvents();
 
-                if (centerPan > 0)
-                {
-                    leftPan = 1.0f - std::abs(centerPan);
-                }
+        // With no voices playing there is nothing to render until the next event, so skip straight to it
+        const u32 remaining = totalFrames - blockStart;
+        frames = FramesUntilNextSequenceEvent(m_Voices.ActiveCount() > 0 ? std::min(kAliveAudioMixBlockFrames, remaining) : remaining);
+        for (u32 i = 0; i < m_Voices.ActiveCount(); i++)
+        {
+            AliveAudioVoice& voice = m_Voices.Active(i);
+            if (!voice.Render(m_VoiceBuffer, frames, Interpolation))
+            {
+                continue;
+            }
 
-                if (centerPan < 0)
-                {
-                    rightPan = 1.0f - std::abs(centerPan);
-                }
+            f32 centerPan = voice.m_Tone->f_Pan;
+            f32 leftPan = 1.0f;
+            f32 rightPan = 1.0f;
 
-                // TODO FIX ME
-                f32  s = voice->GetSample(Interpolation, false);
-                f32 leftSample = (s * leftPan);
-                f32 rightSample = (s * rightPan);
+            if (centerPan > 0)
+            {
+                leftPan = 1.0f - std::abs(centerPan);
+            }
 
-                if (voice->m_Tone->Reverbate || ForceReverb)
-                {
-                    m_ReverbChannelBuffer[i] += leftSample;
-                    m_ReverbChannelBuffer[i + 1] += rightSample;
-                }
-                else
-                {
-                    m_DryChannelBuffer[i] += leftSample;
-                    m_DryChannelBuffer[i + 1] += rightSample;
-                }
+            if (centerPan < 0)
+            {
+                rightPan = 1.0f - std::abs(centerPan);
             }
 
-            mCurrentSampleIndex++;
+            f32* target = (voice.m_Tone->Reverbate || ForceReverb) ? bus.ReverbSend() : bus.Dry();
+            MixKernels::MixMonoToStereo(target + (blockStart * 2), m_VoiceBuffer, frames, leftPan, rightPan);
         }
-    }
 
-    m_Reverb.setEffectMix(ReverbMix);
-
-    // TODO: Find a better way of feeding the data in
-    for (int i = 0; i < StreamLength; i += 2)
-    {
-        const f32 left = static_cast<f32>(m_Reverb.tick(m_ReverbChannelBuffer[i], m_ReverbChannelBuffer[i + 1], 0));
-        const f32 right = static_cast<f32>(m_Reverb.lastOut(1));
-        m_ReverbChannelBuffer[i] = left;
-        m_ReverbChannelBuffer[i + 1] = right;
-    }
-   
-    for (int i = 0; i < StreamLength; i += 2)
-    {
-        const f32 left = m_DryChannelBuffer[i] + m_ReverbChannelBuffer[i];
-        const f32 right = m_DryChannelBuffer[i + 1] + m_ReverbChannelBuffer[i + 1];
-        SDL_MixAudioFormat((u8 *)(AudioStream + i), (const u8*)&left, AUDIO_F32, sizeof(f32), SDL_MIX_MAXVOLUME);
-        SDL_MixAudioFormat((u8 *)(AudioStream + i + 1), (const u8*)&right, AUDIO_F32, sizeof(f32), SDL_MIX_MAXVOLUME);
+        mCurrentSampleIndex += frames;
     }
 
     CleanVoices();
 }
 
-
 void AliveAudio::Play(f32* stream, u32 len)
 {
-    if (m_DryChannelBuffer.size() != len)
+    if (!m_PrivateBus)
     {
-        // Maybe it's ok to have some crackles when the buffer size changes.
-        // (This allocates memory, which you should never do in audio thread.)
-        m_DryChannelBuffer.resize(len);
-        m_ReverbChannelBuffer.resize(len);
+        m_PrivateBus = std::make_unique<AliveAudioMixBus>();
     }
 
+    for (u32 offset = 0; offset < len; offset += kAliveAudioMixBusMaxSamples)
+    {
+        const u32 samples = std::min(kAliveAudioMixBusMaxSamples, len - offset);
+        m_PrivateBus->Begin(samples);
+        AliveRenderAudio(*m_PrivateBus, samples);
+        m_PrivateBus->Resolve(stream + offset, samples);
+    }
+}
 
-    AliveRenderAudio(stream, len);
+void AliveAudio::Mix(AliveAudioMixBus& bus, u32 len)
+{
+    AliveRenderAudio(bus, len);
 }
 
 void AliveAudio::VabBrowserUi()
@@ -213,116 +272,134 @@ void AliveAudio::PlayOneShot(std::string soundID)
 
 void AliveAudio::NoteOn(int program, int note, char velocity, f64 trackDelay, f64 pitch, bool ignoreLoops)
 {
-    for (auto& tone : m_Soundbank->m_Programs[program]->m_Tones)
-    {
-        if (note >= tone->Min && note <= tone->Max)
-        {
-            AliveAudioVoice * voice = new AliveAudioVoice();
-            voice->i_Note = note;
-            voice->m_Tone = tone.get();
-            voice->f_Pitch = pitch;
-            voice->i_Program = program;
-            voice->f_Velocity = velocity / 127.0f;
-            voice->f_TrackDelay = trackDelay;
-            voice->m_DebugDisableResampling = DebugDisableVoiceResampling;
-            voice->mbIgnoreLoops = ignoreLoops;
-            std::unique_lock<std::recursive_mutex> voiceLock(mVoiceMutex);
-            m_Voices.push_back(voice);
-        }
-    }
+    AliveAudioCommand cmd;
+    cmd.mType = eAliveAudioCommands::eNoteOn;
+    cmd.mProgram = program;
+    cmd.mNote = note;
+    cmd.mVelocity = velocity;
+    cmd.mPriority = Priority;
+    cmd.mTrackDelay = trackDelay;
+    cmd.mPitch = pitch;
+    cmd.mIgnoreLoops = ignoreLoops;
+    PushCommand(cmd);
 }
 
 void AliveAudio::NoteOff(int program, int note)
 {
-    std::unique_lock<std::recursive_mutex> voiceLock(mVoiceMutex);
-    for (auto& voice : m_Voices)
-    {
-        if (voice->i_Note == note && voice->i_Program == program)
-        {
-            voice->b_NoteOn = false;
-        }
-    }
+    AliveAudioCommand cmd;
+    cmd.mType = eAliveAudioCommands::eNoteOff;
+    cmd.mProgram = program;
+    cmd.mNote = note;
+    PushCommand(cmd);
 }
 
-void AliveAudio::NoteOffDelay(int program, int note, f32 trackDelay)
+
+void AliveAudio::ClearAllVoices(bool forceKill)
 {
-    std::unique_lock<std::recursive_mutex> voiceLock(mVoiceMutex);
-    for (auto& voice : m_Voices)
-    {
-        if (voice->i_Note == note && voice->i_Program == program && voice->f_TrackDelay < trackDelay && voice->f_NoteOffDelay <= 0)
-        {
-            voice->m_UsesNoteOffDelay = true;
-            voice->f_NoteOffDelay = trackDelay;
-        }
-    }
+    AliveAudioCommand cmd;
+    cmd.mType = eAliveAudioCommands::eClearAllVoices;
+    cmd.mForceKill = forceKill;
+    PushCommand(cmd);
 }
 
+void AliveAudio::ClearAllTrackVoices(bool forceKill)
+{
+    AliveAudioCommand cmd;
+    cmd.mType = eAliveAudioCommands::eClearAllTrackVoices;
+    cmd.mForceKill = forceKill;
+    PushCommand(cmd);
+}
 
-void AliveAudio::ClearAllVoices(bool forceKill)
+void AliveAudio::PlaySequence()
+{
+    AliveAudioCommand cmd;
+    cmd.mType = eAliveAudioCommands::eStartSequence;
+    mSequenceStartsRequested++;
+    PushCommand(cmd);
+}
+
+void AliveAudio::StopSequence()
+{
+    AliveAudioCommand cmd;
+    cmd.mType = eAliveAudioCommands::eStopSequence;
+    PushCommand(cmd);
+}
+
+void AliveAudio::SetSequence(std::vector<AliveAudioSequenceEvent> events)
 {
-    std::vector<AliveAudioVoice *> deadVoices;
+    mSequence = std::move(events);
+    mNextSequenceEvent = 0;
+    mSequencePlaying = false;
+}
 
-    std::unique_lock<std::recursive_mutex> voiceLock(mVoiceMutex);
-    for (auto& voice : m_Voices)
+void AliveAudio::DoNoteOn(const AliveAudioCommand& cmd)
+{
+    if (cmd.mProgram < 0 || cmd.mProgram >= static_cast<int>(m_Soundbank->m_Programs.size()))
     {
-        if (forceKill)
-        {
-            deadVoices.push_back(voice);
-        }
-        else
+        return;
+    }
+
+    for (auto& tone : m_Soundbank->m_Programs[cmd.mProgram]->m_Tones)
+    {
+        if (cmd.mNote >= tone->Min && cmd.mNote <= tone->Max)
         {
-            voice->b_NoteOn = false; // Send a note off to all of the notes though.
-            if (voice->f_SampleOffset == 0) // Let the voices that are CURRENTLY playing play.
+            // Past the polyphony limit this cuts off another voice, or drops the note if they all outrank it
+            AliveAudioVoice* voice = m_Voices.Allocate(cmd.mPriority, std::min(MaxPolyphony, m_Voices.Capacity()), VoiceStealing);
+            if (!voice)
             {
-                deadVoices.push_back(voice);
+                mDroppedNoteCount++;
+                continue;
             }
+
+            voice->i_Note = cmd.mNote;
+            voice->m_Tone = tone.get();
+            voice->f_Pitch = cmd.mPitch;
+            voice->i_Program = cmd.mProgram;
+            voice->f_Velocity = cmd.mVelocity / 127.0f;
+            voice->f_TrackDelay = cmd.mTrackDelay;
+            voice->m_DebugDisableResampling = DebugDisableVoiceResampling;
+            voice->mbIgnoreLoops = cmd.mIgnoreLoops;
         }
     }
+}
 
-
-    for (auto& obj : deadVoices)
+void AliveAudio::DoNoteOff(const AliveAudioCommand& cmd)
+{
+    for (u32 i = 0; i < m_Voices.ActiveCount(); i++)
     {
-        delete obj;
-
-        m_Voices.erase(std::remove(m_Voices.begin(), m_Voices.end(), obj), m_Voices.end());
+        AliveAudioVoice& voice = m_Voices.Active(i);
+        if (voice.i_Note == cmd.mNote && voice.i_Program == cmd.mProgram)
+        {
+            voice.b_NoteOn = false;
+        }
     }
 }
 
-void AliveAudio::ClearAllTrackVoices(bool forceKill)
+void AliveAudio::DoClearVoices(bool forceKill)
 {
-    std::vector<AliveAudioVoice *> deadVoices;
-
-    std::unique_lock<std::recursive_mutex> voiceLock(mVoiceMutex);
-    for (auto& voice : m_Voices)
+    for (u32 i = 0; i < m_Voices.ActiveCount(); i++)
     {
+        AliveAudioVoice& voice = m_Voices.Active(i);
         if (forceKill)
         {
             // Kill the voices no matter what. Cuts of any sounds = Ugly sound
-            deadVoices.push_back(voice);
+            voice.b_Dead = true;
         }
         else
         {
-            voice->b_NoteOn = false; // Send a note off to all of the notes though.
-            if (voice->f_SampleOffset == 0) // Let the voices that are CURRENTLY playing play.
+            voice.b_NoteOn = false; // Send a note off to all of the notes though.
+            if (voice.f_SampleOffset == 0) // Let the voices that are CURRENTLY playing play.
             {
-                // TODO: This will make us delete them all after this loop as with force kill
-                // probably we shouldn't be adding to the "delete" list here?
-                deadVoices.push_back(voice);
+                voice.b_Dead = true;
             }
         }
     }
 
-    for (auto& obj : deadVoices)
-    {
-        delete obj;
-
-        m_Voices.erase(std::remove(m_Voices.begin(), m_Voices.end(), obj), m_Voices.end());
-    }
-
+    CleanVoices();
 }
 
 void AliveAudio::SetSoundbank(std::unique_ptr<AliveAudioSoundbank> soundbank)
 {
-    ClearAllVoices(true);
+    DoClearVoices(true);
     m_Soundbank = std::move(soundbank);
 }
@@ -0,0 +1,70 @@
+#include "oddlib/audio/MixBus.h"
+#include "oddlib/audio/MixKernels.h"
+#include "SDL.h"
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+// Once the reverb has had no input and its output stays under this it is considered finished
+static const f32 kReverbSilenceThreshold = 0.00001f;
+
+static bool IsSilent(const f32* buffer, u32 len, f32 threshold)
+{
+    for (u32 i = 0; i < len; i++)
+    {
+        if (std::abs(buffer[i]) > threshold)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+AliveAudioMixBus::AliveAudioMixBus()
+    : mDry(kAliveAudioMixBusMaxSamples), mReverbSend(kAliveAudioMixBusMaxSamples)
+{
+
+}
+
+void AliveAudioMixBus::Begin(u32 len)
+{
+    // Sized up front so the audio thread never allocates
+    assert(len <= kAliveAudioMixBusMaxSamples);
+
+    std::fill(mDry.begin(), mDry.begin() + len, 0.0f);
+    std::fill(mReverbSend.begin(), mReverbSend.begin() + len, 0.0f);
+}
+
+void AliveAudioMixBus::Resolve(f32* stream, u32 len)
+{
+    const bool inputSilent = IsSilent(mReverbSend.data(), len, 0.0f);
+    if (!inputSilent)
+    {
+        mReverbActive = true;
+    }
+
+    if (mReverbActive)
+    {
+        mReverb.setEffectMix(ReverbMix);
+
+        // TODO: Find a better way of feeding the data in
+        for (u32 i = 0; i < len; i += 2)
+        {
+            const f32 left = static_cast<f32>(mReverb.tick(mReverbSend[i], mReverbSend[i + 1], 0));
+            const f32 right = static_cast<f32>(mReverb.lastOut(1));
+            mReverbSend[i] = left;
+            mReverbSend[i + 1] = right;
+        }
+
+        // Nothing went in and the tail has died away, stop processing until something is sent again
+        if (inputSilent && IsSilent(mReverbSend.data(), len, kReverbSilenceThreshold))
+        {
+            mReverb.clear();
+            mReverbActive = false;
+        }
+
+        MixKernels::Accumulate(mDry.data(), mReverbSend.data(), len);
+    }
+
+    SDL_MixAudioFormat(reinterpret_cast<u8*>(stream), reinterpret_cast<const u8*>(mDry.data()), AUDIO_F32, static_cast<u32>(len * sizeof(f32)), SDL_MIX_MAXVOLUME);
+}
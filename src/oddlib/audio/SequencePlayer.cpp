@@ -44,50 +44,19 @@ f64 SequencePlayer::MidiTimeToSample(int time)
 
 void SequencePlayer::Restart()
 {
-    std::lock_guard<std::mutex> lock(mMutex);
-    m_PlayerState = ALIVE_SEQUENCER_PLAYING;
-    mAliveAudio.mCurrentSampleIndex = 0;
+    m_PrevBar = 0;
+    m_PlayerState = ALIVE_SEQUENCER_STARTING;
+    mAliveAudio.PlaySequence();
 }
 
-// TODO: This thread spin locks
 void SequencePlayer::Update()
 {
-    int channels[16] = {};
-
-    std::lock_guard<std::mutex> lock(mMutex);
-
-    if (m_PlayerState == ALIVE_SEQUENCER_INIT_VOICES)
+    // The song position only means anything once the audio thread has actually (re)started the sequence
+    if (m_PlayerState == ALIVE_SEQUENCER_STARTING && !mAliveAudio.SequenceStartPending())
     {
-        bool firstNote = true;
-
-        for (size_t i = 0; i < m_MessageList.size(); i++)
-        {
-            const AliveAudioMidiMessage& m = m_MessageList[i];
-            switch (m.Type)
-            {
-            case ALIVE_MIDI_NOTE_ON:
-                mAliveAudio.NoteOn(channels[m.Channel], m.Note, m.Velocity, MidiTimeToSample(m.TimeOffset));
-                if (firstNote)
-                {
-                    m_SongBeginSample = static_cast<int>(mAliveAudio.mCurrentSampleIndex + MidiTimeToSample(m.TimeOffset));
-                    firstNote = false;
-                }
-                break;
-            case ALIVE_MIDI_NOTE_OFF:
-                mAliveAudio.NoteOffDelay(channels[m.Channel], m.Note, static_cast<f32>(MidiTimeToSample(m.TimeOffset))); // Fix this. Make note off's have an offset in the voice timeline.
-                break;
-            case ALIVE_MIDI_PROGRAM_CHANGE:
-                channels[m.Channel] = m.Special;
-                break;
-            case ALIVE_MIDI_ENDTRACK:
-                m_PlayerState = ALIVE_SEQUENCER_PLAYING;
-                m_SongFinishSample = static_cast<Uint64>(mAliveAudio.mCurrentSampleIndex + MidiTimeToSample(m.TimeOffset));
-                break;
-            }
-
-        }
+        m_PlayerState = ALIVE_SEQUENCER_PLAYING;
     }
- 
+
     if (m_PlayerState == ALIVE_SEQUENCER_PLAYING && mAliveAudio.mCurrentSampleIndex > m_SongFinishSample)
     {
 
@@ -97,71 +66,133 @@ void SequencePlayer::Update()
         DoQuaterCallback();
     }
 
-    if (m_PlayerState == ALIVE_SEQUENCER_PLAYING)
+    if (m_PlayerState == ALIVE_SEQUENCER_PLAYING && m_TimeSignatureBars > 0)
     {
         const Uint64  quarterBeat = (m_SongFinishSample - m_SongBeginSample) / m_TimeSignatureBars;
-        const int currentQuarterBeat = (int)(floor(GetPlaybackPositionSample() / quarterBeat));
-
-        if (m_PrevBar != currentQuarterBeat)
+        if (quarterBeat > 0)
         {
-            m_PrevBar = currentQuarterBeat;
-            DoQuaterCallback();
+            const int currentQuarterBeat = (int)(floor(GetPlaybackPositionSample() / quarterBeat));
+
+            if (m_PrevBar != currentQuarterBeat)
+            {
+                m_PrevBar = currentQuarterBeat;
+                DoQuaterCallback();
+            }
         }
     }
 }
 
 bool SequencePlayer::AtEnd() const
 {
-    std::lock_guard<std::mutex> lock(mMutex);
-
     return m_PlayerState == ALIVE_SEQUENCER_FINISHED && mAliveAudio.NumberOfActiveVoices() == 0;
 }
 
+// Audio thread context
 void SequencePlayer::Play(f32* stream, u32 len)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
-
     mAliveAudio.Play(stream, len);
 }
 
-u64 SequencePlayer::GetPlaybackPositionSample()
+// Audio thread context
+void SequencePlayer::Mix(AliveAudioMixBus& bus, u32 len)
 {
+    mAliveAudio.Mix(bus, len);
+}
 
-    return mAliveAudio.mCurrentSampleIndex - m_SongBeginSample;
+u64 SequencePlayer::GetPlaybackPositionSample()
+{
+    const u64 currentSample = mAliveAudio.mCurrentSampleIndex;
+    const u64 beginSample = static_cast<u64>(m_SongBeginSample);
+    return currentSample > beginSample ? currentSample - beginSample : 0;
 }
 
 void SequencePlayer::StopSequence()
 {
-    // Ensure the audio thread isn't in Play()
-    std::lock_guard<std::mutex> lock(mMutex);
-
-    SDL_LockAudio();
-
+    // Queued for the audio thread, voices already in their release keep playing
+    mAliveAudio.StopSequence();
     mAliveAudio.ClearAllTrackVoices();
 
     m_PlayerState = ALIVE_SEQUENCER_STOPPED;
     m_PrevBar = 0;
+}
 
-    SDL_UnlockAudio();
+void SequencePlayer::SetPriority(u8 priority)
+{
+    mAliveAudio.Priority = priority;
 }
 
 void SequencePlayer::NoteOnSingleShot(int program, int note, char velocity, f64 trackDelay, f64 pitch)
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     m_PlayerState = ALIVE_SEQUENCER_FINISHED;
     mAliveAudio.NoteOn(program, note, velocity, trackDelay, pitch, true);
 }
 
 void SequencePlayer::PlaySequence()
 {
-    std::lock_guard<std::mutex> lock(mMutex);
     if (m_PlayerState == ALIVE_SEQUENCER_STOPPED || m_PlayerState == ALIVE_SEQUENCER_FINISHED)
     {
-        m_PrevBar = 0;
-        m_PlayerState = ALIVE_SEQUENCER_INIT_VOICES;
+        Restart();
     }
 }
 
+// Turns the parsed MIDI messages into note on/off events at sample offsets, these are
+// dispatched by the audio thread as they fall due so only sounding notes use a voice.
+void SequencePlayer::BuildSequence()
+{
+    std::vector<AliveAudioSequenceEvent> events;
+    events.reserve(m_MessageList.size());
+
+    int channels[16] = {};
+    bool firstNote = true;
+
+    for (const AliveAudioMidiMessage& m : m_MessageList)
+    {
+        AliveAudioSequenceEvent event;
+        event.mSample = static_cast<u64>(MidiTimeToSample(m.TimeOffset));
+
+        switch (m.Type)
+        {
+        case ALIVE_MIDI_NOTE_ON:
+            event.mCommand.mType = eAliveAudioCommands::eNoteOn;
+            event.mCommand.mProgram = channels[m.Channel];
+            event.mCommand.mNote = m.Note;
+            event.mCommand.mVelocity = m.Velocity;
+            events.push_back(event);
+
+            if (firstNote)
+            {
+                m_SongBeginSample = static_cast<int>(event.mSample);
+                firstNote = false;
+            }
+            break;
+
+        case ALIVE_MIDI_NOTE_OFF:
+            event.mCommand.mType = eAliveAudioCommands::eNoteOff;
+            event.mCommand.mProgram = channels[m.Channel];
+            event.mCommand.mNote = m.Note;
+            events.push_back(event);
+            break;
+
+        case ALIVE_MIDI_PROGRAM_CHANGE:
+            channels[m.Channel] = m.Special;
+            break;
+
+        case ALIVE_MIDI_ENDTRACK:
+            m_SongFinishSample = event.mSample;
+            break;
+        }
+    }
+
+    // Messages are in time order already, but make sure as the audio thread relies on it
+    std::stable_sort(events.begin(), events.end(), [](const AliveAudioSequenceEvent& a, const AliveAudioSequenceEvent& b)
+    {
+        return a.mSample < b.mSample;
+    });
+
+    // No need to size the voice pool for the busiest part of the song, past the polyphony limit notes steal voices
+    mAliveAudio.SetSequence(std::move(events));
+}
+
 int SequencePlayer::LoadSequenceStream(Oddlib::IStream& stream)
 {
     StopSequence();
@@ -240,6 +271,7 @@ int SequencePlayer::LoadSequenceStream(Oddlib::IStream& stream)
             {
                 //std::cout << "end of track" << std::endl;
                 m_MessageList.push_back(AliveAudioMidiMessage(ALIVE_MIDI_ENDTRACK, deltaTime, 0, 0, 0));
+                BuildSequence();
                 return 0;
                 /*
                 int loopCount = gSeqInfo.iNumTimesToLoop;// v1 some hard coded data?? or just a local static?
@@ -402,15 +434,38 @@ void SequencePlayer::AudioSettingsUi()
     }
 
     ImGui::Checkbox("Force reverb", &mAliveAudio.ForceReverb);
-    ImGui::DragFloat("Reverb mix", &mAliveAudio.ReverbMix, 0.0f, 1.0f);
 
     ImGui::Checkbox("Disable resampling (= no freq changes)", &mAliveAudio.DebugDisableVoiceResampling);
 
+    int polyphony = static_cast<int>(mAliveAudio.MaxPolyphony);
+    if (ImGui::SliderInt("Max polyphony", &polyphony, 1, static_cast<int>(kAliveAudioDefaultVoices)))
+    {
+        mAliveAudio.MaxPolyphony = static_cast<u32>(polyphony);
+    }
+
+    if (ImGui::RadioButton("Steal oldest", mAliveAudio.VoiceStealing == eVoiceStealing::eOldest))
+    {
+        mAliveAudio.VoiceStealing = eVoiceStealing::eOldest;
+    }
+
+    if (ImGui::RadioButton("Steal quietest", mAliveAudio.VoiceStealing == eVoiceStealing::eQuietest))
+    {
+        mAliveAudio.VoiceStealing = eVoiceStealing::eQuietest;
+    }
+
+    if (ImGui::RadioButton("Steal lowest priority", mAliveAudio.VoiceStealing == eVoiceStealing::eLowestPriority))
+    {
+        mAliveAudio.VoiceStealing = eVoiceStealing::eLowestPriority;
+    }
+
+    ImGui::Text("Voices: %u stolen: %u dropped: %u", mAliveAudio.NumberOfActiveVoices(), mAliveAudio.NumberOfStolenVoices(), mAliveAudio.NumberOfDroppedNotes());
+
     ImGui::End();
 }
 
 void SequencePlayer::DebugUi()
 {
     // NOTE: Read only debug UI - no locks
+    AudioSettingsUi();
     mAliveAudio.VabBrowserUi();
 }
@@ -1,200 +1,260 @@
 #include "oddlib/audio/Voice.h"
 #include "oddlib/audio/AliveAudio.h"
 #include "oddlib/audio/Sample.h"
+#include "oddlib/audio/MixKernels.h"
 #include "logger.hpp"
 
 #include <algorithm>
+#include <cmath>
 
-template<class T>
-static f32 Lerp(T from, T to, f32 t)
-{
-    return from + ((to - from)*t);
-}
+// Voices are rendered in chunks of this many frames so the per frame scratch arrays fit on the stack
+static const u32 kChunkFrames = 64;
 
 static f32 SampleSint16ToFloat(s16 v)
 {
     return (v / 32767.0f);
 }
 
-f32 InterpCubic(f32 x0, f32 x1, f32 x2, f32 x3, f32 t)
+static s32 WrapSampleIndex(s32 index, s32 size)
 {
-    f32 a0, a1, a2, a3;
-    a0 = x3 - x2 - x0 + x1;
-    a1 = x0 - x1 - a0;
-    a2 = x2 - x0;
-    a3 = x1;
-    return a0*(t*t*t) + a1*(t*t) + a2*t + a3;
+    while (index >= size)
+    {
+        index -= size;
+    }
+    return index;
 }
 
-f32 InterpHermite(f32 x0, f32 x1, f32 x2, f32 x3, f32 t)
+// How many frames of a block pass before a delay that counts down by one each frame runs out.
+// The delay is decremented before each frame is checked, so frame i sees delay - (i + 1).
+static u32 FramesUntilExpired(f64 delay, u32 numFrames)
 {
-    f32 c0 = x1;
-    f32 c1 = .5F * (x2 - x0);
-    f32 c2 = x0 - (2.5F * x1) + (2 * x2) - (.5F * x3);
-    f32 c3 = (.5F * (x3 - x0)) + (1.5F * (x1 - x2));
-    return (((((c3 * t) + c2) * t) + c1) * t) + c0;
+    if (delay <= 1.0)
+    {
+        return 0;
+    }
+    const f64 frames = std::ceil(delay - 1.0);
+    return frames >= numFrames ? numFrames : static_cast<u32>(frames);
 }
 
-f32 AliveAudioVoice::GetSample(AudioInterpolation interpolation, bool /*antialiasFilteringEnabled*/)
+f64 AliveAudioVoice::SampleFrameRateMul()
 {
-	if (b_Dead)	// Don't return anything if dead. This voice should now be removed.
-	{
-		return 0;
-	}
+    if (m_DebugDisableResampling)
+    {
+        return 1.0;
+    }
 
-    if (m_ADSR_State == ADSR_State_attack)
+    if (!m_SampleFrameRateMulValid || m_SampleFrameRateMulNote != i_Note || m_SampleFrameRateMulPitch != f_Pitch)
     {
-        if (b_NoteOn)
-        {
-            m_ADSR_Level += ((1.0 / kAliveAudioSampleRate) / m_Tone->Env.AttackTime);
-            if (m_ADSR_Level > 1.0)
-            {
-                m_ADSR_Level = 1.0;
-                m_ADSR_State = ADSR_State_decay;
-            }
-        }
-        else
-        {
-            m_ADSR_State = ADSR_State_release;
-        }
+        // That constant is 2^(1/12)
+        m_SampleFrameRateMul = pow(1.05946309436, i_Note - m_Tone->mMidiRootKey + m_Tone->Pitch + f_Pitch) * (44100.0 / kAliveAudioSampleRate);
+        m_SampleFrameRateMulNote = i_Note;
+        m_SampleFrameRateMulPitch = f_Pitch;
+        m_SampleFrameRateMulValid = true;
     }
-    else if (m_ADSR_State == ADSR_State_decay)
+    return m_SampleFrameRateMul;
+}
+
+// Fills gain with the envelope level of each frame, running each ADSR stage as a tight loop
+// until it ends. Returns how many frames were produced before the envelope reached zero.
+u32 AliveAudioVoice::AdvanceEnvelope(f32* gain, u32 numFrames)
+{
+    const VolumeEnvelope& env = m_Tone->Env;
+    const f64 frameTime = 1.0 / kAliveAudioSampleRate;
+
+    u32 i = 0;
+    while (i < numFrames)
     {
-        if (b_NoteOn)
+        if (m_ADSR_State != ADSR_State_release && !b_NoteOn)
         {
-            if (m_Tone->Env.DecayTime > 0.0)
-                m_ADSR_Level -= ((1.0 / kAliveAudioSampleRate) / m_Tone->Env.DecayTime);
+            m_ADSR_State = ADSR_State_release;
+        }
 
-            if (m_Tone->Env.DecayTime <= 0.0 || m_ADSR_Level < m_Tone->Env.SustainLevel)
+        switch (m_ADSR_State)
+        {
+        case ADSR_State_attack:
+        {
+            const f64 step = frameTime / env.AttackTime;
+            while (i < numFrames && m_ADSR_State == ADSR_State_attack)
             {
-                m_ADSR_Level = m_Tone->Env.SustainLevel;
-                m_ADSR_State = ADSR_State_sustain;
+                m_ADSR_Level += step;
+                if (m_ADSR_Level > 1.0)
+                {
+                    m_ADSR_Level = 1.0;
+                    m_ADSR_State = ADSR_State_decay;
+                }
+                gain[i++] = static_cast<f32>(m_ADSR_Level);
             }
         }
-        else
+        break;
+
+        case ADSR_State_decay:
         {
-            m_ADSR_State = ADSR_State_release;
+            const f64 step = env.DecayTime > 0.0 ? frameTime / env.DecayTime : 0.0;
+            while (i < numFrames && m_ADSR_State == ADSR_State_decay)
+            {
+                m_ADSR_Level -= step;
+                if (env.DecayTime <= 0.0 || m_ADSR_Level < env.SustainLevel)
+                {
+                    m_ADSR_Level = env.SustainLevel;
+                    m_ADSR_State = ADSR_State_sustain;
+                }
+
+                if (m_ADSR_Level <= 0.0)
+                {
+                    m_ADSR_Level = 0.0;
+                    b_Dead = true;
+                    return i;
+                }
+                gain[i++] = static_cast<f32>(m_ADSR_Level);
+            }
         }
-    }
-    else if (m_ADSR_State == ADSR_State_sustain)
-    {
-        if (!b_NoteOn)
-            m_ADSR_State = ADSR_State_release;
-    }
-    else if (m_ADSR_State == ADSR_State_release)
-    {
-        if (m_Tone->Env.ExpRelease)
+        break;
+
+        case ADSR_State_sustain:
+            if (m_ADSR_Level <= 0.0)
+            {
+                m_ADSR_Level = 0.0;
+                b_Dead = true;
+                return i;
+            }
+            std::fill(gain + i, gain + numFrames, static_cast<f32>(m_ADSR_Level));
+            i = numFrames;
+            break;
+
+        case ADSR_State_release:
         {
-            f64 delta = m_ADSR_Level*((1.0 / kAliveAudioSampleRate) / m_Tone->Env.LinearReleaseTime); // Exp starts as fast as linear
-            if (delta < 0.000001)
-                delta = 0.000001; // Avoid denormals, and make sure that the voice ends some day
-            m_ADSR_Level -= delta;
+            const f64 step = frameTime / env.LinearReleaseTime;
+            while (i < numFrames)
+            {
+                if (env.ExpRelease)
+                {
+                    f64 delta = m_ADSR_Level * step; // Exp starts as fast as linear
+                    if (delta < 0.000001)
+                    {
+                        delta = 0.000001; // Avoid denormals, and make sure that the voice ends some day
+                    }
+                    m_ADSR_Level -= delta;
+                }
+                else
+                {
+                    m_ADSR_Level -= step;
+                }
+
+                if (m_ADSR_Level <= 0.0) // Release is done. So the voice is done.
+                {
+                    m_ADSR_Level = 0.0;
+                    b_Dead = true;
+                    return i;
+                }
+                gain[i++] = static_cast<f32>(m_ADSR_Level);
+            }
         }
-        else
-        {
-            m_ADSR_Level -= ((1.0 / kAliveAudioSampleRate) / m_Tone->Env.LinearReleaseTime);
+        break;
         }
     }
+    return numFrames;
+}
 
-    if (m_ADSR_Level <= 0) // Release/decay is done. So the voice is done.
+// Always writes all numFrames frames, the remainder is silence if the voice dies part way through
+void AliveAudioVoice::RenderSegment(f32* buffer, u32 numFrames, AudioInterpolation interpolation)
+{
+    const std::vector<u16>& sampleBuffer = m_Tone->m_Sample->m_SampleBuffer;
+    const s32 size = static_cast<s32>(sampleBuffer.size());
+    if (size == 0)
     {
         b_Dead = true;
-        m_ADSR_Level = 0.0f;
     }
 
-    // That constant is 2^(1/12)
-    f64 sampleFrameRateMul = pow(1.05946309436, i_Note - m_Tone->mMidiRootKey + m_Tone->Pitch + f_Pitch) * (44100.0 / kAliveAudioSampleRate);
-    if (m_DebugDisableResampling)
-    {
-        sampleFrameRateMul = 1.0f;
-    }
+    const f64 sampleSize = static_cast<f64>(m_Tone->m_Sample->mSampleSize);
+    const bool loop = m_Tone->Loop && !mbIgnoreLoops;
+    const f64 sampleFrameRateMul = SampleFrameRateMul();
+    const f32 velocity = static_cast<f32>(f_Velocity);
 
-    f_SampleOffset += (sampleFrameRateMul);
+    f32 gain[kChunkFrames];
+    f32 x0[kChunkFrames];
+    f32 x1[kChunkFrames];
+    f32 x2[kChunkFrames];
+    f32 x3[kChunkFrames];
+    f32 t[kChunkFrames];
 
-    // For some reason, for samples that don't loop, they need to be cut off 1 sample earlier.
-    // Todo: Revise this. Maybe its the loop flag at the end of the sample!? 
-    if (m_Tone->Loop && !mbIgnoreLoops)
-    {
-        if (f_SampleOffset >= m_Tone->m_Sample->mSampleSize)
-        {
-            f_SampleOffset = 0;
-        }
-    }
-    else
-    {
-        if (f_SampleOffset >= m_Tone->m_Sample->mSampleSize - 1)
-        {
-            b_Dead = true;
-            return 0; // Voice is dead now, so don't return anything.
-        }
-    }
-    
-    /* TODO: Below code is revised above but WTF is this even doing? Now the loading sound is prevented from attempting to write out
-    an infinitely long loop. But if we loop the written out sample it dosen't sound like how the below code worked?? Argh
-    if ((m_Tone->Loop) ? f_SampleOffset >= m_Tone->m_Sample->mSampleSize : (f_SampleOffset >= m_Tone->m_Sample->mSampleSize - 1))
+    u32 done = 0;
+    while (done < numFrames && !b_Dead)
     {
-        if (m_Tone->Loop)
-        {
-            while (f_SampleOffset >= m_Tone->m_Sample->mSampleSize)
-                f_SampleOffset -= m_Tone->m_Sample->mSampleSize;
-        }
-        else
-        {
-            b_Dead = true;
-            return 0; // Voice is dead now, so don't return anything.
-        }
-    }*/
-
-    { // Actual sample calculation
-        std::vector<u16>& sampleBuffer = m_Tone->m_Sample->m_SampleBuffer;
+        const u32 count = std::min(numFrames - done, kChunkFrames);
+        u32 alive = AdvanceEnvelope(gain, count);
 
-        f32 sample = 0.0f;
-        if (interpolation == AudioInterpolation_none)
+        // Walk the sample position and gather the 4 taps around it, the interpolation itself
+        // is done for the whole chunk at once afterwards.
+        for (u32 i = 0; i < alive; i++)
         {
-            size_t off = (int)f_SampleOffset;
-            if (off >= sampleBuffer.size())
+            f_SampleOffset += sampleFrameRateMul;
+
+            // For some reason, for samples that don't loop, they need to be cut off 1 sample earlier.
+            // Todo: Revise this. Maybe its the loop flag at the end of the sample!?
+            if (loop)
             {
-                LOG_ERROR("Sample buffer index out of bounds");
-                off = sampleBuffer.size() - 1;
+                if (f_SampleOffset >= sampleSize)
+                {
+                    f_SampleOffset = 0;
+                }
             }
-            sample = SampleSint16ToFloat(sampleBuffer[off]); // No interpolation. Faster but sounds jaggy.
-        }
-        else if (interpolation == AudioInterpolation_linear)
-        {
-            int baseOffset = static_cast<int>(floor(f_SampleOffset));
-            int nextOffset = (baseOffset + 1) % sampleBuffer.size(); // TODO: Don't assume looping
-            if (baseOffset >= static_cast<int>(sampleBuffer.size()))
+            else if (f_SampleOffset >= sampleSize - 1)
             {
-                LOG_ERROR("Sample buffer index out of bounds (interpolated)");
-                baseOffset = nextOffset = static_cast<int>(sampleBuffer.size() - 1);
+                b_Dead = true;
+                alive = i;
+                break;
             }
-            sample = SampleSint16ToFloat(static_cast<s16>(Lerp<s16>(sampleBuffer[baseOffset], sampleBuffer[nextOffset], static_cast<f32>(f_SampleOffset - baseOffset))));
-        }
-        else if (interpolation == AudioInterpolation_cubic || interpolation == AudioInterpolation_hermite)
-        {
-            int offsets[4] = { (int)floor(f_SampleOffset) - 1, 0, 0, 0 };
-            if (offsets[0] < 0)
-                offsets[0] += static_cast<int>(sampleBuffer.size());
-            for (int i = 1; i < 4; ++i)
+
+            s32 base = static_cast<s32>(f_SampleOffset);
+            t[i] = static_cast<f32>(f_SampleOffset - base);
+            if (base >= size)
             {
-                offsets[i] = (offsets[i - 1] + 1) % sampleBuffer.size(); // TODO: Don't assume looping
+                base = size - 1;
+                t[i] = 0.0f;
             }
-            f32 raw_samples[4] =
+
+            if (base >= 1 && base + 2 < size)
             {
-                SampleSint16ToFloat(sampleBuffer[offsets[0]]),
-                SampleSint16ToFloat(sampleBuffer[offsets[1]]),
-                SampleSint16ToFloat(sampleBuffer[offsets[2]]),
-                SampleSint16ToFloat(sampleBuffer[offsets[3]]),
-            };
-
-            f32 t = static_cast<f32>(f_SampleOffset - floor(f_SampleOffset));
-            assert(t >= 0.0 && t <= 1.0);
-            if (interpolation == AudioInterpolation_cubic)
-                sample = InterpCubic(raw_samples[0], raw_samples[1], raw_samples[2], raw_samples[3], t);
-            else 
-                sample = InterpHermite(raw_samples[0], raw_samples[1], raw_samples[2], raw_samples[3], t);
+                x0[i] = SampleSint16ToFloat(sampleBuffer[base - 1]);
+                x1[i] = SampleSint16ToFloat(sampleBuffer[base]);
+                x2[i] = SampleSint16ToFloat(sampleBuffer[base + 1]);
+                x3[i] = SampleSint16ToFloat(sampleBuffer[base + 2]);
+            }
+            else
+            {
+                // Near either end the taps wrap around - TODO: Don't assume looping
+                x0[i] = SampleSint16ToFloat(sampleBuffer[base > 0 ? base - 1 : size - 1]);
+                x1[i] = SampleSint16ToFloat(sampleBuffer[base]);
+                x2[i] = SampleSint16ToFloat(sampleBuffer[WrapSampleIndex(base + 1, size)]);
+                x3[i] = SampleSint16ToFloat(sampleBuffer[WrapSampleIndex(base + 2, size)]);
+            }
         }
 
-        return static_cast<f32>(sample * m_ADSR_Level * f_Velocity);
+        const MixKernels::Taps taps = { x0, x1, x2, x3, t };
+        MixKernels::Resample(buffer + done, taps, gain, velocity, alive, interpolation);
+        std::fill(buffer + done + alive, buffer + done + count, 0.0f);
+        done += count;
     }
+
+    std::fill(buffer + done, buffer + numFrames, 0.0f);
+}
+
+bool AliveAudioVoice::Render(f32* buffer, u32 numFrames, AudioInterpolation interpolation)
+{
+    if (b_Dead) // Don't render anything if dead. This voice should now be removed.
+    {
+        return false;
+    }
+
+    // Work out where in this block the start delay runs out
+    const u32 startFrame = FramesUntilExpired(f_TrackDelay, numFrames);
+    f_TrackDelay -= numFrames;
+    if (startFrame >= numFrames)
+    {
+        return false;
+    }
+
+    std::fill(buffer, buffer + startFrame, 0.0f);
+    RenderSegment(buffer + startFrame, numFrames - startFrame, interpolation);
+    return true;
 }
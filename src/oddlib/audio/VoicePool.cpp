@@ -0,0 +1,143 @@
+#include "oddlib/audio/VoicePool.h"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <limits>
+
+void AliveAudioVoicePool::Reset(u32 capacity)
+{
+    // Indices are stored as u16 to keep the active/free lists small
+    const u32 kMaxCapacity = std::numeric_limits<u16>::max();
+    if (capacity > kMaxCapacity)
+    {
+        LOG_WARNING("Voice pool capacity " << capacity << " clamped to " << kMaxCapacity);
+        capacity = kMaxCapacity;
+    }
+
+    mVoices.clear();
+    mVoices.resize(capacity);
+
+    mPriority.assign(capacity, 0);
+    mStartOrder.assign(capacity, 0);
+    mLevel.assign(capacity, 0.0f);
+
+    mActive.clear();
+    mActive.reserve(capacity);
+
+    // Handed out from the back, so voice 0 goes first
+    mFree.clear();
+    mFree.reserve(capacity);
+    for (u32 i = capacity; i > 0; i--)
+    {
+        mFree.push_back(static_cast<u16>(i - 1));
+    }
+
+    mNextStartOrder = 0;
+    mStolenCount = 0;
+}
+
+AliveAudioVoice* AliveAudioVoicePool::Allocate(u8 priority, u32 polyphony, eVoiceStealing policy)
+{
+    u16 index = 0;
+    if (mActive.size() < polyphony && !mFree.empty())
+    {
+        index = mFree.back();
+        mFree.pop_back();
+        mActive.push_back(index);
+    }
+    else
+    {
+        // The victim keeps its slot in mActive, only what it is playing changes
+        const s32 victim = FindVictim(priority, policy);
+        if (victim < 0)
+        {
+            return nullptr;
+        }
+        index = mActive[victim];
+        if (!mVoices[index].b_Dead)
+        {
+            mStolenCount++;
+        }
+    }
+
+    mVoices[index] = AliveAudioVoice();
+    mPriority[index] = priority;
+    mStartOrder[index] = mNextStartOrder++;
+
+    // Counts as full volume until it has been mixed once so it isn't stolen before it has made a sound
+    mLevel[index] = 1.0f;
+
+    return &mVoices[index];
+}
+
+s32 AliveAudioVoicePool::FindVictim(u8 priority, eVoiceStealing policy) const
+{
+    s32 victim = -1;
+    for (u32 i = 0; i < mActive.size(); i++)
+    {
+        const u16 candidate = mActive[i];
+
+        // Already finished, reuse it before cutting off anything that can still be heard
+        if (mVoices[candidate].b_Dead)
+        {
+            return static_cast<s32>(i);
+        }
+
+        if (mPriority[candidate] > priority)
+        {
+            continue;
+        }
+
+        if (victim < 0)
+        {
+            victim = static_cast<s32>(i);
+            continue;
+        }
+
+        const u16 best = mActive[victim];
+        const bool older = mStartOrder[candidate] < mStartOrder[best];
+        bool better = false;
+        switch (policy)
+        {
+        case eVoiceStealing::eOldest:
+            better = older;
+            break;
+
+        case eVoiceStealing::eQuietest:
+            better = mLevel[candidate] < mLevel[best] || (mLevel[candidate] == mLevel[best] && older);
+            break;
+
+        case eVoiceStealing::eLowestPriority:
+            better = mPriority[candidate] < mPriority[best] || (mPriority[candidate] == mPriority[best] && older);
+            break;
+        }
+
+        if (better)
+        {
+            victim = static_cast<s32>(i);
+        }
+    }
+    return victim;
+}
+
+void AliveAudioVoicePool::Collect()
+{
+    // Compact the active list in place, neither list can grow past the capacity
+    size_t alive = 0;
+    for (size_t i = 0; i < mActive.size(); i++)
+    {
+        const u16 index = mActive[i];
+        const AliveAudioVoice& voice = mVoices[index];
+        if (voice.b_Dead)
+        {
+            mFree.push_back(index);
+        }
+        else
+        {
+            // A voice still waiting out its delay hasn't started its envelope yet
+            mLevel[index] = voice.f_TrackDelay > 0 ? static_cast<f32>(voice.f_Velocity) : voice.Level();
+            mActive[alive++] = index;
+        }
+    }
+    mActive.resize(alive);
+}
@@ -89,7 +89,7 @@ namespace Oddlib
             buffer.resize(buffer.size()*2 );
 
 
-            mdec.DecodeFrameToABGR32((uint16_t*)strip->pixels, (uint16_t*)(buffer.data()),w, 240);
+            mdec.DecodeFrameToRGBA32((uint16_t*)strip->pixels, (uint16_t*)(buffer.data()),w, 240);
 
             SDL_Rect dstRect = {};
             dstRect.x = 32 * u;
@@ -4,8 +4,15 @@
 #include "logger.hpp"
 #include <assert.h>
 #include <array>
+#include <algorithm>
+#include <thread>
 #include "oddlib/PSXMDECDecoder.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MASHER_SSE 1
+#include <emmintrin.h>
+#endif
+
 constexpr u32 kVideoFlag = 1;
 constexpr u32 kAudioFlag = 2;
 constexpr u32 kMacroBlockWidth = 16;
@@ -14,6 +21,9 @@ constexpr u32 kMacroBlockHeight = 16;
 // Which are Red(Cr), Blue(Cb), Luma(Y1), Luma(Y2), Luma(Y3), Luma(Y4)   
 constexpr u32 kNumberOfBlocks = 6;
 
+// Space for the coefficients of each block in mMacroBlockBuffer, they are stored as 32 bit values
+constexpr u32 kBlockBufferSize = 64 * 4;
+
 namespace Oddlib
 {
     void Masher::Read()
@@ -94,6 +104,16 @@ namespace Oddlib
             mStream->Seek(mStream->Pos() + totalSize);
         }
 
+        // Where each frame starts, frames with video and audio have an extra dword for the size of the video data
+        const uint32_t frameHeaderSize = (mbHasVideo && mbHasAudio) ? sizeof(uint32_t) : 0;
+        mFrameOffsets.resize(mFileHeader.mNumberOfFrames);
+        size_t offset = mStream->Pos();
+        for (uint32_t i = 0; i < mFileHeader.mNumberOfFrames; i++)
+        {
+            mFrameOffsets[i] = offset;
+            offset += frameHeaderSize + mFrameSizes[i];
+        }
+
         mMacroBlockBuffer.resize((mNumMacroblocksX * kMacroBlockWidth) * (mNumMacroblocksY * kMacroBlockHeight) * kNumberOfBlocks);
 
         mDecodedVideoFrameData.resize(mVideoHeader.mMaxVideoFrameSize);
@@ -390,16 +410,13 @@ namespace Oddlib
         0x00000036, 0x0000002F, 0x00000037, 0x0000003E, 0x0000003F, 0x0000098E, 0x0000098E, 0x0000F384
     };
 
-    u32 g_252_buffer_unk_635A0C[64] = {};
-    u32 g_252_buffer_unk_63580C[64] = {};
-
     // Return val becomes param 1
 
     // for Cr, Cb, Y1, Y2, Y3, Y4
-    int16_t* ddv_func7_DecodeMacroBlock_impl(int16_t* inPtr, int16_t* outputBlockPtr, bool isYBlock)
+    static int16_t* ddv_func7_DecodeMacroBlock_impl(const MacroBlockContext& ctx, int16_t* inPtr, int16_t* outputBlockPtr, bool isYBlock)
     {
         const int v1 = isYBlock;
-        const u32* pTable = isYBlock ? &g_252_buffer_unk_63580C[1] : &g_252_buffer_unk_635A0C[1];
+        const u32* pTable = isYBlock ? &ctx.mYQuant[1] : &ctx.mCQuant[1];
         unsigned int counter = 0;
         u16* pInput = (u16*)inPtr;
         u32* pOutput = (u32*)outputBlockPtr;              // off 10 quantised coefficients
@@ -518,19 +535,7 @@ namespace Oddlib
         return (int16_t*)pInput;
     }
 
-    // TODO: Should probably just be 64? Making this bigger fixes a sound glitch which is probably caused
-    // by an out of bounds write somewhere.
-    typedef std::array<int32_t, 64 * 4> T64IntsArray;
-
-    static T64IntsArray Cr_block = {};
-    static T64IntsArray Cb_block = {};
-    static T64IntsArray Y1_block = {};
-    static T64IntsArray Y2_block = {};
-    static T64IntsArray Y3_block = {};
-    static T64IntsArray Y4_block = {};
-
-
-    void half_idct(T64IntsArray& pSource, T64IntsArray& pDestination, int nPitch, int nIncrement, int nShift)
+    static void half_idct(T64IntsArray& pSource, T64IntsArray& pDestination, int nPitch, int nIncrement, int nShift)
     {
         std::array<int32_t, 8> pTemp;
 
@@ -564,7 +569,7 @@ namespace Oddlib
     }
 
     // 0x40ED90
-    void idct(int16_t* input, T64IntsArray& pDestination) // dst is 64 dwords
+    static void idct(int16_t* input, T64IntsArray& pDestination) // dst is 64 dwords
     {
         T64IntsArray pTemp;
         T64IntsArray pExtendedSource;
@@ -580,102 +585,302 @@ namespace Oddlib
         half_idct(pTemp, pDestination, 1, 8, 18);
     }
 
-    static int To1d(int x, int y)
+#ifdef MASHER_SSE
+    // Coefficients for a pair of interleaved 16 bit values, as used by _mm_madd_epi16
+    static __m128i Pair(s16 a, s16 b)
     {
-        // 8x8 index to x64 index
-        return y * 8 + x;
+        return _mm_set_epi16(b, a, b, a, b, a, b, a);
     }
 
-    unsigned char Clamp(f32 v)
+    // Same sums as half_idct but for 8 columns at once, in[] holds a row of 16 bit values each.
+    // out[k][0] is row k of columns 0-3, out[k][1] columns 4-7.
+    static void IdctColumnsSse2(const __m128i (&in)[8], __m128i (&out)[8][2], int nShift)
     {
-        if (v < 0.0f) v = 0.0f;
-        if (v > 255.0f) v = 255.0f;
-        return (unsigned char)v;
+        const __m128i shift = _mm_cvtsi32_si128(nShift);
+        for (int half = 0; half < 2; half++)
+        {
+            const __m128i s02 = half ? _mm_unpackhi_epi16(in[0], in[2]) : _mm_unpacklo_epi16(in[0], in[2]);
+            const __m128i s46 = half ? _mm_unpackhi_epi16(in[4], in[6]) : _mm_unpacklo_epi16(in[4], in[6]);
+            const __m128i s13 = half ? _mm_unpackhi_epi16(in[1], in[3]) : _mm_unpacklo_epi16(in[1], in[3]);
+            const __m128i s57 = half ? _mm_unpackhi_epi16(in[5], in[7]) : _mm_unpacklo_epi16(in[5], in[7]);
+
+            const __m128i even[4] =
+            {
+                _mm_add_epi32(_mm_madd_epi16(s02, Pair(8192, 10703)), _mm_madd_epi16(s46, Pair(8192, 4433))),
+                _mm_add_epi32(_mm_madd_epi16(s02, Pair(8192, 4433)), _mm_madd_epi16(s46, Pair(-8192, -10704))),
+                _mm_add_epi32(_mm_madd_epi16(s02, Pair(8192, -4433)), _mm_madd_epi16(s46, Pair(-8192, 10704))),
+                _mm_add_epi32(_mm_madd_epi16(s02, Pair(8192, -10703)), _mm_madd_epi16(s46, Pair(8192, -4433)))
+            };
+
+            const __m128i odd[4] =
+            {
+                _mm_add_epi32(_mm_madd_epi16(s13, Pair(11363, 9633)), _mm_madd_epi16(s57, Pair(6437, 2260))),
+                _mm_add_epi32(_mm_madd_epi16(s13, Pair(9633, -2259)), _mm_madd_epi16(s57, Pair(-11362, -6436))),
+                _mm_add_epi32(_mm_madd_epi16(s13, Pair(6437, -11362)), _mm_madd_epi16(s57, Pair(2261, 9633))),
+                _mm_add_epi32(_mm_madd_epi16(s13, Pair(2260, -6436)), _mm_madd_epi16(s57, Pair(9633, -11363)))
+            };
+
+            for (int k = 0; k < 4; k++)
+            {
+                out[k][half] = _mm_sra_epi32(_mm_add_epi32(even[k], odd[k]), shift);
+                out[7 - k][half] = _mm_sra_epi32(_mm_sub_epi32(even[k], odd[k]), shift);
+            }
+        }
     }
 
-    void SetElement(int x, int y, int width, u32* ptr, u32 value)
+    static void Transpose4x4(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
     {
-        ptr[(width * y) + x] = value;
+        const __m128i t0 = _mm_unpacklo_epi32(r0, r1);
+        const __m128i t1 = _mm_unpacklo_epi32(r2, r3);
+        const __m128i t2 = _mm_unpackhi_epi32(r0, r1);
+        const __m128i t3 = _mm_unpackhi_epi32(r2, r3);
+        r0 = _mm_unpacklo_epi64(t0, t1);
+        r1 = _mm_unpackhi_epi64(t0, t1);
+        r2 = _mm_unpacklo_epi64(t2, t3);
+        r3 = _mm_unpackhi_epi64(t2, t3);
     }
 
-    static void ConvertYuvToRgbAndBlit(u32* pixelBuffer, int xoff, int yoff, int width, int height)
+    static void Transpose8x8(const __m128i (&in)[8], __m128i (&out)[8])
     {
-        // convert the Y1 Y2 Y3 Y4 and Cb and Cr blocks into a 16x16 array of (Y, Cb, Cr) pixels
-        struct Macroblock_YCbCr_Struct
+        const __m128i a0 = _mm_unpacklo_epi16(in[0], in[1]);
+        const __m128i a1 = _mm_unpackhi_epi16(in[0], in[1]);
+        const __m128i a2 = _mm_unpacklo_epi16(in[2], in[3]);
+        const __m128i a3 = _mm_unpackhi_epi16(in[2], in[3]);
+        const __m128i a4 = _mm_unpacklo_epi16(in[4], in[5]);
+        const __m128i a5 = _mm_unpackhi_epi16(in[4], in[5]);
+        const __m128i a6 = _mm_unpacklo_epi16(in[6], in[7]);
+        const __m128i a7 = _mm_unpackhi_epi16(in[6], in[7]);
+
+        const __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+        const __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+        const __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+        const __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+        const __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+        const __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+        const __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+        const __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+
+        out[0] = _mm_unpacklo_epi64(b0, b4);
+        out[1] = _mm_unpackhi_epi64(b0, b4);
+        out[2] = _mm_unpacklo_epi64(b1, b5);
+        out[3] = _mm_unpackhi_epi64(b1, b5);
+        out[4] = _mm_unpacklo_epi64(b2, b6);
+        out[5] = _mm_unpackhi_epi64(b2, b6);
+        out[6] = _mm_unpacklo_epi64(b3, b7);
+        out[7] = _mm_unpackhi_epi64(b3, b7);
+    }
+
+    // Gives exactly what idct does. Both passes multiply 16 bit values, if the first pass
+    // produces anything bigger the block is redone with idct.
+    static void FastIdct(int16_t* input, T64IntsArray& pDestination)
+    {
+        const __m128i* src = reinterpret_cast<const __m128i*>(input);
+        __m128i rows[8];
+        for (int i = 0; i < 8; i++)
         {
-            f32 Y;
-            f32 Cb;
-            f32 Cr;
-        };
+            // Source is signed 16 bits stored every 32 bits, the high halves are junk
+            const __m128i lo = _mm_srai_epi32(_mm_slli_epi32(_mm_loadu_si128(src + (i * 2)), 16), 16);
+            const __m128i hi = _mm_srai_epi32(_mm_slli_epi32(_mm_loadu_si128(src + (i * 2) + 1), 16), 16);
+            rows[i] = _mm_packs_epi32(lo, hi);
+        }
 
-        std::array< std::array<Macroblock_YCbCr_Struct, 16>, 16> Macroblock_YCbCr = {};
+        __m128i pass1[8][2];
+        IdctColumnsSse2(rows, pass1, 11);
 
-        for (int x = 0; x < 8; x++)
+        // Any bits above the low 16 after biasing by 0x8000 means the value didn't fit
+        const __m128i bias = _mm_set1_epi32(0x8000);
+        const __m128i highBits = _mm_set1_epi32(static_cast<int>(0xFFFF0000));
+        __m128i overflow = _mm_setzero_si128();
+        for (int i = 0; i < 8; i++)
         {
-            for (int y = 0; y < 8; y++)
-            {
-                Macroblock_YCbCr[x][y].Y = static_cast<f32>(Y1_block[To1d(x, y)]);
-                Macroblock_YCbCr[x + 8][y].Y = static_cast<f32>(Y2_block[To1d(x, y)]);
-                Macroblock_YCbCr[x][y + 8].Y = static_cast<f32>(Y3_block[To1d(x, y)]);
-                Macroblock_YCbCr[x + 8][y + 8].Y = static_cast<f32>(Y4_block[To1d(x, y)]);
-
-                Macroblock_YCbCr[x * 2][y * 2].Cb = static_cast<f32>(Cb_block[To1d(x, y)]);
-                Macroblock_YCbCr[x * 2 + 1][y * 2].Cb = static_cast<f32>(Cb_block[To1d(x, y)]);
-                Macroblock_YCbCr[x * 2][y * 2 + 1].Cb = static_cast<f32>(Cb_block[To1d(x, y)]);
-                Macroblock_YCbCr[x * 2 + 1][y * 2 + 1].Cb = static_cast<f32>(Cb_block[To1d(x, y)]);
-
-                Macroblock_YCbCr[x * 2][y * 2].Cr = static_cast<f32>(Cr_block[To1d(x, y)]);
-                Macroblock_YCbCr[x * 2 + 1][y * 2].Cr = static_cast<f32>(Cr_block[To1d(x, y)]);
-                Macroblock_YCbCr[x * 2][y * 2 + 1].Cr = static_cast<f32>(Cr_block[To1d(x, y)]);
-                Macroblock_YCbCr[x * 2 + 1][y * 2 + 1].Cr = static_cast<f32>(Cr_block[To1d(x, y)]);
-            }
+            overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_add_epi32(pass1[i][0], bias), highBits));
+            overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_add_epi32(pass1[i][1], bias), highBits));
+            rows[i] = _mm_packs_epi32(pass1[i][0], pass1[i][1]);
         }
 
-        // Convert the (Y, Cb, Cr) pixels into RGB pixels
-        struct Macroblock_RGB_Struct
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(overflow, _mm_setzero_si128())) != 0xFFFF)
         {
-            unsigned char Red;
-            unsigned char Green;
-            unsigned char Blue;
-            unsigned char A;
-        };
+            idct(input, pDestination);
+            return;
+        }
+
+        // The second pass runs along rows, turn them into columns and back again afterwards
+        __m128i columns[8];
+        Transpose8x8(rows, columns);
 
-        std::array< std::array<Macroblock_RGB_Struct, 16>, 16> Macroblock_RGB = {};
+        __m128i pass2[8][2];
+        IdctColumnsSse2(columns, pass2, 18);
 
-        for (u32 x = 0; x < kMacroBlockWidth; x++)
+        __m128i* dst = reinterpret_cast<__m128i*>(pDestination.data());
+        for (int half = 0; half < 2; half++)
         {
-            for (u32 y = 0; y < kMacroBlockHeight; y++)
+            for (int k = 0; k < 8; k += 4)
             {
-                const f32 r = (Macroblock_YCbCr[x][y].Y) + 1.402f *  Macroblock_YCbCr[x][y].Cb;
-                const f32 g = (Macroblock_YCbCr[x][y].Y) - 0.3437f * Macroblock_YCbCr[x][y].Cr - 0.7143f * Macroblock_YCbCr[x][y].Cb;
-                const f32 b = (Macroblock_YCbCr[x][y].Y) + 1.772f *  Macroblock_YCbCr[x][y].Cr;
-
-                Macroblock_RGB[x][y].Red = Clamp(r);
-                Macroblock_RGB[x][y].Green = Clamp(g);
-                Macroblock_RGB[x][y].Blue = Clamp(b);
-
-                // Due to macro block padding this can be out of bounds
-                int xpos = x + xoff;
-                int ypos = y + yoff;
-                if (xpos < width && ypos < height)
+                Transpose4x4(pass2[k][half], pass2[k + 1][half], pass2[k + 2][half], pass2[k + 3][half]);
+                for (int j = 0; j < 4; j++)
                 {
-                    u32 pixelValue = 0;
-                    pixelValue = (pixelValue << 8) + Macroblock_RGB[x][y].Blue;
-                    pixelValue = (pixelValue << 8) + Macroblock_RGB[x][y].Green;
-                    pixelValue = (pixelValue << 8) + Macroblock_RGB[x][y].Red;
-
-                    // Actually is no alpha in FMVs
-                    // pixelValue = (pixelValue << 8) + Macroblock_RGB[x][y].A
-                    SetElement(xpos, ypos, width, pixelBuffer, pixelValue);
+                    _mm_storeu_si128(dst + ((half * 4 + j) * 2) + (k / 4), pass2[k + j][half]);
                 }
             }
         }
     }
+#else
+    static void FastIdct(int16_t* input, T64IntsArray& pDestination)
+    {
+        idct(input, pDestination);
+    }
+#endif
 
-    static void after_block_decode_no_effect_q_impl(int quantScale)
+    // The same single precision maths as Masher, including the order the products are added in,
+    // so that every pixel comes out the same with or without SSE2
+    static const f32 kCbToRed = 1.402f;
+    static const f32 kCrToGreen = 0.3437f;
+    static const f32 kCbToGreen = 0.7143f;
+    static const f32 kCrToBlue = 1.772f;
+
+#ifdef MASHER_SSE
+    // Widens 8 chroma samples to floats, each one covering 2 pixels across
+    static void ChromaToFloatSse2(const s32* row, __m128 (&out)[4])
     {
-        g_252_buffer_unk_63580C[0] = 16;
-        g_252_buffer_unk_635A0C[0] = 16;
+        const __m128 lo = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row)));
+        const __m128 hi = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + 4)));
+        out[0] = _mm_unpacklo_ps(lo, lo);
+        out[1] = _mm_unpackhi_ps(lo, lo);
+        out[2] = _mm_unpacklo_ps(hi, hi);
+        out[3] = _mm_unpackhi_ps(hi, hi);
+    }
+
+    // Clamps to 0 - 255 and truncates, like a float to unsigned char cast of the clamped value
+    static __m128i ClampToByteSse2(__m128 v)
+    {
+        return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.0f)));
+    }
+
+    // Converts and packs 16 pixels as 0x00BBGGRR
+    static void YCbCrToPixelsSse2(const s32* yLeft, const s32* yRight, const s32* cbRow, const s32* crRow, u32* out)
+    {
+        __m128 cb[4];
+        __m128 cr[4];
+        ChromaToFloatSse2(cbRow, cb);
+        ChromaToFloatSse2(crRow, cr);
+
+        const s32* luma[4] = { yLeft, yLeft + 4, yRight, yRight + 4 };
+        __m128i r[4];
+        __m128i g[4];
+        __m128i b[4];
+        for (int i = 0; i < 4; i++)
+        {
+            const __m128 y = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(luma[i])));
+            r[i] = ClampToByteSse2(_mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(kCbToRed), cb[i])));
+            g[i] = ClampToByteSse2(_mm_sub_ps(_mm_sub_ps(y, _mm_mul_ps(_mm_set1_ps(kCrToGreen), cr[i])), _mm_mul_ps(_mm_set1_ps(kCbToGreen), cb[i])));
+            b[i] = ClampToByteSse2(_mm_add_ps(y, _mm_mul_ps(_mm_set1_ps(kCrToBlue), cr[i])));
+        }
+
+        // Everything is already 0 - 255 so the saturating packs don't change anything
+        const __m128i red = _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]), _mm_packs_epi32(r[2], r[3]));
+        const __m128i green = _mm_packus_epi16(_mm_packs_epi32(g[0], g[1]), _mm_packs_epi32(g[2], g[3]));
+        const __m128i blue = _mm_packus_epi16(_mm_packs_epi32(b[0], b[1]), _mm_packs_epi32(b[2], b[3]));
+
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i rgLo = _mm_unpacklo_epi8(red, green);
+        const __m128i rgHi = _mm_unpackhi_epi8(red, green);
+        const __m128i bLo = _mm_unpacklo_epi8(blue, zero);
+        const __m128i bHi = _mm_unpackhi_epi8(blue, zero);
+
+        __m128i* dst = reinterpret_cast<__m128i*>(out);
+        _mm_storeu_si128(dst, _mm_unpacklo_epi16(rgLo, bLo));
+        _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(rgLo, bLo));
+        _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(rgHi, bHi));
+        _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(rgHi, bHi));
+    }
+#else
+    static u32 ClampToByte(f32 v)
+    {
+        if (v < 0.0f) v = 0.0f;
+        if (v > 255.0f) v = 255.0f;
+        return static_cast<u32>(static_cast<unsigned char>(v));
+    }
+#endif
+
+    static void ConvertYuvToRgbAndBlit(const MacroBlockContext& ctx, u32* pixelBuffer, int xoff, int yoff, int width, int height)
+    {
+        // Due to macro block padding this can be out of bounds
+        const int visibleWidth = std::min(static_cast<int>(kMacroBlockWidth), width - xoff);
+        const int visibleHeight = std::min(static_cast<int>(kMacroBlockHeight), height - yoff);
+
+        for (int y = 0; y < visibleHeight; y++)
+        {
+            // Y1 Y2 on top of Y3 Y4, with each chroma sample covering 2x2 pixels
+            const s32* yLeft = (y < 8 ? ctx.mY1 : ctx.mY3).data() + ((y & 7) * 8);
+            const s32* yRight = (y < 8 ? ctx.mY2 : ctx.mY4).data() + ((y & 7) * 8);
+            const s32* cbRow = ctx.mCb.data() + ((y / 2) * 8);
+            const s32* crRow = ctx.mCr.data() + ((y / 2) * 8);
+
+            u32* dst = pixelBuffer + ((yoff + y) * width) + xoff;
+            u32 row[kMacroBlockWidth];
+            u32* out = visibleWidth == static_cast<int>(kMacroBlockWidth) ? dst : row;
+
+#ifdef MASHER_SSE
+            YCbCrToPixelsSse2(yLeft, yRight, cbRow, crRow, out);
+#else
+            for (u32 x = 0; x < kMacroBlockWidth; x++)
+            {
+                const f32 luma = static_cast<f32>(x < 8 ? yLeft[x] : yRight[x - 8]);
+                const f32 cb = static_cast<f32>(cbRow[x / 2]);
+                const f32 cr = static_cast<f32>(crRow[x / 2]);
+
+                // Actually is no alpha in FMVs
+                const u32 red = ClampToByte(luma + kCbToRed * cb);
+                const u32 green = ClampToByte(luma - kCrToGreen * cr - kCbToGreen * cb);
+                const u32 blue = ClampToByte(luma + kCrToBlue * cr);
+                out[x] = (blue << 16) | (green << 8) | red;
+            }
+#endif
+
+            if (out != dst)
+            {
+                std::copy(row, row + visibleWidth, dst);
+            }
+        }
+    }
+
+    static u8 ClampPlane(s32 v)
+    {
+        return static_cast<u8>(std::min(std::max(v, 0), 255));
+    }
+
+    // Masher's names for the chroma blocks are the other way round to what the colour conversion adds them to
+    static void CopyYuvToPlanes(const MacroBlockContext& ctx, u8* yPlane, u8* cbPlane, u8* crPlane, int xoff, int yoff, int width, int height)
+    {
+        const int visibleWidth = std::min(static_cast<int>(kMacroBlockWidth), width - xoff);
+        const int visibleHeight = std::min(static_cast<int>(kMacroBlockHeight), height - yoff);
+        for (int y = 0; y < visibleHeight; y++)
+        {
+            const s32* yLeft = (y < 8 ? ctx.mY1 : ctx.mY3).data() + ((y & 7) * 8);
+            const s32* yRight = (y < 8 ? ctx.mY2 : ctx.mY4).data() + ((y & 7) * 8);
+            u8* dst = yPlane + ((yoff + y) * width) + xoff;
+            for (int x = 0; x < visibleWidth; x++)
+            {
+                dst[x] = ClampPlane(x < 8 ? yLeft[x] : yRight[x - 8]);
+            }
+        }
+
+        const int chromaPitch = (width + 1) / 2;
+        const int chromaOffset = ((yoff / 2) * chromaPitch) + (xoff / 2);
+        for (int y = 0; y < (visibleHeight + 1) / 2; y++)
+        {
+            for (int x = 0; x < (visibleWidth + 1) / 2; x++)
+            {
+                cbPlane[chromaOffset + (y * chromaPitch) + x] = ClampPlane(ctx.mCr[(y * 8) + x] + 128);
+                crPlane[chromaOffset + (y * chromaPitch) + x] = ClampPlane(ctx.mCb[(y * 8) + x] + 128);
+            }
+        }
+    }
+
+    static void after_block_decode_no_effect_q_impl(MacroBlockContext& ctx, int quantScale)
+    {
+        ctx.mYQuant[0] = 16;
+        ctx.mCQuant[0] = 16;
         if (quantScale > 0)
         {
             signed int result = 0;
@@ -683,8 +888,8 @@ namespace Oddlib
             {
                 auto val = gQuant1_dword_42AEC8[result];
                 result++;
-                g_252_buffer_unk_63580C[result] = quantScale * val;
-                g_252_buffer_unk_635A0C[result] = quantScale * gQaunt2_dword_42AFC4[result];
+                ctx.mYQuant[result] = quantScale * val;
+                ctx.mCQuant[result] = quantScale * gQaunt2_dword_42AFC4[result];
 
 
             } while (result < 63);                   // 252/4=63
@@ -694,78 +899,204 @@ namespace Oddlib
             // These are simply null buffers to start with
             for (int i = 0; i < 64; i++)
             {
-                g_252_buffer_unk_635A0C[i] = 16;
-                g_252_buffer_unk_63580C[i] = 16;
+                ctx.mCQuant[i] = 16;
+                ctx.mYQuant[i] = 16;
             }
-            // memset(&g_252_buffer_unk_635A0C[1], 16, 252  /*sizeof(g_252_buffer_unk_635A0C)*/); // u32[63]
-            // memset(&g_252_buffer_unk_63580C[1], 16, 252 /*sizeof(g_252_buffer_unk_63580C)*/);
         }
 
     }
 
-    void Masher::ParseVideoFrame(u32* pixelBuffer)
+    // IDCTs and colour converts rows firstRow to endRow - 1 of the macro block grid
+    void Masher::DecodeMacroBlockRows(const VideoOutput& video, MacroBlockContext& ctx, u32 firstRow, u32 endRow)
     {
-        if (mNumMacroblocksX <= 0 || mNumMacroblocksY <= 0)
+        for (u32 xBlock = 0; xBlock < mNumMacroblocksX; xBlock++)
         {
-            return;
+            for (u32 yBlock = firstRow; yBlock < endRow; yBlock++)
+            {
+                int16_t* blocks = reinterpret_cast<int16_t*>(mMacroBlockBuffer.data()) + (((xBlock * mNumMacroblocksY) + yBlock) * kNumberOfBlocks * kBlockBufferSize);
+                FastIdct(blocks, ctx.mCr);
+                FastIdct(blocks + kBlockBufferSize, ctx.mCb);
+                FastIdct(blocks + (kBlockBufferSize * 2), ctx.mY1);
+                FastIdct(blocks + (kBlockBufferSize * 3), ctx.mY2);
+                FastIdct(blocks + (kBlockBufferSize * 4), ctx.mY3);
+                FastIdct(blocks + (kBlockBufferSize * 5), ctx.mY4);
+
+                if (video.mPixels)
+                {
+                    ConvertYuvToRgbAndBlit(ctx, video.mPixels, xBlock * kMacroBlockWidth, yBlock * kMacroBlockHeight, mVideoHeader.mWidth, mVideoHeader.mHeight);
+                }
+                else
+                {
+                    CopyYuvToPlanes(ctx, video.mY, video.mCb, video.mCr, xBlock * kMacroBlockWidth, yBlock * kMacroBlockHeight, mVideoHeader.mWidth, mVideoHeader.mHeight);
+                }
+            }
         }
+    }
 
-        const int quantScale = decode_bitstream((u16*)mVideoFrameData.data(), mDecodedVideoFrameData.data());
+    void Masher::IdctBlock(int16_t* input, T64IntsArray& output, bool fast)
+    {
+        if (fast)
+        {
+            FastIdct(input, output);
+        }
+        else
+        {
+            idct(input, output);
+        }
+    }
 
-        after_block_decode_no_effect_q_impl(quantScale);
+    void Masher::ConvertMacroBlock(const MacroBlockContext& ctx, u32* pixels, int xoff, int yoff, int width, int height)
+    {
+        ConvertYuvToRgbAndBlit(ctx, pixels, xoff, yoff, width, height);
+    }
 
+    Masher::~Masher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mBandMutex);
+            mStopBandWorkers = true;
+        }
+        mBandStart.notify_all();
 
-        int16_t* bitstreamCurPos = (int16_t*)mDecodedVideoFrameData.data();
-        int16_t* block1Output = (int16_t*)mMacroBlockBuffer.data();
+        for (std::thread& worker : mBandWorkers)
+        {
+            worker.join();
+        }
+    }
+
+    // Only allocates the first time a frame needs more bands than before, normally just the first frame
+    void Masher::StartBandWorkers(u32 bands)
+    {
+        if (mBandContexts.size() < bands)
+        {
+            mBandContexts.resize(bands);
+        }
 
-        int xoff = 0;
-        for (unsigned int xBlock = 0; xBlock < mNumMacroblocksX; xBlock++)
+        while (mBandWorkers.size() + 1 < bands)
         {
-            int yoff = 0;
-            for (unsigned int yBlock = 0; yBlock < mNumMacroblocksY; yBlock++)
+            mBandWorkers.emplace_back(&Masher::BandWorker, this, static_cast<u32>(mBandWorkers.size() + 1), mBandFrame);
+        }
+    }
+
+    // Worker thread context, decodes the same band of every frame that has that many bands
+    void Masher::BandWorker(u32 band, u32 lastFrame)
+    {
+        for (;;)
+        {
+            const VideoOutput* video = nullptr;
+            u32 bands = 0;
             {
-                const int dataSizeBytes = 64 * 4;// thisPtr->mBlockDataSize_q * 4; // Convert to byte count 64*4=256
+                std::unique_lock<std::mutex> lock(mBandMutex);
+                mBandStart.wait(lock, [this, lastFrame]() { return mStopBandWorkers || mBandFrame != lastFrame; });
+                if (mStopBandWorkers)
+                {
+                    return;
+                }
+                lastFrame = mBandFrame;
+                video = mBandVideo;
+                bands = mBandCount;
+            }
 
-                int16_t* afterBlock1Ptr = ddv_func7_DecodeMacroBlock_impl(bitstreamCurPos, block1Output, 0);
-                idct(block1Output, Cr_block);
-                int16_t* block2Output = dataSizeBytes + block1Output;
+            if (band >= bands)
+            {
+                continue;
+            }
 
-                int16_t* afterBlock2Ptr = ddv_func7_DecodeMacroBlock_impl(afterBlock1Ptr, block2Output, 0);
-                idct(block2Output, Cb_block);
-                int16_t* block3Output = dataSizeBytes + block2Output;
+            DecodeMacroBlockRows(*video, mBandContexts[band], (mNumMacroblocksY * band) / bands, (mNumMacroblocksY * (band + 1)) / bands);
 
-                int16_t* afterBlock3Ptr = ddv_func7_DecodeMacroBlock_impl(afterBlock2Ptr, block3Output, 1);
-                idct(block3Output, Y1_block);
-                int16_t* block4Output = dataSizeBytes + block3Output;
+            bool lastBand = false;
+            {
+                std::lock_guard<std::mutex> lock(mBandMutex);
+                lastBand = --mBandsLeft == 0;
+            }
 
-                int16_t* afterBlock4Ptr = ddv_func7_DecodeMacroBlock_impl(afterBlock3Ptr, block4Output, 1);
-                idct(block4Output, Y2_block);
-                int16_t* block5Output = dataSizeBytes + block4Output;
+            if (lastBand)
+            {
+                mBandDone.notify_one();
+            }
+        }
+    }
 
-                int16_t* afterBlock5Ptr = ddv_func7_DecodeMacroBlock_impl(afterBlock4Ptr, block5Output, 1);
-                idct(block5Output, Y3_block);
-                int16_t* block6Output = dataSizeBytes + block5Output;
+    u32 Masher::NumberOfDecodeBands() const
+    {
+        u32 bands = mDecodeThreads;
+        if (bands == 0)
+        {
+            // Waking a worker and waiting for it isn't free, so small frames aren't split up
+            const u32 kMinMacroBlocksPerBand = 300;
+            bands = std::min(std::max(std::thread::hardware_concurrency(), 1u), (mNumMacroblocksX * mNumMacroblocksY) / kMinMacroBlocksPerBand);
+        }
+        return std::min(std::max(bands, 1u), mNumMacroblocksY);
+    }
 
-                bitstreamCurPos = ddv_func7_DecodeMacroBlock_impl(afterBlock5Ptr, block6Output, 1);
-                idct(block6Output, Y4_block);
-                block1Output = dataSizeBytes + block6Output;
+    void Masher::ParseVideoFrame(const VideoOutput& video)
+    {
+        if (mNumMacroblocksX <= 0 || mNumMacroblocksY <= 0)
+        {
+            return;
+        }
 
-                ConvertYuvToRgbAndBlit(pixelBuffer, xoff, yoff, mVideoHeader.mWidth, mVideoHeader.mHeight);
+        const int quantScale = decode_bitstream((u16*)mVideoFrameData.data(), mDecodedVideoFrameData.data());
+
+        MacroBlockContext& ctx = mMacroBlockContext;
+        after_block_decode_no_effect_q_impl(ctx, quantScale);
 
-                yoff += kMacroBlockHeight;
+        // Where each block starts in the bitstream is only known once the one before it has been read, so
+        // this part is serial. It leaves the coefficients of every block of the frame in mMacroBlockBuffer.
+        int16_t* bitstreamCurPos = (int16_t*)mDecodedVideoFrameData.data();
+        int16_t* blockOutput = (int16_t*)mMacroBlockBuffer.data();
+        const u32 numMacroBlocks = mNumMacroblocksX * mNumMacroblocksY;
+        for (u32 i = 0; i < numMacroBlocks; i++)
+        {
+            // Cr and Cb then Y1 to Y4
+            for (u32 block = 0; block < kNumberOfBlocks; block++)
+            {
+                bitstreamCurPos = ddv_func7_DecodeMacroBlock_impl(ctx, bitstreamCurPos, blockOutput, block >= 2);
+                blockOutput += kBlockBufferSize;
             }
-            xoff += kMacroBlockWidth;
         }
 
+        // From here each macro block is independent, so bands of rows can be done at the same time
+        const u32 bands = NumberOfDecodeBands();
+        StartBandWorkers(bands);
+
+        {
+            std::lock_guard<std::mutex> lock(mBandMutex);
+            mBandVideo = &video;
+            mBandCount = bands;
+            mBandsLeft = bands - 1;
+            mBandFrame++;
+        }
+        mBandStart.notify_all();
+
+        DecodeMacroBlockRows(video, mBandContexts[0], 0, mNumMacroblocksY / bands);
+
+        std::unique_lock<std::mutex> lock(mBandMutex);
+        mBandDone.wait(lock, [this]() { return mBandsLeft == 0; });
+        mBandVideo = nullptr;
     }
 
-    AudioDecompressor::AudioDecompressor()
+    // Number of bits needed to hold each byte value
+    static std::array<u8, 256> MakeSoundTable()
     {
-        init_Snd_tbl();
+        std::array<u8, 256> table = {};
+        for (u32 index = 0; index < table.size(); index++)
+        {
+            u8 tableValue = 0;
+            for (u32 i = index; i > 0; ++tableValue)
+            {
+                i >>= 1;
+            }
+            table[index] = tableValue;
+        }
+        return table;
     }
 
     /*static*/ s32 AudioDecompressor::GetSoundTableValue(s16 tblIndex)
     {
+        // Built on first use and never written again, so any number of decoders can share it
+        static const std::array<u8, 256> gSndTbl_byte_62EEB0 = MakeSoundTable();
+
         const s32 positiveTblIdx = static_cast<s32>(abs(tblIndex));
         const u32 shiftedIdx = (positiveTblIdx >> 7) & 0xFF;
         s32 result = (u16)((s16)gSndTbl_byte_62EEB0[shiftedIdx] << 7) | (u16)(positiveTblIdx >> gSndTbl_byte_62EEB0[shiftedIdx]);
@@ -935,27 +1266,6 @@ namespace Oddlib
         return mAudioFrameSizeBytes;
     }
 
-    /*static*/ void AudioDecompressor::init_Snd_tbl()
-    {
-        static bool done = false;
-        if (!done)
-        {
-            done = true;
-            int index = 0;
-            do
-            {
-                int tableValue = 0;
-                for (int i = index; i > 0; ++tableValue)
-                {
-                    i >>= 1;
-                }
-                gSndTbl_byte_62EEB0[index++] = static_cast<u8>(tableValue);
-            } while (index < 256);
-        }
-    }
-
-
-    /*static*/ u8 AudioDecompressor::gSndTbl_byte_62EEB0[256];
 
     void Masher::decode_audio_frame(u16 *rawFrameBuffer, u16 *outPtr, signed int numSamplesPerFrame)
     {
@@ -988,7 +1298,30 @@ namespace Oddlib
         }
     }
 
+    // Every frame is intra coded and audio frames are decoded on their own, so any frame can be decoded first
+    bool Masher::SeekToFrame(u32 frameNumber)
+    {
+        if (frameNumber >= mFileHeader.mNumberOfFrames)
+        {
+            return false;
+        }
+
+        mStream->Seek(mFrameOffsets[frameNumber]);
+        mCurrentFrame = frameNumber;
+        return true;
+    }
+
     bool Masher::Update(u32* pixelBuffer, u8* audioBuffer)
+    {
+        return Update(VideoOutput{ pixelBuffer, nullptr, nullptr, nullptr }, audioBuffer);
+    }
+
+    bool Masher::Update(u8* yPlane, u8* cbPlane, u8* crPlane, u8* audioBuffer)
+    {
+        return Update(VideoOutput{ nullptr, yPlane, cbPlane, crPlane }, audioBuffer);
+    }
+
+    bool Masher::Update(const VideoOutput& video, u8* audioBuffer)
     {
         if (mCurrentFrame < mFileHeader.mNumberOfFrames)
         {
@@ -1011,7 +1344,7 @@ namespace Oddlib
                 // Audio data
                 mAudioFrameData.resize(audioDataSize);
                 mStream->Read(mAudioFrameData);
-                ParseVideoFrame(pixelBuffer);
+                ParseVideoFrame(video);
                 ParseAudioFrame(audioBuffer);
             }
             else if (mbHasAudio)
@@ -1026,7 +1359,7 @@ namespace Oddlib
                 const uint32_t totalSize = mFrameSizes[mCurrentFrame];
                 mVideoFrameData.resize(totalSize);
                 mStream->Read(mVideoFrameData);
-                ParseVideoFrame(pixelBuffer);
+                ParseVideoFrame(video);
             }
             mCurrentFrame++;
             return true;
@@ -7,6 +7,7 @@
 #undef WIN32_LEAN_AND_MEAN
 #endif
 #include "SDL_opengl.h"
+#include <cstring>
 
 #ifdef NDEBUG
 #   define GL(x) x
@@ -151,6 +152,12 @@ public:
         GL(glAttachShader(mShader, shader.mShaderProgram));
     }
 
+    // Must be called before Link()
+    void BindAttribute(GLint location, const char* name)
+    {
+        GL(glBindAttribLocation(mShader, location, name));
+    }
+
     GLint Attribute(const char* name)
     {
         GLint ret = glGetAttribLocation(mShader, name);
@@ -185,6 +192,32 @@ public:
 // TODO: Error message
 #define ALIVE_FATAL_ERROR() abort()
 
+static inline TextureHandle GLToTextureHandle(const GLuint textureNumber)
+{
+    TextureHandle r;
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4312) // 'reinterpret_cast': conversion from 'const GLuint' to 'void *' of greater size
+#endif
+    r.mData = reinterpret_cast<void*>(textureNumber);
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+    return r;
+}
+
+static inline GLuint TextureHandleToGL(TextureHandle handle)
+{
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4311) // 'reinterpret_cast': pointer truncation from 'void *' to 'GLuint'
+#endif
+    return static_cast<GLuint>(reinterpret_cast<uintptr_t>(handle.mData));
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+}
+
 const static GLchar* kVertexShader =
     "#version 330\n"
     "uniform mat4 ProjMtx;\n"
@@ -211,6 +244,51 @@ const static GLchar* kFragmentShader =
     "   Out_Color = Frag_Color * texture( Texture, Frag_UV.st);\n"
     "}\n";
 
+// Texture holds 8 bit palette indices. Filtering has to happen after the palette look up as
+// blending indices together gives unrelated colours, so this does the bilinear filtering by hand.
+const static GLchar* kPaletteFragmentShader =
+    "#version 330\n"
+    "uniform sampler2D Texture;\n"
+    "uniform sampler2D Palette;\n"
+    "in vec2 Frag_UV;\n"
+    "in vec4 Frag_Color;\n"
+    "out vec4 Out_Color;\n"
+    "vec4 Lookup(ivec2 texel, ivec2 size)\n"
+    "{\n"
+    "   float index = texelFetch(Texture, clamp(texel, ivec2(0), size - 1), 0).r;\n"
+    "   return texelFetch(Palette, ivec2(int(index * 255.0 + 0.5), 0), 0);\n"
+    "}\n"
+    "void main()\n"
+    "{\n"
+    "   ivec2 size = textureSize(Texture, 0);\n"
+    "   vec2 pos = Frag_UV.st * vec2(size) - 0.5;\n"
+    "   ivec2 base = ivec2(floor(pos));\n"
+    "   vec2 f = fract(pos);\n"
+    "   vec4 top = mix(Lookup(base, size), Lookup(base + ivec2(1, 0), size), f.x);\n"
+    "   vec4 bottom = mix(Lookup(base + ivec2(0, 1), size), Lookup(base + ivec2(1, 1), size), f.x);\n"
+    "   Out_Color = Frag_Color * mix(top, bottom, f.y);\n"
+    "}\n";
+
+// Texture is the Y plane, Cb and Cr are half its size and can be a texel wider/taller for odd sizes,
+// so their UVs are scaled to line up. The weights are the JFIF ones both FMV formats use.
+const static GLchar* kYCbCrFragmentShader =
+    "#version 330\n"
+    "uniform sampler2D Texture;\n"
+    "uniform sampler2D Cb;\n"
+    "uniform sampler2D Cr;\n"
+    "in vec2 Frag_UV;\n"
+    "in vec4 Frag_Color;\n"
+    "out vec4 Out_Color;\n"
+    "void main()\n"
+    "{\n"
+    "   vec2 chromaUV = Frag_UV.st * vec2(textureSize(Texture, 0)) / vec2(textureSize(Cb, 0) * 2);\n"
+    "   float y = texture(Texture, Frag_UV.st).r;\n"
+    "   float cb = texture(Cb, chromaUV).r - (128.0 / 255.0);\n"
+    "   float cr = texture(Cr, chromaUV).r - (128.0 / 255.0);\n"
+    "   vec3 rgb = vec3(y + (1.402 * cr), y - (0.3437 * cb) - (0.7143 * cr), y + (1.772 * cb));\n"
+    "   Out_Color = Frag_Color * vec4(clamp(rgb, 0.0, 1.0), 1.0);\n"
+    "}\n";
+
 bool OpenGLRenderer::CreateShadersAndBufferObjects()
 {
     mShader = std::make_unique<Shader>();
@@ -226,12 +304,48 @@ bool OpenGLRenderer::CreateShadersAndBufferObjects()
     mAttribLocationUV = mShader->Attribute("UV");
     mAttribLocationColor = mShader->Attribute("Color");
 
+    mPaletteShader = std::make_unique<Shader>();
+    mPaletteShader->mVertexShader.Compile(&kVertexShader);
+    mPaletteShader->mFragmentShader.Compile(&kPaletteFragmentShader);
+    mPaletteShader->AddShader(mPaletteShader->mVertexShader);
+    mPaletteShader->AddShader(mPaletteShader->mFragmentShader);
+
+    // Use the same attribute locations as mShader so both can draw from the same VAOs
+    mPaletteShader->BindAttribute(mAttribLocationPosition, "Position");
+    mPaletteShader->BindAttribute(mAttribLocationUV, "UV");
+    mPaletteShader->BindAttribute(mAttribLocationColor, "Color");
+    mPaletteShader->Link();
+
+    mPaletteLocationTex = mPaletteShader->Uniform("Texture");
+    mPaletteLocationPalette = mPaletteShader->Uniform("Palette");
+    mPaletteLocationProjMtx = mPaletteShader->Uniform("ProjMtx");
+
+    mYCbCrShader = std::make_unique<Shader>();
+    mYCbCrShader->mVertexShader.Compile(&kVertexShader);
+    mYCbCrShader->mFragmentShader.Compile(&kYCbCrFragmentShader);
+    mYCbCrShader->AddShader(mYCbCrShader->mVertexShader);
+    mYCbCrShader->AddShader(mYCbCrShader->mFragmentShader);
+    mYCbCrShader->BindAttribute(mAttribLocationPosition, "Position");
+    mYCbCrShader->BindAttribute(mAttribLocationUV, "UV");
+    mYCbCrShader->BindAttribute(mAttribLocationColor, "Color");
+    mYCbCrShader->Link();
+
+    mYCbCrLocationTex = mYCbCrShader->Uniform("Texture");
+    mYCbCrLocationCb = mYCbCrShader->Uniform("Cb");
+    mYCbCrLocationCr = mYCbCrShader->Uniform("Cr");
+    mYCbCrLocationProjMtx = mYCbCrShader->Uniform("ProjMtx");
+
     mGuiVbo = std::make_unique<BufferObject>(GL_ARRAY_BUFFER);
     mGuiIbo = std::make_unique<BufferObject>(GL_ELEMENT_ARRAY_BUFFER);
     mGuiVao = std::make_unique<Vao>();
     mGuiVao->Bind();
     mGuiVao->BindAttributes(mGuiVbo, mAttribLocationPosition, mAttribLocationColor, mAttribLocationUV);
 
+    for (std::unique_ptr<BufferObject>& pbo : mUploadBuffers)
+    {
+        pbo = std::make_unique<BufferObject>(GL_PIXEL_UNPACK_BUFFER);
+    }
+
     mRendererVbo = std::make_unique<BufferObject>(GL_ARRAY_BUFFER);
     mRendererIbo = std::make_unique<BufferObject>(GL_ELEMENT_ARRAY_BUFFER);
     mRendererVao = std::make_unique<Vao>();
@@ -253,15 +367,40 @@ OpenGLRenderer::~OpenGLRenderer()
     SDL_GL_DeleteContext(mContext);
 }
 
-void OpenGLRenderer::SetWorldMatrix()
+void OpenGLRenderer::UseShader(eShaders shader, const float* projMtx)
+{
+    switch (shader)
+    {
+    case eShaders::ePaletted:
+        mPaletteShader->Use();
+        glUniform1i(mPaletteLocationTex, 0);
+        glUniform1i(mPaletteLocationPalette, 1);
+        glUniformMatrix4fv(mPaletteLocationProjMtx, 1, GL_FALSE, projMtx);
+        break;
+
+    case eShaders::eYCbCr:
+        mYCbCrShader->Use();
+        glUniform1i(mYCbCrLocationTex, 0);
+        glUniform1i(mYCbCrLocationCb, 1);
+        glUniform1i(mYCbCrLocationCr, 2);
+        glUniformMatrix4fv(mYCbCrLocationProjMtx, 1, GL_FALSE, projMtx);
+        break;
+
+    case eShaders::eTextured:
+        mShader->Use();
+        glUniform1i(mAttribLocationTex, 0);
+        glUniformMatrix4fv(mAttribLocationProjMtx, 1, GL_FALSE, projMtx);
+        break;
+    }
+}
+
+void OpenGLRenderer::SetWorldMatrix(eShaders shader)
 {
     glm::mat4 mat = mProjection * mView;
-    mShader->Use();
-    glUniform1i(mAttribLocationTex, 0);
-    glUniformMatrix4fv(mAttribLocationProjMtx, 1, GL_FALSE, &mat[0][0]);
+    UseShader(shader, &mat[0][0]);
 }
 
-void OpenGLRenderer::SetScreenMatrix()
+void OpenGLRenderer::SetScreenMatrix(eShaders shader)
 {
     ImGuiIO& io = ImGui::GetIO();
     const float ortho_projection[4][4] =
@@ -271,21 +410,44 @@ void OpenGLRenderer::SetScreenMatrix()
         { 0.0f,                  0.0f,                  -1.0f, 0.0f },
         { -1.0f,                  1.0f,                   0.0f, 1.0f },
     };
-    mShader->Use();
-    glUniform1i(mAttribLocationTex, 0);
-    glUniformMatrix4fv(mAttribLocationProjMtx, 1, GL_FALSE, &ortho_projection[0][0]);
+    UseShader(shader, &ortho_projection[0][0]);
 }
 
 void OpenGLRenderer::OnSetRenderState(CmdState& info)
 {
-   
+    eShaders shader = eShaders::eTextured;
+    if (info.mPalette.IsValid())
+    {
+        shader = eShaders::ePaletted;
+    }
+    else if (info.mCb.IsValid() && info.mCr.IsValid())
+    {
+        shader = eShaders::eYCbCr;
+    }
+
     if (info.mCoordinateSystem == AbstractRenderer::eScreen)
     {
-        SetScreenMatrix();
+        SetScreenMatrix(shader);
     }
     else if (info.mCoordinateSystem == AbstractRenderer::eWorld)
     {
-        SetWorldMatrix();
+        SetWorldMatrix(shader);
+    }
+
+    // The index or Y texture is bound to unit 0 by ImGuiRender as normal
+    if (shader == eShaders::ePaletted)
+    {
+        GL(glActiveTexture(GL_TEXTURE1));
+        GL(glBindTexture(GL_TEXTURE_2D, TextureHandleToGL(info.mPalette)));
+        GL(glActiveTexture(GL_TEXTURE0));
+    }
+    else if (shader == eShaders::eYCbCr)
+    {
+        GL(glActiveTexture(GL_TEXTURE1));
+        GL(glBindTexture(GL_TEXTURE_2D, TextureHandleToGL(info.mCb)));
+        GL(glActiveTexture(GL_TEXTURE2));
+        GL(glBindTexture(GL_TEXTURE_2D, TextureHandleToGL(info.mCr)));
+        GL(glActiveTexture(GL_TEXTURE0));
     }
 
     if (info.mBlendMode == AbstractRenderer::eNormal)
@@ -311,6 +473,9 @@ static int ToGLFormat(AbstractRenderer::eTextureFormats format)
         return GL_RGB;
     case AbstractRenderer::eTextureFormats::eA:
         return GL_ALPHA;
+    case AbstractRenderer::eTextureFormats::eIndex8:
+    case AbstractRenderer::eTextureFormats::ePlane8:
+        return GL_RED;
     }
     ALIVE_FATAL_ERROR();
 }
@@ -403,32 +568,6 @@ static inline BlendMode ToBlendMode(const AbstractRenderer::eBlendModes mode)
 }
 */
 
-static inline TextureHandle GLToTextureHandle(const GLuint textureNumber)
-{
-    TextureHandle r;
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable: 4312) // 'reinterpret_cast': conversion from 'const GLuint' to 'void *' of greater size
-#endif
-    r.mData = reinterpret_cast<void*>(textureNumber);
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif
-    return r;
-}
-
-static inline GLuint TextureHandleToGL(TextureHandle handle)
-{
-#ifdef _MSC_VER
-#pragma warning(push)
-#pragma warning(disable: 4311) // 'reinterpret_cast': pointer truncation from 'void *' to 'GLuint'
-#endif
-    return static_cast<GLuint>(reinterpret_cast<uintptr_t>(handle.mData));
-#ifdef _MSC_VER
-#pragma warning(pop)
-#endif
-}
-
 void OpenGLRenderer::ImGuiRender(ImDrawData* draw_data, std::unique_ptr<Vao>& vao, std::unique_ptr<BufferObject>& vbo, std::unique_ptr<BufferObject>& ibo)
 {
     // Avoid rendering when minimized, scale coordinates for retina displays (screen coordinates != framebuffer coordinates)
@@ -554,10 +693,27 @@ void OpenGLRenderer::SetVSync(bool on)
     SDL_GL_SetSwapInterval(on ? 1 : 0);
 }
 
-TextureHandle OpenGLRenderer::CreateTexture(eTextureFormats internalFormat, u32 width, u32 height, eTextureFormats inputFormat, const void* pixels, bool interpolation)
+static u32 BytesPerPixel(AbstractRenderer::eTextureFormats format)
+{
+    switch (format)
+    {
+    case AbstractRenderer::eTextureFormats::eRGBA:
+        return 4;
+    case AbstractRenderer::eTextureFormats::eRGB:
+        return 3;
+    case AbstractRenderer::eTextureFormats::eA:
+    case AbstractRenderer::eTextureFormats::eIndex8:
+    case AbstractRenderer::eTextureFormats::ePlane8:
+        return 1;
+    }
+    ALIVE_FATAL_ERROR();
+}
+
+// Alpha only input is expanded to white RGBA, returns pixels unchanged for any other format
+static const void* ConvertInputPixels(AbstractRenderer::eTextureFormats& inputFormat, u32 width, u32 height, const void* pixels)
 {
     static std::vector<u32> converted; // Shared scratch buffer - not thread safe, but then GL isn't thread safe anyway
-    if (inputFormat == AbstractRenderer::eTextureFormats::eA)
+    if (inputFormat == AbstractRenderer::eTextureFormats::eA && pixels)
     {
         converted.resize(width*height);
         const u8* alphaPixels = reinterpret_cast<const u8*>(pixels);
@@ -572,7 +728,14 @@ TextureHandle OpenGLRenderer::CreateTexture(eTextureFormats internalFormat, u32
             }
         }
         inputFormat = AbstractRenderer::eTextureFormats::eRGBA;
+        return converted.data();
     }
+    return pixels;
+}
+
+TextureHandle OpenGLRenderer::CreateTexture(eTextureFormats internalFormat, u32 width, u32 height, eTextureFormats inputFormat, const void* pixels, bool interpolation)
+{
+    pixels = ConvertInputPixels(inputFormat, width, height, pixels);
 
     GLuint tex = 0;
     GL(glGenTextures(1, &tex));
@@ -588,13 +751,44 @@ TextureHandle OpenGLRenderer::CreateTexture(eTextureFormats internalFormat, u32
         width, height, 0,
         ToGLFormat(inputFormat),
         GL_UNSIGNED_BYTE,
-        converted.empty() ? pixels : converted.data()));
-    
-    converted.clear();
+        pixels));
 
     return GLToTextureHandle(tex);
 }
 
+void OpenGLRenderer::UpdateTexture(TextureHandle handle, u32 width, u32 height, eTextureFormats inputFormat, const void* pixels)
+{
+    pixels = ConvertInputPixels(inputFormat, width, height, pixels);
+    const u32 size = width * height * BytesPerPixel(inputFormat);
+
+    BufferObject& pbo = *mUploadBuffers[mNextUploadBuffer];
+    mNextUploadBuffer = (mNextUploadBuffer + 1) % kNumUploadBuffers;
+
+    // Orphan the buffers old storage, if the GPU is still reading from it the driver gives us new storage rather than blocking
+    pbo.SetData<u8>(size, nullptr);
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    const void* source = nullptr; // Offset into the bound pixel unpack buffer
+    if (mapped)
+    {
+        memcpy(mapped, pixels, size);
+        GL(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+    }
+    else
+    {
+        // Fall back to a synchronous upload from client memory
+        LOG_WARNING("Failed to map pixel unpack buffer");
+        GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+        source = pixels;
+    }
+
+    GL(glBindTexture(GL_TEXTURE_2D, TextureHandleToGL(handle)));
+    GL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+    GL(glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, ToGLFormat(inputFormat), GL_UNSIGNED_BYTE, source));
+
+    // Texture uploads from client memory (CreateTexture) don't work with a pixel unpack buffer bound
+    GL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+}
+
 void OpenGLRenderer::DestroyTextures()
 {
     if (!mDestroyTextureList.empty())
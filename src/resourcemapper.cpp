@@ -3,9 +3,42 @@
 #include "oddlib/bits_factory.hpp"
 #include "oddlib/audio/vab.hpp"
 #include <cmath>
+#include <cstdio>
 #include "oddlib/audio/SequencePlayer.h"
 
-Animation::AnimationSetHolder::AnimationSetHolder(std::shared_ptr<Oddlib::LvlArchive> sLvlPtr, std::shared_ptr<Oddlib::AnimationSet> sAnimSetPtr, u32 animIdx) : mLvlPtr(sLvlPtr), mAnimSetPtr(sAnimSetPtr)
+AnimationPaletteTexture::AnimationPaletteTexture(const std::vector<u32>& palette) : mPalette(palette)
+{
+
+}
+
+AnimationPaletteTexture::~AnimationPaletteTexture()
+{
+    Destroy();
+}
+
+TextureHandle AnimationPaletteTexture::Get(AbstractRenderer& rend)
+{
+    if (!mTexture.IsValid() || mRenderer != &rend || mRendererLifetime.expired())
+    {
+        Destroy();
+        mRenderer = &rend;
+        mRendererLifetime = rend.Lifetime();
+        mTexture = rend.CreateTexture(AbstractRenderer::eTextureFormats::eRGBA, Oddlib::AnimationSet::kPaletteSize, 1, AbstractRenderer::eTextureFormats::eRGBA, mPalette.data(), false);
+    }
+    return mTexture;
+}
+
+void AnimationPaletteTexture::Destroy()
+{
+    // A renderer that has been shut down has already let go of all of its textures
+    if (mTexture.IsValid() && !mRendererLifetime.expired())
+    {
+        mRenderer->DestroyTexture(mTexture);
+    }
+    mTexture.mData = nullptr;
+}
+
+Animation::AnimationSetHolder::AnimationSetHolder(std::shared_ptr<Oddlib::LvlArchive> sLvlPtr, std::shared_ptr<Oddlib::AnimationSet> sAnimSetPtr, std::shared_ptr<AnimationPaletteTexture> sPaletteTexturePtr, u32 animIdx) : mLvlPtr(sLvlPtr), mAnimSetPtr(sAnimSetPtr), mPaletteTexturePtr(sPaletteTexturePtr)
 {
     mAnim = mAnimSetPtr->AnimationAt(animIdx);
 }
@@ -25,6 +58,29 @@ u32 Animation::AnimationSetHolder::MaxH() const
     return mAnimSetPtr->MaxH();
 }
 
+const std::vector<u32>& Animation::AnimationSetHolder::Palette() const
+{
+    return mAnimSetPtr->Palette();
+}
+
+TextureHandle Animation::AnimationSetHolder::PaletteTexture(AbstractRenderer& rend) const
+{
+    return mPaletteTexturePtr->Get(rend);
+}
+
+// Converts an indexed frame to RGBA for renderers that can't do the palette look up on the GPU
+static const std::vector<u32>& ExpandIndexedFrame(const SDL_Surface& frame, const std::vector<u32>& palette)
+{
+    static std::vector<u32> expanded; // Shared scratch buffer - rendering only happens on the main thread
+    expanded.resize(frame.w * frame.h);
+    const u8* indices = static_cast<const u8*>(frame.pixels);
+    for (size_t i = 0; i < expanded.size(); i++)
+    {
+        expanded[i] = palette[indices[i]];
+    }
+    return expanded;
+}
+
 Animation::Animation(AnimationSetHolder anim, bool isPsx, bool scaleFrameOffsets, u32 defaultBlendingMode, const std::string& sourceDataSet) : mAnim(anim), mIsPsx(isPsx), mScaleFrameOffsets(scaleFrameOffsets), mSourceDataSet(sourceDataSet)
 {
     switch (defaultBlendingMode)
@@ -115,20 +171,51 @@ void Animation::Render(AbstractRenderer& rend, bool flipX, int layer, AbstractRe
     {
         xFrameOffset = -xFrameOffset;
     }
-    // Render sprite as textured quad
-    const TextureHandle textureId = rend.CreateTexture(AbstractRenderer::eTextureFormats::eRGBA, frame.mFrame->w, frame.mFrame->h, AbstractRenderer::eTextureFormats::eRGBA, frame.mFrame->pixels, true);
-    rend.TexturedQuad(
-        textureId,
-        xpos + xFrameOffset,
-        ypos + yFrameOffset,
-        static_cast<f32>(frame.mFrame->w) * (flipX ? -ScaleX() : ScaleX()),
-        static_cast<f32>(frame.mFrame->h) * mScale,
-        layer,
-        ColourU8{ 255, 255, 255, 255 },
-        AbstractRenderer::eNormal,
-        coordinateSystem
-    );
-    rend.DestroyTexture(textureId);
+    const f32 quadX = xpos + xFrameOffset;
+    const f32 quadY = ypos + yFrameOffset;
+    const f32 quadW = static_cast<f32>(frame.mFrame->w) * (flipX ? -ScaleX() : ScaleX());
+    const f32 quadH = static_cast<f32>(frame.mFrame->h) * mScale;
+
+    // Don't upload the frame if it can't be seen
+    if (rend.IsVisible(quadX, quadY, quadW, quadH, coordinateSystem))
+    {
+        // Render sprite as textured quad
+        if (rend.SupportsPalettedTextures())
+        {
+            // Upload the 8 bit indices as is, the colours are looked up in the palette on the GPU
+            const TextureHandle textureId = rend.CreateTexture(AbstractRenderer::eTextureFormats::eIndex8, frame.mFrame->w, frame.mFrame->h, AbstractRenderer::eTextureFormats::eIndex8, frame.mFrame->pixels, false);
+            rend.PalettedTexturedQuad(
+                textureId,
+                mAnim.PaletteTexture(rend),
+                quadX,
+                quadY,
+                quadW,
+                quadH,
+                layer,
+                ColourU8{ 255, 255, 255, 255 },
+                AbstractRenderer::eNormal,
+                coordinateSystem
+            );
+            rend.DestroyTexture(textureId);
+        }
+        else
+        {
+            const std::vector<u32>& pixels = ExpandIndexedFrame(*frame.mFrame, mAnim.Palette());
+            const TextureHandle textureId = rend.CreateTexture(AbstractRenderer::eTextureFormats::eRGBA, frame.mFrame->w, frame.mFrame->h, AbstractRenderer::eTextureFormats::eRGBA, pixels.data(), true);
+            rend.TexturedQuad(
+                textureId,
+                quadX,
+                quadY,
+                quadW,
+                quadH,
+                layer,
+                ColourU8{ 255, 255, 255, 255 },
+                AbstractRenderer::eNormal,
+                coordinateSystem
+            );
+            rend.DestroyTexture(textureId);
+        }
+    }
 
     if (Debugging().mAnimBoundingBoxes)
     {
@@ -152,13 +239,13 @@ void Animation::Render(AbstractRenderer& rend, bool flipX, int layer, AbstractRe
     {
         // Render frame pos and frame number
         const glm::vec2 xyposScreen(rend.WorldToScreen(glm::vec2(xpos, ypos)));
+
+        // Formatted into a local buffer as this runs for every animation every frame
+        char debugText[256] = {};
+        snprintf(debugText, sizeof(debugText), "%s x: %f y: %f f: %d", mSourceDataSet.c_str(), xpos, ypos, FrameNumber());
         rend.Text(xyposScreen.x, xyposScreen.y,
             24.0f,
-            (mSourceDataSet
-                + " x: " + std::to_string(xpos)
-                + " y: " + std::to_string(ypos)
-                + " f: " + std::to_string(FrameNumber())
-                ).c_str(),
+            debugText,
             ColourU8{ 255,255,255,255 },
             AbstractRenderer::eLayers::eFmv,
             AbstractRenderer::eBlendModes::eNormal,
@@ -407,7 +494,7 @@ std::future<std::string> ResourceLocator::LocateScript(const std::string& script
     });
 }
 
-std::unique_ptr<ISound> ResourceLocator::DoLoadSoundMusic(const char* resourceName, const DataPaths::FileSystemInfo& fs, const std::string& strSb, const MusicResource& musicRes)
+std::unique_ptr<ISound> ResourceLocator::DoLoadSoundMusic(const char* resourceName, const DataPaths::FileSystemInfo& fs, const std::string& strSb, const MusicResource& musicRes, s32 priority)
 {
     const SoundBankLocation* sbl = mResMapper.FindSoundBank(strSb);
 
@@ -462,7 +549,9 @@ std::unique_ptr<ISound> ResourceLocator::DoLoadSoundMusic(const char* resourceNa
 
                     LOG_INFO("Using sound bank: " << sbl->mName);
 
-                    return std::make_unique<SeqSound>(resourceName, std::move(vab), std::move(seqStream));
+                    auto sound = std::make_unique<SeqSound>(resourceName, std::move(vab), std::move(seqStream));
+                    sound->mPriority = priority;
+                    return std::move(sound);
                 }
             }
         }
@@ -525,7 +614,7 @@ std::future<std::unique_ptr<Vab>> ResourceLocator::LocateVab(const std::string&
     });
 }
 
-std::unique_ptr<ISound> ResourceLocator::DoLoadSoundEffect(const char* resourceName, const DataPaths::FileSystemInfo& fs, const std::string& strSb, const SoundEffectResource& sfxRes, const SoundEffectResourceLocation& sfxResLoc)
+std::unique_ptr<ISound> ResourceLocator::DoLoadSoundEffect(const char* resourceName, const DataPaths::FileSystemInfo& fs, const std::string& strSb, const SoundEffectResource& sfxRes, const SoundEffectResourceLocation& sfxResLoc, s32 priority)
 {
     const SoundBankLocation* sbl = mResMapper.FindSoundBank(strSb);
 
@@ -573,13 +662,15 @@ std::unique_ptr<ISound> ResourceLocator::DoLoadSoundEffect(const char* resourceN
 
                 LOG_INFO("Using sound bank: " << sbl->mName);
 
-                return std::make_unique<SingleSeqSampleSound>(resourceName,
+                auto sound = std::make_unique<SingleSeqSampleSound>(resourceName,
                     std::move(vab),
                     sfxResLoc.mProgram,
                     sfxResLoc.mTone,
                     sfxRes.mMinPitch,
                     sfxRes.mMaxPitch,
                     sfxRes.mVolume);
+                sound->mPriority = priority;
+                return std::move(sound);
             }
         }
     }
@@ -608,7 +699,7 @@ std::future<std::unique_ptr<ISound>> ResourceLocator::LocateSound(const std::str
                         const std::set<std::string>& soundBanks = !explicitSoundBankName.empty() ? std::set<std::string> { explicitSoundBankName } : sr->mMusic.mSoundBanks;
                         for (const std::string& sb : soundBanks)
                         {
-                            auto ret = DoLoadSoundMusic(resourceName.c_str(), fs, sb, sr->mMusic);
+                            auto ret = DoLoadSoundMusic(resourceName.c_str(), fs, sb, sr->mMusic, sr->mPriority);
                             if (ret)
                             {
                                 return ret;
@@ -629,7 +720,7 @@ std::future<std::unique_ptr<ISound>> ResourceLocator::LocateSound(const std::str
                             const std::set<std::string>& soundBanks = !explicitSoundBankName.empty() ? std::set<std::string> { explicitSoundBankName } : loc.mSoundBanks;
                             for (const std::string& sb : soundBanks)
                             {
-                                auto ret = DoLoadSoundEffect(resourceName.c_str(), fs, sb, sr->mSoundEffect, loc);
+                                auto ret = DoLoadSoundEffect(resourceName.c_str(), fs, sb, sr->mSoundEffect, loc, sr->mPriority);
                                 if (ret)
                                 {
                                     return ret;
@@ -953,7 +1044,9 @@ std::unique_ptr<IMovie> ResourceLocator::DoLocateFmvFromFileLocation(const Resou
                     subTitles = std::make_unique<SubTitleParser>(std::move(subsStream));
                 }
             }
-            return IMovie::Factory(resourceName, audioController, std::move(stream), std::move(subTitles), location.mStartSector, location.mEndSector);
+            auto movie = IMovie::Factory(resourceName, audioController, std::move(stream), std::move(subTitles), location.mStartSector, location.mEndSector);
+            movie->SetFrameIndexCache(mDataPaths.GameFs(), "{CacheDir}/" + fs.mDataSetName + "_" + resourceName + "_" + std::to_string(location.mStartSector) + ".fmvidx");
+            return movie;
         }
     }
     return nullptr;
@@ -1109,7 +1202,7 @@ std::unique_ptr<Animation> ResourceLocator::DoLocateAnimation(const DataPaths::F
 
                             // Construct the animation from the chunk bytes
                             return std::make_unique<Animation>(
-                                Animation::AnimationSetHolder(lvlPtr, animSetPtr, animFile.mAnimationIndex),
+                                Animation::AnimationSetHolder(lvlPtr, animSetPtr, mCache.GetPaletteTexture(animSetPtr), animFile.mAnimationIndex),
                                 dataSetFileAttributes.mIsPsx,
                                 dataSetFileAttributes.mScaleFrameOffsets,
                                 animMapping.mBlendingMode,
@@ -1124,6 +1217,11 @@ std::unique_ptr<Animation> ResourceLocator::DoLocateAnimation(const DataPaths::F
     return nullptr;
 }
 
+void ISound::Mix(AliveAudioMixBus& bus, u32 len)
+{
+    Play(bus.Dry(), len);
+}
+
 BaseSeqSound::BaseSeqSound(const char* soundName, std::unique_ptr<Vab> vab)
     : mVab(std::move(vab)), mSoundName(soundName)
 {
@@ -1140,6 +1238,11 @@ void BaseSeqSound::Play(f32* stream, u32 len)
     mSeqPlayer->Play(stream, len);
 }
 
+void BaseSeqSound::Mix(AliveAudioMixBus& bus, u32 len)
+{
+    mSeqPlayer->Mix(bus, len);
+}
+
 bool BaseSeqSound::AtEnd() const
 {
     return mSeqPlayer->AtEnd();
@@ -1165,6 +1268,13 @@ const std::string& BaseSeqSound::Name() const
     return mSoundName;
 }
 
+std::unique_ptr<SequencePlayer> BaseSeqSound::CreatePlayer()
+{
+    auto player = std::make_unique<SequencePlayer>(mSoundName.c_str(), *mVab);
+    player->SetPriority(static_cast<u8>(std::min(std::max(mPriority, 0), 255)));
+    return player;
+}
+
 SingleSeqSampleSound::SingleSeqSampleSound(const char* soundName, std::unique_ptr<Vab> vab, u32 program, u32 note, u32 minPitch, u32 maxPitch, u32 /*vol*/)
     : BaseSeqSound(soundName, std::move(vab)), mProgram(program), mNote(note), mMinPitch(minPitch), mMaxPitch(maxPitch)
 {
@@ -1178,7 +1288,7 @@ static float RandFloat(float a, float b)
 
 void SingleSeqSampleSound::Load()
 {
-    mSeqPlayer = std::make_unique<SequencePlayer>(mSoundName.c_str(), *mVab);
+    mSeqPlayer = CreatePlayer();
     mSeqPlayer->NoteOnSingleShot(mProgram, mNote, 127, 0.0f, RandFloat(static_cast<f32>(mMinPitch), static_cast<f32>(mMaxPitch)));
 }
 
@@ -1190,7 +1300,7 @@ SeqSound::SeqSound(const char* soundName, std::unique_ptr<Vab> vab, std::unique_
 
 void SeqSound::Load()
 {
-    mSeqPlayer = std::make_unique<SequencePlayer>(mSoundName.c_str(), *mVab);
+    mSeqPlayer = CreatePlayer();
     mSeqPlayer->LoadSequenceStream(*mSeqData);
     mSeqPlayer->PlaySequence();
 }
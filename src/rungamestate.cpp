@@ -160,6 +160,7 @@ EngineStates RunGameState::Update(const InputState& input, CoordinateSpace& coor
                 if (mLevel->LoadMap(*mPathBeingLoaded))
                 {
                     mState = RunGameStates::eSoundsLoading;
+                    mSound->SetPrioritySounds(mLevel->SoundResources());
                     mSound->SetMusicTheme(mPathBeingLoaded->MusicThemeName().c_str());
                 }
             }
@@ -5,9 +5,35 @@
 
 std::atomic<SoundId> Sound::mSoundId(99);
 
+// Lets the sound bank debugger's player be handed to the audio thread like any other sound
+class SoundBankBrowserSound : public ISound
+{
+public:
+    SoundBankBrowserSound(const std::string& name, Vab& vab)
+        : mPlayer(name, vab)
+    {
+
+    }
+
+    virtual void Load() override { }
+    virtual void DebugUi() override { mPlayer.DebugUi(); }
+    virtual void Play(f32* stream, u32 len) override { mPlayer.Play(stream, len); }
+    virtual void Mix(AliveAudioMixBus& bus, u32 len) override { mPlayer.Mix(bus, len); }
+    virtual bool AtEnd() const override { return false; }
+    virtual void Restart() override { }
+    virtual void Update() override { mPlayer.Update(); }
+    virtual void Stop() override { mPlayer.StopSequence(); }
+    virtual const std::string& Name() const override { return mPlayer.Name(); }
+
+private:
+    SequencePlayer mPlayer;
+};
+
 Sound::Sound(IAudioController& audioController, ResourceLocator& locator, OSBaseFileSystem& fs)
     : mAudioController(audioController), mLocator(locator), mCache(fs)
 {
+    mAudioThreadSounds.reserve(mToAudioThread.Capacity());
+
     mAudioController.AddPlayer(this);
 
     Debugging().AddSection([&]()
@@ -27,8 +53,8 @@ Sound::~Sound()
 
 void Sound::SetMusicTheme(const char* themeName, const char* eventOnLoad)
 {
-    mAmbiance = nullptr;
-    mMusicTrack = nullptr;
+    ReplaceSound(mAmbiance, nullptr);
+    ReplaceSound(mMusicTrack, nullptr);
 
     // This is just an in-memory non blocking look up
     mThemeToLoad = mLocator.LocateSoundTheme(themeName).get();
@@ -51,6 +77,11 @@ void Sound::SetMusicTheme(const char* themeName, const char* eventOnLoad)
     }
 }
 
+void Sound::SetPrioritySounds(std::vector<std::string> soundNames)
+{
+    mPrioritySounds = std::move(soundNames);
+}
+
 bool Sound::IsLoading() const
 {
     return mState != eSoundStates::eIdle;
@@ -94,14 +125,14 @@ void Sound::HandleMusicEvent(const char* eventName)
 
     if (strcmp(eventName, "AMBIANCE") == 0)
     {
-        mMusicTrack = nullptr;
+        ReplaceSound(mMusicTrack, nullptr);
         return;
     }
 
     auto ret = PlayThemeEntry(eventName);
     if (ret)
     {
-        mMusicTrack = std::move(ret);
+        ReplaceSound(mMusicTrack, std::move(ret));
     }
 }
 
@@ -110,24 +141,143 @@ SoundId Sound::PlaySoundEffect(const char* soundName)
     auto pSound = PlaySound(soundName, "", true, true, true);
     if (pSound)
     {
-        std::lock_guard<std::mutex> lock(mSoundPlayersMutex);
-        auto id = mSoundId++;
-        mSoundPlayers[id] = std::move(pSound);
-        return id;
+        return AddSoundEffect(std::move(pSound), SoundPriority(soundName));
     }
     return 0;
 }
 
 void Sound::StopSoundEffect(SoundId id)
 {
-    std::lock_guard<std::mutex> lock(mSoundPlayersMutex);
     auto it = mSoundPlayers.find(id);
     if (it != mSoundPlayers.end())
     {
+        RetireSound(std::move(it->second.mSound));
         mSoundPlayers.erase(it);
     }
 }
 
+s32 Sound::SoundPriority(const std::string& soundName)
+{
+    const SoundResource* res = mLocator.mResMapper.FindSound(soundName.c_str());
+    return res ? res->mPriority : kDefaultSoundPriority;
+}
+
+SoundId Sound::AddSoundEffect(std::unique_ptr<ISound> sound, s32 priority)
+{
+    // Bounds the mixing cost of busy scenes, the lowest priority effect gives way and the
+    // oldest of those if there is a tie. A new effect never cuts off a more important one.
+    while (!mSoundPlayers.empty() && mSoundPlayers.size() >= mMaxSoundEffects)
+    {
+        auto victim = mSoundPlayers.end();
+        for (auto it = mSoundPlayers.begin(); it != mSoundPlayers.end(); it++)
+        {
+            if (it->second.mPriority <= priority && (victim == mSoundPlayers.end() || it->second.mPriority < victim->second.mPriority))
+            {
+                victim = it;
+            }
+        }
+
+        if (victim == mSoundPlayers.end())
+        {
+            // Never reached the audio thread so it can just be freed
+            mRejectedSoundEffects++;
+            return 0;
+        }
+
+        RetireSound(std::move(victim->second.mSound));
+        mSoundPlayers.erase(victim);
+    }
+
+    const SoundId id = mSoundId++;
+    StartSound(sound.get());
+    SoundEffect& effect = mSoundPlayers[id];
+    effect.mSound = std::move(sound);
+    effect.mPriority = priority;
+    return id;
+}
+
+void Sound::StartSound(ISound* sound)
+{
+    AudioThreadCommand cmd;
+    cmd.mType = eAudioThreadCommands::eAddSound;
+    cmd.mSound = sound;
+    mUnsentCommands.push_back(cmd);
+    FlushAudioThreadCommands();
+}
+
+void Sound::RetireSound(std::unique_ptr<ISound> sound)
+{
+    if (sound)
+    {
+        AudioThreadCommand cmd;
+        cmd.mType = eAudioThreadCommands::eRemoveSound;
+        cmd.mSound = sound.get();
+        mUnsentCommands.push_back(cmd);
+        mRetiredSounds.push_back(std::move(sound));
+        FlushAudioThreadCommands();
+    }
+}
+
+void Sound::ReplaceSound(std::unique_ptr<ISound>& slot, std::unique_ptr<ISound> sound)
+{
+    RetireSound(std::move(slot));
+    if (sound)
+    {
+        StartSound(sound.get());
+    }
+    slot = std::move(sound);
+}
+
+void Sound::FlushAudioThreadCommands()
+{
+    while (!mUnsentCommands.empty() && mToAudioThread.Push(mUnsentCommands.front()))
+    {
+        mUnsentCommands.pop_front();
+    }
+}
+
+void Sound::FreeRetiredSounds()
+{
+    ISound* stopped = nullptr;
+    while (mFromAudioThread.Pop(stopped))
+    {
+        for (auto it = mRetiredSounds.begin(); it != mRetiredSounds.end(); it++)
+        {
+            if (it->get() == stopped)
+            {
+                mRetiredSounds.erase(it);
+                break;
+            }
+        }
+    }
+}
+
+// Audio thread context
+void Sound::ProcessAudioThreadCommands()
+{
+    AudioThreadCommand cmd;
+    while (mToAudioThread.Pop(cmd))
+    {
+        switch (cmd.mType)
+        {
+        case eAudioThreadCommands::eAddSound:
+            // If we are at capacity the sound just doesn't play
+            if (mAudioThreadSounds.size() < mAudioThreadSounds.capacity())
+            {
+                mAudioThreadSounds.push_back(cmd.mSound);
+            }
+            break;
+
+        case eAudioThreadCommands::eRemoveSound:
+            mAudioThreadSounds.erase(std::remove(mAudioThreadSounds.begin(), mAudioThreadSounds.end(), cmd.mSound), mAudioThreadSounds.end());
+
+            // If this fails the sound is only freed when Sound is destroyed, which is better than freeing it here
+            mFromAudioThread.Push(cmd.mSound);
+            break;
+        }
+    }
+}
+
 void Sound::CacheActiveTheme(bool add)
 {
     for (auto& entry : mActiveTheme->mEntries)
@@ -136,7 +286,7 @@ void Sound::CacheActiveTheme(bool add)
         {
             if (add)
             {
-                mCache.CacheSound(mLocator, e.mMusicName);
+                mCache.CacheSound(mLocator, e.mMusicName, false, true);
             }
             else
             {
@@ -164,37 +314,28 @@ std::unique_ptr<ISound> Sound::PlayThemeEntry(const char* entryName)
 
 void Sound::EnsureAmbiance()
 {
-    std::lock_guard<std::mutex> lock(mSoundPlayersMutex);
     if (!mAmbiance)
     {
-        mAmbiance = PlayThemeEntry("AMBIANCE");
+        ReplaceSound(mAmbiance, PlayThemeEntry("AMBIANCE"));
     }
 }
 
 // Audio thread context
 bool Sound::Play(f32* stream, u32 len)
 {
-    auto copy = mSoundBankBeingBrowsed;
-    if (copy)
-    {
-        copy->Play(stream, len);
-    }
-
-    std::lock_guard<std::mutex> lock(mSoundPlayersMutex);
-
-    if (mAmbiance)
-    {
-        mAmbiance->Play(stream, len);
-    }
-
-    if (mMusicTrack)
-    {
-        mMusicTrack->Play(stream, len);
-    }
+    // Nothing in here may block or allocate
+    ProcessAudioThreadCommands();
 
-    for (auto& player : mSoundPlayers)
+    // Everything mixes into the same buses so there is one reverb for all sounds
+    for (u32 offset = 0; offset < len; offset += kAliveAudioMixBusMaxSamples)
     {
-        player.second->Play(stream, len);
+        const u32 samples = std::min(kAliveAudioMixBusMaxSamples, len - offset);
+        mMixBus.Begin(samples);
+        for (ISound* sound : mAudioThreadSounds)
+        {
+            sound->Mix(mMixBus, samples);
+        }
+        mMixBus.Resolve(stream + offset, samples);
     }
     return false;
 }
@@ -216,13 +357,30 @@ void Sound::Update()
 
     case eSoundStates::eLoadSoundEffects:
         SetState(eSoundStates::eLoadingSoundEffects);
+
+        // What the map and its music need goes first, the rest of the sound effects fill in behind while playing
+        for (const std::string& soundName : mPrioritySounds)
+        {
+            mCache.CacheSound(mLocator, soundName, true, true);
+        }
+
+        if (mActiveTheme)
+        {
+            CacheActiveTheme(true);
+        }
+
         mCache.CacheAllSoundEffects(mLocator);
         break;
 
     case eSoundStates::eLoadingSoundEffects:
-        if (!mCache.IsBusy())
+        if (!mCache.IsBusyWithHighPriority())
         {
-            SetState(eSoundStates::eLoadActiveSoundTheme);
+            SetState(eSoundStates::eIdle);
+            if (!mEventToSetAfterLoad.empty())
+            {
+                HandleMusicEvent(mEventToSetAfterLoad.c_str());
+                mEventToSetAfterLoad.clear();
+            }
         }
         break;
 
@@ -247,39 +405,21 @@ void Sound::Update()
         mThemeToLoad = nullptr;
         SetState(eSoundStates::eLoadSoundEffects);
         break;
-
-    case eSoundStates::eLoadActiveSoundTheme:
-        if (mActiveTheme)
-        {
-            CacheActiveTheme(true);
-        }
-        SetState(eSoundStates::eLoadingActiveSoundTheme);
-        break;
-
-    case eSoundStates::eLoadingActiveSoundTheme:
-        if (!mCache.IsBusy())
-        {
-            SetState(eSoundStates::eIdle);
-            if (!mEventToSetAfterLoad.empty())
-            {
-                HandleMusicEvent(mEventToSetAfterLoad.c_str());
-                mEventToSetAfterLoad.clear();
-            }
-        }
-        break;
     }
 
-    auto copy = mSoundBankBeingBrowsed;
-    if (copy)
+    FreeRetiredSounds();
+    FlushAudioThreadCommands();
+
+    if (mSoundBankBeingBrowsed)
     {
-        copy->Update();
+        mSoundBankBeingBrowsed->Update();
     }
 
-    std::lock_guard<std::mutex> lock(mSoundPlayersMutex);
     for (auto it = mSoundPlayers.begin(); it != mSoundPlayers.end();)
     {
-        if ((it->second)->AtEnd())
+        if (it->second.mSound->AtEnd())
         {
+            RetireSound(std::move(it->second.mSound));
             it = mSoundPlayers.erase(it);
         }
         else
@@ -304,18 +444,18 @@ void Sound::Update()
         {
             if (mActiveThemeEntry.ToNextEntry())
             {
-                mMusicTrack = PlaySound(mActiveThemeEntry.Entry()->mMusicName, "", true, true, true);
+                ReplaceSound(mMusicTrack, PlaySound(mActiveThemeEntry.Entry()->mMusicName, "", true, true, true));
             }
             else
             {
-                mMusicTrack = nullptr;
+                ReplaceSound(mMusicTrack, nullptr);
             }
         }
     }
 
     for (auto& player : mSoundPlayers)
     {
-        player.second->Update();
+        player.second.mSound->Update();
     }
 }
 
@@ -334,10 +474,17 @@ static const char* kMusicEvents[] =
 void Sound::SoundBrowserUi()
 {
     {
-        std::lock_guard<std::mutex> lock(mSoundPlayersMutex);
         if (!mSoundPlayers.empty())
         {
-            mSoundPlayers[0]->DebugUi();
+            mSoundPlayers.begin()->second.mSound->DebugUi();
+        }
+
+        const SoundCacheProgress progress = mCache.Progress();
+        if (progress.mTotal > progress.mDone)
+        {
+            char overlay[64] = {};
+            snprintf(overlay, sizeof(overlay), "%u/%u ETA %.0fs", progress.mDone, progress.mTotal, progress.mSecondsRemaining);
+            ImGui::ProgressBar(static_cast<f32>(progress.mDone) / progress.mTotal, ImVec2(-1.0f, 0.0f), overlay);
         }
 
         if (ImGui::CollapsingHeader("Active SEQs"))
@@ -360,15 +507,22 @@ void Sound::SoundBrowserUi()
                 ImGui::TextUnformatted("Music: (none)");
             }
 
+            ImGui::SliderFloat("Reverb mix", &mMixBus.ReverbMix, 0.0f, 1.0f);
+            ImGui::Text("Reverb: %s", mMixBus.ReverbActive() ? "active" : "idle");
+
+            int maxSoundEffects = static_cast<int>(mMaxSoundEffects);
+            if (ImGui::SliderInt("Max sound effects", &maxSoundEffects, 1, 64))
+            {
+                mMaxSoundEffects = static_cast<u32>(maxSoundEffects);
+            }
+            ImGui::Text("Sound effects: %u rejected: %u", static_cast<u32>(mSoundPlayers.size()), mRejectedSoundEffects);
+
             int i = 0;
             for (auto& player : mSoundPlayers)
             {
-                if (ImGui::Button((std::to_string(i) + player.second->Name()).c_str()))
+                if (ImGui::Button((std::to_string(i) + player.second.mSound->Name() + " (" + std::to_string(player.second.mPriority) + ")").c_str()))
                 {
-                    if (player.second.get() == mSoundPlayers[i].get())
-                    {
-                        player.second->Stop();
-                    }
+                    player.second.mSound->Stop();
                 }
                 i++;
             }
@@ -382,7 +536,7 @@ void Sound::SoundBrowserUi()
             if (ImGui::Selectable(soundBank.mName.c_str()))
             {
                 auto vab = mLocator.LocateVab(soundBank.mDataSetName, soundBank.mSoundBankName).get();
-                mSoundBankBeingBrowsed = std::make_unique<SequencePlayer>(soundBank.mName, *vab);
+                ReplaceSound(mSoundBankBeingBrowsed, std::make_unique<SoundBankBrowserSound>(soundBank.mName, *vab));
             }
         }
 
@@ -390,11 +544,7 @@ void Sound::SoundBrowserUi()
 
     if (mSoundBankBeingBrowsed)
     {
-        auto copy = mSoundBankBeingBrowsed;
-        if (copy)
-        {
-            copy->DebugUi();
-        }
+        mSoundBankBeingBrowsed->DebugUi();
     }
 
     if (ImGui::CollapsingHeader("Sound list"))
@@ -427,6 +577,7 @@ void Sound::SoundBrowserUi()
                     ImGui::TextWrapped("Comment: %s", selected->mComment.empty() ? "(none)" : selected->mComment.c_str());
                     ImGui::Separator();
                     ImGui::TextWrapped("Is memory resident: %s", selected->mIsCacheResident ? "true" : "false");
+                    ImGui::TextWrapped("Priority: %d", selected->mPriority);
                     ImGui::TextWrapped("Is cached: %s", mCache.ExistsInMemoryCache(selected->mResourceName) ? "true" : "false");
 
                     static bool bUseCache = false;
@@ -445,8 +596,7 @@ void Sound::SoundBrowserUi()
                                     auto player = PlaySound(selected->mResourceName, sb, true, false, bUseCache);
                                     if (player)
                                     {
-                                        std::lock_guard<std::mutex> lock(mSoundPlayersMutex);
-                                        mSoundPlayers[mSoundId++] = std::move(player);
+                                        AddSoundEffect(std::move(player), selected->mPriority);
                                     }
                                 }
                             }
@@ -466,8 +616,7 @@ void Sound::SoundBrowserUi()
                                         auto player = PlaySound(selected->mResourceName, sb, false, true, bUseCache);
                                         if (player)
                                         {
-                                            std::lock_guard<std::mutex> lock(mSoundPlayersMutex);
-                                            mSoundPlayers[mSoundId++] = std::move(player);
+                                            AddSoundEffect(std::move(player), selected->mPriority);
                                         }
                                     }
                                 }
@@ -130,6 +130,11 @@ void SoundResources::Parse(const std::string& json)
                     soundRes.mIsCacheResident = false;
                 }
 
+                if (obj.HasMember("priority"))
+                {
+                    soundRes.mPriority = obj["priority"].GetInt();
+                }
+
                 mSounds.push_back(soundRes);
             }
         }
@@ -221,6 +226,10 @@ void SoundResources::Dump(const std::string& fileName)
         soundResourceObject << "resource_name" << sndRes.mResourceName;
         soundResourceObject << "comment" << sndRes.mComment;
         soundResourceObject << "is_cache_resident" << sndRes.mIsCacheResident;
+        if (sndRes.mPriority != kDefaultSoundPriority)
+        {
+            soundResourceObject << "priority" << sndRes.mPriority;
+        }
         soundsArray << soundResourceObject;
     }
 
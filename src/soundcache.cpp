@@ -3,68 +3,142 @@
 #include "resourcemapper.hpp"
 #include "audioconverter.hpp"
 #include "alive_version.h"
+#include "spscqueue.hpp"
+#include "oddlib/audio/MixBus.h"
+#include "oddlib/audio/MixKernels.h"
+#include <algorithm>
 
-class WavSound : public ISound
+// Interleaved samples decoded ahead of the audio thread, about 370ms of stereo
+static const u32 kStreamRingSamples = 32768;
+
+// Samples decoded at a time
+static const u32 kStreamChunkSamples = 2048;
+
+class OggStreamSound : public ISound
 {
 public:
-    WavSound(const std::string& name, std::shared_ptr<std::vector<u8>>& data)
-        : mName(name), mData(data)
+    OggStreamSound(const std::string& name, std::unique_ptr<OggDecoder> decoder)
+        : mName(name), mDecoder(std::move(decoder)), mChannels(mDecoder->OutputChannels()), mRing(kStreamRingSamples)
     {
-        memcpy(&mHeader.mData, data->data(), sizeof(mHeader.mData));
-        mOffsetInBytes = sizeof(mHeader.mData);
+        Fill();
     }
 
     virtual void Load() override { }
     virtual void DebugUi() override {}
 
+    // Audio thread context, without the shared reverb the send is played dry
     virtual void Play(f32* stream, u32 len) override
     {
-        size_t kLenInBytes = len * sizeof(f32);
-
-        // Handle the case where the audio call back wants N data but we only have N-X left
-        if (mOffsetInBytes + kLenInBytes > mData->size())
-        {
-            kLenInBytes = mData->size() - mOffsetInBytes;
-        }
+        Render(stream, stream, len);
+    }
 
-        const f32* src = reinterpret_cast<const f32*>(mData->data() + mOffsetInBytes);
-        for (auto i = 0u; i < kLenInBytes / sizeof(f32); i++)
-        {
-            stream[i] += src[i];
-        }
-        mOffsetInBytes += kLenInBytes;
+    // Audio thread context
+    virtual void Mix(AliveAudioMixBus& bus, u32 len) override
+    {
+        Render(bus.Dry(), bus.ReverbSend(), len);
     }
 
     virtual bool AtEnd() const override
     {
-        return mOffsetInBytes >= mData->size();
+        return mStopped || (mDecoderAtEnd && mRing.Empty());
     }
 
+    // Meant for looping once AtEnd(), anything still buffered plays before the start again
     virtual void Restart() override
     {
-        mOffsetInBytes = sizeof(mHeader.mData);
+        mDecoder->Rewind();
+        mDecoderAtEnd = false;
+        mStopped = false;
+        Fill();
+    }
+
+    virtual void Update() override
+    {
+        Fill();
     }
 
-    virtual void Update() override { }
     virtual const std::string& Name() const override { return mName; }
 
     virtual void Stop() override
     {
-        mOffsetInBytes = mData->size();
+        mStopped = true;
     }
 
 private:
-    size_t mOffsetInBytes = 0;
+    // Audio thread context, len is interleaved stereo samples. 4 channel sounds were converted
+    // without reverb and carry their send in the last 2 channels.
+    void Render(f32* dry, f32* send, u32 len)
+    {
+        f32 buffer[kStreamChunkSamples];
+        const bool stopped = mStopped;
+        const u32 numFrames = len / 2;
+        const u32 chunkFrames = kStreamChunkSamples / mChannels;
+        for (u32 frame = 0; frame < numFrames;)
+        {
+            // Only whole frames are ever pushed so only whole frames come back out
+            const u32 popped = mRing.PopMany(buffer, std::min(chunkFrames, numFrames - frame) * mChannels) / mChannels;
+            if (popped == 0)
+            {
+                // Either the end or the game thread hasn't decoded fast enough, in both cases the rest is silence
+                break;
+            }
+
+            if (!stopped)
+            {
+                f32* dryOut = dry + (frame * 2);
+                if (mChannels == 4)
+                {
+                    f32* sendOut = send + (frame * 2);
+                    for (u32 i = 0; i < popped; i++)
+                    {
+                        dryOut[(i * 2)] += buffer[(i * 4)];
+                        dryOut[(i * 2) + 1] += buffer[(i * 4) + 1];
+                        sendOut[(i * 2)] += buffer[(i * 4) + 2];
+                        sendOut[(i * 2) + 1] += buffer[(i * 4) + 3];
+                    }
+                }
+                else
+                {
+                    MixKernels::Accumulate(dryOut, buffer, popped * 2);
+                }
+            }
+            frame += popped;
+        }
+    }
+
+    // Game thread context, tops the ring up a chunk at a time
+    void Fill()
+    {
+        while (!mDecoderAtEnd && !mStopped && mRing.Capacity() - mRing.Size() >= kStreamChunkSamples)
+        {
+            const u32 frames = mDecoder->Decode(mChunk, kStreamChunkSamples / mChannels);
+            if (frames == 0)
+            {
+                mDecoderAtEnd = true;
+                break;
+            }
+            mRing.PushMany(mChunk, frames * mChannels);
+        }
+    }
+
     std::string mName;
-    std::shared_ptr<std::vector<u8>> mData;
-    WavHeader mHeader;
+    std::unique_ptr<OggDecoder> mDecoder;
+    u32 mChannels = 2;
+    SpscQueue<f32> mRing;
+    f32 mChunk[kStreamChunkSamples];
+    bool mDecoderAtEnd = false; // Game thread only
+
+    // Set by the game thread, the audio thread keeps draining the ring but doesn't mix it
+    std::atomic<bool> mStopped{ false };
 };
 
 SoundCache::SoundCache(OSBaseFileSystem& fs)
     : mFs(fs),
     mLoaderQueue([&](UP_BaseSoundCacheJob item, std::atomic<bool>& quitFlag) { AsyncQueueWorkerFunction(std::move(item), quitFlag); })
 {
-    mLoaderQueue.Start();
+    // Converting is CPU bound and each sound is independent, so use every core bar the one the game thread is on
+    const u32 cores = std::thread::hardware_concurrency();
+    mLoaderQueue.Start(cores > 1 ? cores - 1 : 1);
 }
 
 SoundCache::~SoundCache()
@@ -76,10 +150,11 @@ SoundCache::~SoundCache()
 void SoundCache::Sync()
 {
     TRACE_ENTRYEXIT;
+
+    // Every job syncs first, the lock makes sure only the first one does the work
+    std::lock_guard<std::recursive_mutex> lock(mCacheMutex);
     if (!mSyncDone)
     {
-        std::lock_guard<std::recursive_mutex> lock(mCacheMutex);
-
         mSoundDataCache.clear();
 
         bool ok = false;
@@ -98,6 +173,9 @@ void SoundCache::Sync()
         }
 
         DeleteFromDiskCache("*.tmp");
+
+        // Left over from when the cache held uncompressed wavs
+        DeleteFromDiskCache("*.wav");
     }
     mSyncDone = true;
 }
@@ -108,7 +186,7 @@ void SoundCache::DeleteAll()
 
     std::lock_guard<std::recursive_mutex> lock(mCacheMutex);
 
-    DeleteFromDiskCache("*.wav");
+    DeleteFromDiskCache("*.ogg");
 
     // Remove from memory
     mSoundDataCache.clear();
@@ -146,7 +224,22 @@ std::unique_ptr<ISound> SoundCache::GetCached(const std::string& name)
     auto it = mSoundDataCache.find(name);
     if (it != std::end(mSoundDataCache))
     {
-        return std::make_unique<WavSound>(name, it->second);
+        std::unique_ptr<OggDecoder> decoder;
+        if (it->second.mData)
+        {
+            decoder = std::make_unique<OggDecoder>(it->second.mData);
+        }
+        else
+        {
+            decoder = std::make_unique<OggDecoder>(mFs.Open(it->second.mFileName));
+        }
+
+        if (!decoder->IsOpen())
+        {
+            LOG_ERROR("Cached sound " << name << " could not be decoded");
+            return nullptr;
+        }
+        return std::make_unique<OggStreamSound>(name, std::move(decoder));
     }
     return nullptr;
 }
@@ -156,16 +249,35 @@ bool SoundCache::IsBusy() const
     return mLoaderQueue.IsIdle() == false;
 }
 
+SoundCacheProgress SoundCache::Progress() const
+{
+    SoundCacheProgress progress;
+    progress.mDone = mJobsDone;
+    progress.mTotal = mJobsQueued;
+    if (progress.mDone > 0 && progress.mTotal > progress.mDone)
+    {
+        std::chrono::steady_clock::time_point startTime;
+        {
+            std::lock_guard<std::recursive_mutex> lock(mCacheMutex);
+            startTime = mBatchStartTime;
+        }
+        const f32 elapsed = std::chrono::duration<f32>(std::chrono::steady_clock::now() - startTime).count();
+        progress.mSecondsRemaining = (elapsed / progress.mDone) * (progress.mTotal - progress.mDone);
+    }
+    return progress;
+}
+
 void SoundCache::Cancel()
 {
     mLoaderQueue.PauseAndCancelASync();
 }
 
-void SoundCache::AddToMemoryAndDiskCache(std::unique_ptr<ISound> sound, std::atomic<bool>& quitFlag)
+void SoundCache::AddToMemoryAndDiskCache(std::unique_ptr<ISound> sound, bool memoryResident, std::atomic<bool>& quitFlag)
 {
     const std::string baseFileName = mFs.ExpandPath("{CacheDir}/" + sound->Name());
-    const std::string tmpFileName = baseFileName + ".tmp";
-    const std::string finalFileName = baseFileName + ".wav";
+    // Unique as the same sound can be queued at both priorities and be converted by two workers at once
+    const std::string tmpFileName = baseFileName + "." + std::to_string(mTmpFileCounter++) + ".tmp";
+    const std::string finalFileName = baseFileName + ".ogg";
 
     // TODO: mod files that are already wav shouldn't be converted - but could still be copied to the cache
 
@@ -179,7 +291,9 @@ void SoundCache::AddToMemoryAndDiskCache(std::unique_ptr<ISound> sound, std::ato
     // Write to a .tmp file and atomically (or as atomically as possible) rename when completed
     // to handle the process crashing/being killed in anyway during conversion. Otherwise we will try to load
     // incomplete conversions of sound data.
-    AudioConverter::Convert<WavEncoder>(*sound, tmpFileName.c_str(), quitFlag);
+    // The reverb is left to the shared bus at playback so it follows the live reverb settings
+    // and the conversion doesn't have to render the tail
+    AudioConverter::Convert<OggEncoder>(*sound, tmpFileName.c_str(), quitFlag, eConvertReverb::eSeparate);
 
     // Ensure we don't rename if it was stopped halfway! 
     if (quitFlag)
@@ -190,16 +304,12 @@ void SoundCache::AddToMemoryAndDiskCache(std::unique_ptr<ISound> sound, std::ato
 
     mFs.RenameFile(tmpFileName.c_str(), finalFileName.c_str());
 
-    auto stream = mFs.Open(finalFileName);
-    auto data = std::make_shared<std::vector<u8>>(Oddlib::IStream::ReadAll(*stream));;
-
     if (quitFlag)
     {
         return;
     }
 
-    std::lock_guard<std::recursive_mutex> lock(mCacheMutex);
-    mSoundDataCache[sound->Name()] = data;
+    AddToMemoryCacheFromDiskCache(sound->Name(), memoryResident);
 }
 
 void SoundCache::AsyncQueueWorkerFunction(UP_BaseSoundCacheJob item, std::atomic<bool>& quitFlag)
@@ -212,10 +322,22 @@ void SoundCache::AsyncQueueWorkerFunction(UP_BaseSoundCacheJob item, std::atomic
     item->Execute(quitFlag);
 }
 
-void SoundCache::CacheSound(ResourceLocator& locator, const std::string& name)
+void SoundCache::CacheSound(ResourceLocator& locator, const std::string& name, bool memoryResident, bool highPriority)
 {
+    {
+        std::lock_guard<std::recursive_mutex> lock(mCacheMutex);
+        if (mJobsAlive == 0)
+        {
+            // Start of a new batch, progress is only reported for the sounds in it
+            mJobsQueued = 0;
+            mJobsDone = 0;
+            mBatchStartTime = std::chrono::steady_clock::now();
+        }
+        mJobsQueued++;
+    }
+
     mLoaderQueue.UnPause();
-    mLoaderQueue.Add(std::make_unique<SoundAddToCacheJob>(*this, locator, name));
+    mLoaderQueue.Add(std::make_unique<SoundAddToCacheJob>(*this, locator, name, memoryResident, highPriority), highPriority);
 }
 
 void SoundCache::CacheAllSoundEffects(ResourceLocator& locator)
@@ -224,9 +346,29 @@ void SoundCache::CacheAllSoundEffects(ResourceLocator& locator)
     mLoaderQueue.Add(std::make_unique<CacheAllSoundEffectsJob>(*this, locator));
 }
 
+SoundAddToCacheJob::SoundAddToCacheJob(SoundCache& soundCache, ResourceLocator& locator, const std::string& name, bool memoryResident, bool highPriority)
+    : BaseSoundCacheJob(soundCache, locator), mName(name), mMemoryResident(memoryResident), mHighPriority(highPriority)
+{
+    mSoundCache.mJobsAlive++;
+    if (mHighPriority)
+    {
+        mSoundCache.mHighPriorityJobsAlive++;
+    }
+}
+
+SoundAddToCacheJob::~SoundAddToCacheJob()
+{
+    if (mHighPriority)
+    {
+        mSoundCache.mHighPriorityJobsAlive--;
+    }
+    mSoundCache.mJobsAlive--;
+}
+
 void SoundAddToCacheJob::Execute(std::atomic<bool>& quitFlag)
 {
-    mSoundCache.CacheSoundImpl(mLocator, mName, quitFlag);
+    mSoundCache.CacheSoundImpl(mLocator, mName, mMemoryResident, quitFlag);
+    mSoundCache.mJobsDone++;
 }
 
 void CacheAllSoundEffectsJob::Execute(std::atomic<bool>& quitFlag)
@@ -249,20 +391,26 @@ void SoundCache::CacheAllSoundEffectsImp(ResourceLocator& locator, std::atomic<b
 
         if (resource.mIsCacheResident)
         {
-            CacheSound(locator, resource.mResourceName);
+            CacheSound(locator, resource.mResourceName, true);
         }
     }
 }
 
-void SoundCache::CacheSoundImpl(ResourceLocator& locator, const std::string& name, std::atomic<bool>& quitFlag)
+void SoundCache::CacheSoundImpl(ResourceLocator& locator, const std::string& name, bool memoryResident, std::atomic<bool>& quitFlag)
 {
+    // High priority sounds can run before CacheAllSoundEffectsJob has synced
+    if (!mSyncDone)
+    {
+        Sync();
+    }
+
     if (quitFlag || ExistsInMemoryCache(name))
     {
         // Already in memory
         return;
     }
 
-    if (quitFlag || AddToMemoryCacheFromDiskCache(name))
+    if (quitFlag || AddToMemoryCacheFromDiskCache(name, memoryResident))
     {
         // Already on disk and now added to in memory cache
         return;
@@ -272,19 +420,25 @@ void SoundCache::CacheSoundImpl(ResourceLocator& locator, const std::string& nam
     if (!quitFlag && pSound)
     {
         // Write into disk cache and then load from disk cache into memory cache
-        AddToMemoryAndDiskCache(std::move(pSound), quitFlag);
+        AddToMemoryAndDiskCache(std::move(pSound), memoryResident, quitFlag);
     }
 }
 
-bool SoundCache::AddToMemoryCacheFromDiskCache(const std::string& name)
+bool SoundCache::AddToMemoryCacheFromDiskCache(const std::string& name, bool memoryResident)
 {
-    std::string fileName = mFs.ExpandPath("{CacheDir}/" + name + ".wav");
+    std::string fileName = mFs.ExpandPath("{CacheDir}/" + name + ".ogg");
     if (mFs.FileExists(fileName))
     {
-        auto stream = mFs.Open(fileName);
-        auto data = std::make_shared<std::vector<u8>>(Oddlib::IStream::ReadAll(*stream));
+        CachedSound cached;
+        cached.mFileName = fileName;
+        if (memoryResident)
+        {
+            auto stream = mFs.Open(fileName);
+            cached.mData = std::make_shared<std::vector<u8>>(Oddlib::IStream::ReadAll(*stream));
+        }
+
         std::lock_guard<std::recursive_mutex> lock(mCacheMutex);
-        mSoundDataCache[name] = data;
+        mSoundDataCache[name] = cached;
         return true;
     }
     return false;
@@ -16,3 +16,27 @@ TEST(ASyncQueue, QueueWork)
         q.Add(std::make_unique<int>(i));
     }
 }
+
+TEST(ASyncQueue, HighPriorityFirst)
+{
+    std::vector<int> order;
+    ASyncQueue<std::unique_ptr<int>> q([&](std::unique_ptr<int> v, std::atomic<bool>&)
+    {
+        order.push_back(*v);
+    });
+
+    // Queued before there is a worker so the order only depends on the priority
+    q.Add(std::make_unique<int>(1));
+    q.Add(std::make_unique<int>(2));
+    q.Add(std::make_unique<int>(3), true);
+    q.Add(std::make_unique<int>(4), true);
+    q.Start(1);
+
+    while (!q.IsIdle())
+    {
+        std::this_thread::yield();
+    }
+    q.Stop();
+
+    ASSERT_EQ((std::vector<int>{ 3, 4, 1, 2 }), order);
+}
@@ -103,3 +103,30 @@ TEST(CoordinateSpace, ScreenToWorld_12_offset)
     ASSERT_EQ(glm::round(50.0f), glm::round(actual.x));
     ASSERT_EQ(glm::round(100.0f), glm::round(actual.y));
 }
+
+TEST(CoordinateSpace, WorldViewRect)
+{
+    TestCoordinateSpace coords(640 * 2, 480 * 2);
+    coords.SetCameraPosition({ 100.0f, 50.0f });
+    coords.SetScreenSize({ 640.0f, 480.0f });
+
+    const glm::vec4 actual = coords.WorldViewRect();
+    ASSERT_EQ(glm::round(100.0f - 320.0f), glm::round(actual.x));
+    ASSERT_EQ(glm::round(50.0f - 240.0f), glm::round(actual.y));
+    ASSERT_EQ(glm::round(640.0f), glm::round(actual.z));
+    ASSERT_EQ(glm::round(480.0f), glm::round(actual.w));
+}
+
+TEST(CoordinateSpace, RectsOverlap)
+{
+    const glm::vec4 view(0.0f, 0.0f, 368.0f, 240.0f);
+
+    ASSERT_TRUE(CoordinateSpace::RectsOverlap(view, 10.0f, 10.0f, 20.0f, 20.0f));
+    ASSERT_TRUE(CoordinateSpace::RectsOverlap(view, -10.0f, -10.0f, 20.0f, 20.0f));
+    ASSERT_FALSE(CoordinateSpace::RectsOverlap(view, 400.0f, 10.0f, 20.0f, 20.0f));
+    ASSERT_FALSE(CoordinateSpace::RectsOverlap(view, 10.0f, -50.0f, 20.0f, 20.0f));
+
+    // Flipped sprites have a negative width
+    ASSERT_TRUE(CoordinateSpace::RectsOverlap(view, 10.0f, 10.0f, -20.0f, 20.0f));
+    ASSERT_FALSE(CoordinateSpace::RectsOverlap(view, -10.0f, 10.0f, -20.0f, 20.0f));
+}
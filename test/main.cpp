@@ -170,6 +170,62 @@ TEST(CdFs, Read_XaSectors)
 
 }
 
+// Raw reads hand back the sub header and data of each sector, without the sync and header
+static const size_t kRawSectorData = kRawSectorSize - 16;
+
+static std::vector<u8> ReadRawSectors(Oddlib::IStream& stream, size_t numSectors)
+{
+    std::vector<u8> data(numSectors * kRawSectorData);
+    for (size_t i = 0; i < numSectors; i++)
+    {
+        stream.ReadBytes(data.data() + (i * kRawSectorData), kRawSectorData);
+    }
+    return data;
+}
+
+TEST(CdFs, Read_RawSectorsInOneRead)
+{
+    RawCdImage img(get_xa());
+
+    // XBIG.TXT is 2 whole sectors
+    const size_t kNumSectors = 2;
+    auto single = img.ReadFile("XA1\\XBIG.TXT", true);
+    const std::vector<u8> expected = ReadRawSectors(*single, kNumSectors);
+
+    auto bulk = img.ReadFile("XA1\\XBIG.TXT", true);
+    std::vector<u8> actual(kNumSectors * kRawSectorData);
+    bulk->ReadBytes(actual.data(), actual.size());
+
+    ASSERT_EQ(expected, actual);
+    ASSERT_EQ(kNumSectors * 2048, single->Pos());
+    ASSERT_EQ(kNumSectors * 2048, bulk->Pos());
+}
+
+TEST(CdFs, Seek_RawSectorsInClone)
+{
+    RawCdImage img(get_xa());
+    auto file = img.ReadFile("XA1\\XBIG.TXT", true);
+    const std::vector<u8> sectors = ReadRawSectors(*file, 2);
+
+    // Positions are relative to the start of the clone, not the file it came from
+    std::unique_ptr<Oddlib::IStream> whole(file->Clone(0, 2));
+    std::unique_ptr<Oddlib::IStream> second(file->Clone(1, 1));
+    for (size_t k : { 1u, 0u, 1u })
+    {
+        whole->Seek(k * 2048);
+        ASSERT_EQ(k * 2048, whole->Pos());
+        ASSERT_EQ(std::vector<u8>(sectors.begin() + (k * kRawSectorData), sectors.begin() + ((k + 1) * kRawSectorData)), ReadRawSectors(*whole, 1));
+        ASSERT_EQ((k + 1) * 2048, whole->Pos());
+    }
+
+    second->Seek(0);
+    ASSERT_EQ(0u, second->Pos());
+    ASSERT_EQ(std::vector<u8>(sectors.begin() + kRawSectorData, sectors.end()), ReadRawSectors(*second, 1));
+    ASSERT_EQ(2048u, second->Pos());
+
+    ASSERT_THROW(whole->Seek(100), std::runtime_error);
+}
+
 TEST(SubTitleParser, Parse)
 {
     // Check full range
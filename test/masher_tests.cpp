@@ -1,5 +1,8 @@
 #include <gmock/gmock.h>
 #include "oddlib/masher.hpp"
+#include "ycbcrshader.hpp"
+#include <thread>
+#include <random>
 #include "all_colours_high_compression_30_fps.ddv.g.h"
 #include "ddv_test1.ddv.g.h"
 #include "all_colours_low_compression_30_fps.ddv.g.h"
@@ -1651,6 +1654,8 @@ public:
     }
 
     using Oddlib::Masher::decode_audio_frame;
+    using Oddlib::Masher::IdctBlock;
+    using Oddlib::Masher::ConvertMacroBlock;
 };
 
 // Audio and video test
@@ -1699,6 +1704,283 @@ TEST(Masher, all_colours_low_compression_30_fps)
     ASSERT_TRUE(masher.CompareDecodedFrameData(expected));
 }
 
+static std::vector<u32> DecodeAllFrames(std::vector<u8> ddv, u32 decodeThreads = 0)
+{
+    Oddlib::Masher masher(std::make_unique<Oddlib::MemoryStream>(std::move(ddv)));
+    masher.SetDecodeThreads(decodeThreads);
+    std::vector<u32> pixelBuffer(masher.Width() * masher.Height());
+    std::vector<u32> frames;
+    while (masher.Update(pixelBuffer.data(), nullptr))
+    {
+        frames.insert(frames.end(), pixelBuffer.begin(), pixelBuffer.end());
+    }
+    return frames;
+}
+
+TEST(Masher, DecodersDontShareState)
+{
+    const std::vector<u32> low = DecodeAllFrames(get_all_colours_low_compression_30_fps());
+    const std::vector<u32> high = DecodeAllFrames(get_all_colours_high_compression_30_fps());
+    ASSERT_NE(low, high);
+
+    // Different quant scales on each thread, any shared tables or blocks would corrupt one of them
+    for (int i = 0; i < 4; i++)
+    {
+        std::vector<u32> lowThreaded;
+        std::vector<u32> highThreaded;
+        std::thread lowThread([&]() { lowThreaded = DecodeAllFrames(get_all_colours_low_compression_30_fps()); });
+        std::thread highThread([&]() { highThreaded = DecodeAllFrames(get_all_colours_high_compression_30_fps()); });
+        lowThread.join();
+        highThread.join();
+        ASSERT_EQ(low, lowThreaded);
+        ASSERT_EQ(high, highThreaded);
+    }
+}
+
+TEST(Masher, BandedDecodeMatchesSingleThread)
+{
+    const std::vector<u32> single = DecodeAllFrames(get_all_colours_low_compression_30_fps(), 1);
+
+    // 13 macro block rows, so some bands have more rows than others
+    for (u32 threads : { 2u, 3u, 5u, 64u })
+    {
+        ASSERT_EQ(single, DecodeAllFrames(get_all_colours_low_compression_30_fps(), threads)) << threads << " threads";
+    }
+}
+
+TEST(Masher, BandWorkersFollowThreadChanges)
+{
+    const std::vector<u32> single = DecodeAllFrames(get_all_colours_low_compression_30_fps(), 1);
+
+    // The same workers are reused, more are started when needed and spare ones sit out
+    Oddlib::Masher masher(std::make_unique<Oddlib::MemoryStream>(get_all_colours_low_compression_30_fps()));
+    std::vector<u32> pixelBuffer(masher.Width() * masher.Height());
+    for (u32 threads : { 2u, 5u, 3u, 1u, 5u, 8u })
+    {
+        masher.SetDecodeThreads(threads);
+        ASSERT_TRUE(masher.SeekToFrame(0));
+        ASSERT_TRUE(masher.Update(pixelBuffer.data(), nullptr));
+        ASSERT_EQ(single, pixelBuffer) << threads << " threads";
+    }
+}
+
+// FNV-1a of every frame, low byte of each pixel first
+static u64 HashFrames(const std::vector<u32>& frames)
+{
+    u64 hash = 14695981039346656037ull;
+    for (u32 pixel : frames)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            hash ^= (pixel >> (i * 8)) & 0xFF;
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+TEST(Masher, PixelsMatchFloatDecoder)
+{
+    // Taken from the float IDCT and colour conversion Masher used before the SSE2 versions
+    ASSERT_EQ(0x0839630B05E28063ull, HashFrames(DecodeAllFrames(get_all_colours_low_compression_30_fps())));
+    ASSERT_EQ(0x69D73191B26890E9ull, HashFrames(DecodeAllFrames(get_all_colours_high_compression_30_fps())));
+    ASSERT_EQ(0x27F1BAB0CAAE0857ull, HashFrames(DecodeAllFrames(get_all_colours_max_compression_30_fps())));
+    ASSERT_EQ(0xD2E50A7C9B85B508ull, HashFrames(DecodeAllFrames(get_all_colours_medium_compression_30_fps())));
+    ASSERT_EQ(0xBF074814B377A4DEull, HashFrames(DecodeAllFrames(get_all_colours_min_compression_30_fps())));
+}
+
+static u32 ReferenceClamp(f32 v)
+{
+    if (v < 0.0f) v = 0.0f;
+    if (v > 255.0f) v = 255.0f;
+    return (unsigned char)v;
+}
+
+// The float colour conversion Masher used before it was vectorised, a pixel at a time down each column
+static void ReferenceConvertMacroBlock(const Oddlib::MacroBlockContext& ctx, u32* pixels, int xoff, int yoff, int width, int height)
+{
+    for (int x = 0; x < 16; x++)
+    {
+        for (int y = 0; y < 16; y++)
+        {
+            const Oddlib::T64IntsArray& luma = y < 8 ? (x < 8 ? ctx.mY1 : ctx.mY2) : (x < 8 ? ctx.mY3 : ctx.mY4);
+            const f32 Y = static_cast<f32>(luma[((y % 8) * 8) + (x % 8)]);
+            const f32 Cb = static_cast<f32>(ctx.mCb[((y / 2) * 8) + (x / 2)]);
+            const f32 Cr = static_cast<f32>(ctx.mCr[((y / 2) * 8) + (x / 2)]);
+
+            const f32 r = Y + 1.402f * Cb;
+            const f32 g = Y - 0.3437f * Cr - 0.7143f * Cb;
+            const f32 b = Y + 1.772f * Cr;
+
+            if (x + xoff < width && y + yoff < height)
+            {
+                pixels[((y + yoff) * width) + x + xoff] = (ReferenceClamp(b) << 16) | (ReferenceClamp(g) << 8) | ReferenceClamp(r);
+            }
+        }
+    }
+}
+
+TEST(Masher, ColourConversionMatchesFloatMaths)
+{
+    std::mt19937 rng(42);
+
+    // Well past both ends of 0 - 255 so that clamping is covered too
+    std::uniform_int_distribution<s32> value(-600, 850);
+
+    // The second block hangs off the bottom right corner
+    const int width = 24;
+    const int height = 20;
+    for (int i = 0; i < 2000; i++)
+    {
+        Oddlib::MacroBlockContext ctx;
+        for (Oddlib::T64IntsArray* block : { &ctx.mCr, &ctx.mCb, &ctx.mY1, &ctx.mY2, &ctx.mY3, &ctx.mY4 })
+        {
+            for (s32& v : *block)
+            {
+                v = value(rng);
+            }
+        }
+
+        std::vector<u32> expected(width * height, 0xDEADBEEF);
+        std::vector<u32> pixels(width * height, 0xDEADBEEF);
+        ReferenceConvertMacroBlock(ctx, expected.data(), 0, 0, width, height);
+        ReferenceConvertMacroBlock(ctx, expected.data(), 16, 16, width, height);
+        TestMasher::ConvertMacroBlock(ctx, pixels.data(), 0, 0, width, height);
+        TestMasher::ConvertMacroBlock(ctx, pixels.data(), 16, 16, width, height);
+        ASSERT_EQ(expected, pixels) << "block " << i;
+    }
+}
+
+static void ExpectFastIdctMatchesIdct(std::mt19937& rng, s32 lowest, s32 highest)
+{
+    std::uniform_int_distribution<s32> coefficient(lowest, highest);
+    std::uniform_int_distribution<s32> junk(-32768, 32767);
+    for (int i = 0; i < 5000; i++)
+    {
+        // Coefficients are 16 bits stored every 32 bits, the other half is left over from the VLC decode
+        int16_t input[64 * 2];
+        for (int j = 0; j < 64; j++)
+        {
+            input[j * 2] = static_cast<int16_t>(coefficient(rng));
+            input[(j * 2) + 1] = static_cast<int16_t>(junk(rng));
+        }
+
+        Oddlib::T64IntsArray expected = {};
+        Oddlib::T64IntsArray actual = {};
+        TestMasher::IdctBlock(input, expected, false);
+        TestMasher::IdctBlock(input, actual, true);
+        ASSERT_EQ(expected, actual) << "coefficients " << lowest << " to " << highest << ", block " << i;
+    }
+}
+
+TEST(Masher, FastIdctMatchesIdct)
+{
+    std::mt19937 rng(42);
+
+    // Stays within 16 bits between the passes
+    ExpectFastIdctMatchesIdct(rng, -64, 64);
+
+    // Some blocks fit and some go back through the scalar idct
+    ExpectFastIdctMatchesIdct(rng, -1024, 1024);
+
+    // Nearly always too big after the first pass
+    ExpectFastIdctMatchesIdct(rng, -32768, 32767);
+
+    // 32767 * 8192 >> 11 is far past 16 bits, so this is only ever done by the fallback
+    int16_t input[64 * 2] = {};
+    input[0] = 32767;
+    Oddlib::T64IntsArray expected = {};
+    Oddlib::T64IntsArray actual = {};
+    TestMasher::IdctBlock(input, expected, false);
+    TestMasher::IdctBlock(input, actual, true);
+    ASSERT_EQ(expected, actual);
+    ASSERT_EQ((((32767 * 8192) >> 11) * 8192) >> 18, expected[0]);
+}
+
+static bool IsSaturated(u8 v)
+{
+    return v == 0 || v == 255;
+}
+
+TEST(Masher, PlanesMatchRgb)
+{
+    Oddlib::Masher rgbMasher(std::make_unique<Oddlib::MemoryStream>(get_all_colours_low_compression_30_fps()));
+    Oddlib::Masher planeMasher(std::make_unique<Oddlib::MemoryStream>(get_all_colours_low_compression_30_fps()));
+    const u32 width = planeMasher.Width();
+    const u32 height = planeMasher.Height();
+    const u32 chromaWidth = (width + 1) / 2;
+    std::vector<u32> pixels(width * height);
+    std::vector<u8> y(width * height);
+    std::vector<u8> cb(chromaWidth * ((height + 1) / 2));
+    std::vector<u8> cr(cb.size());
+
+    u32 frame = 0;
+    while (rgbMasher.Update(pixels.data(), nullptr))
+    {
+        ASSERT_TRUE(planeMasher.Update(y.data(), cb.data(), cr.data(), nullptr));
+        for (u32 py = 0; py < height; py++)
+        {
+            for (u32 px = 0; px < width; px++)
+            {
+                const u8 luma = y[(py * width) + px];
+                const u8 blue = cb[((py / 2) * chromaWidth) + (px / 2)];
+                const u8 red = cr[((py / 2) * chromaWidth) + (px / 2)];
+                if (IsSaturated(luma) || IsSaturated(blue) || IsSaturated(red))
+                {
+                    // The RGB path adds up the unclamped values, the planes can't hold them
+                    continue;
+                }
+
+                // The fixed point conversion rounds a little differently
+                const std::array<u8, 3> rgb = ShaderYCbCrToRgb(luma, blue, red);
+                const u32 pixel = pixels[(py * width) + px];
+                for (u32 c = 0; c < 3; c++)
+                {
+                    ASSERT_NEAR(rgb[c], (pixel >> (c * 8)) & 0xFF, 1) << "channel " << c << " of frame " << frame << " at " << px << "," << py;
+                }
+            }
+        }
+        frame++;
+    }
+    ASSERT_EQ(rgbMasher.NumberOfFrames(), frame);
+}
+
+// Decodes every frame one after the other, then each one again on its own by seeking to it last frame first
+static void ExpectSeekMatchesSequential(std::vector<u8> ddv)
+{
+    Oddlib::Masher masher(std::make_unique<Oddlib::MemoryStream>(std::move(ddv)));
+    const size_t pixelCount = masher.Width() * masher.Height();
+    const size_t audioBytes = masher.SingleAudioFrameSizeSamples() * 4;
+    std::vector<u32> pixelBuffer(pixelCount);
+    std::vector<u8> audioBuffer(audioBytes);
+
+    std::vector<u32> pixels;
+    std::vector<u8> audio;
+    while (masher.Update(masher.HasVideo() ? pixelBuffer.data() : nullptr, masher.HasAudio() ? audioBuffer.data() : nullptr))
+    {
+        pixels.insert(pixels.end(), pixelBuffer.begin(), pixelBuffer.end());
+        audio.insert(audio.end(), audioBuffer.begin(), audioBuffer.end());
+    }
+    ASSERT_EQ(masher.NumberOfFrames(), masher.FrameNumber());
+    ASSERT_FALSE(masher.SeekToFrame(masher.NumberOfFrames()));
+
+    for (u32 i = masher.NumberOfFrames(); i-- > 0;)
+    {
+        ASSERT_TRUE(masher.SeekToFrame(i));
+        ASSERT_TRUE(masher.Update(masher.HasVideo() ? pixelBuffer.data() : nullptr, masher.HasAudio() ? audioBuffer.data() : nullptr));
+        ASSERT_EQ(i + 1, masher.FrameNumber());
+        ASSERT_TRUE(std::equal(pixelBuffer.begin(), pixelBuffer.end(), pixels.begin() + (i * pixelCount))) << "frame " << i;
+        ASSERT_TRUE(std::equal(audioBuffer.begin(), audioBuffer.end(), audio.begin() + (i * audioBytes))) << "frame " << i;
+    }
+}
+
+TEST(Masher, SeekToFrame)
+{
+    ExpectSeekMatchesSequential(get_all_colours_low_compression_30_fps());
+    ExpectSeekMatchesSequential(get_stereo_16_high_compression_all_samples());
+    ExpectSeekMatchesSequential(get_all_colours_low_compression_15fps_8bit_mono_high_compression_5_frames_interleave());
+}
+
 TEST(Masher, all_colours_max_compression_30_fps)
 {
     //Oddlib::Masher masher(get_all_colours_max_compression_30_fps());
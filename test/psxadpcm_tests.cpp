@@ -0,0 +1,206 @@
+#include <gmock/gmock.h>
+#include <random>
+#include "oddlib/PSXADPCMDecoder.h"
+
+// The float XA decoder PSXADPCMDecoder used to be, with the out of range results clamped
+class ReferenceXaDecoder
+{
+public:
+    void Decode(const u8* frame, std::vector<s16>& out)
+    {
+        const PSXADPCMDecoder::SoundFrame& sf = *reinterpret_cast<const PSXADPCMDecoder::SoundFrame*>(frame);
+        out.resize(PSXADPCMDecoder::kSamplesPerFrame);
+        int dstLeft = 0;
+        int dstRight = 1;
+        for (int i = 0; i < 18; i++)
+        {
+            for (int b = 0; b < 4; b++)
+            {
+                DecodeBlock(out, sf.sound_groups[i], b, 1, dstLeft, mOldLeft, mOlderLeft);
+                DecodeBlock(out, sf.sound_groups[i], b, 0, dstRight, mOldRight, mOlderRight);
+            }
+        }
+    }
+
+private:
+    static void DecodeBlock(std::vector<s16>& out, const PSXADPCMDecoder::SoundFrame::SoundGroup& sg, int block, int nibble, int& dst, f64& old, f64& older)
+    {
+        const int kPos[5] = { 0, +60, +115, +98, +122 };
+        const int kNeg[5] = { 0, 0, -52, -55, -60 };
+
+        const int shift = 12 - (sg.sound_parameters[4 + block * 2 + nibble] & 0xF);
+        const int filter = (sg.sound_parameters[4 + block * 2 + nibble] & 0x30) >> 4;
+        for (int d = 0; d < 28; d++)
+        {
+            const int n = (sg.audio_sample_bytes[block + d * 4] >> (nibble * 4)) & 0xF;
+            const int t = (n & 0x8) ? n - 16 : n;
+            int s = static_cast<int>((t * (1 << shift)) + ((old * kPos[filter] + older * kNeg[filter] + 32) / 64));
+            s = std::min(std::max(s, -32768), 32767);
+            out[dst] = static_cast<s16>(s);
+            dst += 2;
+            older = old;
+            old = s;
+        }
+    }
+
+    f64 mOldLeft = 0;
+    f64 mOlderLeft = 0;
+    f64 mOldRight = 0;
+    f64 mOlderRight = 0;
+};
+
+static std::vector<u8> RandomXaFrame(std::mt19937& rng)
+{
+    std::uniform_int_distribution<int> byte(0, 255);
+    std::uniform_int_distribution<int> range(0, 12);
+    std::vector<u8> frame(sizeof(PSXADPCMDecoder::SoundFrame));
+    for (u8& b : frame)
+    {
+        b = static_cast<u8>(byte(rng));
+    }
+
+    PSXADPCMDecoder::SoundFrame& sf = *reinterpret_cast<PSXADPCMDecoder::SoundFrame*>(frame.data());
+    for (auto& sg : sf.sound_groups)
+    {
+        for (u8& p : sg.sound_parameters)
+        {
+            // Reserved ranges were never handled by the float decoder
+            p = static_cast<u8>((byte(rng) & 0x30) | range(rng));
+        }
+    }
+    return frame;
+}
+
+TEST(PSXADPCMDecoder, XaMatchesFloatDecoder)
+{
+    std::mt19937 rng(470);
+    PSXADPCMDecoder decoder;
+    ReferenceXaDecoder reference;
+
+    // Several frames so the filter state is carried over too
+    for (int i = 0; i < 8; i++)
+    {
+        std::vector<u8> frame = RandomXaFrame(rng);
+
+        std::array<s16, PSXADPCMDecoder::kSamplesPerFrame> decoded;
+        decoder.DecodeFrameToPCM(decoded, frame.data());
+
+        std::vector<s16> expected;
+        reference.Decode(frame.data(), expected);
+        ASSERT_TRUE(std::equal(expected.begin(), expected.end(), decoded.begin())) << "frame " << i;
+    }
+}
+
+// The float VAG decoder PSXADPCMDecoder used to be
+static std::vector<s16> ReferenceVagDecode(const std::vector<u8>& vag)
+{
+    const f64 kPos[5] = { 0, +60, +115, +98, +122 };
+    const f64 kNeg[5] = { 0, 0, -52, -55, -60 };
+
+    std::vector<s16> out;
+    f64 old = 0.0;
+    f64 older = 0.0;
+    for (size_t block = 0; block + 16 <= vag.size() && (vag[block + 1] & 1) == 0; block += 16)
+    {
+        const int shift = vag[block] & 0xF;
+        const int filter = vag[block] >> 4;
+        for (int i = 0; i < 28; i++)
+        {
+            const u8 d = vag[block + 2 + (i / 2)];
+            int s = (i % 2) == 0 ? (d & 0x0F) << 12 : (d & 0xF0) << 8;
+            if (s & 0x8000)
+            {
+                s |= 0xFFFF0000;
+            }
+
+            const f64 sample = static_cast<f64>(s >> shift) + old * (kPos[filter] / 64.0) + older * (kNeg[filter] / 64.0);
+            older = old;
+            old = sample;
+
+            const int x = static_cast<int>(sample + 0.5);
+            out.push_back(static_cast<s16>(static_cast<u16>(x & 0xFFFF)));
+        }
+    }
+    return out;
+}
+
+static std::vector<s16> DecodeVag(std::vector<u8> vag)
+{
+    Oddlib::MemoryStream stream(std::move(vag));
+    std::vector<u8> bytes;
+    PSXADPCMDecoder().DecodeVagStream(stream, bytes);
+
+    std::vector<s16> samples(bytes.size() / 2);
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        samples[i] = static_cast<s16>(bytes[(i * 2)] | (bytes[(i * 2) + 1] << 8));
+    }
+    return samples;
+}
+
+TEST(PSXADPCMDecoder, VagNibbleOrderAndScale)
+{
+    std::vector<u8> vag(16);
+    vag[0] = 0x00; // Filter 0, shift 0
+    vag[2] = 0xF1; // 1 then -1
+    vag[3] = 0x87; // 7 then -8
+    vag.push_back(0x00);
+    vag.push_back(0x01); // End
+    vag.resize(vag.size() + 14);
+
+    const std::vector<s16> samples = DecodeVag(vag);
+    ASSERT_EQ(28u, samples.size());
+    // The rounding bias truncates toward zero, so negative samples come out one smaller
+    ASSERT_EQ(4096, samples[0]);
+    ASSERT_EQ(-4095, samples[1]);
+    ASSERT_EQ(28672, samples[2]);
+    ASSERT_EQ(-32767, samples[3]);
+    ASSERT_EQ(0, samples[4]);
+}
+
+TEST(PSXADPCMDecoder, VagFilterCarriesAcrossBlocks)
+{
+    std::vector<u8> vag(32);
+    vag[0] = 0x0C; // Filter 0, shift 12
+    vag[2 + 13] = 0x40; // Last sample is 4
+    vag[16] = 0x1C; // Filter 1, silent nibbles
+    vag.push_back(0x00);
+    vag.push_back(0x01);
+    vag.resize(vag.size() + 14);
+
+    const std::vector<s16> samples = DecodeVag(vag);
+    ASSERT_EQ(56u, samples.size());
+    ASSERT_EQ(4, samples[27]);
+
+    // 4 * 60 / 64 is 3.75 then 3.52, both still round to 4
+    ASSERT_EQ(4, samples[28]);
+    ASSERT_EQ(4, samples[29]);
+}
+
+TEST(PSXADPCMDecoder, VagMatchesFloatDecoder)
+{
+    std::mt19937 rng(39);
+    std::uniform_int_distribution<int> byte(0, 255);
+    // Including the reserved shifts, which VAG decodes the same as any other
+    std::uniform_int_distribution<int> shift(0, 15);
+    std::uniform_int_distribution<int> filter(0, 4);
+
+    // Lots of blocks so the filter state is carried a long way
+    std::vector<u8> vag;
+    for (int i = 0; i < 256; i++)
+    {
+        vag.push_back(static_cast<u8>((filter(rng) << 4) | shift(rng)));
+        vag.push_back(0x00);
+        for (int j = 0; j < 14; j++)
+        {
+            vag.push_back(static_cast<u8>(byte(rng)));
+        }
+    }
+    vag.push_back(0x00);
+    vag.push_back(0x01); // End
+    vag.resize(vag.size() + 14);
+
+    const std::vector<s16> expected = ReferenceVagDecode(vag);
+    ASSERT_EQ(256u * 28u, expected.size());
+    ASSERT_EQ(expected, DecodeVag(vag));
+}
@@ -0,0 +1,323 @@
+#include <gmock/gmock.h>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "oddlib/PSXMDECDecoder.h"
+#include "ycbcrshader.hpp"
+
+class TestPSXMDECDecoder : public PSXMDECDecoder
+{
+public:
+    using PSXMDECDecoder::VLC_SBIT;
+    using PSXMDECDecoder::VLC_FAST_BITS;
+    using PSXMDECDecoder::VLC_ESCAPE_CODE;
+    using PSXMDECDecoder::VLC_EOB_CODE;
+    using PSXMDECDecoder::VLCFastTable;
+    using PSXMDECDecoder::VLCLookup;
+    using PSXMDECDecoder::IDCTScalar;
+    using PSXMDECDecoder::DecodeDCTVLC;
+};
+
+// Writes bits most significant first into 16 bit words
+class BitWriter
+{
+public:
+    void Put(uint32_t value, int count)
+    {
+        for (int i = count - 1; i >= 0; i--)
+        {
+            mAcc = (mAcc << 1) | ((value >> i) & 1);
+            if (++mBits == 16)
+            {
+                mWords.push_back(static_cast<uint16_t>(mAcc));
+                mAcc = 0;
+                mBits = 0;
+            }
+        }
+    }
+
+    std::vector<uint16_t> Finish()
+    {
+        Put(0, (16 - mBits) % 16);
+
+        // The decoder reads ahead a little past the end
+        mWords.resize(mWords.size() + 8);
+        return mWords;
+    }
+
+private:
+    std::vector<uint16_t> mWords;
+    uint32_t mAcc = 0;
+    int mBits = 0;
+};
+
+// Builds a version 2 frame where every block only has a DC value, luma gives the DC of the 4 Y blocks of each macro block
+// and chroma the Cr and Cb DC of all of them
+static std::vector<uint16_t> FlatFrame(const std::vector<std::array<int, 4>>& luma, const std::array<int, 2>& chroma = { { 0, 0 } })
+{
+    BitWriter bits;
+
+    for (const auto& mb : luma)
+    {
+        // Cr and Cb then Y1 to Y4, each a 10 bit DC followed by the 2 bit end of block code
+        const int dc[6] = { chroma[0], chroma[1], mb[0], mb[1], mb[2], mb[3] };
+        for (int value : dc)
+        {
+            bits.Put(value & 0x3ff, 10);
+            bits.Put(2, 2);
+        }
+    }
+    const std::vector<uint16_t> words = bits.Finish();
+
+    const uint16_t codes = static_cast<uint16_t>(luma.size() * 6 * 2);
+    std::vector<uint16_t> frame = { static_cast<uint16_t>(codes / 2), 0x3800, 1, 2 };
+    frame.insert(frame.end(), words.begin(), words.end());
+    return frame;
+}
+
+static uint8_t Grey(const std::vector<uint8_t>& image, uint32_t pitch, uint32_t x, uint32_t y)
+{
+    const uint8_t* pixel = &image[(y * pitch) + (x * 4)];
+    EXPECT_EQ(pixel[0], pixel[1]);
+    EXPECT_EQ(pixel[0], pixel[2]);
+    EXPECT_EQ(0xFF, pixel[3]);
+    return pixel[0];
+}
+
+TEST(PSXMDECDecoder, LumaBlockOrder)
+{
+    const std::vector<uint16_t> frame = FlatFrame({ { -32, -16, 16, 32 } });
+
+    std::vector<uint8_t> image(16 * 16 * 4);
+    PSXMDECDecoder().DecodeFrameToRGBA32(image.data(), 16 * 4, frame.data(), 16, 16);
+
+    // Top left, top right, bottom left then bottom right, each DC of 4 is one step
+    ASSERT_EQ(120, Grey(image, 16 * 4, 7, 7));
+    ASSERT_EQ(124, Grey(image, 16 * 4, 8, 7));
+    ASSERT_EQ(132, Grey(image, 16 * 4, 7, 8));
+    ASSERT_EQ(136, Grey(image, 16 * 4, 8, 8));
+}
+
+TEST(PSXMDECDecoder, PitchedOutputClipsToFrame)
+{
+    // 2x2 macro blocks going down each column first, cut down to 24x20
+    const std::vector<uint16_t> frame = FlatFrame({ { 0, 0, 0, 0 }, { 16, 16, 16, 16 }, { 32, 32, 32, 32 }, { 48, 48, 48, 48 } });
+    const uint32_t width = 24;
+    const uint32_t height = 20;
+    const uint32_t pitch = (width * 4) + 20;
+
+    std::vector<uint8_t> image(pitch * height, 0xCD);
+    PSXMDECDecoder().DecodeFrameToRGBA32(image.data(), pitch, frame.data(), width, height);
+
+    ASSERT_EQ(128, Grey(image, pitch, 0, 0));
+    ASSERT_EQ(132, Grey(image, pitch, 0, 16));
+    ASSERT_EQ(136, Grey(image, pitch, 16, 0));
+    ASSERT_EQ(140, Grey(image, pitch, width - 1, height - 1));
+
+    // Nothing past the end of each row is touched
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t i = width * 4; i < pitch; i++)
+        {
+            ASSERT_EQ(0xCD, image[(y * pitch) + i]) << "row " << y;
+        }
+    }
+
+    // The packed overload is the same with no padding
+    std::vector<uint16_t> packed(width * height * 2);
+    std::vector<uint16_t> bs = frame;
+    PSXMDECDecoder().DecodeFrameToRGBA32(packed.data(), bs.data(), width, height);
+    for (uint32_t y = 0; y < height; y++)
+    {
+        ASSERT_EQ(0, memcmp(&image[y * pitch], &packed[y * width * 2], width * 4)) << "row " << y;
+    }
+}
+
+TEST(PSXMDECDecoder, PlanesMatchRgba)
+{
+    // More red than blue, cut down like PitchedOutputClipsToFrame so the planes have an odd chroma edge
+    const std::vector<uint16_t> frame = FlatFrame({ { 0, 0, 0, 0 }, { 16, 16, 16, 16 }, { 32, 32, 32, 32 }, { 48, 48, 48, 48 } }, { { 32, -32 } });
+    const uint32_t width = 24;
+    const uint32_t height = 20;
+    const uint32_t chromaWidth = width / 2;
+
+    std::vector<uint8_t> image(width * height * 4);
+    PSXMDECDecoder().DecodeFrameToRGBA32(image.data(), width * 4, frame.data(), width, height);
+
+    std::vector<uint8_t> y(width * height);
+    std::vector<uint8_t> cb(chromaWidth * (height / 2));
+    std::vector<uint8_t> cr(cb.size());
+    PSXMDECDecoder().DecodeFrameToYCbCr420(y.data(), cb.data(), cr.data(), frame.data(), width, height);
+
+    ASSERT_EQ(128, y[0]);
+    ASSERT_EQ(132, y[16 * width]);
+    ASSERT_EQ(136, y[16]);
+    ASSERT_EQ(140, y[(width * height) - 1]);
+    for (size_t i = 0; i < cb.size(); i++)
+    {
+        ASSERT_EQ(120, cb[i]) << i;
+        ASSERT_EQ(136, cr[i]) << i;
+    }
+
+    // The first chroma block is Cr, so red gets the 1.402 weight and blue the 1.772 one
+    ASSERT_EQ(139, image[0]);
+    ASSERT_EQ(126, image[1]);
+    ASSERT_EQ(114, image[2]);
+
+    for (uint32_t py = 0; py < height; py++)
+    {
+        for (uint32_t px = 0; px < width; px++)
+        {
+            // The CPU conversion truncates instead of rounding
+            const size_t chroma = ((py / 2) * chromaWidth) + (px / 2);
+            const std::array<uint8_t, 3> rgb = ShaderYCbCrToRgb(y[(py * width) + px], cb[chroma], cr[chroma]);
+            const uint8_t* pixel = &image[((py * width) + px) * 4];
+            for (int c = 0; c < 3; c++)
+            {
+                ASSERT_NEAR(rgb[c], pixel[c], 1) << "channel " << c << " at " << px << "," << py;
+            }
+        }
+    }
+}
+
+TEST(PSXMDECDecoder, FastVlcTableMatchesTableChain)
+{
+    const uint32_t* fastTable = TestPSXMDECDecoder::VLCFastTable();
+    const uint32_t shift = TestPSXMDECDecoder::VLC_SBIT - TestPSXMDECDecoder::VLC_FAST_BITS;
+    for (uint32_t window = 0; window < (1u << TestPSXMDECDecoder::VLC_SBIT); window++)
+    {
+        const uint32_t chained = TestPSXMDECDecoder::VLCLookup(window);
+        const uint32_t fast = fastTable[window >> shift];
+        if (fast)
+        {
+            ASSERT_EQ(chained, fast) << "window " << window;
+        }
+        else
+        {
+            // Only codes too long for the fast table are left to the chain
+            ASSERT_TRUE(chained == 0 || (chained >> 16) > 12) << "window " << window;
+        }
+    }
+}
+
+TEST(PSXMDECDecoder, FastVlcDecodesLikeTableChain)
+{
+    std::mt19937 rng(43);
+    std::uniform_int_distribution<uint32_t> windowBits(0, (1u << TestPSXMDECDecoder::VLC_SBIT) - 1);
+    std::uniform_int_distribution<int> leadingZeros(0, 11);
+    std::uniform_int_distribution<int> codePairs(0, 24);
+    std::uniform_int_distribution<uint32_t> word(0, 0xffff);
+    const uint16_t q = 7;
+
+    // Random codes with the lengths the chain gives them, skewed towards the long ones that the
+    // fast table leaves to the chain, each expected to come out as the chain decodes it
+    BitWriter bits;
+    std::vector<uint16_t> expected;
+    int longCodes = 0;
+    int escapes = 0;
+    for (int block = 0; block < 6 * 64; block++)
+    {
+        const uint32_t dc = word(rng) & 0x3ff;
+        bits.Put(dc, 10);
+        expected.push_back(static_cast<uint16_t>((q << 10) | dc));
+
+        // Pairs of codes so that each block fills whole 32 bit words, which is what the header counts
+        const int count = codePairs(rng) * 2;
+        for (int i = 0; i < count;)
+        {
+            const uint32_t window = windowBits(rng) >> leadingZeros(rng);
+            const uint32_t code = TestPSXMDECDecoder::VLCLookup(window);
+            if (!code || code == TestPSXMDECDecoder::VLC_EOB_CODE)
+            {
+                continue;
+            }
+
+            const uint32_t length = code >> 16;
+            bits.Put(window >> (TestPSXMDECDecoder::VLC_SBIT - length), length);
+            if (code == TestPSXMDECDecoder::VLC_ESCAPE_CODE)
+            {
+                const uint32_t runLevel = word(rng);
+                bits.Put(runLevel, 16);
+                expected.push_back(static_cast<uint16_t>(runLevel));
+                escapes++;
+            }
+            else
+            {
+                expected.push_back(static_cast<uint16_t>(code));
+                if (length > 12)
+                {
+                    longCodes++;
+                }
+            }
+            i++;
+        }
+
+        bits.Put(2, 2);
+        expected.push_back(static_cast<uint16_t>(TestPSXMDECDecoder::VLC_EOB_CODE));
+    }
+    const std::vector<uint16_t> words = bits.Finish();
+    ASSERT_GT(longCodes, 100);
+    ASSERT_GT(escapes, 100);
+
+    std::vector<uint16_t> frame = { static_cast<uint16_t>(expected.size() / 2), 0x3800, q, 2 };
+    frame.insert(frame.end(), words.begin(), words.end());
+    expected.insert(expected.begin(), frame.begin(), frame.begin() + 2);
+
+    std::vector<uint16_t> rl(expected.size());
+    TestPSXMDECDecoder().DecodeDCTVLC(rl.data(), frame.data());
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        ASSERT_EQ(expected[i], rl[i]) << "code " << i;
+    }
+}
+
+static void ExpectIdctMatchesScalar(std::mt19937& rng, int lowest, int highest)
+{
+    std::uniform_int_distribution<int> coefficient(lowest, highest);
+    std::uniform_int_distribution<int> count(2, 64);
+    std::uniform_int_distribution<int> position(0, 63);
+    for (int i = 0; i < 5000; i++)
+    {
+        // Scattered so that some columns are all zero, which the scalar IDCT skips
+        std::array<int16_t, 64> expected = {};
+        const int k = count(rng);
+        for (int j = 0; j < k; j++)
+        {
+            expected[position(rng)] = static_cast<int16_t>(coefficient(rng));
+        }
+
+        std::array<int16_t, 64> actual = expected;
+        TestPSXMDECDecoder::IDCTScalar(expected.data(), static_cast<uint8_t>(k));
+        TestPSXMDECDecoder::IDCT(actual.data(), static_cast<uint8_t>(k));
+        ASSERT_EQ(expected, actual) << "coefficients " << lowest << " to " << highest << ", block " << i;
+    }
+}
+
+TEST(PSXMDECDecoder, IdctMatchesScalarIdct)
+{
+    std::mt19937 rng(44);
+
+    // What dequantised coefficients usually look like
+    ExpectIdctMatchesScalar(rng, -256, 256);
+
+    // Wraps around 16 bits part way through
+    ExpectIdctMatchesScalar(rng, -32768, 32767);
+
+    // Every coefficient at the limits
+    const int16_t limits[][2] = { { 32767, 32767 }, { -32768, -32768 }, { 32767, -32768 } };
+    for (const auto& limit : limits)
+    {
+        std::array<int16_t, 64> expected;
+        for (int j = 0; j < 64; j++)
+        {
+            expected[j] = limit[((j / 8) + j) % 2];
+        }
+
+        std::array<int16_t, 64> actual = expected;
+        TestPSXMDECDecoder::IDCTScalar(expected.data(), 64);
+        TestPSXMDECDecoder::IDCT(actual.data(), 64);
+        ASSERT_EQ(expected, actual) << limit[0] << ", " << limit[1];
+    }
+}
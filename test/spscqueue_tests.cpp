@@ -0,0 +1,147 @@
+#include <gmock/gmock.h>
+#include <thread>
+#include "spscqueue.hpp"
+
+TEST(SpscQueue, CapacityRoundsUpToPowerOf2)
+{
+    SpscQueue<int> q(5);
+    ASSERT_EQ(8u, q.Capacity());
+}
+
+TEST(SpscQueue, PushPopInOrder)
+{
+    SpscQueue<int> q(4);
+    ASSERT_TRUE(q.Empty());
+
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_TRUE(q.Push(i));
+    }
+
+    // Full
+    ASSERT_FALSE(q.Push(4));
+
+    int v = -1;
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_TRUE(q.Pop(v));
+        ASSERT_EQ(i, v);
+    }
+
+    ASSERT_FALSE(q.Pop(v));
+    ASSERT_TRUE(q.Empty());
+}
+
+TEST(SpscQueue, WrapsAround)
+{
+    SpscQueue<int> q(2);
+    int v = 0;
+    for (int i = 0; i < 100; i++)
+    {
+        ASSERT_TRUE(q.Push(i));
+        ASSERT_TRUE(q.Pop(v));
+        ASSERT_EQ(i, v);
+    }
+}
+
+TEST(SpscQueue, ProducerAndConsumerThreads)
+{
+    const int kCount = 100000;
+    SpscQueue<int> q(64);
+
+    std::thread producer([&]()
+    {
+        for (int i = 0; i < kCount; i++)
+        {
+            while (!q.Push(i))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    bool inOrder = true;
+    int expected = 0;
+    while (expected < kCount)
+    {
+        int v = 0;
+        if (q.Pop(v))
+        {
+            if (v != expected)
+            {
+                inOrder = false;
+            }
+            expected++;
+        }
+    }
+
+    producer.join();
+    ASSERT_TRUE(inOrder);
+    ASSERT_TRUE(q.Empty());
+}
+
+TEST(SpscQueue, PushManyPopManyWrapAround)
+{
+    SpscQueue<int> q(8);
+
+    const int items[6] = { 0, 1, 2, 3, 4, 5 };
+    int out[8] = {};
+
+    // Move the head and tail past the middle so the next batch wraps
+    ASSERT_EQ(6u, q.PushMany(items, 6));
+    ASSERT_EQ(6u, q.PopMany(out, 8));
+    ASSERT_TRUE(q.Empty());
+
+    ASSERT_EQ(6u, q.PushMany(items, 6));
+    ASSERT_EQ(2u, q.PushMany(items, 6));
+    ASSERT_EQ(8u, q.Size());
+
+    ASSERT_EQ(8u, q.PopMany(out, 8));
+    for (int i = 0; i < 6; i++)
+    {
+        ASSERT_EQ(i, out[i]);
+    }
+    ASSERT_EQ(0, out[6]);
+    ASSERT_EQ(1, out[7]);
+    ASSERT_EQ(0u, q.PopMany(out, 8));
+}
+
+TEST(SpscQueue, PushManyPopManyThreads)
+{
+    const int kCount = 100000;
+    SpscQueue<int> q(64);
+
+    // Batch sizes that don't divide the capacity so the copies split at every point of the buffer
+    std::thread producer([&]()
+    {
+        int batch[7];
+        for (int next = 0; next < kCount;)
+        {
+            const int count = std::min(7, kCount - next);
+            for (int i = 0; i < count; i++)
+            {
+                batch[i] = next + i;
+            }
+            next += static_cast<int>(q.PushMany(batch, count));
+        }
+    });
+
+    bool inOrder = true;
+    int expected = 0;
+    int batch[5];
+    while (expected < kCount)
+    {
+        const u32 popped = q.PopMany(batch, 5);
+        for (u32 i = 0; i < popped; i++)
+        {
+            if (batch[i] != expected++)
+            {
+                inOrder = false;
+            }
+        }
+    }
+
+    producer.join();
+    ASSERT_TRUE(inOrder);
+    ASSERT_TRUE(q.Empty());
+}
@@ -53,6 +53,12 @@ TEST(string_util, endsWith)
     ASSERT_FALSE(string_util::ends_with(t3, "Lr"));
     ASSERT_TRUE(string_util::ends_with(t3, ""));
     ASSERT_TRUE(string_util::ends_with(t3, "lL"));
+
+    const boost::string_view sv = "<i>italic</I>";
+    ASSERT_TRUE(string_util::ends_with(sv, "</i>", true));
+    ASSERT_FALSE(string_util::ends_with(sv, "</i>"));
+    ASSERT_TRUE(string_util::starts_with(sv, "<I>", true));
+    ASSERT_FALSE(string_util::starts_with(sv.substr(0, 2), "<i>"));
 }
 
 TEST(string_util, contains)
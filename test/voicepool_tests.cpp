@@ -0,0 +1,171 @@
+#include <gmock/gmock.h>
+#include "oddlib/audio/VoicePool.h"
+#include "oddlib/audio/AliveAudio.h"
+
+static AliveAudioVoice* StartNote(AliveAudioVoicePool& pool, int note, u8 priority, u32 polyphony, eVoiceStealing policy)
+{
+    AliveAudioVoice* voice = pool.Allocate(priority, polyphony, policy);
+    if (voice)
+    {
+        voice->i_Note = note;
+    }
+    return voice;
+}
+
+static bool IsPlaying(AliveAudioVoicePool& pool, int note)
+{
+    for (u32 i = 0; i < pool.ActiveCount(); i++)
+    {
+        if (pool.Active(i).i_Note == note)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST(AliveAudioVoicePool, AllocatesUpToPolyphony)
+{
+    AliveAudioVoicePool pool;
+    pool.Reset(8);
+
+    for (int i = 0; i < 4; i++)
+    {
+        ASSERT_NE(nullptr, StartNote(pool, i, 10, 4, eVoiceStealing::eOldest));
+    }
+    ASSERT_EQ(4u, pool.ActiveCount());
+    ASSERT_EQ(0u, pool.StolenCount());
+
+    // Over the limit, the oldest note goes
+    ASSERT_NE(nullptr, StartNote(pool, 4, 10, 4, eVoiceStealing::eOldest));
+    ASSERT_EQ(4u, pool.ActiveCount());
+    ASSERT_EQ(1u, pool.StolenCount());
+    ASSERT_FALSE(IsPlaying(pool, 0));
+    ASSERT_TRUE(IsPlaying(pool, 4));
+}
+
+TEST(AliveAudioVoicePool, NeverStealsHigherPriority)
+{
+    AliveAudioVoicePool pool;
+    pool.Reset(2);
+
+    ASSERT_NE(nullptr, StartNote(pool, 0, 20, 2, eVoiceStealing::eLowestPriority));
+    ASSERT_NE(nullptr, StartNote(pool, 1, 10, 2, eVoiceStealing::eLowestPriority));
+
+    // Lower than everything playing
+    ASSERT_EQ(nullptr, StartNote(pool, 2, 5, 2, eVoiceStealing::eLowestPriority));
+
+    // Takes the lowest priority voice even though it is the newest
+    ASSERT_NE(nullptr, StartNote(pool, 3, 20, 2, eVoiceStealing::eLowestPriority));
+    ASSERT_TRUE(IsPlaying(pool, 0));
+    ASSERT_FALSE(IsPlaying(pool, 1));
+    ASSERT_TRUE(IsPlaying(pool, 3));
+}
+
+TEST(AliveAudioVoicePool, StealsQuietest)
+{
+    AliveAudioVoicePool pool;
+    pool.Reset(2);
+
+    StartNote(pool, 0, 10, 2, eVoiceStealing::eQuietest)->f_Velocity = 1.0;
+    StartNote(pool, 1, 10, 2, eVoiceStealing::eQuietest)->f_Velocity = 0.1;
+
+    // Levels are only known once the voices have been mixed
+    for (u32 i = 0; i < pool.ActiveCount(); i++)
+    {
+        pool.Active(i).f_TrackDelay = 1.0;
+    }
+    pool.Collect();
+
+    ASSERT_NE(nullptr, StartNote(pool, 2, 10, 2, eVoiceStealing::eQuietest));
+    ASSERT_TRUE(IsPlaying(pool, 0));
+    ASSERT_FALSE(IsPlaying(pool, 1));
+}
+
+TEST(AliveAudioVoicePool, CollectFreesDeadVoices)
+{
+    AliveAudioVoicePool pool;
+    pool.Reset(2);
+
+    StartNote(pool, 0, 10, 2, eVoiceStealing::eOldest)->b_Dead = true;
+    StartNote(pool, 1, 10, 2, eVoiceStealing::eOldest);
+    pool.Collect();
+    ASSERT_EQ(1u, pool.ActiveCount());
+    ASSERT_TRUE(IsPlaying(pool, 1));
+
+    // The freed voice is used without stealing
+    ASSERT_NE(nullptr, StartNote(pool, 2, 10, 2, eVoiceStealing::eOldest));
+    ASSERT_EQ(0u, pool.StolenCount());
+    ASSERT_TRUE(IsPlaying(pool, 1));
+}
+
+// Program 0 is a single tone over every note with a second of sample, so notes keep their voice while the test runs
+static std::unique_ptr<AliveAudioSoundbank> MakeSoundbank(Vab& vab)
+{
+    Oddlib::MemoryStream zeros(std::vector<u8>(64));
+    vab.mTones.push_back(std::make_unique<VagAtr>(zeros));
+    VagAtr& tone = *vab.mTones.back();
+    tone.iVol = 127;
+    tone.iPan = 64;
+    tone.iCenter = 60;
+    tone.iMin = 0;
+    tone.iMax = 127;
+    tone.iVag = 1;
+
+    for (ProgAtr& prog : vab.mProgs)
+    {
+        prog.iNumTones = 0;
+        prog.iMode = 0;
+    }
+    vab.mProgs[0].iNumTones = 1;
+    vab.mProgs[0].iTones.push_back(&tone);
+    vab.mSamples.push_back(Vab::SampleData(kAliveAudioSampleRate * 2, 0x10));
+    return std::make_unique<AliveAudioSoundbank>(vab);
+}
+
+// Starts a one note sequence at sequencePriority, then with every voice taken plays a note at notePriority
+static void NoteAfterSequenceNote(u8 sequencePriority, u8 notePriority, u32& stolen, u32& dropped)
+{
+    Vab vab;
+    AliveAudio audio;
+    audio.SetSoundbank(MakeSoundbank(vab));
+    audio.MaxPolyphony = 1;
+    audio.VoiceStealing = eVoiceStealing::eLowestPriority;
+
+    AliveAudioSequenceEvent event;
+    event.mCommand.mType = eAliveAudioCommands::eNoteOn;
+    event.mCommand.mNote = 60;
+    event.mCommand.mVelocity = 127;
+    audio.SetSequence({ event });
+
+    // Set once the sequence is loaded, like SequencePlayer::SetPriority
+    audio.Priority = sequencePriority;
+    audio.PlaySequence();
+
+    std::vector<f32> buffer(512);
+    audio.Play(buffer.data(), static_cast<u32>(buffer.size()));
+    ASSERT_EQ(1u, audio.NumberOfActiveVoices());
+
+    audio.Priority = notePriority;
+    audio.NoteOn(0, 61, 127);
+    audio.Play(buffer.data(), static_cast<u32>(buffer.size()));
+    ASSERT_EQ(1u, audio.NumberOfActiveVoices());
+
+    stolen = audio.NumberOfStolenVoices();
+    dropped = audio.NumberOfDroppedNotes();
+}
+
+TEST(AliveAudioVoicePool, SequenceNotesUsePriority)
+{
+    u32 stolen = 0;
+    u32 dropped = 0;
+
+    // Both sides of the default priority, so this fails if the sequence note doesn't get the one that was set
+    NoteAfterSequenceNote(10, 30, stolen, dropped);
+    ASSERT_EQ(1u, stolen);
+    ASSERT_EQ(0u, dropped);
+
+    NoteAfterSequenceNote(100, 80, stolen, dropped);
+    ASSERT_EQ(0u, stolen);
+    ASSERT_EQ(1u, dropped);
+}
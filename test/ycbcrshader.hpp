@@ -0,0 +1,27 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include "types.hpp"
+
+// What kYCbCrFragmentShader in openglrenderer.cpp does with a Y, Cb and Cr texel, written out to an
+// 8 bit framebuffer. Keep the weights in step with the shader.
+inline std::array<u8, 3> ShaderYCbCrToRgb(u8 y, u8 cb, u8 cr)
+{
+    const f32 luma = y / 255.0f;
+    const f32 blueDiff = cb / 255.0f - (128.0f / 255.0f);
+    const f32 redDiff = cr / 255.0f - (128.0f / 255.0f);
+    const f32 rgb[3] =
+    {
+        luma + (1.402f * redDiff),
+        luma - (0.3437f * blueDiff) - (0.7143f * redDiff),
+        luma + (1.772f * blueDiff)
+    };
+
+    std::array<u8, 3> ret;
+    for (size_t i = 0; i < ret.size(); i++)
+    {
+        ret[i] = static_cast<u8>((std::min(std::max(rgb[i], 0.0f), 1.0f) * 255.0f) + 0.5f);
+    }
+    return ret;
+}
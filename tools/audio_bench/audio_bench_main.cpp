@@ -0,0 +1,573 @@
+#define _CRT_SECURE_NO_WARNINGS
+
+#include "SDL.h"
+#include "oddlib/stream.hpp"
+#include "oddlib/lvlarchive.hpp"
+#include "oddlib/audio/vab.hpp"
+#include "oddlib/audio/AliveAudio.h"
+#include "oddlib/audio/SequencePlayer.h"
+#include "msvc_sdl_link.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+// Renders scripted mixes offline through the same code the game uses and reports how long they took.
+// Without arguments a generated sound bank and sequence are used so that runs are comparable between
+// machines, --vh/--vb (and optionally --seq) run the same scenarios on real game data.
+
+// Every allocation in the process is counted so the mixer can be checked for allocating
+static std::atomic<u64> gAllocations{ 0 };
+
+void* operator new(std::size_t size)
+{
+    gAllocations++;
+    void* p = std::malloc(size > 0 ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+struct BenchOptions
+{
+    f64 mSeconds = 1.0;
+    f64 mWarmUpSeconds = 0.25;
+    u32 mBlockFrames = 1024; // What the SDL callback usually asks for
+    f64 mMaxNsPerSample = 0.0; // 0 for no limit
+    bool mFailOnAlloc = false;
+    bool mPsx = false;
+    std::string mVhFile;
+    std::string mVbFile;
+    std::string mSeqFile;
+};
+
+struct BenchResult
+{
+    f64 mNsPerSample = 0.0;
+    f64 mAverageVoices = 0.0;
+    u64 mAllocations = 0;
+};
+
+class ByteWriter
+{
+public:
+    template<class T>
+    void Write(T value)
+    {
+        const size_t pos = mData.size();
+        mData.resize(pos + sizeof(T));
+        memcpy(mData.data() + pos, &value, sizeof(T));
+    }
+
+    std::vector<u8> mData;
+};
+
+// The note every generated tone is rooted on
+static const u8 kRootNote = 60;
+
+// Program 0 plays the sample dry, program 1 through the reverb
+static const u16 kNumGeneratedPrograms = 2;
+
+static void GenerateVab(Vab& vab)
+{
+    ByteWriter vh;
+    vh.Write(Oddlib::MakeType("VABp"));
+    vh.Write<u32>(0); // Version
+    vh.Write<u32>(0); // Id
+    vh.Write<u32>(0); // File size
+    vh.Write<u16>(0);
+    vh.Write<u16>(kNumGeneratedPrograms);
+    vh.Write<u16>(kNumGeneratedPrograms * 16);
+    vh.Write<u16>(1); // One sample
+    vh.Write<u8>(127);
+    vh.Write<u8>(64);
+    vh.Write<u8>(0);
+    vh.Write<u8>(0);
+    vh.Write<u32>(0);
+
+    for (u32 i = 0; i < 128; i++)
+    {
+        vh.Write<u8>(i < kNumGeneratedPrograms ? 1 : 0); // Tones
+        vh.Write<u8>(127); // Volume
+        vh.Write<u8>(0); // Priority
+        vh.Write<u8>(i == 1 ? 4 : 0); // Mode, 4 is reverb
+        vh.Write<u8>(64); // Pan
+        vh.Write<u8>(0);
+        vh.Write<u16>(0);
+        vh.Write<u32>(0);
+        vh.Write<u32>(0);
+    }
+
+    for (u16 prog = 0; prog < kNumGeneratedPrograms; prog++)
+    {
+        for (u16 tone = 0; tone < 16; tone++)
+        {
+            vh.Write<u8>(0); // Priority
+            vh.Write<u8>(0); // Mode
+            vh.Write<u8>(127); // Volume
+            vh.Write<u8>(64); // Pan
+            vh.Write<u8>(kRootNote);
+            vh.Write<u8>(0); // Shift
+            vh.Write<u8>(0); // Min note
+            vh.Write<u8>(127); // Max note
+            for (int i = 0; i < 8; i++)
+            {
+                vh.Write<u8>(0);
+            }
+            vh.Write<u16>(0x000E); // Fast attack, decay to 15/16ths
+            vh.Write<u16>(0x000A); // Release over about 50ms
+            vh.Write<s16>(static_cast<s16>(prog));
+            vh.Write<s16>(tone == 0 ? 1 : 0); // Vag, 0 is no sample
+            for (int i = 0; i < 4; i++)
+            {
+                vh.Write<s16>(0);
+            }
+        }
+    }
+
+    // A couple of seconds of a tone with some harmonics, voices that run out get retriggered
+    const u32 kSampleFrames = kAliveAudioSampleRate * 2;
+    const f64 kTwoPi = 6.283185307179586;
+    ByteWriter vb;
+    vb.Write<u32>(kSampleFrames * sizeof(s16));
+    vb.Write<u32>(kAliveAudioSampleRate);
+    for (u32 i = 0; i < kSampleFrames; i++)
+    {
+        const f64 t = static_cast<f64>(i) / kAliveAudioSampleRate;
+        const f64 s = (0.5 * std::sin(kTwoPi * 261.6 * t)) + (0.25 * std::sin(kTwoPi * 523.2 * t)) + (0.125 * std::sin(kTwoPi * 784.8 * t));
+        vb.Write<s16>(static_cast<s16>(s * 16000.0));
+    }
+
+    Oddlib::MemoryStream vhStream(std::move(vh.mData));
+    vab.ReadVh(vhStream, false);
+
+    Oddlib::MemoryStream vbStream(std::move(vb.mData));
+    vab.ReadVb(vbStream, false, false);
+}
+
+static void WriteVarLen(ByteWriter& w, u32 value)
+{
+    u8 bytes[4] = {};
+    int count = 0;
+    do
+    {
+        bytes[count++] = value & 0x7f;
+        value >>= 7;
+    } while (value > 0 && count < 4);
+
+    while (count-- > 0)
+    {
+        w.Write<u8>(static_cast<u8>(bytes[count] | (count > 0 ? 0x80 : 0)));
+    }
+}
+
+// A note every 100ms on each of 4 channels, each held for 400ms, so around 16 voices are sounding
+static std::vector<u8> GenerateSeq(f64 seconds, u8 program)
+{
+    ByteWriter seq;
+    seq.Write(Oddlib::MakeType("SEQp"));
+    seq.Write<u32>(1);
+    seq.Write<u16>(480);
+
+    // 120 bpm, big endian, which makes 1 tick 1ms
+    seq.Write<u8>(0x07);
+    seq.Write<u8>(0xA1);
+    seq.Write<u8>(0x20);
+    seq.Write<u8>(4);
+    seq.Write<u8>(4);
+
+    for (u8 channel = 0; channel < 4; channel++)
+    {
+        WriteVarLen(seq, 0);
+        seq.Write<u8>(0xC0 | channel);
+        seq.Write<u8>(program);
+    }
+
+    const u32 kNoteTicks = 100;
+    const u32 kHoldNotes = 4;
+    const u32 numSteps = static_cast<u32>(seconds * 1000.0) / kNoteTicks;
+    u32 lastTick = 0;
+    for (u32 step = 0; step < numSteps + kHoldNotes; step++)
+    {
+        const u32 tick = step * kNoteTicks;
+        for (u8 channel = 0; channel < 4; channel++)
+        {
+            // Release the notes started kHoldNotes steps ago
+            if (step >= kHoldNotes)
+            {
+                WriteVarLen(seq, tick - lastTick);
+                lastTick = tick;
+                seq.Write<u8>(0x80 | channel);
+                seq.Write<u8>(static_cast<u8>(kRootNote - 12 + ((step - kHoldNotes) * 5 + channel * 7) % 24));
+                seq.Write<u8>(0);
+            }
+
+            if (step < numSteps)
+            {
+                WriteVarLen(seq, tick - lastTick);
+                lastTick = tick;
+                seq.Write<u8>(0x90 | channel);
+                seq.Write<u8>(static_cast<u8>(kRootNote - 12 + (step * 5 + channel * 7) % 24));
+                seq.Write<u8>(100);
+            }
+        }
+    }
+
+    WriteVarLen(seq, kNoteTicks);
+    seq.Write<u8>(0xff);
+    seq.Write<u8>(0x2f);
+    seq.Write<u8>(0);
+    return std::move(seq.mData);
+}
+
+// Mixes the way SdlAudioWrapper and Sound::Play do, every source into one shared bus that is then resolved
+static BenchResult Render(const BenchOptions& options, const std::function<void()>& update, const std::function<void(AliveAudioMixBus&, u32)>& mix, const std::function<u32()>& activeVoices)
+{
+    auto bus = std::make_unique<AliveAudioMixBus>();
+    std::vector<f32> stream(options.mBlockFrames * 2);
+
+    auto renderBlock = [&]()
+    {
+        update();
+        std::fill(stream.begin(), stream.end(), 0.0f);
+        const u32 len = static_cast<u32>(stream.size());
+        for (u32 offset = 0; offset < len; offset += kAliveAudioMixBusMaxSamples)
+        {
+            const u32 samples = std::min(kAliveAudioMixBusMaxSamples, len - offset);
+            bus->Begin(samples);
+            mix(*bus, samples);
+            bus->Resolve(stream.data() + offset, samples);
+        }
+    };
+
+    const u32 warmUpBlocks = static_cast<u32>((options.mWarmUpSeconds * kAliveAudioSampleRate) / options.mBlockFrames);
+    for (u32 i = 0; i < warmUpBlocks; i++)
+    {
+        renderBlock();
+    }
+
+    const u32 blocks = std::max(1u, static_cast<u32>((options.mSeconds * kAliveAudioSampleRate) / options.mBlockFrames));
+    u64 voiceSum = 0;
+    const u64 allocationsBefore = gAllocations;
+    const auto start = std::chrono::steady_clock::now();
+    for (u32 i = 0; i < blocks; i++)
+    {
+        renderBlock();
+        voiceSum += activeVoices();
+    }
+    const auto end = std::chrono::steady_clock::now();
+
+    BenchResult result;
+    result.mAllocations = gAllocations - allocationsBefore;
+    result.mAverageVoices = static_cast<f64>(voiceSum) / blocks;
+    result.mNsPerSample = std::chrono::duration<f64, std::nano>(end - start).count() / (static_cast<f64>(blocks) * options.mBlockFrames);
+    return result;
+}
+
+// Finds something that will make a sound in a bank that might not have been made for this
+static bool FindPlayableNote(const AliveAudioSoundbank& bank, int& program, int& note)
+{
+    for (size_t i = 0; i < bank.m_Programs.size(); i++)
+    {
+        for (const auto& tone : bank.m_Programs[i]->m_Tones)
+        {
+            if (tone->m_Sample && tone->m_Sample->mSampleSize > 0)
+            {
+                program = static_cast<int>(i);
+                note = tone->Min;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static const char* InterpolationName(AudioInterpolation interpolation)
+{
+    switch (interpolation)
+    {
+    case AudioInterpolation_none: return "none";
+    case AudioInterpolation_linear: return "linear";
+    case AudioInterpolation_cubic: return "cubic";
+    case AudioInterpolation_hermite: return "hermite";
+    }
+    return "?";
+}
+
+class Bench
+{
+public:
+    Bench(const BenchOptions& options, Vab& vab, const std::vector<u8>& realSeq)
+        : mOptions(options), mVab(vab), mRealSeq(realSeq)
+    {
+        std::printf("%-40s %8s %12s %12s %8s\n", "scenario", "voices", "ns/sample", "voices/core", "allocs");
+    }
+
+    // numVoices notes held at once, retriggered as they end like the game does with sound effects
+    void Voices(u32 numVoices, AudioInterpolation interpolation, bool reverb)
+    {
+        auto soundbank = std::make_unique<AliveAudioSoundbank>(mVab);
+        int program = 0;
+        int note = 0;
+        if (!FindPlayableNote(*soundbank, program, note))
+        {
+            std::printf("No playable tones in the sound bank\n");
+            mFailed = true;
+            return;
+        }
+
+        AliveAudio audio;
+        audio.SetSoundbank(std::move(soundbank));
+        audio.ReserveVoices(numVoices);
+        audio.MaxPolyphony = numVoices;
+        audio.Interpolation = interpolation;
+        audio.ForceReverb = reverb;
+
+        u32 retrigger = 0;
+        auto update = [&]()
+        {
+            // Spread the pitches over 2 octaves so the voices resample at different rates
+            for (u32 i = audio.NumberOfActiveVoices(); i < numVoices; i++)
+            {
+                const s32 semitones = static_cast<s32>(retrigger++ % 25) - 12;
+                audio.NoteOn(program, note, 100, 0.0, static_cast<f64>(semitones));
+            }
+        };
+
+        const BenchResult result = Render(mOptions, update,
+            [&](AliveAudioMixBus& bus, u32 len) { audio.Mix(bus, len); },
+            [&]() { return audio.NumberOfActiveVoices(); });
+
+        Report(std::string("voices ") + std::to_string(numVoices) + " " + InterpolationName(interpolation) + (reverb ? " reverb" : ""), result);
+    }
+
+    // numSeqs sequences playing at once, as when music and several sound effects overlap
+    void Sequences(u32 numSeqs, bool reverb)
+    {
+        const f64 seconds = mOptions.mSeconds + mOptions.mWarmUpSeconds + 1.0;
+        const std::vector<u8> seqData = mRealSeq.empty() ? GenerateSeq(seconds, reverb ? 1 : 0) : mRealSeq;
+
+        std::vector<std::unique_ptr<SequencePlayer>> players;
+        for (u32 i = 0; i < numSeqs; i++)
+        {
+            auto player = std::make_unique<SequencePlayer>("bench", mVab);
+            Oddlib::MemoryStream stream(std::vector<u8>(seqData));
+            player->LoadSequenceStream(stream);
+            player->PlaySequence();
+            players.emplace_back(std::move(player));
+        }
+
+        auto update = [&]()
+        {
+            for (auto& player : players)
+            {
+                player->Update();
+                if (player->AtEnd())
+                {
+                    player->Restart();
+                }
+            }
+        };
+
+        const BenchResult result = Render(mOptions, update,
+            [&](AliveAudioMixBus& bus, u32 len)
+            {
+                for (auto& player : players)
+                {
+                    player->Mix(bus, len);
+                }
+            },
+            [&]()
+            {
+                u32 voices = 0;
+                for (auto& player : players)
+                {
+                    voices += player->NumberOfActiveVoices();
+                }
+                return voices;
+            });
+
+        Report(std::string("seqs ") + std::to_string(numSeqs) + (mRealSeq.empty() ? (reverb ? " reverb" : "") : " " + mOptions.mSeqFile), result);
+    }
+
+    bool Failed() const { return mFailed; }
+
+private:
+    void Report(const std::string& name, const BenchResult& result)
+    {
+        // How many voices of this mix one core could render in real time
+        const f64 kRealTimeNsPerSample = 1000000000.0 / kAliveAudioSampleRate;
+        const f64 voicesPerCore = result.mNsPerSample > 0.0 ? (kRealTimeNsPerSample / result.mNsPerSample) * result.mAverageVoices : 0.0;
+
+        std::printf("%-40s %8.1f %12.1f %12.0f %8llu\n", name.c_str(), result.mAverageVoices, result.mNsPerSample, voicesPerCore, static_cast<unsigned long long>(result.mAllocations));
+
+        if (mOptions.mMaxNsPerSample > 0.0 && result.mNsPerSample > mOptions.mMaxNsPerSample)
+        {
+            std::printf("  over the %.1f ns/sample budget\n", mOptions.mMaxNsPerSample);
+            mFailed = true;
+        }
+
+        if (mOptions.mFailOnAlloc && result.mAllocations > 0)
+        {
+            std::printf("  allocated while mixing\n");
+            mFailed = true;
+        }
+    }
+
+    const BenchOptions& mOptions;
+    Vab& mVab;
+    const std::vector<u8>& mRealSeq;
+    bool mFailed = false;
+};
+
+static std::vector<u8> ReadFile(const std::string& fileName)
+{
+    Oddlib::FileStream stream(fileName, Oddlib::IStream::ReadMode::ReadOnly);
+    std::vector<u8> data(stream.Size());
+    stream.ReadBytes(data.data(), data.size());
+    return data;
+}
+
+static void Usage()
+{
+    std::printf(
+        "AudioBench [options]\n"
+        "  --seconds <n>             Time rendered per scenario, default 1\n"
+        "  --block <frames>          Frames mixed per callback, default 1024\n"
+        "  --max-ns-per-sample <n>   Fail if any scenario is slower than this\n"
+        "  --fail-on-alloc           Fail if anything allocates while mixing\n"
+        "  --vh <file> --vb <file>   Use a real sound bank instead of the generated one\n"
+        "  --psx                     The sound bank is from the PSX version\n"
+        "  --seq <file>              Use a real sequence for the sequence scenarios\n");
+}
+
+static bool ParseArgs(int argc, char** argv, BenchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--seconds" && hasValue)
+        {
+            options.mSeconds = std::atof(argv[++i]);
+        }
+        else if (arg == "--block" && hasValue)
+        {
+            options.mBlockFrames = static_cast<u32>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--max-ns-per-sample" && hasValue)
+        {
+            options.mMaxNsPerSample = std::atof(argv[++i]);
+        }
+        else if (arg == "--fail-on-alloc")
+        {
+            options.mFailOnAlloc = true;
+        }
+        else if (arg == "--vh" && hasValue)
+        {
+            options.mVhFile = argv[++i];
+        }
+        else if (arg == "--vb" && hasValue)
+        {
+            options.mVbFile = argv[++i];
+        }
+        else if (arg == "--psx")
+        {
+            options.mPsx = true;
+        }
+        else if (arg == "--seq" && hasValue)
+        {
+            options.mSeqFile = argv[++i];
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return options.mVhFile.empty() == options.mVbFile.empty();
+}
+
+int main(int argc, char** argv)
+{
+    BenchOptions options;
+    if (!ParseArgs(argc, argv, options))
+    {
+        Usage();
+        return 1;
+    }
+
+    Vab vab;
+    std::vector<u8> realSeq;
+    try
+    {
+        if (options.mVhFile.empty())
+        {
+            GenerateVab(vab);
+        }
+        else
+        {
+            Oddlib::MemoryStream vh(ReadFile(options.mVhFile));
+            vab.ReadVh(vh, options.mPsx);
+
+            Oddlib::MemoryStream vb(ReadFile(options.mVbFile));
+            vab.ReadVb(vb, options.mPsx, false);
+        }
+
+        if (!options.mSeqFile.empty())
+        {
+            realSeq = ReadFile(options.mSeqFile);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::printf("Failed to load: %s\n", e.what());
+        return 1;
+    }
+
+    Bench bench(options, vab, realSeq);
+
+    const AudioInterpolation kInterpolations[] = { AudioInterpolation_none, AudioInterpolation_linear, AudioInterpolation_cubic, AudioInterpolation_hermite };
+    for (u32 voices : { 8u, 32u, 128u })
+    {
+        for (AudioInterpolation interpolation : kInterpolations)
+        {
+            bench.Voices(voices, interpolation, false);
+            bench.Voices(voices, interpolation, true);
+        }
+    }
+
+    for (u32 seqs : { 1u, 4u, 16u })
+    {
+        bench.Sequences(seqs, false);
+        if (realSeq.empty())
+        {
+            bench.Sequences(seqs, true);
+        }
+    }
+
+    return bench.Failed() ? 1 : 0;
+}
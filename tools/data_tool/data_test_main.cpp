@@ -20,6 +20,7 @@
 #include "data_set_type.hpp"
 #include "sound_resources_dumper.hpp"
 #include "data_inspector.hpp"
+#include "fmv_bench.hpp"
 #include "../engine_hook/seq_name_algorithm.hpp"
 
 void HackToReferencePrintEtc()
@@ -933,14 +934,15 @@ public:
             const int frameW = MaxW(*deDupedAnim->mAnimation);
             const int w = frameW * deDupedAnim->mAnimation->NumFrames();
             const int h = MaxH(*deDupedAnim->mAnimation);
-            const auto& calcFrame = deDupedAnim->mAnimation->GetFrame(0);
+
+            // Frames are 8 bit indexed, blitting them onto an RGBA surface applies their palette
             SDL_SurfacePtr sprites(SDL_CreateRGBSurface(0,
                 w, h,
-                calcFrame.mFrame->format->BitsPerPixel,
-                calcFrame.mFrame->format->Rmask,
-                calcFrame.mFrame->format->Gmask,
-                calcFrame.mFrame->format->Bmask,
-                calcFrame.mFrame->format->Amask));
+                32,
+                0x000000ff,
+                0x0000ff00,
+                0x00ff0000,
+                0xff000000));
             SDL_SetSurfaceBlendMode(sprites.get(), SDL_BLENDMODE_NONE);
 
             int xpos = 0;
@@ -1360,8 +1362,17 @@ public:
 
 // Don't use SDL main
 #undef main
-int main(int /*argc*/, char** /*argv*/)
+int main(int argc, char** argv)
 {
+    // With no arguments the LVL inspectors below are run, otherwise it is one of the FMV modes
+    FmvBenchOptions fmvOptions;
+    const bool fmvMode = argc > 1;
+    if (fmvMode && !ParseFmvBenchArgs(argc, argv, fmvOptions))
+    {
+        FmvBenchUsage();
+        return 1;
+    }
+
     const std::vector<std::string> aoPcLvls =
     {
         "c1.lvl",
@@ -1529,6 +1540,19 @@ int main(int /*argc*/, char** /*argv*/)
     }
 
     ResourceLocator resourceLocator(std::move(mapper), std::move(dataPaths));
+
+    if (fmvMode && !fmvOptions.mDataSetPath.empty())
+    {
+        // Logs and does nothing if DataSets.json already has a path for it
+        resourceLocator.GetDataPaths().Add(fmvOptions.mDataSetPath, fmvOptions.mDataSetName);
+    }
+
+    if (fmvMode && resourceLocator.GetDataPaths().PathFor(fmvOptions.mDataSetName).empty())
+    {
+        std::cout << "No path for data set " << fmvOptions.mDataSetName << std::endl;
+        return 1;
+    }
+
     DataPaths::PathVector dataSet;
 
     for (const auto& gd : gameDefs)
@@ -1540,6 +1564,11 @@ int main(int /*argc*/, char** /*argv*/)
 
     resourceLocator.GetDataPaths().SetActiveDataPaths(gameFs, dataSet);
 
+    if (fmvMode)
+    {
+        return RunFmvBench(resourceLocator, fmvOptions);
+    }
+
     //AudioConverter::Convert<OggEncoder>(resourceLocator, "AE_FE_10_1", "F:\\Data\\alive\\alive\\test.ogg");
     //AudioConverter::Convert<WavEncoder>(resourceLocator, "BW_5_1", "F:\\Data\\alive\\alive\\test.wav");
 
@@ -0,0 +1,315 @@
+#include "fmv_bench.hpp"
+#include "fmv.hpp"
+#include "resourcemapper.hpp"
+#include "core/audiobuffer.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+// Every allocation in the tool is counted so the decoders can be checked for allocating per frame
+static std::atomic<u64> gAllocations{ 0 };
+
+void* operator new(std::size_t size)
+{
+    gAllocations++;
+    void* p = std::malloc(size > 0 ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+// By now every frame and audio buffer has been used at least once, so nothing should allocate after it
+static const size_t kWarmUpFrames = 32;
+
+// Nothing is played, the movie is drained by IMovie::DecodeAll instead
+class NullAudioController : public IAudioController
+{
+public:
+    virtual void AddPlayer(IAudioPlayer* /*player*/) override { }
+    virtual void RemovePlayer(IAudioPlayer* /*player*/) override { }
+    virtual u16 AudioFrameSize() const override { return 0; }
+    virtual u32 SampleRate() const override { return 44100; }
+    virtual void SetExclusiveAudioPlayer(IAudioPlayer* /*player*/) override { }
+};
+
+// FNV-1a, enough to tell if the output changed between runs
+class OutputHash
+{
+public:
+    void Add(const u8* data, size_t len)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            mHash = (mHash ^ data[i]) * 1099511628211ull;
+        }
+    }
+
+    u64 Value() const { return mHash; }
+private:
+    u64 mHash = 14695981039346656037ull;
+};
+
+struct FmvBenchResult
+{
+    size_t mFrames = 0;
+    u32 mW = 0;
+    u32 mH = 0;
+    u64 mMacroBlocks = 0;
+    u64 mAudioSamples = 0;
+    f64 mSeconds = 0.0;
+    u64 mAllocations = 0;
+    u64 mSteadyAllocations = 0;
+    u64 mVideoHash = 0;
+    u64 mAudioHash = 0;
+};
+
+static FmvBenchResult DecodeFmv(IMovie& movie, std::ofstream* rgbFile, std::ofstream* pcmFile)
+{
+    FmvBenchResult result;
+    OutputHash videoHash;
+    OutputHash audioHash;
+    std::vector<u8> rgb;
+    u64 steadyAllocationsStart = 0;
+
+    // Only the decode thread's own time is counted, so repacking, hashing and writing the frames out here
+    // doesn't show up in the fps or us/mb figures
+    const u64 allocationsBefore = gAllocations;
+    result.mSeconds = movie.DecodeAll(
+        [&](size_t /*frameNum*/, u32 w, u32 h, const u8* pixels)
+        {
+            if (result.mFrames == 0)
+            {
+                result.mW = w;
+                result.mH = h;
+            }
+            result.mFrames++;
+            result.mMacroBlocks += ((w + 15) / 16) * ((h + 15) / 16);
+
+            // Alpha is always opaque, leaving it out means the dump can be fed straight to anything taking rgb24
+            const size_t numPixels = w * h;
+            if (rgb.size() < numPixels * 3)
+            {
+                rgb.resize(numPixels * 3);
+            }
+            for (size_t i = 0; i < numPixels; i++)
+            {
+                rgb[(i * 3)] = pixels[(i * 4)];
+                rgb[(i * 3) + 1] = pixels[(i * 4) + 1];
+                rgb[(i * 3) + 2] = pixels[(i * 4) + 2];
+            }
+            videoHash.Add(rgb.data(), numPixels * 3);
+            if (rgbFile)
+            {
+                rgbFile->write(reinterpret_cast<const char*>(rgb.data()), numPixels * 3);
+            }
+        },
+        [&](const s16* samples, u32 count)
+        {
+            result.mAudioSamples += count;
+            audioHash.Add(reinterpret_cast<const u8*>(samples), count * sizeof(s16));
+            if (pcmFile)
+            {
+                pcmFile->write(reinterpret_cast<const char*>(samples), count * sizeof(s16));
+            }
+        },
+        [&](size_t frameNum)
+        {
+            // Taken on the decode thread, by the time onFrame gets a frame the decoder can be a whole
+            // queue of frames further on
+            if (frameNum == kWarmUpFrames)
+            {
+                steadyAllocationsStart = gAllocations;
+            }
+        });
+
+    result.mAllocations = gAllocations - allocationsBefore;
+    result.mSteadyAllocations = result.mFrames > kWarmUpFrames ? gAllocations - steadyAllocationsStart : 0;
+    result.mVideoHash = videoHash.Value();
+    result.mAudioHash = audioHash.Value();
+    return result;
+}
+
+void FmvBenchUsage()
+{
+    std::printf(
+        "DataTool fmv-bench <data set> [options]\n"
+        "DataTool fmv-export <data set> <output dir> [options]\n"
+        "  --data <path>             Path to the data set, default is the one in DataSets.json\n"
+        "  --filter <text>           Only FMVs with text in their name\n"
+        "  --max-us-per-mb <n>       Fail if any FMV takes the decode thread longer than this per macro block\n"
+        "  --fail-on-alloc           Fail if anything allocates once the first frames are decoded\n"
+        "fmv-export writes <name>.rgb, rgb24 frames, and <name>.pcm, 16 bit stereo at 44100, for each FMV\n");
+}
+
+bool ParseFmvBenchArgs(int argc, char** argv, FmvBenchOptions& options)
+{
+    if (argc < 3)
+    {
+        return false;
+    }
+
+    const std::string mode = argv[1];
+    options.mDataSetName = argv[2];
+    int i = 3;
+    if (mode == "fmv-export")
+    {
+        if (argc < 4)
+        {
+            return false;
+        }
+        options.mExportDir = argv[i++];
+    }
+    else if (mode != "fmv-bench")
+    {
+        return false;
+    }
+
+    for (; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--data" && hasValue)
+        {
+            options.mDataSetPath = argv[++i];
+        }
+        else if (arg == "--filter" && hasValue)
+        {
+            options.mNameFilter = argv[++i];
+        }
+        else if (arg == "--max-us-per-mb" && hasValue)
+        {
+            options.mMaxUsPerMacroBlock = std::atof(argv[++i]);
+        }
+        else if (arg == "--fail-on-alloc")
+        {
+            options.mFailOnAlloc = true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int RunFmvBench(ResourceLocator& locator, const FmvBenchOptions& options)
+{
+    NullAudioController audioController;
+    bool failed = false;
+    u32 numFmvs = 0;
+    FmvBenchResult total;
+
+    std::printf("%-24s %7s %9s %9s %9s %8s %8s %16s %16s\n", "fmv", "frames", "size", "fps", "us/mb", "allocs", "steady", "video", "audio");
+    for (const auto& fmv : locator.FmvMaps())
+    {
+        if (!options.mNameFilter.empty() && fmv.first.find(options.mNameFilter) == std::string::npos)
+        {
+            continue;
+        }
+
+        for (const ResourceMapper::FmvFileLocation& location : fmv.second.mLocations)
+        {
+            if (location.mDataSetName != options.mDataSetName)
+            {
+                continue;
+            }
+
+            std::unique_ptr<IMovie> movie = locator.LocateFmv(audioController, fmv.first, &location).get();
+            if (!movie)
+            {
+                std::printf("%-24s not found in %s\n", fmv.first.c_str(), location.mFileName.c_str());
+                failed = true;
+                continue;
+            }
+
+            std::unique_ptr<std::ofstream> rgbFile;
+            std::unique_ptr<std::ofstream> pcmFile;
+            if (!options.mExportDir.empty())
+            {
+                rgbFile = std::make_unique<std::ofstream>(options.mExportDir + "/" + fmv.first + ".rgb", std::ios::binary);
+                pcmFile = std::make_unique<std::ofstream>(options.mExportDir + "/" + fmv.first + ".pcm", std::ios::binary);
+                if (!*rgbFile || !*pcmFile)
+                {
+                    std::printf("Can't write to %s\n", options.mExportDir.c_str());
+                    return 1;
+                }
+            }
+
+            const FmvBenchResult result = DecodeFmv(*movie, rgbFile.get(), pcmFile.get());
+            const f64 fps = result.mSeconds > 0.0 ? result.mFrames / result.mSeconds : 0.0;
+            const f64 usPerMacroBlock = result.mMacroBlocks > 0 ? (result.mSeconds * 1000000.0) / result.mMacroBlocks : 0.0;
+            const std::string size = std::to_string(result.mW) + "x" + std::to_string(result.mH);
+            std::printf("%-24s %7llu %9s %9.1f %9.3f %8llu %8llu %016llx %016llx\n",
+                fmv.first.c_str(),
+                static_cast<unsigned long long>(result.mFrames),
+                size.c_str(),
+                fps,
+                usPerMacroBlock,
+                static_cast<unsigned long long>(result.mAllocations),
+                static_cast<unsigned long long>(result.mSteadyAllocations),
+                static_cast<unsigned long long>(result.mVideoHash),
+                static_cast<unsigned long long>(result.mAudioHash));
+
+            if (result.mFrames == 0)
+            {
+                std::printf("  no frames decoded\n");
+                failed = true;
+            }
+
+            if (options.mMaxUsPerMacroBlock > 0.0 && usPerMacroBlock > options.mMaxUsPerMacroBlock)
+            {
+                std::printf("  over the %.3f us/mb budget\n", options.mMaxUsPerMacroBlock);
+                failed = true;
+            }
+
+            if (options.mFailOnAlloc && result.mSteadyAllocations > 0)
+            {
+                std::printf("  allocated while decoding\n");
+                failed = true;
+            }
+
+            numFmvs++;
+            total.mFrames += result.mFrames;
+            total.mMacroBlocks += result.mMacroBlocks;
+            total.mSeconds += result.mSeconds;
+            total.mAllocations += result.mAllocations;
+            total.mSteadyAllocations += result.mSteadyAllocations;
+        }
+    }
+
+    if (numFmvs == 0)
+    {
+        std::printf("No FMVs found for %s\n", options.mDataSetName.c_str());
+        return 1;
+    }
+
+    std::printf("%-24s %7llu %9s %9.1f %9.3f %8llu %8llu\n",
+        "total",
+        static_cast<unsigned long long>(total.mFrames),
+        "",
+        total.mSeconds > 0.0 ? total.mFrames / total.mSeconds : 0.0,
+        total.mMacroBlocks > 0 ? (total.mSeconds * 1000000.0) / total.mMacroBlocks : 0.0,
+        static_cast<unsigned long long>(total.mAllocations),
+        static_cast<unsigned long long>(total.mSteadyAllocations));
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include "types.hpp"
+
+class ResourceLocator;
+
+struct FmvBenchOptions
+{
+    std::string mDataSetName; // E.g AoPc, only FMVs from this data set are decoded
+    std::string mDataSetPath; // Used instead of what DataSets.json says when set
+    std::string mNameFilter; // Only FMVs with this in their name
+    std::string mExportDir; // Raw RGB and PCM are written here when set
+    f64 mMaxUsPerMacroBlock = 0.0; // 0 for no limit
+    bool mFailOnAlloc = false;
+};
+
+// Returns false for a usage error
+bool ParseFmvBenchArgs(int argc, char** argv, FmvBenchOptions& options);
+void FmvBenchUsage();
+
+// Decodes every FMV in fmvs.json for the data set without an audio device or renderer and reports
+// how fast it went. Returns the process exit code.
+int RunFmvBench(ResourceLocator& locator, const FmvBenchOptions& options);